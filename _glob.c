@@ -0,0 +1,190 @@
+/* autogenerated - do not edit */
+#include <jim.h>
+int Jim_globInit(Jim_Interp *interp)
+{
+	return Jim_EvalSource(interp, "glob.tcl", 1, "\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"package require readdir\n"
+"\n"
+"\n"
+"proc glob.globdir {dir pattern} {\n"
+"	set result {}\n"
+"	set files [readdir $dir]\n"
+"	lappend files . ..\n"
+"\n"
+"	foreach name $files {\n"
+"		if {[string match $pattern $name]} {\n"
+"\n"
+"			if {[string index $name 0] eq \".\" && [string index $pattern 0] ne \".\"} {\n"
+"				continue\n"
+"			}\n"
+"			lappend result $name\n"
+"		}\n"
+"	}\n"
+"\n"
+"	return $result\n"
+"}\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"proc glob.explode {pattern} {\n"
+"	set oldexp {}\n"
+"	set newexp {\"\"}\n"
+"\n"
+"	while 1 {\n"
+"		set oldexp $newexp\n"
+"		set newexp {}\n"
+"		set ob [string first \\{ $pattern]\n"
+"		set cb [string first \\} $pattern]\n"
+"\n"
+"		if {$ob < $cb && $ob != -1} {\n"
+"			set mid [string range $pattern 0 $ob-1]\n"
+"			set subexp [lassign [glob.explode [string range $pattern $ob+1 end]] pattern]\n"
+"			if {$pattern eq \"\"} {\n"
+"				error \"unmatched open brace in glob pattern\"\n"
+"			}\n"
+"			set pattern [string range $pattern 1 end]\n"
+"\n"
+"			foreach subs $subexp {\n"
+"				foreach sub [split $subs ,] {\n"
+"					foreach old $oldexp {\n"
+"						lappend newexp $old$mid$sub\n"
+"					}\n"
+"				}\n"
+"			}\n"
+"		} elseif {$cb != -1} {\n"
+"			set suf  [string range $pattern 0 $cb-1]\n"
+"			set rest [string range $pattern $cb end]\n"
+"			break\n"
+"		} else {\n"
+"			set suf  $pattern\n"
+"			set rest \"\"\n"
+"			break\n"
+"		}\n"
+"	}\n"
+"\n"
+"	foreach old $oldexp {\n"
+"		lappend newexp $old$suf\n"
+"	}\n"
+"	linsert $newexp 0 $rest\n"
+"}\n"
+"\n"
+"\n"
+"\n"
+"proc glob.glob {base pattern} {\n"
+"	set dir [file dirname $pattern]\n"
+"	if {$pattern eq $dir || $pattern eq \"\"} {\n"
+"		return [list [file join $base $dir] $pattern]\n"
+"	} elseif {$pattern eq [file tail $pattern]} {\n"
+"		set dir \"\"\n"
+"	}\n"
+"\n"
+"\n"
+"	set dirlist [glob.glob $base $dir]\n"
+"	set pattern [file tail $pattern]\n"
+"\n"
+"\n"
+"	set result {}\n"
+"	foreach {realdir dir} $dirlist {\n"
+"		if {![file isdir $realdir]} {\n"
+"			continue\n"
+"		}\n"
+"		if {[string index $dir end] ne \"/\" && $dir ne \"\"} {\n"
+"			append dir /\n"
+"		}\n"
+"		foreach name [glob.globdir $realdir $pattern] {\n"
+"			lappend result [file join $realdir $name] $dir$name\n"
+"		}\n"
+"	}\n"
+"	return $result\n"
+"}\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"\n"
+"proc glob {args} {\n"
+"	set nocomplain 0\n"
+"	set base \"\"\n"
+"\n"
+"	set n 0\n"
+"	foreach arg $args {\n"
+"		if {[info exists param]} {\n"
+"			set $param $arg\n"
+"			unset param\n"
+"			incr n\n"
+"			continue\n"
+"		}\n"
+"		switch -glob -- $arg {\n"
+"			-d* {\n"
+"				set switch $arg\n"
+"				set param base\n"
+"			}\n"
+"			-n* {\n"
+"				set nocomplain 1\n"
+"			}\n"
+"			-t* {\n"
+"\n"
+"			}\n"
+"\n"
+"			-* {\n"
+"				return -code error \"bad option \\\"$switch\\\": must be -directory, -nocomplain, -tails, or --\"\n"
+"			}\n"
+"			-- {\n"
+"				incr n\n"
+"				break\n"
+"			}\n"
+"			*  {\n"
+"				break\n"
+"			}\n"
+"		}\n"
+"		incr n\n"
+"	}\n"
+"	if {[info exists param]} {\n"
+"		return -code error \"missing argument to \\\"$switch\\\"\"\n"
+"	}\n"
+"	if {[llength $args] <= $n} {\n"
+"		return -code error \"wrong # args: should be \\\"glob ?options? pattern ?pattern ...?\\\"\"\n"
+"	}\n"
+"\n"
+"	set args [lrange $args $n end]\n"
+"\n"
+"	set result {}\n"
+"	foreach pattern $args {\n"
+"		set pattern [string map {\n"
+"			\\\\\\\\ \\x01 \\\\\\{ \\x02 \\\\\\} \\x03 \\\\, \\x04\n"
+"		} $pattern]\n"
+"		set patexps [lassign [glob.explode $pattern] rest]\n"
+"		if {$rest ne \"\"} {\n"
+"			return -code error \"unmatched close brace in glob pattern\"\n"
+"		}\n"
+"		foreach patexp $patexps {\n"
+"			set patexp [string map {\n"
+"				\\x01 \\\\\\\\ \\x02 \\{ \\x03 \\} \\x04 ,\n"
+"			} $patexp]\n"
+"			foreach {realname name} [glob.glob $base $patexp] {\n"
+"				lappend result $name\n"
+"			}\n"
+"		}\n"
+"	}\n"
+"\n"
+"	if {!$nocomplain && [llength $result] == 0} {\n"
+"		return -code error \"no files matched glob patterns\"\n"
+"	}\n"
+"\n"
+"	return $result\n"
+"}\n");
+}
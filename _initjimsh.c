@@ -0,0 +1,36 @@
+/* autogenerated - do not edit */
+#include <jim.h>
+int Jim_initjimshInit(Jim_Interp *interp)
+{
+	return Jim_EvalSource(interp, "initjimsh.tcl", 1, "\n"
+"\n"
+"\n"
+"proc _jimsh_init {} {\n"
+"    rename _jimsh_init {}\n"
+"\n"
+"\n"
+"    lappend p {*}[split [env JIMLIB {}] $::tcl_platform(pathSeparator)]\n"
+"    lappend p {*}$::auto_path\n"
+"    lappend p [file dirname [info nameofexecutable]]\n"
+"    lappend p [pwd]\n"
+"    set ::auto_path $p\n"
+"\n"
+"    if {$::tcl_interactive && [env HOME {}] ne \"\"} {\n"
+"        foreach src {.jimrc jimrc.tcl} {\n"
+"            if {[file exists [env HOME]/$src]} {\n"
+"                uplevel #0 source [env HOME]/$src\n"
+"                break\n"
+"            }\n"
+"        }\n"
+"    }\n"
+"\n"
+"\n"
+"    package provide Tcl\n"
+"}\n"
+"\n"
+"if {$tcl_platform(platform) eq \"windows\"} {\n"
+"    set jim_argv0 [string map {\\\\ /} $jim_argv0]\n"
+"}\n"
+"\n"
+"_jimsh_init\n");
+}
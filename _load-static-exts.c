@@ -0,0 +1,97 @@
+
+/* autogenerated - do not edit */
+#include "jim.h"
+#include "jimautoconf.h"
+
+#ifdef JIM_LAZY_EXTS
+static const char * const stdlib_cmds[] = { "lambda", "lambda.finalizer", "curry", "function", "stacktrace", "stackdump", "errorInfo", "info nameofexecutable", "dict with", "dict update", "dict merge", "dict replace", "dict lappend", "dict append", "dict incr", "dict remove", "dict values", "dict for", NULL };
+static const char * const nshelper_cmds[] = { "namespace delete", "namespace origin", "namespace which", "namespace code", "namespace inscope", "namespace import", "namespace info", "namespace upvar", NULL };
+static const char * const oo_cmds[] = { "class", "super", NULL };
+static const char * const binary_cmds[] = { "binary", "binary format", "binary scan", "binary::nextarg", NULL };
+static const char * const glob_cmds[] = { "glob.globdir", "glob.explode", "glob.glob", "glob", NULL };
+static const char * const tree_cmds[] = { "tree", NULL };
+#endif
+
+int Jim_InitStaticExtensions(Jim_Interp *interp)
+
+{
+	extern int Jim_stdlibInit(Jim_Interp *);
+	extern int Jim_aioInit(Jim_Interp *);
+	extern int Jim_arrayInit(Jim_Interp *);
+	extern int Jim_clockInit(Jim_Interp *);
+	extern int Jim_eventloopInit(Jim_Interp *);
+	extern int Jim_execInit(Jim_Interp *);
+	extern int Jim_fileInit(Jim_Interp *);
+	extern int Jim_historyInit(Jim_Interp *);
+	extern int Jim_interpInit(Jim_Interp *);
+	extern int Jim_listextInit(Jim_Interp *);
+	extern int Jim_loadInit(Jim_Interp *);
+	extern int Jim_namespaceInit(Jim_Interp *);
+	extern int Jim_nshelperInit(Jim_Interp *);
+	extern int Jim_ooInit(Jim_Interp *);
+	extern int Jim_packInit(Jim_Interp *);
+	extern int Jim_packageInit(Jim_Interp *);
+	extern int Jim_posixInit(Jim_Interp *);
+	extern int Jim_readdirInit(Jim_Interp *);
+	extern int Jim_regexpInit(Jim_Interp *);
+	extern int Jim_signalInit(Jim_Interp *);
+	extern int Jim_syslogInit(Jim_Interp *);
+	extern int Jim_tclcompatInit(Jim_Interp *);
+	extern int Jim_tclprefixInit(Jim_Interp *);
+	extern int Jim_threadInit(Jim_Interp *);
+	extern int Jim_binaryInit(Jim_Interp *);
+	extern int Jim_globInit(Jim_Interp *);
+	extern int Jim_treeInit(Jim_Interp *);
+#ifdef JIM_LAZY_EXTS
+	Jim_RegisterLazyExtension(interp, "stdlib", Jim_stdlibInit, stdlib_cmds);
+#else
+	Jim_stdlibInit(interp);
+#endif
+	Jim_aioInit(interp);
+	Jim_arrayInit(interp);
+	Jim_clockInit(interp);
+	Jim_eventloopInit(interp);
+	Jim_execInit(interp);
+	Jim_fileInit(interp);
+	Jim_historyInit(interp);
+	Jim_interpInit(interp);
+	Jim_listextInit(interp);
+	Jim_loadInit(interp);
+	Jim_namespaceInit(interp);
+#ifdef JIM_LAZY_EXTS
+	Jim_RegisterLazyExtension(interp, "nshelper", Jim_nshelperInit, nshelper_cmds);
+#else
+	Jim_nshelperInit(interp);
+#endif
+#ifdef JIM_LAZY_EXTS
+	Jim_RegisterLazyExtension(interp, "oo", Jim_ooInit, oo_cmds);
+#else
+	Jim_ooInit(interp);
+#endif
+	Jim_packInit(interp);
+	Jim_packageInit(interp);
+	Jim_posixInit(interp);
+	Jim_readdirInit(interp);
+	Jim_regexpInit(interp);
+	Jim_signalInit(interp);
+	Jim_syslogInit(interp);
+	Jim_tclcompatInit(interp);
+	Jim_tclprefixInit(interp);
+	Jim_threadInit(interp);
+#ifdef JIM_LAZY_EXTS
+	Jim_RegisterLazyExtension(interp, "binary", Jim_binaryInit, binary_cmds);
+#else
+	Jim_binaryInit(interp);
+#endif
+#ifdef JIM_LAZY_EXTS
+	Jim_RegisterLazyExtension(interp, "glob", Jim_globInit, glob_cmds);
+#else
+	Jim_globInit(interp);
+#endif
+#ifdef JIM_LAZY_EXTS
+	Jim_RegisterLazyExtension(interp, "tree", Jim_treeInit, tree_cmds);
+#else
+	Jim_treeInit(interp);
+#endif
+	return JIM_OK;
+}
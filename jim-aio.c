@@ -42,6 +42,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 #include <fcntl.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
@@ -66,6 +67,10 @@
 
 #define AIO_CMD_LEN 32      /* e.g. aio.handleXXXXXX */
 #define AIO_BUF_LEN 256     /* Can keep this small and rely on stdio buffering */
+#ifndef AIO_MAX_VALUE_LEN
+#define AIO_MAX_VALUE_LEN (64 * 1024 * 1024) /* Largest frame accepted by putvalue/getvalue */
+#endif
+#define AIO_VALUE_CHUNK 65536 /* getvalue grows its buffer by at most this much per read */
 
 #ifndef HAVE_FTELLO
     #define ftello ftell
@@ -510,6 +515,126 @@ static int aio_cmd_puts(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
     return JIM_ERR;
 }
 
+/* A serialized value is written as a frame: the length of the data (4 bytes, big-endian)
+ * followed by the data from Jim_SerializeObj()
+ */
+static int aio_cmd_putvalue(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    AioFile *af = Jim_CmdPrivData(interp);
+    Jim_Obj *objPtr = Jim_SerializeObj(interp, argv[0]);
+    unsigned char header[4];
+    const char *wdata;
+    int wlen;
+    int rc = JIM_ERR;
+
+    if (objPtr == NULL) {
+        return JIM_ERR;
+    }
+    wdata = Jim_GetString(objPtr, &wlen);
+    if (wlen > AIO_MAX_VALUE_LEN) {
+        Jim_SetResultString(interp, "serialized value too large", -1);
+    }
+    else {
+        header[0] = (unsigned char)(wlen >> 24);
+        header[1] = (unsigned char)(wlen >> 16);
+        header[2] = (unsigned char)(wlen >> 8);
+        header[3] = (unsigned char)wlen;
+        if (fwrite(header, 1, 4, af->fp) == 4 && fwrite(wdata, 1, wlen, af->fp) == (unsigned)wlen) {
+            rc = JIM_OK;
+        }
+        else {
+            JimAioSetError(interp, af->filename);
+        }
+    }
+    Jim_FreeNewObj(interp, objPtr);
+    return rc;
+}
+
+/* Reads one frame written by putvalue.
+ *
+ * The length comes from the stream, so it is capped at AIO_MAX_VALUE_LEN and the
+ * buffer only grows as the data actually arrives.
+ * A partial frame can't be pushed back, so the channel must be blocking.
+ */
+static int aio_cmd_getvalue(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    AioFile *af = Jim_CmdPrivData(interp);
+    unsigned char header[4];
+    Jim_Obj *objPtr = NULL;
+    char *buf = NULL;
+    int truncated = 0;
+    int retval;
+    unsigned len;
+    unsigned got = 0;
+
+#ifdef O_NDELAY
+    if (fcntl(af->fd, F_GETFL) & O_NONBLOCK) {
+        Jim_SetResultString(interp, "getvalue requires a blocking channel", -1);
+        return JIM_ERR;
+    }
+#endif
+
+    errno = 0;
+    retval = fread(header, 1, 4, af->fp);
+    if (retval == 4) {
+        len = ((unsigned)header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+        if (len > AIO_MAX_VALUE_LEN) {
+            Jim_SetResultString(interp, "serialized value too large", -1);
+            return JIM_ERR;
+        }
+        buf = Jim_Alloc(1);
+        while (got < len) {
+            unsigned chunk = len - got;
+
+            if (chunk > AIO_VALUE_CHUNK) {
+                chunk = AIO_VALUE_CHUNK;
+            }
+            buf = Jim_Realloc(buf, got + chunk + 1);
+            retval = fread(buf + got, 1, chunk, af->fp);
+            got += retval;
+            if (retval != (int)chunk) {
+                break;
+            }
+        }
+        if (got == len) {
+            objPtr = Jim_DeserializeObj(interp, buf, len);
+            Jim_Free(buf);
+            if (objPtr == NULL) {
+                return JIM_ERR;
+            }
+        }
+        else {
+            Jim_Free(buf);
+            truncated = 1;
+        }
+    }
+    else if (retval) {
+        truncated = 1;
+    }
+    if (JimCheckStreamError(interp, af)) {
+        return JIM_ERR;
+    }
+    if (truncated) {
+        Jim_SetResultString(interp, "truncated value", -1);
+        return JIM_ERR;
+    }
+
+    if (argc) {
+        if (objPtr && Jim_SetVariable(interp, argv[0], objPtr) != JIM_OK) {
+            return JIM_ERR;
+        }
+        /* Returns 0 on eof if varName was specified */
+        Jim_SetResultBool(interp, objPtr != NULL);
+    }
+    else if (objPtr) {
+        Jim_SetResult(interp, objPtr);
+    }
+    else {
+        Jim_SetEmptyResult(interp);
+    }
+    return JIM_OK;
+}
+
 static int aio_cmd_isatty(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 {
 #ifdef HAVE_ISATTY
@@ -892,6 +1017,20 @@ static const jim_subcmd_type aio_command_table[] = {
         2,
         /* Description: Write the string, with newline unless -nonewline */
     },
+    {   "putvalue",
+        "value",
+        aio_cmd_putvalue,
+        1,
+        1,
+        /* Description: Write the value as a serialized frame */
+    },
+    {   "getvalue",
+        "?var?",
+        aio_cmd_getvalue,
+        0,
+        1,
+        /* Description: Read one serialized frame and return the value or store it in the var */
+    },
     {   "isatty",
         NULL,
         aio_cmd_isatty,
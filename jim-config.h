@@ -0,0 +1,6 @@
+#ifndef _JIM_CONFIG_H
+#define _JIM_CONFIG_H
+#define HAVE_LONG_LONG 1
+#define JIM_UTF8 1
+#define JIM_VERSION 75
+#endif
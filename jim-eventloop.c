@@ -109,17 +109,11 @@ typedef struct Jim_EventLoop
 static void JimAfterTimeHandler(Jim_Interp *interp, void *clientData);
 static void JimAfterTimeEventFinalizer(Jim_Interp *interp, void *clientData);
 
-int Jim_EvalObjBackground(Jim_Interp *interp, Jim_Obj *scriptObjPtr)
+/* Try to report the error (if any) from an event handler via the bgerror proc */
+static void JimBackgroundError(Jim_Interp *interp, int retval)
 {
     Jim_EventLoop *eventLoop = Jim_GetAssocData(interp, "eventloop");
-    Jim_CallFrame *savedFramePtr;
-    int retval;
 
-    savedFramePtr = interp->framePtr;
-    interp->framePtr = interp->topFramePtr;
-    retval = Jim_EvalObj(interp, scriptObjPtr);
-    interp->framePtr = savedFramePtr;
-    /* Try to report the error (if any) via the bgerror proc */
     if (retval != JIM_OK && !eventLoop->suppress_bgerror) {
         Jim_Obj *objv[2];
         int rc = JIM_ERR;
@@ -144,6 +138,18 @@ int Jim_EvalObjBackground(Jim_Interp *interp, Jim_Obj *scriptObjPtr)
         Jim_DecrRefCount(interp, objv[0]);
         Jim_DecrRefCount(interp, objv[1]);
     }
+}
+
+int Jim_EvalObjBackground(Jim_Interp *interp, Jim_Obj *scriptObjPtr)
+{
+    Jim_CallFrame *savedFramePtr;
+    int retval;
+
+    savedFramePtr = interp->framePtr;
+    interp->framePtr = interp->topFramePtr;
+    retval = Jim_EvalObj(interp, scriptObjPtr);
+    interp->framePtr = savedFramePtr;
+    JimBackgroundError(interp, retval);
     return retval;
 }
 
@@ -727,6 +733,119 @@ static int JimELAfterCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
     return JIM_OK;
 }
 
+#ifdef JIM_COROUTINES
+/* A coroutine waiting in coroutine::after, coroutine::readable or coroutine::writable.
+ * This lives on the coroutine's own stack while it is suspended. */
+typedef struct JimCoroutineWait {
+    Jim_Coroutine *coro;
+    int fired;
+} JimCoroutineWait;
+
+static void JimCoroutineWake(Jim_Interp *interp, JimCoroutineWait *wait)
+{
+    wait->fired = 1;
+    JimBackgroundError(interp, Jim_ResumeCoroutine(interp, wait->coro, NULL));
+}
+
+static void JimCoroutineTimeProc(Jim_Interp *interp, void *clientData)
+{
+    JimCoroutineWake(interp, clientData);
+}
+
+/* Unlike Jim_DeleteFileHandler() this only removes the one handler */
+static void JimCoroutineRemoveFileHandler(Jim_EventLoop *eventLoop, JimCoroutineWait *wait)
+{
+    Jim_FileEvent **fep;
+
+    for (fep = &eventLoop->fileEventHead; *fep; fep = &(*fep)->next) {
+        if ((*fep)->clientData == wait) {
+            Jim_FileEvent *fe = *fep;
+
+            *fep = fe->next;
+            Jim_Free(fe);
+            break;
+        }
+    }
+}
+
+static int JimCoroutineFileProc(Jim_Interp *interp, void *clientData, int mask)
+{
+    /* Remove the handler before resuming since the coroutine may well wait again */
+    JimCoroutineRemoveFileHandler(Jim_GetAssocData(interp, "eventloop"), clientData);
+    JimCoroutineWake(interp, clientData);
+    return JIM_OK;
+}
+
+static int JimCoroutineWaitStart(Jim_Interp *interp, JimCoroutineWait *wait, Jim_Obj *cmdObj)
+{
+    wait->coro = Jim_CurrentCoroutine(interp);
+    wait->fired = 0;
+    if (wait->coro == NULL) {
+        Jim_SetResultFormatted(interp, "%#s can only be called in a coroutine", cmdObj);
+        return JIM_ERR;
+    }
+    return JIM_OK;
+}
+
+/* coroutine::after ms */
+static int JimELCoroutineAfterCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimCoroutineWait wait;
+    jim_wide ms;
+    jim_wide id;
+    int rc;
+
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "ms");
+        return JIM_ERR;
+    }
+    if (Jim_GetWide(interp, argv[1], &ms) != JIM_OK || JimCoroutineWaitStart(interp, &wait, argv[0]) != JIM_OK) {
+        return JIM_ERR;
+    }
+    id = Jim_CreateTimeHandler(interp, ms, JimCoroutineTimeProc, &wait, NULL);
+    rc = Jim_YieldCoroutine(interp, NULL);
+    if (!wait.fired) {
+        /* Resumed some other way, or killed */
+        Jim_DeleteTimeHandler(interp, id);
+    }
+    return rc;
+}
+
+/* coroutine::readable channel, coroutine::writable channel */
+static int JimELCoroutineWaitFile(Jim_Interp *interp, int argc, Jim_Obj *const *argv, int mask)
+{
+    Jim_EventLoop *eventLoop = Jim_CmdPrivData(interp);
+    JimCoroutineWait wait;
+    FILE *fh;
+    int rc;
+
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "channel");
+        return JIM_ERR;
+    }
+    fh = Jim_AioFilehandle(interp, argv[1]);
+    if (fh == NULL || JimCoroutineWaitStart(interp, &wait, argv[0]) != JIM_OK) {
+        return JIM_ERR;
+    }
+    Jim_CreateFileHandler(interp, fh, mask, JimCoroutineFileProc, &wait, NULL);
+    rc = Jim_YieldCoroutine(interp, NULL);
+    if (!wait.fired) {
+        JimCoroutineRemoveFileHandler(eventLoop, &wait);
+    }
+    return rc;
+}
+
+static int JimELCoroutineReadableCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    return JimELCoroutineWaitFile(interp, argc, argv, JIM_EVENT_READABLE);
+}
+
+static int JimELCoroutineWritableCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    return JimELCoroutineWaitFile(interp, argc, argv, JIM_EVENT_WRITABLE);
+}
+#endif
+
 int Jim_eventloopInit(Jim_Interp *interp)
 {
     Jim_EventLoop *eventLoop;
@@ -742,6 +861,11 @@ int Jim_eventloopInit(Jim_Interp *interp)
     Jim_CreateCommand(interp, "vwait", JimELVwaitCommand, eventLoop, NULL);
     Jim_CreateCommand(interp, "update", JimELUpdateCommand, eventLoop, NULL);
     Jim_CreateCommand(interp, "after", JimELAfterCommand, eventLoop, NULL);
+#ifdef JIM_COROUTINES
+    Jim_CreateCommand(interp, "coroutine::after", JimELCoroutineAfterCommand, eventLoop, NULL);
+    Jim_CreateCommand(interp, "coroutine::readable", JimELCoroutineReadableCommand, eventLoop, NULL);
+    Jim_CreateCommand(interp, "coroutine::writable", JimELCoroutineWritableCommand, eventLoop, NULL);
+#endif
 
     return JIM_OK;
 }
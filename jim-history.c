@@ -19,7 +19,9 @@ static int history_cmd_getline(Jim_Interp *interp, int argc, Jim_Obj *const *arg
         return JIM_OK;
     }
 
-    objPtr = Jim_NewStringObjNoAlloc(interp, line, -1);
+    /* The line is from malloc(), so it can't be owned by the object */
+    objPtr = Jim_NewStringObj(interp, line, -1);
+    free(line);
 
     /* Returns the length of the string if varName was specified */
     if (argc == 2) {
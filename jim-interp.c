@@ -81,6 +81,45 @@ static const Jim_HashTableType JimInterpHashTableType = {
     JimSlavesHTValDestructor     /* val destructor */
 };
 
+/* Objects must never be shared between interpreters, since each interpreter
+ * allocates, caches and frees its own objects. Values are passed as strings,
+ * except that frozen values are shared without copying.
+ */
+static Jim_Obj *
+JimInterpCopyObj(Jim_Interp *target, Jim_Obj *obj)
+{
+    int len;
+    const char *rep;
+    Jim_Obj *shared = Jim_ShareFrozenObj(target, obj);
+    if (shared) {
+        return shared;
+    }
+    rep = Jim_GetString(obj, &len);
+    return Jim_NewStringObj(target, rep, len);
+}
+
+/* Interpreters created ahead of time by [interp pool size], ready to be handed out
+ * by [interp create]. The pool is only refilled by [interp pool size].
+ */
+struct JimInterpPool {
+    Jim_Interp **ready;
+    int count;      /* Number of interpreters in ready[] */
+    int size;       /* Number of interpreters to keep ready */
+};
+
+static Jim_Interp *
+JimInterpNewSlave(Jim_Interp *interp, int safe)
+{
+    Jim_Interp *slave = Jim_CreateInterp();
+    Jim_RegisterCoreCommands(slave);
+    if (!safe) {
+        Jim_InitStaticExtensions(slave);
+        Jim_initjimshInit(slave);
+    }
+    Jim_SetAssocData(slave, "interp::master", NULL, interp);
+    return slave;
+}
+
 static int
 interp_create_cmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 {
@@ -88,6 +127,7 @@ interp_create_cmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
         return JIM_ERR;
 
     Jim_HashTable *slaves = Jim_GetAssocData(interp, "interp::slaves");
+    struct JimInterpPool *pool = Jim_GetAssocData(interp, "interp::pool");
 
     int save = argc - 1;
     const char *name = Jim_String(argv[0 + save]);
@@ -97,21 +137,52 @@ interp_create_cmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
         Jim_DeleteHashEntry(slaves, name);
     }
 
-    Jim_Interp *slave = Jim_CreateInterp();
-    Jim_RegisterCoreCommands(slave);
-    if (save == 0) {
-        Jim_InitStaticExtensions(slave);
-        Jim_initjimshInit(slave);
+    Jim_Interp *slave;
+    if (save == 0 && pool->count) {
+        slave = pool->ready[--pool->count];
+    }
+    else {
+        slave = JimInterpNewSlave(interp, save);
     }
 
     Jim_AddHashEntry(slaves, name, slave);
 
-    Jim_SetAssocData(slave, "interp::master", NULL, interp);
-
     Jim_SetResultString(interp, name, -1);
     return JIM_OK;
 }
 
+static int
+interp_pool_cmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    struct JimInterpPool *pool = Jim_GetAssocData(interp, "interp::pool");
+
+    if (argc == 1) {
+        long size;
+        if (Jim_GetLong(interp, argv[0], &size) != JIM_OK) {
+            return JIM_ERR;
+        }
+        if (size < 0) {
+            Jim_SetResultString(interp, "pool size must be >= 0", -1);
+            return JIM_ERR;
+        }
+        while (pool->count > size) {
+            Jim_FreeInterp(pool->ready[--pool->count]);
+        }
+        if (size > pool->size) {
+            pool->ready = Jim_Realloc(pool->ready, sizeof(*pool->ready) * size);
+        }
+        pool->size = size;
+
+        /* Top up the pool */
+        while (pool->count < pool->size) {
+            pool->ready[pool->count++] = JimInterpNewSlave(interp, 0);
+        }
+    }
+
+    Jim_SetResultInt(interp, pool->count);
+    return JIM_OK;
+}
+
 static int
 interp_eval_cmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 {
@@ -129,10 +200,16 @@ interp_eval_cmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 
     int rc;
     if (argc == 2) {
-        rc = Jim_EvalObj(slave, argv[1]);
+        rc = Jim_EvalObj(slave, JimInterpCopyObj(slave, argv[1]));
     }
     else {
-        rc = Jim_EvalObjPrefix(slave, argv[1], argc - 2, argv + 2);
+        int i;
+        Jim_Obj **args = Jim_Alloc(sizeof(*args) * (argc - 2));
+        for (i = 2; i < argc; i++) {
+            args[i - 2] = JimInterpCopyObj(slave, argv[i]);
+        }
+        rc = Jim_EvalObjPrefix(slave, JimInterpCopyObj(slave, argv[1]), argc - 2, args);
+        Jim_Free(args);
     }
 
     if (rc == JIM_ERR) {
@@ -140,7 +217,7 @@ interp_eval_cmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
         slave->addStackTrace++;
     }
 
-    Jim_SetResult(interp, Jim_GetResult(slave));
+    Jim_SetResult(interp, JimInterpCopyObj(interp, Jim_GetResult(slave)));
     return rc;
 }
 
@@ -205,21 +282,25 @@ interp_slave_alias_cmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
     Jim_Obj *prefixListObj = Jim_CmdPrivData(interp);
     Jim_Interp *master = Jim_GetAssocData(interp, "interp::master");
 
+    int i;
     cmdList = Jim_DuplicateObj(master, prefixListObj);
-    Jim_ListInsertElements(master, cmdList, Jim_ListLength(master, cmdList), argc - 1, argv + 1);
+    for (i = 1; i < argc; i++) {
+        Jim_ListAppendElement(master, cmdList, JimInterpCopyObj(master, argv[i]));
+    }
 
     int rc;
     rc = Jim_EvalObjList(master, cmdList);
 
-    Jim_SetResult(interp, Jim_GetResult(master));
+    Jim_SetResult(interp, JimInterpCopyObj(interp, Jim_GetResult(master)));
     return rc;
 }
 
 static void
 interp_slave_alias_delete(Jim_Interp *interp, void *privData)
 {
+    /* The prefix belongs to the master */
     Jim_Obj *prefixListObj = privData;
-    Jim_DecrRefCount(interp, prefixListObj);
+    Jim_DecrRefCount((Jim_Interp *)Jim_GetAssocData(interp, "interp::master"), prefixListObj);
 }
 
 static int
@@ -243,7 +324,7 @@ interp_alias_cmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 
     Jim_Obj *prefixListObj;
     const char *newname;
-    prefixListObj = Jim_NewListObj(slave, argv + 2, argc - 2);
+    prefixListObj = Jim_NewListObj(interp, argv + 2, argc - 2);
     Jim_IncrRefCount(prefixListObj);
     newname = Jim_String(argv[1]);
     if (newname[0] == ':' && newname[1] == ':') {
@@ -280,6 +361,14 @@ static const jim_subcmd_type array_command_table[] = {
         -1,
         /* Description: interp delete */
     },
+    {
+        "pool",
+        "?size?",
+        interp_pool_cmd,
+        0,
+        1,
+        /* Description: interp pool */
+    },
     {
         "exists",
         "name",
@@ -317,6 +406,17 @@ interp_free_slaves(Jim_Interp *interp, void *data)
     Jim_Free(slaves);
 }
 
+static void
+interp_free_pool(Jim_Interp *interp, void *data)
+{
+    struct JimInterpPool *pool = data;
+    while (pool->count) {
+        Jim_FreeInterp(pool->ready[--pool->count]);
+    }
+    Jim_Free(pool->ready);
+    Jim_Free(pool);
+}
+
 int
 Jim_interpInit(Jim_Interp *interp)
 {
@@ -327,6 +427,10 @@ Jim_interpInit(Jim_Interp *interp)
     Jim_InitHashTable(slaves, &JimInterpHashTableType, NULL);
     Jim_SetAssocData(interp, "interp::slaves", interp_free_slaves, slaves);
 
+    struct JimInterpPool *pool = Jim_Alloc(sizeof(*pool));
+    memset(pool, 0, sizeof(*pool));
+    Jim_SetAssocData(interp, "interp::pool", interp_free_pool, pool);
+
     Jim_CreateCommand(interp, "interp", Jim_SubCmdProc, (void *)array_command_table, NULL);
     return JIM_OK;
 }
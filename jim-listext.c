@@ -0,0 +1,304 @@
+/*
+ * Implements the set commands [lintersect], [lunion], [ldifference]
+ * and [lsubtract] for jim
+ *
+ * Based on listext.tcl
+ * (c) 2014 Florian Schäfer <florian.schaefer@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE JIM TCL PROJECT ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * JIM TCL PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * official policies, either expressed or implied, of the Jim Tcl Project.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <jim.h>
+
+/* Below this many elements a linear scan is cheaper than building a hash table */
+#define LISTEXT_HASH_MIN_LEN 8
+
+enum {
+    LISTEXT_INTERSECT,
+    LISTEXT_UNION,
+    LISTEXT_DIFFERENCE,
+    LISTEXT_SUBTRACT
+};
+
+/* A read-only view of a list used for membership tests */
+typedef struct ListSet {
+    int len;
+    Jim_Obj **ele;
+    int hashed;
+    Jim_HashTable ht;
+} ListSet;
+
+static unsigned int ListSetHashFunction(const void *key)
+{
+    int len;
+    const char *str = Jim_GetString((Jim_Obj *)key, &len);
+
+    return Jim_GenHashFunction((const unsigned char *)str, len);
+}
+
+static int ListSetKeyCompare(void *privdata, const void *key1, const void *key2)
+{
+    JIM_NOTUSED(privdata);
+    return Jim_StringEqObj((Jim_Obj *)key1, (Jim_Obj *)key2);
+}
+
+/* The keys are the list elements themselves, so nothing is copied or freed */
+static const Jim_HashTableType ListSetHashTableType = {
+    ListSetHashFunction,        /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    ListSetKeyCompare,          /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+static void ListSetInit(Jim_Interp *interp, ListSet *set, Jim_Obj *listObjPtr, int hash)
+{
+    int i;
+
+    set->len = Jim_ListLength(interp, listObjPtr);
+    set->ele = Jim_Alloc(sizeof(*set->ele) * (set->len + 1));
+    for (i = 0; i < set->len; i++) {
+        set->ele[i] = Jim_ListGetIndex(interp, listObjPtr, i);
+    }
+    set->hashed = (hash && set->len >= LISTEXT_HASH_MIN_LEN);
+    if (set->hashed) {
+        Jim_InitHashTable(&set->ht, &ListSetHashTableType, NULL);
+        Jim_ExpandHashTable(&set->ht, set->len);
+        for (i = 0; i < set->len; i++) {
+            /* Duplicates are simply ignored */
+            Jim_AddHashEntry(&set->ht, set->ele[i], NULL);
+        }
+    }
+}
+
+static void ListSetFree(ListSet *set)
+{
+    if (set->hashed) {
+        Jim_FreeHashTable(&set->ht);
+    }
+    Jim_Free(set->ele);
+}
+
+static int ListSetContains(ListSet *set, Jim_Obj *objPtr)
+{
+    int i;
+
+    if (set->hashed) {
+        return Jim_FindHashEntry(&set->ht, objPtr) != NULL;
+    }
+    for (i = 0; i < set->len; i++) {
+        if (Jim_StringEqObj(set->ele[i], objPtr)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Hash based implementation. The order of the elements is preserved:
+ * elements of list1 come first, in order, followed by any elements of list2.
+ */
+static int ListSetOpHashed(int op, ListSet *a, ListSet *b, Jim_Obj **result)
+{
+    int i;
+    int n = 0;
+
+    switch (op) {
+        case LISTEXT_INTERSECT:
+            for (i = 0; i < a->len; i++) {
+                if (ListSetContains(b, a->ele[i])) {
+                    result[n++] = a->ele[i];
+                }
+            }
+            break;
+
+        case LISTEXT_SUBTRACT:
+        case LISTEXT_DIFFERENCE:
+            for (i = 0; i < a->len; i++) {
+                if (!ListSetContains(b, a->ele[i])) {
+                    result[n++] = a->ele[i];
+                }
+            }
+            if (op == LISTEXT_SUBTRACT) {
+                break;
+            }
+            /* fall through */
+
+        case LISTEXT_UNION:
+            if (op == LISTEXT_UNION) {
+                memcpy(result, a->ele, sizeof(*result) * a->len);
+                n = a->len;
+            }
+            for (i = 0; i < b->len; i++) {
+                if (!ListSetContains(a, b->ele[i])) {
+                    result[n++] = b->ele[i];
+                }
+            }
+            break;
+    }
+    return n;
+}
+
+/**
+ * Merge based implementation for lists which are already sorted
+ * in ascii order (as per [lsort]). The result is also sorted.
+ */
+static int ListSetOpSorted(Jim_Interp *interp, int op, ListSet *a, ListSet *b, Jim_Obj **result)
+{
+    int i = 0;
+    int j = 0;
+    int n = 0;
+
+    while (i < a->len && j < b->len) {
+        int cmp = Jim_StringCompareObj(interp, a->ele[i], b->ele[j], 0);
+
+        if (cmp < 0) {
+            if (op != LISTEXT_INTERSECT) {
+                result[n++] = a->ele[i];
+            }
+            i++;
+        }
+        else if (cmp > 0) {
+            if (op == LISTEXT_UNION || op == LISTEXT_DIFFERENCE) {
+                result[n++] = b->ele[j];
+            }
+            j++;
+        }
+        else {
+            switch (op) {
+                case LISTEXT_INTERSECT:
+                    result[n++] = a->ele[i++];
+                    break;
+                case LISTEXT_SUBTRACT:
+                    i++;
+                    break;
+                case LISTEXT_UNION:
+                    /* Keep every copy from list1, drop this one from list2 */
+                    j++;
+                    break;
+                case LISTEXT_DIFFERENCE: {
+                    /* Drop every copy of this element from both lists */
+                    Jim_Obj *objPtr = a->ele[i];
+
+                    while (i < a->len && Jim_StringEqObj(a->ele[i], objPtr)) {
+                        i++;
+                    }
+                    while (j < b->len && Jim_StringEqObj(b->ele[j], objPtr)) {
+                        j++;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    if (op != LISTEXT_INTERSECT) {
+        while (i < a->len) {
+            result[n++] = a->ele[i++];
+        }
+    }
+    if (op == LISTEXT_UNION || op == LISTEXT_DIFFERENCE) {
+        while (j < b->len) {
+            result[n++] = b->ele[j++];
+        }
+    }
+    return n;
+}
+
+static int ListSetOpCmd(Jim_Interp *interp, int op, int argc, Jim_Obj *const *argv)
+{
+    ListSet a, b;
+    Jim_Obj **result;
+    int sorted = 0;
+    int n;
+
+    if (argc == 4 && Jim_CompareStringImmediate(interp, argv[1], "-sorted")) {
+        sorted = 1;
+        argc--;
+        argv++;
+    }
+    if (argc != 3) {
+        Jim_WrongNumArgs(interp, 1, argv, "?-sorted? list1 list2");
+        return JIM_ERR;
+    }
+
+    /* With -sorted nothing is hashed, otherwise list1 is only hashed if it is searched */
+    ListSetInit(interp, &a, argv[1], !sorted && (op == LISTEXT_UNION || op == LISTEXT_DIFFERENCE));
+    ListSetInit(interp, &b, argv[2], !sorted);
+
+    result = Jim_Alloc(sizeof(*result) * (a.len + b.len + 1));
+    if (sorted) {
+        n = ListSetOpSorted(interp, op, &a, &b, result);
+    }
+    else {
+        n = ListSetOpHashed(op, &a, &b, result);
+    }
+    Jim_SetResult(interp, Jim_NewListObj(interp, result, n));
+
+    Jim_Free(result);
+    ListSetFree(&a);
+    ListSetFree(&b);
+    return JIM_OK;
+}
+
+static int Jim_LintersectCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    return ListSetOpCmd(interp, LISTEXT_INTERSECT, argc, argv);
+}
+
+static int Jim_LunionCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    return ListSetOpCmd(interp, LISTEXT_UNION, argc, argv);
+}
+
+static int Jim_LdifferenceCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    return ListSetOpCmd(interp, LISTEXT_DIFFERENCE, argc, argv);
+}
+
+static int Jim_LsubtractCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    return ListSetOpCmd(interp, LISTEXT_SUBTRACT, argc, argv);
+}
+
+int Jim_listextInit(Jim_Interp *interp)
+{
+    if (Jim_PackageProvide(interp, "listext", "1.0", JIM_ERRMSG))
+        return JIM_ERR;
+
+    Jim_CreateCommand(interp, "lintersect", Jim_LintersectCmd, NULL, NULL);
+    Jim_CreateCommand(interp, "lunion", Jim_LunionCmd, NULL, NULL);
+    Jim_CreateCommand(interp, "ldifference", Jim_LdifferenceCmd, NULL, NULL);
+    Jim_CreateCommand(interp, "lsubtract", Jim_LsubtractCmd, NULL, NULL);
+    return JIM_OK;
+}
@@ -125,8 +125,11 @@ int Jim_PackageRequire(Jim_Interp *interp, const char *name, int flags)
 
     he = Jim_FindHashEntry(&interp->packages, name);
     if (he == NULL) {
-        /* Try to load the package. */
-        int retcode = JimLoadPackage(interp, name, flags);
+        /* A static extension may be waiting to be initialised. If not, try to load the package. */
+        int retcode = Jim_InitLazyExtension(interp, name);
+        if (retcode < 0) {
+            retcode = JimLoadPackage(interp, name, flags);
+        }
         if (retcode != JIM_OK) {
             if (flags & JIM_ERRMSG) {
                 int len = Jim_Length(Jim_GetResult(interp));
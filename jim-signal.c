@@ -30,7 +30,9 @@ static void signal_handler(int sig)
     /* We just remember which signals occurred. Jim_Eval() will
      * notice this as soon as it can and throw an error
      */
-    *sigloc |= sig_to_bit(sig);
+    if (sigloc) {
+        *sigloc |= sig_to_bit(sig);
+    }
 }
 
 static void signal_ignorer(int sig)
@@ -43,6 +45,10 @@ static void signal_init_names(void)
 {
 #define SET_SIG_NAME(SIG) siginfo[SIG].name = #SIG
 
+    if (siginfo[SIGABRT].name) {
+        /* Already done by an earlier interpreter, which may be running on another thread */
+        return;
+    }
     SET_SIG_NAME(SIGABRT);
     SET_SIG_NAME(SIGALRM);
     SET_SIG_NAME(SIGBUS);
@@ -506,6 +512,13 @@ static int Jim_KillCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
     return JIM_ERR;
 }
 
+static void signal_interp_deleted(Jim_Interp *interp, void *data)
+{
+    if (sigloc == &interp->sigmask) {
+        sigloc = NULL;
+    }
+}
+
 int Jim_signalInit(Jim_Interp *interp)
 {
     if (Jim_PackageProvide(interp, "signal", "1.0", JIM_ERRMSG))
@@ -516,8 +529,14 @@ int Jim_signalInit(Jim_Interp *interp)
     /* Teach the jim core how to set a result from a sigmask */
     interp->signal_set_result = signal_set_sigmask_result;
 
-    /* Make sure we know where to store the signals which occur */
-    sigloc = &interp->sigmask;
+    /* Make sure we know where to store the signals which occur.
+     * Signals are process wide, so they belong to the first interpreter
+     * until it is deleted. Other interpreters may be running on other threads.
+     */
+    if (sigloc == NULL) {
+        sigloc = &interp->sigmask;
+    }
+    Jim_SetAssocData(interp, "signal", signal_interp_deleted, NULL);
 
     Jim_CreateCommand(interp, "signal", Jim_SubCmdProc, (void *)signal_command_table, NULL);
     Jim_CreateCommand(interp, "alarm", Jim_AlarmCmd, 0, 0);
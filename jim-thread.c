@@ -0,0 +1,1637 @@
+/*
+ * Implements the thread extension for jim: independent interpreters
+ * running on their own threads and communicating through mailboxes.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials
+ *    provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE JIM TCL PROJECT ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+ * PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * JIM TCL PROJECT OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The views and conclusions contained in the software and documentation
+ * are those of the authors and should not be interpreted as representing
+ * official policies, either expressed or implied, of the Jim Tcl Project.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include "jimautoconf.h"
+#include <jim.h>
+#include <jim-eventloop.h>
+#include <jim-subcmd.h>
+
+/* From initjimsh.tcl */
+extern int Jim_initjimshInit(Jim_Interp *interp);
+
+/*
+ * Every interpreter which loads this extension has a JimThread, whether
+ * or not it runs on a thread of its own, and so may receive messages.
+ *
+ * Senders push messages onto the mailbox, a lock-free stack, and write
+ * to the wakeup pipe if the mailbox was empty. The owner notices the pipe
+ * from its event loop, takes the whole stack at once and appends it in
+ * order to its private inbox. Once closed, the mailbox refuses messages.
+ *
+ * Jim_Objs never cross threads. Scripts and results are copied as strings.
+ */
+
+enum {
+    JIM_THREAD_SEND,
+    JIM_THREAD_REPLY,
+    JIM_THREAD_RELEASE
+};
+
+typedef struct JimThreadMsg {
+    struct JimThreadMsg *next;
+    int type;
+    struct JimThread *replyTo;  /* SEND: where the result goes, or NULL if not wanted */
+    unsigned long serial;       /* Identifies the synchronous send being replied to */
+    int code;                   /* REPLY: return code */
+    char *str;                  /* SEND: script. REPLY: result */
+    int len;
+    char *varName;              /* Variable to receive the result of an asynchronous send */
+} JimThreadMsg;
+
+/* A synchronous [thread::send] waiting for its reply */
+typedef struct JimThreadWait {
+    unsigned long serial;
+    int done;
+    int code;
+    Jim_Obj *resultObj;
+    struct JimThreadWait *next;
+} JimThreadWait;
+
+typedef struct JimThread {
+    int refCount;               /* Updated atomically */
+    int id;
+    JimThreadMsg *mailbox;      /* Updated atomically */
+    int wakefd[2];
+    struct JimThread *next;     /* In JimThreadRegistry, while the mailbox is open */
+
+    /* These belong to the owning interpreter */
+    FILE *wakeFh;
+    JimThreadMsg *inbox;
+    JimThreadMsg *inboxTail;
+    JimThreadWait *waits;
+    unsigned long nextSerial;
+    int released;               /* Set by [thread::release] to end [thread::wait] */
+    struct JimThread **children;/* Threads created by this interpreter, not yet joined */
+    int numChildren;
+
+    /* These belong to the creator */
+    pthread_t thread;
+    char *script;               /* Passed to the new thread */
+} JimThread;
+
+static JimThreadMsg JimMailboxClosedMsg;
+#define JIM_MAILBOX_CLOSED (&JimMailboxClosedMsg)
+
+/* Protects the registry and JimThreadNextId */
+static pthread_mutex_t JimThreadLock = PTHREAD_MUTEX_INITIALIZER;
+static JimThread *JimThreadRegistry;
+static int JimThreadNextId;
+
+static void JimThreadDecrRef(JimThread *t);
+
+static JimThreadMsg *JimThreadNewMsg(int type, const char *str, int len)
+{
+    JimThreadMsg *msg = Jim_Alloc(sizeof(*msg));
+
+    memset(msg, 0, sizeof(*msg));
+    msg->type = type;
+    if (str) {
+        msg->str = Jim_Alloc(len + 1);
+        memcpy(msg->str, str, len);
+        msg->str[len] = 0;
+        msg->len = len;
+    }
+    return msg;
+}
+
+static void JimThreadFreeMsg(JimThreadMsg *msg)
+{
+    if (msg->replyTo) {
+        JimThreadDecrRef(msg->replyTo);
+    }
+    Jim_Free(msg->str);
+    Jim_Free(msg->varName);
+    Jim_Free(msg);
+}
+
+static void JimThreadFreeMsgList(JimThreadMsg *msg)
+{
+    while (msg) {
+        JimThreadMsg *next = msg->next;
+        JimThreadFreeMsg(msg);
+        msg = next;
+    }
+}
+
+static JimThread *JimThreadNew(void)
+{
+    JimThread *t = Jim_Alloc(sizeof(*t));
+
+    memset(t, 0, sizeof(*t));
+    if (pipe(t->wakefd) != 0) {
+        Jim_Free(t);
+        return NULL;
+    }
+    fcntl(t->wakefd[0], F_SETFL, O_NONBLOCK);
+    fcntl(t->wakefd[1], F_SETFL, O_NONBLOCK);
+    t->refCount = 1;
+
+    pthread_mutex_lock(&JimThreadLock);
+    t->id = ++JimThreadNextId;
+    t->next = JimThreadRegistry;
+    JimThreadRegistry = t;
+    pthread_mutex_unlock(&JimThreadLock);
+
+    return t;
+}
+
+static void JimThreadIncrRef(JimThread *t)
+{
+    __atomic_add_fetch(&t->refCount, 1, __ATOMIC_RELAXED);
+}
+
+static void JimThreadDecrRef(JimThread *t)
+{
+    if (__atomic_sub_fetch(&t->refCount, 1, __ATOMIC_ACQ_REL) == 0) {
+        /* Nobody can send to us any more, so closing the pipe is safe */
+        if (t->mailbox != JIM_MAILBOX_CLOSED) {
+            JimThreadFreeMsgList(t->mailbox);
+        }
+        JimThreadFreeMsgList(t->inbox);
+        if (t->wakeFh) {
+            fclose(t->wakeFh);
+        }
+        else {
+            close(t->wakefd[0]);
+        }
+        close(t->wakefd[1]);
+        Jim_Free(t->children);
+        Jim_Free(t->script);
+        Jim_Free(t);
+    }
+}
+
+/* Returns the thread with the given id, with an extra reference, or NULL */
+static JimThread *JimThreadFind(int id)
+{
+    JimThread *t;
+
+    pthread_mutex_lock(&JimThreadLock);
+    for (t = JimThreadRegistry; t; t = t->next) {
+        if (t->id == id) {
+            JimThreadIncrRef(t);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&JimThreadLock);
+    return t;
+}
+
+static JimThread *JimThreadFromObj(Jim_Interp *interp, Jim_Obj *idObj)
+{
+    const char *str = Jim_String(idObj);
+    JimThread *t = NULL;
+    int id;
+    char dummy;
+
+    if (sscanf(str, "tid%d%c", &id, &dummy) == 1) {
+        t = JimThreadFind(id);
+    }
+    if (t == NULL) {
+        Jim_SetResultFormatted(interp, "thread \"%#s\" does not exist", idObj);
+    }
+    return t;
+}
+
+static Jim_Obj *JimThreadIdObj(Jim_Interp *interp, JimThread *t)
+{
+    char buf[32];
+
+    snprintf(buf, sizeof(buf), "tid%d", t->id);
+    return Jim_NewStringObj(interp, buf, -1);
+}
+
+/* Returns JIM_OK if the message was delivered, or JIM_ERR if the mailbox is closed.
+ * The mailbox takes ownership of msg only on success.
+ */
+static int JimMailboxPush(JimThread *t, JimThreadMsg *msg)
+{
+    JimThreadMsg *head = __atomic_load_n(&t->mailbox, __ATOMIC_ACQUIRE);
+
+    do {
+        if (head == JIM_MAILBOX_CLOSED) {
+            return JIM_ERR;
+        }
+        msg->next = head;
+    } while (!__atomic_compare_exchange_n(&t->mailbox, &head, msg, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+
+    if (head == NULL) {
+        /* The mailbox was empty, so the owner may be asleep. If the pipe is full,
+         * the owner is bound to wake up anyway.
+         */
+        char c = 0;
+        ssize_t n = write(t->wakefd[1], &c, 1);
+        JIM_NOTUSED(n);
+    }
+    return JIM_OK;
+}
+
+/* Moves everything in the mailbox to the inbox, replacing it with 'with' */
+static void JimMailboxTake(JimThread *t, JimThreadMsg *with)
+{
+    JimThreadMsg *head = __atomic_load_n(&t->mailbox, __ATOMIC_ACQUIRE);
+    JimThreadMsg *list = NULL;
+
+    do {
+        if (head == JIM_MAILBOX_CLOSED) {
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&t->mailbox, &head, with, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+    /* The stack is newest first */
+    while (head) {
+        JimThreadMsg *next = head->next;
+        head->next = list;
+        list = head;
+        head = next;
+    }
+    if (list) {
+        if (t->inboxTail) {
+            t->inboxTail->next = list;
+        }
+        else {
+            t->inbox = list;
+        }
+        while (list->next) {
+            list = list->next;
+        }
+        t->inboxTail = list;
+    }
+}
+
+static void JimMailboxClose(JimThread *t)
+{
+    JimThread **tp;
+
+    pthread_mutex_lock(&JimThreadLock);
+    for (tp = &JimThreadRegistry; *tp; tp = &(*tp)->next) {
+        if (*tp == t) {
+            *tp = t->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&JimThreadLock);
+
+    JimMailboxTake(t, JIM_MAILBOX_CLOSED);
+}
+
+static int JimThreadSendMsg(JimThread *t, int type)
+{
+    JimThreadMsg *msg = JimThreadNewMsg(type, NULL, 0);
+
+    if (JimMailboxPush(t, msg) != JIM_OK) {
+        JimThreadFreeMsg(msg);
+        return JIM_ERR;
+    }
+    return JIM_OK;
+}
+
+/* Sends the result of a SEND message back to the sender, if wanted */
+static void JimThreadReply(JimThreadMsg *msg, int code, const char *str, int len)
+{
+    JimThreadMsg *reply;
+
+    if (msg->replyTo == NULL) {
+        return;
+    }
+    reply = JimThreadNewMsg(JIM_THREAD_REPLY, str, len);
+    reply->serial = msg->serial;
+    reply->code = code;
+    reply->varName = msg->varName;
+    msg->varName = NULL;
+    if (JimMailboxPush(msg->replyTo, reply) != JIM_OK) {
+        /* The sender has gone */
+        JimThreadFreeMsg(reply);
+    }
+}
+
+static void JimThreadHandleMsg(Jim_Interp *interp, JimThread *t, JimThreadMsg *msg)
+{
+    Jim_Obj *objPtr;
+    JimThreadWait *w;
+
+    switch (msg->type) {
+        case JIM_THREAD_SEND:
+            objPtr = Jim_NewStringObj(interp, msg->str, msg->len);
+            Jim_IncrRefCount(objPtr);
+            if (msg->replyTo) {
+                Jim_CallFrame *savedFramePtr = interp->framePtr;
+                int len;
+                const char *str;
+                int code;
+
+                interp->framePtr = interp->topFramePtr;
+                code = Jim_EvalObj(interp, objPtr);
+                interp->framePtr = savedFramePtr;
+                str = Jim_GetString(Jim_GetResult(interp), &len);
+                JimThreadReply(msg, code, str, len);
+            }
+            else {
+                Jim_EvalObjBackground(interp, objPtr);
+            }
+            Jim_DecrRefCount(interp, objPtr);
+            break;
+
+        case JIM_THREAD_REPLY:
+            objPtr = Jim_NewStringObj(interp, msg->str, msg->len);
+            if (msg->varName) {
+                Jim_SetGlobalVariableStr(interp, msg->varName, objPtr);
+                break;
+            }
+            for (w = t->waits; w; w = w->next) {
+                if (w->serial == msg->serial) {
+                    w->done = 1;
+                    w->code = msg->code;
+                    w->resultObj = objPtr;
+                    Jim_IncrRefCount(objPtr);
+                    break;
+                }
+            }
+            if (w == NULL) {
+                Jim_FreeNewObj(interp, objPtr);
+            }
+            break;
+
+        case JIM_THREAD_RELEASE:
+            t->released = 1;
+            break;
+    }
+    JimThreadFreeMsg(msg);
+}
+
+static int JimThreadMailboxHandler(Jim_Interp *interp, void *clientData, int mask)
+{
+    JimThread *t = clientData;
+    char buf[64];
+
+    /* Drain the pipe before taking the mailbox so that no wakeup is lost */
+    while (read(t->wakefd[0], buf, sizeof(buf)) > 0) {
+    }
+    JimMailboxTake(t, NULL);
+
+    /* A message may lead to this being called recursively, so
+     * take one message at a time to preserve the order.
+     */
+    while (t->inbox) {
+        JimThreadMsg *msg = t->inbox;
+
+        t->inbox = msg->next;
+        if (t->inbox == NULL) {
+            t->inboxTail = NULL;
+        }
+        JimThreadHandleMsg(interp, t, msg);
+    }
+    return JIM_OK;
+}
+
+/* Processes events until w is done or the event loop fails */
+static int JimThreadWaitFor(Jim_Interp *interp, JimThread *t, JimThreadWait *w)
+{
+    int rc = 0;
+
+    w->next = t->waits;
+    t->waits = w;
+    while (!w->done && rc >= 0) {
+        rc = Jim_ProcessEvents(interp, JIM_ALL_EVENTS);
+    }
+    t->waits = w->next;
+    if (rc == -1) {
+        Jim_SetResultString(interp, "no events to wait for", -1);
+    }
+    return w->done ? JIM_OK : JIM_ERR;
+}
+
+static void *JimThreadMain(void *arg)
+{
+    JimThread *t = arg;
+    Jim_Interp *interp;
+    Jim_Obj *scriptObj;
+    sigset_t sigs;
+
+    /* Signals are for the main thread */
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+    interp = Jim_CreateInterp();
+    /* For Jim_threadInit() to find */
+    Jim_SetAssocData(interp, "thread::new", NULL, t);
+    Jim_RegisterCoreCommands(interp);
+    Jim_InitStaticExtensions(interp);
+    Jim_initjimshInit(interp);
+
+    if (Jim_GetAssocData(interp, "thread::new")) {
+        /* The extension was not initialised, so nobody will read the mailbox */
+        JimMailboxClose(t);
+        JimThreadDecrRef(t);
+    }
+    else {
+        scriptObj = Jim_NewStringObj(interp, t->script, -1);
+        Jim_IncrRefCount(scriptObj);
+        if (Jim_EvalObj(interp, scriptObj) == JIM_ERR) {
+            Jim_MakeErrorMessage(interp);
+            fprintf(stderr, "%s\n", Jim_String(Jim_GetResult(interp)));
+        }
+        Jim_DecrRefCount(interp, scriptObj);
+    }
+    Jim_FreeInterp(interp);
+    return NULL;
+}
+
+static void JimThreadDelProc(Jim_Interp *interp, void *data)
+{
+    JimThread *t = data;
+    int i;
+
+    /* Refuse any further messages and fail any which have not been handled */
+    JimMailboxClose(t);
+    while (t->inbox) {
+        JimThreadMsg *msg = t->inbox;
+        static const char msgstr[] = "target thread died";
+
+        t->inbox = msg->next;
+        if (msg->type == JIM_THREAD_SEND) {
+            JimThreadReply(msg, JIM_ERR, msgstr, sizeof(msgstr) - 1);
+        }
+        JimThreadFreeMsg(msg);
+    }
+    t->inboxTail = NULL;
+
+    /* Ask any threads created here to finish, and wait for them */
+    for (i = 0; i < t->numChildren; i++) {
+        JimThreadSendMsg(t->children[i], JIM_THREAD_RELEASE);
+        pthread_join(t->children[i]->thread, NULL);
+        JimThreadDecrRef(t->children[i]);
+    }
+    t->numChildren = 0;
+
+    JimThreadDecrRef(t);
+}
+
+/* ---------------------------------------------------------------------- */
+
+static int JimThreadCreateCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimThread *self = Jim_CmdPrivData(interp);
+    JimThread *t;
+
+    if (argc > 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "?script?");
+        return JIM_ERR;
+    }
+
+    t = JimThreadNew();
+    if (t == NULL) {
+        Jim_SetResultString(interp, "failed to create thread mailbox", -1);
+        return JIM_ERR;
+    }
+    t->script = Jim_StrDup(argc == 2 ? Jim_String(argv[1]) : "thread::wait");
+
+    /* One reference for the new thread and one for us */
+    JimThreadIncrRef(t);
+    if (pthread_create(&t->thread, NULL, JimThreadMain, t) != 0) {
+        JimMailboxClose(t);
+        JimThreadDecrRef(t);
+        JimThreadDecrRef(t);
+        Jim_SetResultString(interp, "failed to create thread", -1);
+        return JIM_ERR;
+    }
+
+    self->children = Jim_Realloc(self->children, sizeof(*self->children) * (self->numChildren + 1));
+    self->children[self->numChildren++] = t;
+
+    Jim_SetResult(interp, JimThreadIdObj(interp, t));
+    return JIM_OK;
+}
+
+static int JimThreadSendCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimThread *self = Jim_CmdPrivData(interp);
+    JimThread *t;
+    JimThreadMsg *msg;
+    JimThreadWait w;
+    const char *str;
+    int len;
+    int async = 0;
+    Jim_Obj *varNameObj = NULL;
+    int rc;
+
+    if (argc > 1 && Jim_CompareStringImmediate(interp, argv[1], "-async")) {
+        async = 1;
+        argc--;
+        argv++;
+    }
+    if (argc != 3 && argc != 4) {
+        Jim_WrongNumArgs(interp, 1, argv, "?-async? id script ?varName?");
+        return JIM_ERR;
+    }
+    if (argc == 4) {
+        varNameObj = argv[3];
+    }
+
+    t = JimThreadFromObj(interp, argv[1]);
+    if (t == NULL) {
+        return JIM_ERR;
+    }
+
+    if (t == self && !async) {
+        /* No need for a message */
+        Jim_CallFrame *savedFramePtr = interp->framePtr;
+
+        JimThreadDecrRef(t);
+        interp->framePtr = interp->topFramePtr;
+        rc = Jim_EvalObj(interp, argv[2]);
+        interp->framePtr = savedFramePtr;
+        w.resultObj = Jim_GetResult(interp);
+        Jim_IncrRefCount(w.resultObj);
+        w.code = rc;
+    }
+    else {
+        str = Jim_GetString(argv[2], &len);
+        msg = JimThreadNewMsg(JIM_THREAD_SEND, str, len);
+        if (!async || varNameObj) {
+            msg->replyTo = self;
+            JimThreadIncrRef(self);
+            msg->serial = ++self->nextSerial;
+            if (async) {
+                msg->varName = Jim_StrDup(Jim_String(varNameObj));
+            }
+        }
+        /* Once delivered, msg belongs to the receiver */
+        w.serial = msg->serial;
+        rc = JimMailboxPush(t, msg);
+        JimThreadDecrRef(t);
+        if (rc != JIM_OK) {
+            JimThreadFreeMsg(msg);
+            Jim_SetResultFormatted(interp, "thread \"%#s\" does not exist", argv[1]);
+            return JIM_ERR;
+        }
+        if (async) {
+            Jim_SetEmptyResult(interp);
+            return JIM_OK;
+        }
+
+        w.done = 0;
+        w.resultObj = NULL;
+        if (JimThreadWaitFor(interp, self, &w) != JIM_OK) {
+            return JIM_ERR;
+        }
+    }
+
+    if (varNameObj) {
+        rc = Jim_SetVariable(interp, varNameObj, w.resultObj);
+        Jim_DecrRefCount(interp, w.resultObj);
+        if (rc != JIM_OK) {
+            return JIM_ERR;
+        }
+        Jim_SetResultInt(interp, w.code);
+        return JIM_OK;
+    }
+    Jim_SetResult(interp, w.resultObj);
+    Jim_DecrRefCount(interp, w.resultObj);
+    return w.code;
+}
+
+static int JimThreadWaitCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimThread *self = Jim_CmdPrivData(interp);
+
+    if (argc != 1) {
+        Jim_WrongNumArgs(interp, 1, argv, "");
+        return JIM_ERR;
+    }
+    while (!self->released) {
+        if (Jim_ProcessEvents(interp, JIM_ALL_EVENTS) == -2) {
+            return JIM_ERR;
+        }
+    }
+    self->released = 0;
+    Jim_SetEmptyResult(interp);
+    return JIM_OK;
+}
+
+static int JimThreadReleaseCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimThread *self = Jim_CmdPrivData(interp);
+    JimThread *t;
+
+    if (argc > 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "?id?");
+        return JIM_ERR;
+    }
+    if (argc == 1) {
+        self->released = 1;
+        return JIM_OK;
+    }
+    t = JimThreadFromObj(interp, argv[1]);
+    if (t == NULL) {
+        return JIM_ERR;
+    }
+    JimThreadSendMsg(t, JIM_THREAD_RELEASE);
+    JimThreadDecrRef(t);
+    return JIM_OK;
+}
+
+static int JimThreadJoinCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimThread *self = Jim_CmdPrivData(interp);
+    int id;
+    int i;
+    char dummy;
+
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "id");
+        return JIM_ERR;
+    }
+    if (sscanf(Jim_String(argv[1]), "tid%d%c", &id, &dummy) != 1) {
+        id = 0;
+    }
+    for (i = 0; i < self->numChildren; i++) {
+        JimThread *t = self->children[i];
+
+        if (t->id == id) {
+            self->children[i] = self->children[--self->numChildren];
+            pthread_join(t->thread, NULL);
+            JimThreadDecrRef(t);
+            return JIM_OK;
+        }
+    }
+    Jim_SetResultFormatted(interp, "thread \"%#s\" was not created by this interpreter", argv[1]);
+    return JIM_ERR;
+}
+
+static int JimThreadIdCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    if (argc != 1) {
+        Jim_WrongNumArgs(interp, 1, argv, "");
+        return JIM_ERR;
+    }
+    Jim_SetResult(interp, JimThreadIdObj(interp, Jim_CmdPrivData(interp)));
+    return JIM_OK;
+}
+
+static int JimThreadNamesCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    Jim_Obj *listObj = Jim_NewListObj(interp, NULL, 0);
+    JimThread *t;
+
+    if (argc != 1) {
+        Jim_WrongNumArgs(interp, 1, argv, "");
+        return JIM_ERR;
+    }
+    pthread_mutex_lock(&JimThreadLock);
+    for (t = JimThreadRegistry; t; t = t->next) {
+        Jim_ListAppendElement(interp, listObj, JimThreadIdObj(interp, t));
+    }
+    pthread_mutex_unlock(&JimThreadLock);
+    Jim_SetResult(interp, listObj);
+    return JIM_OK;
+}
+
+static int JimThreadExistsCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimThread *t;
+
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "id");
+        return JIM_ERR;
+    }
+    t = JimThreadFromObj(interp, argv[1]);
+    if (t) {
+        JimThreadDecrRef(t);
+    }
+    Jim_SetResultBool(interp, t != NULL);
+    return JIM_OK;
+}
+
+/* ----------------------------------------------------------------------
+ * [parallel lmap] and [parallel foreach]
+ *
+ * A pool of worker threads, each with its own interpreter, is created on
+ * first use and kept for later jobs. The list is copied as strings, and
+ * the workers repeatedly claim the next chunk of items from a shared
+ * counter until none are left. Since a worker which finishes early simply
+ * claims more, uneven item costs balance out without per-worker queues.
+ * Results are stored by index, so they come back in order.
+ */
+
+/* Aim for this many chunks per worker, so late chunks are small */
+#define JIM_PARALLEL_CHUNKS_PER_WORKER 8
+
+typedef struct JimParallelJob {
+    int numVars;
+    char **varNames;
+    char *body;
+    char *init;                 /* Script to run in each worker first, or NULL */
+    int numElems;
+    char **elems;               /* numElems strings */
+    int *elemLens;
+    int numItems;               /* numElems / numVars, rounded up */
+    int chunk;
+    int next;                   /* Next item to claim. Updated atomically */
+    int collect;                /* Keep the results? */
+    char **results;             /* numItems results, NULL if skipped with [continue] */
+    int *resultLens;
+    int failed;                 /* Updated atomically. Stop claiming items */
+
+    /* Protected by the pool lock */
+    int errIndex;               /* Item which failed, or -1 for -init */
+    char *errMsg;
+    int running;                /* Number of workers still working on this job */
+} JimParallelJob;
+
+typedef struct JimParallelPool {
+    int numWorkers;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t jobCond;     /* A new job, or shutdown */
+    pthread_cond_t doneCond;    /* A worker finished the job */
+    JimParallelJob *job;
+    unsigned long jobSeq;
+    int shutdown;
+} JimParallelPool;
+
+static char *JimParallelStrDup(const char *str, int len)
+{
+    char *copy = Jim_Alloc(len + 1);
+
+    memcpy(copy, str, len);
+    copy[len] = 0;
+    return copy;
+}
+
+static void JimParallelSetError(JimParallelPool *pool, JimParallelJob *job, int index, Jim_Interp *interp)
+{
+    int len;
+    const char *msg = Jim_GetString(Jim_GetResult(interp), &len);
+
+    __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&pool->lock);
+    /* Keep the first -init failure, otherwise the error from the earliest item */
+    if (job->errMsg == NULL || index < job->errIndex) {
+        Jim_Free(job->errMsg);
+        job->errMsg = JimParallelStrDup(msg, len);
+        job->errIndex = index;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void JimParallelRunJob(Jim_Interp *interp, JimParallelPool *pool, JimParallelJob *job)
+{
+    Jim_Obj *bodyObj;
+    int rc;
+
+    if (job->init) {
+        rc = Jim_EvalGlobal(interp, job->init);
+        if (rc != JIM_OK) {
+            JimParallelSetError(pool, job, -1, interp);
+            return;
+        }
+    }
+
+    /* One object for the whole job, so the body is only parsed once */
+    bodyObj = Jim_NewStringObj(interp, job->body, -1);
+    Jim_IncrRefCount(bodyObj);
+
+    while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        int first = __atomic_fetch_add(&job->next, job->chunk, __ATOMIC_RELAXED);
+        int i;
+
+        if (first >= job->numItems) {
+            break;
+        }
+        for (i = first; i < first + job->chunk && i < job->numItems; i++) {
+            int v;
+
+            for (v = 0; v < job->numVars; v++) {
+                int e = i * job->numVars + v;
+                Jim_Obj *valObj = (e < job->numElems) ?
+                    Jim_NewStringObj(interp, job->elems[e], job->elemLens[e]) :
+                    Jim_NewEmptyStringObj(interp);
+                Jim_SetVariableStr(interp, job->varNames[v], valObj);
+            }
+            rc = Jim_EvalObj(interp, bodyObj);
+            if (rc == JIM_OK) {
+                if (job->collect) {
+                    int len;
+                    const char *str = Jim_GetString(Jim_GetResult(interp), &len);
+                    job->results[i] = JimParallelStrDup(str, len);
+                    job->resultLens[i] = len;
+                }
+            }
+            else if (rc != JIM_CONTINUE) {
+                if (rc == JIM_BREAK) {
+                    Jim_SetResultString(interp, "break is not supported in a parallel body", -1);
+                }
+                JimParallelSetError(pool, job, i, interp);
+                break;
+            }
+        }
+    }
+    Jim_DecrRefCount(interp, bodyObj);
+}
+
+static void *JimParallelWorkerMain(void *arg)
+{
+    JimParallelPool *pool = arg;
+    Jim_Interp *interp;
+    unsigned long seq = 0;
+    sigset_t sigs;
+
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+    interp = Jim_CreateInterp();
+    Jim_RegisterCoreCommands(interp);
+    Jim_InitStaticExtensions(interp);
+    Jim_initjimshInit(interp);
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        JimParallelJob *job;
+
+        while (!pool->shutdown && pool->jobSeq == seq) {
+            pthread_cond_wait(&pool->jobCond, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seq = pool->jobSeq;
+        job = pool->job;
+        pthread_mutex_unlock(&pool->lock);
+
+        JimParallelRunJob(interp, pool, job);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--job->running == 0) {
+            pthread_cond_signal(&pool->doneCond);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    Jim_FreeInterp(interp);
+    return NULL;
+}
+
+static void JimParallelFreePool(Jim_Interp *interp, void *data)
+{
+    JimParallelPool *pool = data;
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->jobCond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->numWorkers; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->jobCond);
+    pthread_cond_destroy(&pool->doneCond);
+    Jim_Free(pool->threads);
+    Jim_Free(pool);
+}
+
+static int JimParallelDefaultWorkers(void)
+{
+    long ncpus = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return ncpus < 1 ? 1 : (int)ncpus;
+}
+
+static JimParallelPool *JimParallelGetPool(Jim_Interp *interp, int numWorkers)
+{
+    JimParallelPool *pool = Jim_GetAssocData(interp, "parallel::pool");
+
+    if (pool && (numWorkers <= 0 || numWorkers == pool->numWorkers)) {
+        return pool;
+    }
+    if (pool) {
+        Jim_DeleteAssocData(interp, "parallel::pool");
+    }
+    if (numWorkers <= 0) {
+        numWorkers = JimParallelDefaultWorkers();
+    }
+
+    pool = Jim_Alloc(sizeof(*pool));
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->jobCond, NULL);
+    pthread_cond_init(&pool->doneCond, NULL);
+    pool->threads = Jim_Alloc(sizeof(*pool->threads) * numWorkers);
+    while (pool->numWorkers < numWorkers) {
+        if (pthread_create(&pool->threads[pool->numWorkers], NULL, JimParallelWorkerMain, pool) != 0) {
+            break;
+        }
+        pool->numWorkers++;
+    }
+    Jim_SetAssocData(interp, "parallel::pool", JimParallelFreePool, pool);
+    if (pool->numWorkers == 0) {
+        Jim_DeleteAssocData(interp, "parallel::pool");
+        Jim_SetResultString(interp, "failed to create worker threads", -1);
+        return NULL;
+    }
+    return pool;
+}
+
+static int JimParallelMap(Jim_Interp *interp, int argc, Jim_Obj *const *argv, int collect)
+{
+    JimParallelPool *pool;
+    JimParallelJob job;
+    Jim_Obj *initObj = NULL;
+    Jim_Obj *listObj;
+    int i;
+    int rc = JIM_OK;
+
+    if (argc == 5) {
+        if (!Jim_CompareStringImmediate(interp, argv[0], "-init")) {
+            Jim_SetResultFormatted(interp, "bad option \"%#s\": must be -init", argv[0]);
+            return JIM_ERR;
+        }
+        initObj = argv[1];
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc != 3) {
+        Jim_SetResultString(interp, "wrong # args: should be \"?-init script? varList list body\"", -1);
+        return JIM_ERR;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.numVars = Jim_ListLength(interp, argv[0]);
+    if (job.numVars < 1) {
+        Jim_SetResultString(interp, "parallel varlist is empty", -1);
+        return JIM_ERR;
+    }
+
+    pool = JimParallelGetPool(interp, 0);
+    if (pool == NULL) {
+        return JIM_ERR;
+    }
+
+    /* Copy everything the workers need as plain strings */
+    job.varNames = Jim_Alloc(sizeof(*job.varNames) * job.numVars);
+    for (i = 0; i < job.numVars; i++) {
+        job.varNames[i] = Jim_StrDup(Jim_String(Jim_ListGetIndex(interp, argv[0], i)));
+    }
+    job.body = Jim_StrDup(Jim_String(argv[2]));
+    job.init = initObj ? Jim_StrDup(Jim_String(initObj)) : NULL;
+    listObj = argv[1];
+    job.numElems = Jim_ListLength(interp, listObj);
+    job.elems = Jim_Alloc(sizeof(*job.elems) * (job.numElems + 1));
+    job.elemLens = Jim_Alloc(sizeof(*job.elemLens) * (job.numElems + 1));
+    for (i = 0; i < job.numElems; i++) {
+        const char *str = Jim_GetString(Jim_ListGetIndex(interp, listObj, i), &job.elemLens[i]);
+        job.elems[i] = JimParallelStrDup(str, job.elemLens[i]);
+    }
+    job.numItems = (job.numElems + job.numVars - 1) / job.numVars;
+    job.chunk = job.numItems / (pool->numWorkers * JIM_PARALLEL_CHUNKS_PER_WORKER);
+    if (job.chunk < 1) {
+        job.chunk = 1;
+    }
+    job.collect = collect;
+    job.results = Jim_Alloc(sizeof(*job.results) * (job.numItems + 1));
+    memset(job.results, 0, sizeof(*job.results) * (job.numItems + 1));
+    job.resultLens = Jim_Alloc(sizeof(*job.resultLens) * (job.numItems + 1));
+    job.errIndex = -1;
+
+    pthread_mutex_lock(&pool->lock);
+    job.running = pool->numWorkers;
+    pool->job = &job;
+    pool->jobSeq++;
+    pthread_cond_broadcast(&pool->jobCond);
+    while (job.running) {
+        pthread_cond_wait(&pool->doneCond, &pool->lock);
+    }
+    pool->job = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (job.failed) {
+        Jim_SetResultString(interp, job.errMsg, -1);
+        rc = JIM_ERR;
+    }
+    else if (collect) {
+        Jim_Obj *resultObj = Jim_NewListObj(interp, NULL, 0);
+        for (i = 0; i < job.numItems; i++) {
+            if (job.results[i]) {
+                Jim_ListAppendElement(interp, resultObj, Jim_NewStringObj(interp, job.results[i], job.resultLens[i]));
+            }
+        }
+        Jim_SetResult(interp, resultObj);
+    }
+    else {
+        Jim_SetEmptyResult(interp);
+    }
+
+    for (i = 0; i < job.numVars; i++) {
+        Jim_Free(job.varNames[i]);
+    }
+    for (i = 0; i < job.numElems; i++) {
+        Jim_Free(job.elems[i]);
+    }
+    for (i = 0; i < job.numItems; i++) {
+        Jim_Free(job.results[i]);
+    }
+    Jim_Free(job.varNames);
+    Jim_Free(job.body);
+    Jim_Free(job.init);
+    Jim_Free(job.elems);
+    Jim_Free(job.elemLens);
+    Jim_Free(job.results);
+    Jim_Free(job.resultLens);
+    Jim_Free(job.errMsg);
+    return rc;
+}
+
+static int parallel_cmd_lmap(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    return JimParallelMap(interp, argc, argv, 1);
+}
+
+static int parallel_cmd_foreach(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    return JimParallelMap(interp, argc, argv, 0);
+}
+
+static int parallel_cmd_workers(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimParallelPool *pool;
+
+    if (argc == 1) {
+        long n;
+        if (Jim_GetLong(interp, argv[0], &n) != JIM_OK) {
+            return JIM_ERR;
+        }
+        if (n < 1) {
+            Jim_SetResultString(interp, "number of workers must be at least 1", -1);
+            return JIM_ERR;
+        }
+        pool = JimParallelGetPool(interp, n);
+        if (pool == NULL) {
+            return JIM_ERR;
+        }
+        Jim_SetResultInt(interp, pool->numWorkers);
+        return JIM_OK;
+    }
+    pool = Jim_GetAssocData(interp, "parallel::pool");
+    Jim_SetResultInt(interp, pool ? pool->numWorkers : JimParallelDefaultWorkers());
+    return JIM_OK;
+}
+
+static const jim_subcmd_type parallel_command_table[] = {
+    {   "lmap",
+        "?-init script? varList list body",
+        parallel_cmd_lmap,
+        3,
+        5,
+        /* Description: Maps body over the list using the worker threads */
+    },
+    {   "foreach",
+        "?-init script? varList list body",
+        parallel_cmd_foreach,
+        3,
+        5,
+        /* Description: Evaluates body for each list item using the worker threads */
+    },
+    {   "workers",
+        "?count?",
+        parallel_cmd_workers,
+        0,
+        1,
+        /* Description: Returns or sets the number of worker threads */
+    },
+    { NULL }
+};
+
+/* ----------------------------------------------------------------------
+ * Shared variables: tsv::*
+ *
+ * Process wide named arrays of string values, shared by all interpreters
+ * on all threads. The arrays are spread over a fixed set of stripes by name,
+ * each with its own lock, so operations on arrays in different stripes don't
+ * contend. Each command holds the lock for the duration, so read-modify-write
+ * commands such as [tsv::incr] and [tsv::cas] are atomic.
+ */
+
+#define JIM_TSV_STRIPES 16
+
+typedef struct JimTsvValue {
+    int len;
+    char str[1];                /* len bytes plus a terminating null */
+} JimTsvValue;
+
+typedef struct JimTsvStripe {
+    pthread_mutex_t lock;
+    Jim_HashTable arrays;       /* name -> Jim_HashTable of key -> JimTsvValue */
+} JimTsvStripe;
+
+static JimTsvStripe JimTsvStripes[JIM_TSV_STRIPES];
+static pthread_once_t JimTsvOnce = PTHREAD_ONCE_INIT;
+
+static unsigned int JimTsvHTHashFunction(const void *key)
+{
+    return Jim_GenHashFunction((const unsigned char *)key, strlen(key));
+}
+
+static void *JimTsvHTDup(void *privdata, const void *key)
+{
+    JIM_NOTUSED(privdata);
+    return Jim_StrDup(key);
+}
+
+static int JimTsvHTKeyCompare(void *privdata, const void *key1, const void *key2)
+{
+    JIM_NOTUSED(privdata);
+    return strcmp(key1, key2) == 0;
+}
+
+static void JimTsvHTFree(void *privdata, void *ptr)
+{
+    JIM_NOTUSED(privdata);
+    Jim_Free(ptr);
+}
+
+static void JimTsvHTArrayDestructor(void *privdata, void *val)
+{
+    JIM_NOTUSED(privdata);
+    Jim_FreeHashTable(val);
+    Jim_Free(val);
+}
+
+static const Jim_HashTableType JimTsvValueHashTableType = {
+    JimTsvHTHashFunction,       /* hash function */
+    JimTsvHTDup,                /* key dup */
+    NULL,                       /* val dup */
+    JimTsvHTKeyCompare,         /* key compare */
+    JimTsvHTFree,               /* key destructor */
+    JimTsvHTFree                /* val destructor */
+};
+
+static const Jim_HashTableType JimTsvArrayHashTableType = {
+    JimTsvHTHashFunction,       /* hash function */
+    JimTsvHTDup,                /* key dup */
+    NULL,                       /* val dup */
+    JimTsvHTKeyCompare,         /* key compare */
+    JimTsvHTFree,               /* key destructor */
+    JimTsvHTArrayDestructor     /* val destructor */
+};
+
+static void JimTsvInit(void)
+{
+    int i;
+
+    for (i = 0; i < JIM_TSV_STRIPES; i++) {
+        pthread_mutex_init(&JimTsvStripes[i].lock, NULL);
+        Jim_InitHashTable(&JimTsvStripes[i].arrays, &JimTsvArrayHashTableType, NULL);
+    }
+}
+
+/* Locks and returns the stripe holding the given array */
+static JimTsvStripe *JimTsvLock(Jim_Obj *arrayObj)
+{
+    int len;
+    const char *name = Jim_GetString(arrayObj, &len);
+    JimTsvStripe *stripe = &JimTsvStripes[Jim_GenHashFunction((const unsigned char *)name, len) % JIM_TSV_STRIPES];
+
+    pthread_mutex_lock(&stripe->lock);
+    return stripe;
+}
+
+static void JimTsvUnlock(JimTsvStripe *stripe)
+{
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+/* Returns the elements of the given array. If create is set, the array is created if necessary */
+static Jim_HashTable *JimTsvArray(JimTsvStripe *stripe, Jim_Obj *arrayObj, int create)
+{
+    Jim_HashEntry *he = Jim_FindHashEntry(&stripe->arrays, Jim_String(arrayObj));
+    Jim_HashTable *ht;
+
+    if (he) {
+        return Jim_GetHashEntryVal(he);
+    }
+    if (!create) {
+        return NULL;
+    }
+    ht = Jim_Alloc(sizeof(*ht));
+    Jim_InitHashTable(ht, &JimTsvValueHashTableType, NULL);
+    Jim_AddHashEntry(&stripe->arrays, Jim_String(arrayObj), ht);
+    return ht;
+}
+
+static JimTsvValue *JimTsvGet(JimTsvStripe *stripe, Jim_Obj *arrayObj, Jim_Obj *keyObj)
+{
+    Jim_HashTable *ht = JimTsvArray(stripe, arrayObj, 0);
+    Jim_HashEntry *he;
+
+    if (ht && (he = Jim_FindHashEntry(ht, Jim_String(keyObj))) != NULL) {
+        return Jim_GetHashEntryVal(he);
+    }
+    return NULL;
+}
+
+static void JimTsvSet(JimTsvStripe *stripe, Jim_Obj *arrayObj, Jim_Obj *keyObj, Jim_Obj *valueObj)
+{
+    int len;
+    const char *str = Jim_GetString(valueObj, &len);
+    JimTsvValue *value = Jim_Alloc(sizeof(*value) + len);
+
+    value->len = len;
+    memcpy(value->str, str, len);
+    value->str[len] = 0;
+    Jim_ReplaceHashEntry(JimTsvArray(stripe, arrayObj, 1), Jim_String(keyObj), value);
+}
+
+static Jim_Obj *JimTsvValueObj(Jim_Interp *interp, JimTsvValue *value)
+{
+    return Jim_NewStringObj(interp, value->str, value->len);
+}
+
+static void JimTsvNoSuchElement(Jim_Interp *interp, Jim_Obj *arrayObj, Jim_Obj *keyObj)
+{
+    Jim_SetResultFormatted(interp, "no key \"%#s\" in shared array \"%#s\"", keyObj, arrayObj);
+}
+
+/* tsv::set array key ?value? */
+static int JimTsvSetCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimTsvStripe *stripe;
+    JimTsvValue *value;
+
+    if (argc != 3 && argc != 4) {
+        Jim_WrongNumArgs(interp, 1, argv, "array key ?value?");
+        return JIM_ERR;
+    }
+    stripe = JimTsvLock(argv[1]);
+    if (argc == 4) {
+        JimTsvSet(stripe, argv[1], argv[2], argv[3]);
+        JimTsvUnlock(stripe);
+        Jim_SetResult(interp, argv[3]);
+        return JIM_OK;
+    }
+    value = JimTsvGet(stripe, argv[1], argv[2]);
+    if (value) {
+        Jim_SetResult(interp, JimTsvValueObj(interp, value));
+    }
+    else {
+        JimTsvNoSuchElement(interp, argv[1], argv[2]);
+    }
+    JimTsvUnlock(stripe);
+    return value ? JIM_OK : JIM_ERR;
+}
+
+/* tsv::get array key ?varName? */
+static int JimTsvGetCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimTsvStripe *stripe;
+    JimTsvValue *value;
+    Jim_Obj *valueObj = NULL;
+
+    if (argc != 3 && argc != 4) {
+        Jim_WrongNumArgs(interp, 1, argv, "array key ?varName?");
+        return JIM_ERR;
+    }
+    stripe = JimTsvLock(argv[1]);
+    value = JimTsvGet(stripe, argv[1], argv[2]);
+    if (value) {
+        valueObj = JimTsvValueObj(interp, value);
+    }
+    JimTsvUnlock(stripe);
+
+    if (argc == 4) {
+        if (valueObj && Jim_SetVariable(interp, argv[3], valueObj) != JIM_OK) {
+            return JIM_ERR;
+        }
+        Jim_SetResultBool(interp, valueObj != NULL);
+        return JIM_OK;
+    }
+    if (valueObj == NULL) {
+        JimTsvNoSuchElement(interp, argv[1], argv[2]);
+        return JIM_ERR;
+    }
+    Jim_SetResult(interp, valueObj);
+    return JIM_OK;
+}
+
+/* tsv::exists array ?key? */
+static int JimTsvExistsCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimTsvStripe *stripe;
+    int exists;
+
+    if (argc != 2 && argc != 3) {
+        Jim_WrongNumArgs(interp, 1, argv, "array ?key?");
+        return JIM_ERR;
+    }
+    stripe = JimTsvLock(argv[1]);
+    if (argc == 3) {
+        exists = JimTsvGet(stripe, argv[1], argv[2]) != NULL;
+    }
+    else {
+        exists = JimTsvArray(stripe, argv[1], 0) != NULL;
+    }
+    JimTsvUnlock(stripe);
+    Jim_SetResultBool(interp, exists);
+    return JIM_OK;
+}
+
+/* tsv::unset array ?key? */
+static int JimTsvUnsetCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimTsvStripe *stripe;
+    Jim_HashTable *ht;
+    int rc = JIM_ERR;
+
+    if (argc != 2 && argc != 3) {
+        Jim_WrongNumArgs(interp, 1, argv, "array ?key?");
+        return JIM_ERR;
+    }
+    stripe = JimTsvLock(argv[1]);
+    ht = JimTsvArray(stripe, argv[1], 0);
+    if (ht) {
+        if (argc == 2) {
+            rc = Jim_DeleteHashEntry(&stripe->arrays, Jim_String(argv[1]));
+        }
+        else {
+            rc = Jim_DeleteHashEntry(ht, Jim_String(argv[2]));
+        }
+    }
+    JimTsvUnlock(stripe);
+    if (rc != JIM_OK) {
+        if (argc == 2) {
+            Jim_SetResultFormatted(interp, "no shared array \"%#s\"", argv[1]);
+        }
+        else {
+            JimTsvNoSuchElement(interp, argv[1], argv[2]);
+        }
+        return JIM_ERR;
+    }
+    return JIM_OK;
+}
+
+/* tsv::incr array key ?increment? */
+static int JimTsvIncrCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimTsvStripe *stripe;
+    JimTsvValue *value;
+    jim_wide increment = 1;
+    jim_wide wideValue = 0;
+    Jim_Obj *valueObj;
+
+    if (argc != 3 && argc != 4) {
+        Jim_WrongNumArgs(interp, 1, argv, "array key ?increment?");
+        return JIM_ERR;
+    }
+    if (argc == 4 && Jim_GetWide(interp, argv[3], &increment) != JIM_OK) {
+        return JIM_ERR;
+    }
+    stripe = JimTsvLock(argv[1]);
+    value = JimTsvGet(stripe, argv[1], argv[2]);
+    if (value) {
+        valueObj = JimTsvValueObj(interp, value);
+        if (Jim_GetWide(interp, valueObj, &wideValue) != JIM_OK) {
+            JimTsvUnlock(stripe);
+            Jim_FreeNewObj(interp, valueObj);
+            return JIM_ERR;
+        }
+        Jim_FreeNewObj(interp, valueObj);
+    }
+    valueObj = Jim_NewWideObj(interp, wideValue + increment);
+    JimTsvSet(stripe, argv[1], argv[2], valueObj);
+    JimTsvUnlock(stripe);
+    Jim_SetResult(interp, valueObj);
+    return JIM_OK;
+}
+
+/* tsv::append array key ?value ...? and tsv::lappend array key ?value ...? */
+static int JimTsvAppend(Jim_Interp *interp, int argc, Jim_Obj *const *argv, int list)
+{
+    JimTsvStripe *stripe;
+    JimTsvValue *value;
+    Jim_Obj *valueObj;
+    int i;
+
+    if (argc < 3) {
+        Jim_WrongNumArgs(interp, 1, argv, "array key ?value ...?");
+        return JIM_ERR;
+    }
+    stripe = JimTsvLock(argv[1]);
+    value = JimTsvGet(stripe, argv[1], argv[2]);
+    if (list) {
+        valueObj = value ? JimTsvValueObj(interp, value) : Jim_NewListObj(interp, NULL, 0);
+        Jim_IncrRefCount(valueObj);
+        /* Parse the stored value as a list while still holding the lock, exactly
+         * as [lappend] does for a variable. Jim's list parser accepts any string
+         * (unbalanced braces and quotes included), so as with [lappend] there is
+         * no error case here.
+         */
+        Jim_ListLength(interp, valueObj);
+        for (i = 3; i < argc; i++) {
+            Jim_ListAppendElement(interp, valueObj, argv[i]);
+        }
+    }
+    else {
+        valueObj = value ? JimTsvValueObj(interp, value) : Jim_NewEmptyStringObj(interp);
+        Jim_IncrRefCount(valueObj);
+        for (i = 3; i < argc; i++) {
+            Jim_AppendObj(interp, valueObj, argv[i]);
+        }
+    }
+    JimTsvSet(stripe, argv[1], argv[2], valueObj);
+    JimTsvUnlock(stripe);
+    Jim_SetResult(interp, valueObj);
+    Jim_DecrRefCount(interp, valueObj);
+    return JIM_OK;
+}
+
+static int JimTsvAppendCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    return JimTsvAppend(interp, argc, argv, 0);
+}
+
+static int JimTsvLappendCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    return JimTsvAppend(interp, argc, argv, 1);
+}
+
+/* tsv::cas array key expected value
+ *
+ * Sets the element to value only if it currently exists and equals expected.
+ * Returns 1 if it was set.
+ */
+static int JimTsvCasCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimTsvStripe *stripe;
+    JimTsvValue *value;
+    int len;
+    const char *expected;
+    int swapped = 0;
+
+    if (argc != 5) {
+        Jim_WrongNumArgs(interp, 1, argv, "array key expected value");
+        return JIM_ERR;
+    }
+    expected = Jim_GetString(argv[3], &len);
+    stripe = JimTsvLock(argv[1]);
+    value = JimTsvGet(stripe, argv[1], argv[2]);
+    if (value && value->len == len && memcmp(value->str, expected, len) == 0) {
+        JimTsvSet(stripe, argv[1], argv[2], argv[4]);
+        swapped = 1;
+    }
+    JimTsvUnlock(stripe);
+    Jim_SetResultBool(interp, swapped);
+    return JIM_OK;
+}
+
+static void JimTsvAppendMatching(Jim_Interp *interp, Jim_Obj *listObj, Jim_HashTable *ht, Jim_Obj *patternObj)
+{
+    Jim_HashTableIterator *htiter = Jim_GetHashTableIterator(ht);
+    Jim_HashEntry *he;
+
+    while ((he = Jim_NextHashEntry(htiter)) != NULL) {
+        Jim_Obj *nameObj = Jim_NewStringObj(interp, he->key, -1);
+
+        if (patternObj == NULL || Jim_StringMatchObj(interp, patternObj, nameObj, 0)) {
+            Jim_ListAppendElement(interp, listObj, nameObj);
+        }
+        else {
+            Jim_FreeNewObj(interp, nameObj);
+        }
+    }
+    Jim_FreeHashTableIterator(htiter);
+}
+
+/* tsv::names ?pattern? */
+static int JimTsvNamesCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    Jim_Obj *listObj;
+    int i;
+
+    if (argc > 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "?pattern?");
+        return JIM_ERR;
+    }
+    listObj = Jim_NewListObj(interp, NULL, 0);
+    for (i = 0; i < JIM_TSV_STRIPES; i++) {
+        pthread_mutex_lock(&JimTsvStripes[i].lock);
+        JimTsvAppendMatching(interp, listObj, &JimTsvStripes[i].arrays, argc == 2 ? argv[1] : NULL);
+        pthread_mutex_unlock(&JimTsvStripes[i].lock);
+    }
+    Jim_SetResult(interp, listObj);
+    return JIM_OK;
+}
+
+/* tsv::keys array ?pattern? */
+static int JimTsvKeysCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    JimTsvStripe *stripe;
+    Jim_HashTable *ht;
+    Jim_Obj *listObj;
+
+    if (argc != 2 && argc != 3) {
+        Jim_WrongNumArgs(interp, 1, argv, "array ?pattern?");
+        return JIM_ERR;
+    }
+    listObj = Jim_NewListObj(interp, NULL, 0);
+    stripe = JimTsvLock(argv[1]);
+    ht = JimTsvArray(stripe, argv[1], 0);
+    if (ht) {
+        JimTsvAppendMatching(interp, listObj, ht, argc == 3 ? argv[2] : NULL);
+    }
+    JimTsvUnlock(stripe);
+    Jim_SetResult(interp, listObj);
+    return JIM_OK;
+}
+
+int Jim_threadInit(Jim_Interp *interp)
+{
+    JimThread *t;
+
+    if (Jim_PackageProvide(interp, "thread", "1.0", JIM_ERRMSG))
+        return JIM_ERR;
+
+    if (Jim_GetAssocData(interp, "eventloop") == NULL) {
+        Jim_SetResultString(interp, "thread requires the eventloop extension", -1);
+        return JIM_ERR;
+    }
+
+    /* A new thread already has its JimThread. Otherwise make one. */
+    t = Jim_GetAssocData(interp, "thread::new");
+    if (t) {
+        Jim_DeleteAssocData(interp, "thread::new");
+    }
+    else {
+        t = JimThreadNew();
+        if (t == NULL) {
+            Jim_SetResultString(interp, "failed to create thread mailbox", -1);
+            return JIM_ERR;
+        }
+    }
+    t->wakeFh = fdopen(t->wakefd[0], "r");
+    Jim_SetAssocData(interp, "thread", JimThreadDelProc, t);
+    Jim_CreateFileHandler(interp, t->wakeFh, JIM_EVENT_READABLE, JimThreadMailboxHandler, t, NULL);
+
+    Jim_CreateCommand(interp, "thread::create", JimThreadCreateCmd, t, NULL);
+    Jim_CreateCommand(interp, "thread::send", JimThreadSendCmd, t, NULL);
+    Jim_CreateCommand(interp, "thread::wait", JimThreadWaitCmd, t, NULL);
+    Jim_CreateCommand(interp, "thread::release", JimThreadReleaseCmd, t, NULL);
+    Jim_CreateCommand(interp, "thread::join", JimThreadJoinCmd, t, NULL);
+    Jim_CreateCommand(interp, "thread::id", JimThreadIdCmd, t, NULL);
+    Jim_CreateCommand(interp, "thread::names", JimThreadNamesCmd, t, NULL);
+    Jim_CreateCommand(interp, "thread::exists", JimThreadExistsCmd, t, NULL);
+    Jim_CreateCommand(interp, "parallel", Jim_SubCmdProc, (void *)parallel_command_table, NULL);
+
+    pthread_once(&JimTsvOnce, JimTsvInit);
+    Jim_CreateCommand(interp, "tsv::set", JimTsvSetCmd, NULL, NULL);
+    Jim_CreateCommand(interp, "tsv::get", JimTsvGetCmd, NULL, NULL);
+    Jim_CreateCommand(interp, "tsv::exists", JimTsvExistsCmd, NULL, NULL);
+    Jim_CreateCommand(interp, "tsv::unset", JimTsvUnsetCmd, NULL, NULL);
+    Jim_CreateCommand(interp, "tsv::incr", JimTsvIncrCmd, NULL, NULL);
+    Jim_CreateCommand(interp, "tsv::append", JimTsvAppendCmd, NULL, NULL);
+    Jim_CreateCommand(interp, "tsv::lappend", JimTsvLappendCmd, NULL, NULL);
+    Jim_CreateCommand(interp, "tsv::cas", JimTsvCasCmd, NULL, NULL);
+    Jim_CreateCommand(interp, "tsv::names", JimTsvNamesCmd, NULL, NULL);
+    Jim_CreateCommand(interp, "tsv::keys", JimTsvKeysCmd, NULL, NULL);
+    return JIM_OK;
+}
@@ -52,7 +52,6 @@
 #include <assert.h>
 #include <errno.h>
 #include <time.h>
-#include <setjmp.h>
 
 #include "jim.h"
 #include "jimautoconf.h"
@@ -67,6 +66,24 @@
 #ifdef HAVE_CRT_EXTERNS_H
 #include <crt_externs.h>
 #endif
+#ifdef JIM_THREADS
+#include <pthread.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef JIM_JIT
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_SETITIMER
+#include <signal.h>
+#endif
+#ifdef JIM_COROUTINES
+#include <ucontext.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#endif
 
 /* For INFINITY, even if math functions are not enabled */
 #include <math.h>
@@ -98,6 +115,10 @@
 #define JIM_DEBUG_COMMAND
 #define JIM_DEBUG_PANIC
 #endif
+#if defined(JIM_MEMSTATS) && !defined(JIM_DEBUG_COMMAND)
+/* [debug memstats] needs the debug command */
+#define JIM_DEBUG_COMMAND
+#endif
 /* Enable this (in conjunction with valgrind) to help debug
  * reference counting issues
  */
@@ -141,6 +162,28 @@ static int JimSign(jim_wide w);
 static int JimValidName(Jim_Interp *interp, const char *type, Jim_Obj *nameObjPtr);
 static void JimPrngSeed(Jim_Interp *interp, unsigned char *seed, int seedLen);
 static void JimRandomBytes(Jim_Interp *interp, void *dest, unsigned int len);
+static int JimGlobMatchObj(Jim_Interp *interp, Jim_Obj *patternObjPtr, const char *str, int len, int nocase);
+static void JimFreeProfiler(struct JimProfiler *prof);
+#ifdef JIM_DEBUG_COMMAND
+#ifdef JIM_THREADS
+static int JimShimmerActive;    /* Number of threads with a tracing interp */
+#define JimShimmerEnabled() __atomic_load_n(&JimShimmerActive, __ATOMIC_RELAXED)
+#else
+static struct JimShimmerTrace *JimShimmerTracer;
+#define JimShimmerEnabled() (JimShimmerTracer != NULL)
+#endif
+static void JimRecordShimmer(Jim_Interp *interp, Jim_Obj *objPtr, const Jim_ObjType *toType);
+static void JimFreeShimmerTrace(Jim_Interp *interp);
+/* Called just before objPtr is converted to toType, or to a string rep if toType is NULL.
+ * interp is the interp doing the conversion, or NULL if not known.
+ */
+#define JimTraceShimmer(interp, objPtr, toType) do { if (JimShimmerEnabled()) JimRecordShimmer((interp), (objPtr), (toType)); } while (0)
+#else
+#define JimTraceShimmer(interp, objPtr, toType)
+#endif
+#ifdef JIM_COROUTINES
+static void JimKillCoroutines(Jim_Interp *interp);
+#endif
 
 
 /* Fast access to the int (wide) value of an object which is known to be of int type */
@@ -359,65 +402,155 @@ static int JimStringCompareLen(const char *s1, const char *s2, int maxchars, int
     return 0;
 }
 
-/* Search 's1' inside 's2', starting to search from char 'index' of 's2'.
- * The index of the first occurrence of s1 in s2 is returned.
- * If s1 is not found inside s2, -1 is returned. */
-static int JimStringFirst(const char *s1, int l1, const char *s2, int l2, int idx)
-{
-    int i;
-    int l1bytelen;
+/* Needles at least this long use the skip table search when memmem() is not available */
+#define JIM_MEMFIND_SKIP_LEN 8
 
-    if (!l1 || !l2 || l1 > l2) {
-        return -1;
+/**
+ * Search for 'needle' ('nlen' bytes) inside 'haystack' ('hlen' bytes).
+ * Works on binary data.
+ *
+ * Returns a pointer to the first occurrence, or NULL if not found.
+ */
+static const char *JimMemFind(const char *haystack, int hlen, const char *needle, int nlen)
+{
+    if (nlen <= 0 || nlen > hlen) {
+        return NULL;
     }
-    if (idx < 0)
-        idx = 0;
-    s2 += utf8_index(s2, idx);
+#ifdef HAVE_MEMMEM
+    return memmem(haystack, hlen, needle, nlen);
+#else
+    if (nlen < JIM_MEMFIND_SKIP_LEN) {
+        /* Short needle. Let memchr() find candidates for the first byte */
+        const char *end = haystack + hlen - nlen + 1;
 
-    l1bytelen = utf8_index(s1, l1);
+        while ((haystack = memchr(haystack, needle[0], end - haystack)) != NULL) {
+            if (memcmp(haystack + 1, needle + 1, nlen - 1) == 0) {
+                return haystack;
+            }
+            haystack++;
+        }
+        return NULL;
+    }
+    else {
+        /* Long needle. Boyer-Moore-Horspool, skipping on the byte under the end of the needle */
+        int skip[256];
+        int i;
+        const char *end = haystack + hlen - nlen;
+        int last = UCHAR(needle[nlen - 1]);
 
-    for (i = idx; i <= l2 - l1; i++) {
-        int c;
-        if (memcmp(s2, s1, l1bytelen) == 0) {
-            return i;
+        for (i = 0; i < 256; i++) {
+            skip[i] = nlen;
+        }
+        for (i = 0; i < nlen - 1; i++) {
+            skip[UCHAR(needle[i])] = nlen - 1 - i;
+        }
+        while (haystack <= end) {
+            int c = UCHAR(haystack[nlen - 1]);
+            if (c == last && memcmp(haystack, needle, nlen - 1) == 0) {
+                return haystack;
+            }
+            haystack += skip[c];
         }
-        s2 += utf8_tounicode(s2, &c);
+        return NULL;
     }
-    return -1;
+#endif
 }
 
 /**
- * Note: Lengths and return value are in bytes, not chars.
+ * Search backwards for 'needle' ('nlen' bytes) inside 'haystack' ('hlen' bytes),
+ * considering only matches which start before byte offset 'limit'.
+ * Works on binary data.
+ *
+ * Returns a pointer to the last such occurrence, or NULL if not found.
+ */
+static const char *JimMemFindLast(const char *haystack, int hlen, int limit, const char *needle, int nlen)
+{
+    const char *p;
+
+    if (limit > hlen - nlen + 1) {
+        limit = hlen - nlen + 1;
+    }
+    if (nlen <= 0 || limit <= 0) {
+        return NULL;
+    }
+#ifdef HAVE_MEMRCHR
+    while ((p = memrchr(haystack, needle[0], limit)) != NULL) {
+        if (memcmp(p + 1, needle + 1, nlen - 1) == 0) {
+            return p;
+        }
+        limit = p - haystack;
+    }
+#else
+    for (p = haystack + limit - 1; p >= haystack; p--) {
+        if (*p == *needle && memcmp(p + 1, needle + 1, nlen - 1) == 0) {
+            return p;
+        }
+    }
+#endif
+    return NULL;
+}
+
+/* Search 's1' inside 's2', starting to search from char 'idx' of 's2'.
+ * The index (in chars) of the first occurrence of s1 in s2 is returned.
+ * If s1 is not found inside s2, -1 is returned.
+ *
+ * Note: l1 and l2 are byte lengths while 'charlen' is the length of s2 in chars.
+ * The search itself is bytewise since a match of valid UTF-8 always starts on a
+ * char boundary, so the index and result only need converting if s2 contains
+ * multi-byte chars.
  */
-static int JimStringLast(const char *s1, int l1, const char *s2, int l2)
+static int JimStringFirst(const char *s1, int l1, const char *s2, int l2, int charlen, int idx)
 {
     const char *p;
+    int offset;
 
-    if (!l1 || !l2 || l1 > l2)
+    if (idx < 0) {
+        idx = 0;
+    }
+    if (idx >= charlen) {
         return -1;
+    }
+    offset = (charlen == l2) ? idx : utf8_index(s2, idx);
 
-    /* Now search for the needle */
-    for (p = s2 + l2 - 1; p != s2 - 1; p--) {
-        if (*p == *s1 && memcmp(s1, p, l1) == 0) {
-            return p - s2;
-        }
+    p = JimMemFind(s2 + offset, l2 - offset, s1, l1);
+    if (p == NULL) {
+        return -1;
     }
-    return -1;
+    if (charlen == l2) {
+        return p - s2;
+    }
+    return idx + utf8_strlen(s2 + offset, p - s2 - offset);
 }
 
-#ifdef JIM_UTF8
-/**
- * Note: Lengths and return value are in chars.
+/* Search backwards for 's1' inside 's2', considering only matches which start
+ * before char 'idx' of 's2'.
+ * The index (in chars) of the last such occurrence of s1 in s2 is returned.
+ * If s1 is not found inside s2, -1 is returned.
+ *
+ * Note: Lengths are as for JimStringFirst().
  */
-static int JimStringLastUtf8(const char *s1, int l1, const char *s2, int l2)
+static int JimStringLast(const char *s1, int l1, const char *s2, int l2, int charlen, int idx)
 {
-    int n = JimStringLast(s1, utf8_index(s1, l1), s2, utf8_index(s2, l2));
-    if (n > 0) {
-        n = utf8_strlen(s2, n);
+    const char *p;
+    int limit;
+
+    if (idx > charlen) {
+        idx = charlen;
+    }
+    if (idx <= 0) {
+        return -1;
     }
-    return n;
+    limit = (charlen == l2) ? idx : utf8_index(s2, idx);
+    if (l1 > limit) {
+        return -1;
+    }
+
+    p = JimMemFindLast(s2, l2, limit, s1, l1);
+    if (p == NULL) {
+        return -1;
+    }
+    return (charlen == l2) ? p - s2 : utf8_strlen(s2, p - s2);
 }
-#endif
 
 /**
  * After an strtol()/strtod()-like conversion,
@@ -563,12 +696,17 @@ int Jim_StringToDouble(const char *str, double *doublePtr)
 
 static jim_wide JimPowWide(jim_wide b, jim_wide e)
 {
-    jim_wide i, res = 1;
+    jim_wide res = 1;
 
     if ((b == 0 && e != 0) || (e < 0))
         return 0;
-    for (i = 0; i < e; i++) {
-        res *= b;
+    /* Exponentiation by squaring, since this may be evaluated at compile time */
+    while (e) {
+        if (e & 1) {
+            res *= b;
+        }
+        e >>= 1;
+        b *= b;
     }
     return res;
 }
@@ -615,6 +753,210 @@ static void JimPanicDump(int condition, const char *fmt, ...)
  * Memory allocation
  * ---------------------------------------------------------------------------*/
 
+/* Categories for [debug memstats]. Anything not allocated with
+ * JimAllocCategory(), including all extensions, is "other".
+ */
+enum {
+    JIM_MEM_OTHER,
+    JIM_MEM_OBJECT,
+    JIM_MEM_STRING,
+    JIM_MEM_LIST,
+    JIM_MEM_HASH,
+    JIM_MEM_CALLFRAME,
+    JIM_MEM_SCRIPT,
+    JIM_MEM_EXPR,
+    JIM_MEM_CATEGORIES
+};
+
+#ifdef JIM_MEMSTATS
+static const char * const JimMemCategoryNames[] = {
+    "other", "object", "string", "list", "hash", "callframe", "script", "expr", "total"
+};
+
+/* Each allocation is preceded by this header. The union keeps the returned pointer aligned */
+typedef union JimMemHeader {
+    struct {
+        int size;
+        int category;
+    } h;
+    long double ld;
+    jim_wide w;
+    void *p;
+} JimMemHeader;
+
+typedef struct JimMemCount {
+    jim_wide bytes;             /* Currently allocated */
+    jim_wide count;             /* Current number of allocations */
+    jim_wide peak;              /* High-water mark of bytes */
+    jim_wide allocs;            /* Allocations since the last reset */
+} JimMemCount;
+
+/* Indexed by category, with the total at the end. Shared by all interps */
+static JimMemCount JimMemCounts[JIM_MEM_CATEGORIES + 1];
+
+#ifdef JIM_THREADS
+static pthread_mutex_t JimMemMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void JimMemAccount(int category, jim_wide bytes, int count)
+{
+    int i;
+
+#ifdef JIM_THREADS
+    pthread_mutex_lock(&JimMemMutex);
+#endif
+    for (i = 0; i < 2; i++) {
+        JimMemCount *c = &JimMemCounts[i == 0 ? category : JIM_MEM_CATEGORIES];
+
+        c->bytes += bytes;
+        c->count += count;
+        if (count > 0) {
+            c->allocs++;
+        }
+        if (c->bytes > c->peak) {
+            c->peak = c->bytes;
+        }
+    }
+#ifdef JIM_THREADS
+    pthread_mutex_unlock(&JimMemMutex);
+#endif
+}
+
+/* Kept out of line: once inlined, GCC sees the pointer past the header as
+ * a zero-sized object and warns (-Warray-bounds) about callers that clear it
+ */
+#ifdef __GNUC__
+#define JIM_MEM_NOINLINE __attribute__((noinline))
+#else
+#define JIM_MEM_NOINLINE
+#endif
+
+static JIM_MEM_NOINLINE void *JimAllocCategory(int size, int category)
+{
+    /* Unlike the plain allocator, a zero size is not NULL. Some callers pass
+     * the result to memcpy() with zero length, which lets the compiler assume
+     * the pointer is non-NULL and drop the check in Jim_Free()
+     */
+    JimMemHeader *hdr;
+
+    if (size < 0) {
+        return NULL;
+    }
+    hdr = malloc(sizeof(*hdr) + (size_t)size);
+    if (hdr == NULL) {
+        return NULL;
+    }
+    hdr->h.size = size;
+    hdr->h.category = category;
+    JimMemAccount(category, size, 1);
+    return hdr + 1;
+}
+
+/* Memory keeps the category it was first allocated with */
+static JIM_MEM_NOINLINE void *JimReallocCategory(void *ptr, int size, int category)
+{
+    JimMemHeader *hdr;
+    int oldsize;
+
+    if (size < 0) {
+        return NULL;
+    }
+    if (ptr == NULL) {
+        return JimAllocCategory(size, category);
+    }
+    if (size == 0) {
+        Jim_Free(ptr);
+        return NULL;
+    }
+    hdr = (JimMemHeader *)ptr - 1;
+    oldsize = hdr->h.size;
+    hdr = realloc(hdr, sizeof(*hdr) + (size_t)size);
+    if (hdr == NULL) {
+        return NULL;
+    }
+    hdr->h.size = size;
+    JimMemAccount(hdr->h.category, size - oldsize, 0);
+    return hdr + 1;
+}
+
+void *Jim_Alloc(int size)
+{
+    return JimAllocCategory(size, JIM_MEM_OTHER);
+}
+
+void Jim_Free(void *ptr)
+{
+    if (ptr) {
+        JimMemHeader *hdr = (JimMemHeader *)ptr - 1;
+
+        JimMemAccount(hdr->h.category, -hdr->h.size, -1);
+        free(hdr);
+    }
+}
+
+void *Jim_Realloc(void *ptr, int size)
+{
+    return JimReallocCategory(ptr, size, JIM_MEM_OTHER);
+}
+
+char *Jim_StrDup(const char *s)
+{
+    /* strdup() would bypass the accounting */
+    return Jim_StrDupLen(s, strlen(s));
+}
+
+/* Returns a list of category {bytes b count n peak p allocs a}, including the total */
+static Jim_Obj *JimMemStatsReport(Jim_Interp *interp)
+{
+    Jim_Obj *listObj = Jim_NewListObj(interp, NULL, 0);
+    JimMemCount counts[JIM_MEM_CATEGORIES + 1];
+    int i;
+
+#ifdef JIM_THREADS
+    pthread_mutex_lock(&JimMemMutex);
+#endif
+    memcpy(counts, JimMemCounts, sizeof(counts));
+#ifdef JIM_THREADS
+    pthread_mutex_unlock(&JimMemMutex);
+#endif
+
+    for (i = 0; i <= JIM_MEM_CATEGORIES; i++) {
+        Jim_Obj *objv[8];
+
+        objv[0] = Jim_NewStringObj(interp, "bytes", -1);
+        objv[1] = Jim_NewWideObj(interp, counts[i].bytes);
+        objv[2] = Jim_NewStringObj(interp, "count", -1);
+        objv[3] = Jim_NewWideObj(interp, counts[i].count);
+        objv[4] = Jim_NewStringObj(interp, "peak", -1);
+        objv[5] = Jim_NewWideObj(interp, counts[i].peak);
+        objv[6] = Jim_NewStringObj(interp, "allocs", -1);
+        objv[7] = Jim_NewWideObj(interp, counts[i].allocs);
+        Jim_ListAppendElement(interp, listObj, Jim_NewStringObj(interp, JimMemCategoryNames[i], -1));
+        Jim_ListAppendElement(interp, listObj, Jim_NewListObj(interp, objv, 8));
+    }
+    return listObj;
+}
+
+/* Resets the high-water marks to the current usage, and the allocation counts */
+static void JimMemStatsReset(void)
+{
+    int i;
+
+#ifdef JIM_THREADS
+    pthread_mutex_lock(&JimMemMutex);
+#endif
+    for (i = 0; i <= JIM_MEM_CATEGORIES; i++) {
+        JimMemCounts[i].peak = JimMemCounts[i].bytes;
+        JimMemCounts[i].allocs = 0;
+    }
+#ifdef JIM_THREADS
+    pthread_mutex_unlock(&JimMemMutex);
+#endif
+}
+#else
+#define JimAllocCategory(size, category) Jim_Alloc(size)
+#define JimReallocCategory(ptr, size, category) Jim_Realloc((ptr), (size))
+
 void *Jim_Alloc(int size)
 {
     return size ? malloc(size) : NULL;
@@ -634,6 +976,7 @@ char *Jim_StrDup(const char *s)
 {
     return strdup(s);
 }
+#endif /* JIM_MEMSTATS */
 
 char *Jim_StrDupLen(const char *s, int l)
 {
@@ -657,6 +1000,19 @@ static jim_wide JimClock(void)
     return (jim_wide) tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
+/* Returns a monotonic time in nanoseconds, for measuring intervals */
+static jim_wide JimMonotonicClock(void)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (jim_wide) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return JimClock() * 1000;
+#endif
+}
+
 /* -----------------------------------------------------------------------------
  * Hash Tables
  * ---------------------------------------------------------------------------*/
@@ -753,7 +1109,7 @@ void Jim_ExpandHashTable(Jim_HashTable *ht, unsigned int size)
     Jim_InitHashTable(&n, ht->type, ht->privdata);
     n.size = realsize;
     n.sizemask = realsize - 1;
-    n.table = Jim_Alloc(realsize * sizeof(Jim_HashEntry *));
+    n.table = JimAllocCategory(realsize * sizeof(Jim_HashEntry *), JIM_MEM_HASH);
     /* Keep the same 'uniq' as the original */
     n.uniq = ht->uniq;
 
@@ -998,7 +1354,7 @@ static Jim_HashEntry *JimInsertHashEntry(Jim_HashTable *ht, const void *key, int
     }
 
     /* Allocates the memory and stores key */
-    he = Jim_Alloc(sizeof(*he));
+    he = JimAllocCategory(sizeof(*he), JIM_MEM_HASH);
     he->next = ht->table[h];
     ht->table[h] = he;
     ht->used++;
@@ -1981,12 +2337,12 @@ static Jim_Obj *JimParserGetTokenObj(Jim_Interp *interp, struct JimParserCtx *pc
     end = pc->tend;
     if (start > end) {
         len = 0;
-        token = Jim_Alloc(1);
+        token = JimAllocCategory(1, JIM_MEM_STRING);
         token[0] = '\0';
     }
     else {
         len = (end - start) + 1;
-        token = Jim_Alloc(len + 1);
+        token = JimAllocCategory(len + 1, JIM_MEM_STRING);
         if (pc->tt != JIM_TT_ESC) {
             /* No escape conversion needed? Just copy it. */
             memcpy(token, start, len);
@@ -2157,7 +2513,7 @@ Jim_Obj *Jim_NewObj(Jim_Interp *interp)
     }
     else {
         /* -- No ready to use objects: allocate a new one -- */
-        objPtr = Jim_Alloc(sizeof(*objPtr));
+        objPtr = JimAllocCategory(sizeof(*objPtr), JIM_MEM_OBJECT);
     }
 
     /* Object is returned with refCount of 0. Every
@@ -2242,7 +2598,7 @@ Jim_Obj *Jim_DuplicateObj(Jim_Interp *interp, Jim_Obj *objPtr)
         return dupPtr;
     }
     else {
-        dupPtr->bytes = Jim_Alloc(objPtr->length + 1);
+        dupPtr->bytes = JimAllocCategory(objPtr->length + 1, JIM_MEM_STRING);
         dupPtr->length = objPtr->length;
         /* Copy the null byte too */
         memcpy(dupPtr->bytes, objPtr->bytes, objPtr->length + 1);
@@ -2271,6 +2627,7 @@ const char *Jim_GetString(Jim_Obj *objPtr, int *lenPtr)
     if (objPtr->bytes == NULL) {
         /* Invalid string repr. Generate it. */
         JimPanic((objPtr->typePtr->updateStringProc == NULL, "UpdateStringProc called against '%s' type.", objPtr->typePtr->name));
+        JimTraceShimmer(NULL, objPtr, NULL);
         objPtr->typePtr->updateStringProc(objPtr);
     }
     if (lenPtr)
@@ -2284,6 +2641,7 @@ int Jim_Length(Jim_Obj *objPtr)
     if (objPtr->bytes == NULL) {
         /* Invalid string repr. Generate it. */
         JimPanic((objPtr->typePtr->updateStringProc == NULL, "UpdateStringProc called against '%s' type.", objPtr->typePtr->name));
+        JimTraceShimmer(NULL, objPtr, NULL);
         objPtr->typePtr->updateStringProc(objPtr);
     }
     return objPtr->length;
@@ -2295,6 +2653,7 @@ const char *Jim_String(Jim_Obj *objPtr)
     if (objPtr->bytes == NULL) {
         /* Invalid string repr. Generate it. */
         JimPanic((objPtr->typePtr->updateStringProc == NULL, "UpdateStringProc called against '%s' type.", objPtr->typePtr->name));
+        JimTraceShimmer(NULL, objPtr, NULL);
         objPtr->typePtr->updateStringProc(objPtr);
     }
     return objPtr->bytes;
@@ -2302,8 +2661,9 @@ const char *Jim_String(Jim_Obj *objPtr)
 
 static void JimSetStringBytes(Jim_Obj *objPtr, const char *str)
 {
-    objPtr->bytes = Jim_StrDup(str);
     objPtr->length = strlen(str);
+    objPtr->bytes = JimAllocCategory(objPtr->length + 1, JIM_MEM_STRING);
+    memcpy(objPtr->bytes, str, objPtr->length + 1);
 }
 
 static void FreeDictSubstInternalRep(Jim_Interp *interp, Jim_Obj *objPtr);
@@ -2360,10 +2720,12 @@ static void DupStringInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *d
 static int SetStringFromAny(Jim_Interp *interp, Jim_Obj *objPtr)
 {
     if (objPtr->typePtr != &stringObjType) {
+        JimTraceShimmer(interp, objPtr, &stringObjType);
         /* Get a fresh string representation. */
         if (objPtr->bytes == NULL) {
             /* Invalid string repr. Generate it. */
             JimPanic((objPtr->typePtr->updateStringProc == NULL, "UpdateStringProc called against '%s' type.", objPtr->typePtr->name));
+            JimTraceShimmer(interp, objPtr, NULL);
             objPtr->typePtr->updateStringProc(objPtr);
         }
         /* Free any other internal representation. */
@@ -2409,7 +2771,7 @@ Jim_Obj *Jim_NewStringObj(Jim_Interp *interp, const char *s, int len)
         objPtr->bytes = JimEmptyStringRep;
     }
     else {
-        objPtr->bytes = Jim_Alloc(len + 1);
+        objPtr->bytes = JimAllocCategory(len + 1, JIM_MEM_STRING);
         memcpy(objPtr->bytes, s, len);
         objPtr->bytes[len] = '\0';
     }
@@ -2469,7 +2831,7 @@ static void StringAppendString(Jim_Obj *objPtr, const char *str, int len)
             needlen = 7;
         }
         if (objPtr->bytes == JimEmptyStringRep) {
-            objPtr->bytes = Jim_Alloc(needlen + 1);
+            objPtr->bytes = JimAllocCategory(needlen + 1, JIM_MEM_STRING);
         }
         else {
             objPtr->bytes = Jim_Realloc(objPtr->bytes, needlen + 1);
@@ -2533,12 +2895,12 @@ int Jim_StringEqObj(Jim_Obj *aObjPtr, Jim_Obj *bObjPtr)
     }
 }
 
-/**
- * Note. Does not support embedded nulls in either the pattern or the object.
- */
 int Jim_StringMatchObj(Jim_Interp *interp, Jim_Obj *patternObjPtr, Jim_Obj *objPtr, int nocase)
 {
-    return JimGlobMatch(Jim_String(patternObjPtr), Jim_String(objPtr), nocase);
+    int len;
+    const char *str = Jim_GetString(objPtr, &len);
+
+    return JimGlobMatchObj(interp, patternObjPtr, str, len, nocase);
 }
 
 /*
@@ -3092,103 +3454,501 @@ static int qsortCompareStringPointers(const void *a, const void *b)
     return strcmp(*sa, *sb);
 }
 
-
 /* -----------------------------------------------------------------------------
- * Source Object
- *
- * This object is just a string from the language point of view, but
- * the internal representation contains the filename and line number
- * where this token was read. This information is used by
- * Jim_EvalObj() if the object passed happens to be of type "source".
- *
- * This allows propagation of the information about line numbers and file
- * names and gives error messages with absolute line numbers.
+ * Glob Pattern Object
  *
- * Note that this object uses the internal representation of the Jim_Object,
- * so there is almost no memory overhead. (One Jim_Obj for each filename).
+ * Caches a compiled form of a glob pattern, as used by [string match],
+ * [switch -glob], [lsearch -glob], [info commands pattern], etc.
+ * so that the pattern is not reparsed every time it is matched.
  *
- * Also the object will be converted to something else if the given
- * token it represents in the source file is not something to be
- * evaluated (not a script), and will be specialized in some other way,
- * so the time overhead is also almost zero.
+ * The pattern is compiled into a short program of ops, with runs of literal
+ * chars coalesced and charsets reduced to ranges. For case sensitive patterns,
+ * a leading and trailing literal is matched directly against the start and
+ * end of the string, and a literal following '*' is located with JimMemFind().
  * ---------------------------------------------------------------------------*/
 
-static void FreeSourceInternalRep(Jim_Interp *interp, Jim_Obj *objPtr);
-static void DupSourceInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr);
+enum {
+    JIM_GLOB_LITERAL,           /* Literal chars */
+    JIM_GLOB_ANY,               /* ? */
+    JIM_GLOB_STAR,              /* * (consecutive stars are merged) */
+    JIM_GLOB_SET,               /* [...] */
+};
 
-static const Jim_ObjType sourceObjType = {
-    "source",
-    FreeSourceInternalRep,
-    DupSourceInternalRep,
+typedef struct JimGlobOp {
+    int type;
+    int offset;                 /* LITERAL: offset into text, SET: index of first range */
+    int len;                    /* LITERAL: length in bytes, SET: number of ranges */
+} JimGlobOp;
+
+typedef struct JimGlobProgram {
+    int nocase;                 /* Compiled for -nocase matching */
+    int numOps;
+    int prefixLen;              /* Length of the leading literal, if any, or 0 */
+    int suffixLen;              /* Length of the trailing literal, if any, or 0 */
+    int startPc;                /* First op to run after the prefix has been matched */
+    int endPc;                  /* Op after the last to run before the suffix */
+    JimGlobOp *ops;
+    int *ranges;                /* Pairs of start, end chars for charsets */
+    char *text;                 /* Unescaped literal chars */
+} JimGlobProgram;
+
+static void FreeGlobInternalRep(Jim_Interp *interp, Jim_Obj *objPtr);
+static void DupGlobInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr);
+
+static const Jim_ObjType globObjType = {
+    "glob",
+    FreeGlobInternalRep,
+    DupGlobInternalRep,
     NULL,
-    JIM_TYPE_REFERENCES,
+    JIM_TYPE_NONE,
 };
 
-void FreeSourceInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
+static void FreeGlobInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
 {
-    Jim_DecrRefCount(interp, objPtr->internalRep.sourceValue.fileNameObj);
+    JimGlobProgram *prog = objPtr->internalRep.ptr;
+
+    JIM_NOTUSED(interp);
+    Jim_Free(prog->ops);
+    Jim_Free(prog->ranges);
+    Jim_Free(prog->text);
+    Jim_Free(prog);
 }
 
-void DupSourceInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr)
+static void DupGlobInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr)
 {
-    dupPtr->internalRep.sourceValue = srcPtr->internalRep.sourceValue;
-    Jim_IncrRefCount(dupPtr->internalRep.sourceValue.fileNameObj);
+    JIM_NOTUSED(interp);
+    JIM_NOTUSED(srcPtr);
+
+    /* Just returns an simple string. */
+    dupPtr->typePtr = NULL;
 }
 
-static void JimSetSourceInfo(Jim_Interp *interp, Jim_Obj *objPtr,
-    Jim_Obj *fileNameObj, int lineNumber)
+static JimGlobOp *JimGlobAddOp(JimGlobProgram *prog, int type, int offset, int len)
 {
-    JimPanic((Jim_IsShared(objPtr), "JimSetSourceInfo called with shared object"));
-    JimPanic((objPtr->typePtr != NULL, "JimSetSourceInfo called with typed object"));
-    Jim_IncrRefCount(fileNameObj);
-    objPtr->internalRep.sourceValue.fileNameObj = fileNameObj;
-    objPtr->internalRep.sourceValue.lineNumber = lineNumber;
-    objPtr->typePtr = &sourceObjType;
+    JimGlobOp *op = &prog->ops[prog->numOps++];
+
+    op->type = type;
+    op->offset = offset;
+    op->len = len;
+    return op;
 }
 
-/* -----------------------------------------------------------------------------
- * ScriptLine Object
- *
- * This object is used only in the Script internal represenation.
- * For each line of the script, it holds the number of tokens on the line
- * and the source line number.
+/**
+ * Compiles the pattern of 'len' bytes.
+ * The parsing of escapes and charsets exactly follows JimGlobMatch() and
+ * JimCharsetMatch() (with JIM_CHARSET_GLOB).
  */
-static const Jim_ObjType scriptLineObjType = {
-    "scriptline",
-    NULL,
-    NULL,
-    NULL,
-    JIM_NONE,
-};
-
-static Jim_Obj *JimNewScriptLineObj(Jim_Interp *interp, int argc, int line)
+static JimGlobProgram *JimGlobCompile(const char *pattern, int len, int nocase)
 {
-    Jim_Obj *objPtr;
+    JimGlobProgram *prog = Jim_Alloc(sizeof(*prog));
+    const char *end = pattern + len;
+    int textLen = 0;
+    int numRanges = 0;
+    int c;
 
-#ifdef DEBUG_SHOW_SCRIPT
-    char buf[100];
-    snprintf(buf, sizeof(buf), "line=%d, argc=%d", line, argc);
-    objPtr = Jim_NewStringObj(interp, buf, -1);
-#else
-    objPtr = Jim_NewEmptyStringObj(interp);
-#endif
-    objPtr->typePtr = &scriptLineObjType;
-    objPtr->internalRep.scriptLineValue.argc = argc;
-    objPtr->internalRep.scriptLineValue.line = line;
+    /* Each op consumes at least one byte of the pattern, as does each range */
+    prog->ops = Jim_Alloc(sizeof(*prog->ops) * (len + 1));
+    prog->ranges = Jim_Alloc(sizeof(*prog->ranges) * 2 * (len + 1));
+    prog->text = Jim_Alloc(len + 1);
+    prog->numOps = 0;
+    prog->nocase = nocase;
 
-    return objPtr;
-}
+    while (pattern < end) {
+        int n;
 
-/* -----------------------------------------------------------------------------
- * Script Object
- *
- * This object holds the parsed internal representation of a script.
- * This representation is help within an allocated ScriptObj (see below)
- */
-static void FreeScriptInternalRep(Jim_Interp *interp, Jim_Obj *objPtr);
-static void DupScriptInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr);
-static int JimSetScriptFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr);
-static int JimParseCheckMissing(Jim_Interp *interp, int ch);
+        switch (*pattern) {
+            case '*':
+                while (pattern < end && *pattern == '*') {
+                    pattern++;
+                }
+                JimGlobAddOp(prog, JIM_GLOB_STAR, 0, 0);
+                continue;
+
+            case '?':
+                JimGlobAddOp(prog, JIM_GLOB_ANY, 0, 0);
+                pattern++;
+                continue;
+
+            case '[': {
+                    JimGlobOp *op = JimGlobAddOp(prog, JIM_GLOB_SET, numRanges, 0);
+
+                    pattern++;
+                    while (pattern < end && *pattern != ']') {
+                        int start;
+                        int last;
+
+                        /* A backslash is just another char in the set */
+                        pattern += utf8_tounicode_case(pattern, &start, nocase);
+                        last = start;
+                        if (start != '\\' && pattern + 1 < end && pattern[0] == '-') {
+                            /* Range. Handle reversed ranges too */
+                            pattern++;
+                            pattern += utf8_tounicode_case(pattern, &last, nocase);
+                            if (last < start) {
+                                c = start;
+                                start = last;
+                                last = c;
+                            }
+                        }
+                        prog->ranges[numRanges * 2] = start;
+                        prog->ranges[numRanges * 2 + 1] = last;
+                        numRanges++;
+                    }
+                    op->len = numRanges - op->offset;
+                    if (pattern < end) {
+                        /* Skip the ']' */
+                        pattern++;
+                    }
+                    continue;
+                }
+
+            case '\\':
+                if (pattern + 1 < end) {
+                    pattern++;
+                }
+                break;
+        }
+
+        /* A literal char, coalesced with any preceding literal */
+        n = utf8_tounicode(pattern, &c);
+        if (n > end - pattern) {
+            n = end - pattern;
+        }
+        if (prog->numOps && prog->ops[prog->numOps - 1].type == JIM_GLOB_LITERAL) {
+            prog->ops[prog->numOps - 1].len += n;
+        }
+        else {
+            JimGlobAddOp(prog, JIM_GLOB_LITERAL, textLen, n);
+        }
+        memcpy(prog->text + textLen, pattern, n);
+        textLen += n;
+        pattern += n;
+    }
+
+    /* For case sensitive matching, a leading and trailing literal can be compared bytewise */
+    prog->prefixLen = prog->suffixLen = 0;
+    prog->startPc = 0;
+    prog->endPc = prog->numOps;
+    if (!nocase) {
+        if (prog->endPc > prog->startPc && prog->ops[prog->startPc].type == JIM_GLOB_LITERAL) {
+            prog->prefixLen = prog->ops[prog->startPc++].len;
+        }
+        if (prog->endPc > prog->startPc && prog->ops[prog->endPc - 1].type == JIM_GLOB_LITERAL) {
+            prog->suffixLen = prog->ops[--prog->endPc].len;
+        }
+    }
+
+    return prog;
+}
+
+/**
+ * Returns 1 if the char 'c' is in the given charset op.
+ */
+static int JimGlobSetMatch(const JimGlobProgram *prog, const JimGlobOp *op, int c)
+{
+    const int *range = &prog->ranges[op->offset * 2];
+    int i;
+
+    if (prog->nocase) {
+        c = utf8_upper(c);
+    }
+    for (i = 0; i < op->len; i++, range += 2) {
+        if (c >= range[0] && c <= range[1]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Compares the literal of 'len' bytes, ignoring case, against the string at *strPtr.
+ * On match, advances *strPtr past the matching chars and returns 1.
+ * Otherwise returns 0.
+ */
+static int JimGlobLiteralNocase(const char *p, int len, const char **strPtr, const char *end)
+{
+    const char *pend = p + len;
+    const char *str = *strPtr;
+
+    while (p < pend) {
+        int c, pchar;
+
+        if (str >= end) {
+            return 0;
+        }
+        str += utf8_tounicode_case(str, &c, 1);
+        p += utf8_tounicode_case(p, &pchar, 1);
+        if (c != pchar) {
+            return 0;
+        }
+    }
+    *strPtr = str;
+    return 1;
+}
+
+/**
+ * If the op at 'pc' is a case sensitive literal, returns the first position
+ * at or after 'str' where it can match, or NULL if it can't match at all.
+ * Otherwise just returns 'str'.
+ */
+static const char *JimGlobNextCandidate(const JimGlobProgram *prog, int pc, const char *str, const char *end)
+{
+    if (!prog->nocase && pc < prog->endPc && prog->ops[pc].type == JIM_GLOB_LITERAL) {
+        return JimMemFind(str, end - str, prog->text + prog->ops[pc].offset, prog->ops[pc].len);
+    }
+    return str;
+}
+
+/**
+ * Runs the program ops from startPc to endPc against the string from 'str' to 'end'.
+ *
+ * Since every op other than '*' matches a fixed number of chars, it is sufficient
+ * to backtrack only to the most recent '*'.
+ *
+ * Returns 1 on match or 0 on no match.
+ */
+static int JimGlobExec(const JimGlobProgram *prog, const char *str, const char *end)
+{
+    int pc = prog->startPc;
+    int starPc = -1;
+    const char *starStr = NULL;
+    int c;
+
+    while (1) {
+        if (pc == prog->endPc) {
+            if (str == end) {
+                return 1;
+            }
+        }
+        else {
+            const JimGlobOp *op = &prog->ops[pc];
+
+            switch (op->type) {
+                case JIM_GLOB_STAR:
+                    starPc = ++pc;
+                    if (starPc == prog->endPc) {
+                        return 1;
+                    }
+                    str = JimGlobNextCandidate(prog, pc, str, end);
+                    if (str == NULL) {
+                        return 0;
+                    }
+                    starStr = str;
+                    continue;
+
+                case JIM_GLOB_ANY:
+                    if (str < end) {
+                        str += utf8_tounicode(str, &c);
+                        pc++;
+                        continue;
+                    }
+                    break;
+
+                case JIM_GLOB_SET:
+                    if (str < end) {
+                        str += utf8_tounicode(str, &c);
+                        if (JimGlobSetMatch(prog, op, c)) {
+                            pc++;
+                            continue;
+                        }
+                    }
+                    break;
+
+                case JIM_GLOB_LITERAL:
+                    if (!prog->nocase) {
+                        if (end - str >= op->len && memcmp(str, prog->text + op->offset, op->len) == 0) {
+                            str += op->len;
+                            pc++;
+                            continue;
+                        }
+                    }
+                    else if (JimGlobLiteralNocase(prog->text + op->offset, op->len, &str, end)) {
+                        pc++;
+                        continue;
+                    }
+                    break;
+            }
+        }
+
+        /* No match here, so try again one char further on from the last '*', if any */
+        if (starPc < 0 || starStr >= end) {
+            return 0;
+        }
+        starStr += utf8_tounicode(starStr, &c);
+        starStr = JimGlobNextCandidate(prog, starPc, starStr, end);
+        if (starStr == NULL) {
+            return 0;
+        }
+        str = starStr;
+        pc = starPc;
+    }
+}
+
+/**
+ * Returns the compiled glob pattern for the object, compiling it if necessary.
+ * Returns NULL if the object is a list or dict since the caller may be iterating
+ * over the same object.
+ */
+static JimGlobProgram *JimGetGlobProgram(Jim_Interp *interp, Jim_Obj *objPtr, int nocase)
+{
+    JimGlobProgram *prog;
+    const char *pattern;
+    int len;
+
+    if (objPtr->typePtr == &globObjType) {
+        prog = objPtr->internalRep.ptr;
+        if (prog->nocase == nocase) {
+            return prog;
+        }
+    }
+    else if (Jim_IsList(objPtr) || Jim_IsDict(objPtr)) {
+        return NULL;
+    }
+
+    pattern = Jim_GetString(objPtr, &len);
+    prog = JimGlobCompile(pattern, len, nocase);
+
+    Jim_FreeIntRep(interp, objPtr);
+    objPtr->typePtr = &globObjType;
+    objPtr->internalRep.ptr = prog;
+
+    return prog;
+}
+
+/**
+ * Matches the string of 'len' bytes against the glob pattern object.
+ * Returns 1 on match or 0 on no match.
+ */
+static int JimGlobMatchObj(Jim_Interp *interp, Jim_Obj *patternObjPtr, const char *str, int len, int nocase)
+{
+    JimGlobProgram *prog = JimGetGlobProgram(interp, patternObjPtr, nocase);
+    const char *end = str + len;
+
+    if (prog == NULL) {
+        return JimGlobMatch(Jim_String(patternObjPtr), str, nocase);
+    }
+
+    if (prog->prefixLen) {
+        if (len < prog->prefixLen || memcmp(str, prog->text, prog->prefixLen) != 0) {
+            return 0;
+        }
+        str += prog->prefixLen;
+    }
+    if (prog->suffixLen) {
+        if (end - str < prog->suffixLen ||
+            memcmp(end - prog->suffixLen, prog->text + prog->ops[prog->endPc].offset, prog->suffixLen) != 0) {
+            return 0;
+        }
+        end -= prog->suffixLen;
+    }
+
+    /* Fast path for "*literal*" */
+    if (!prog->nocase && prog->endPc - prog->startPc == 3 && prog->ops[prog->startPc].type == JIM_GLOB_STAR &&
+        prog->ops[prog->startPc + 1].type == JIM_GLOB_LITERAL && prog->ops[prog->startPc + 2].type == JIM_GLOB_STAR) {
+        const JimGlobOp *op = &prog->ops[prog->startPc + 1];
+        return JimMemFind(str, end - str, prog->text + op->offset, op->len) != NULL;
+    }
+
+    return JimGlobExec(prog, str, end);
+}
+
+
+/* -----------------------------------------------------------------------------
+ * Source Object
+ *
+ * This object is just a string from the language point of view, but
+ * the internal representation contains the filename and line number
+ * where this token was read. This information is used by
+ * Jim_EvalObj() if the object passed happens to be of type "source".
+ *
+ * This allows propagation of the information about line numbers and file
+ * names and gives error messages with absolute line numbers.
+ *
+ * Note that this object uses the internal representation of the Jim_Object,
+ * so there is almost no memory overhead. (One Jim_Obj for each filename).
+ *
+ * Also the object will be converted to something else if the given
+ * token it represents in the source file is not something to be
+ * evaluated (not a script), and will be specialized in some other way,
+ * so the time overhead is also almost zero.
+ * ---------------------------------------------------------------------------*/
+
+static void FreeSourceInternalRep(Jim_Interp *interp, Jim_Obj *objPtr);
+static void DupSourceInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr);
+
+static const Jim_ObjType sourceObjType = {
+    "source",
+    FreeSourceInternalRep,
+    DupSourceInternalRep,
+    NULL,
+    JIM_TYPE_REFERENCES,
+};
+
+void FreeSourceInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    Jim_DecrRefCount(interp, objPtr->internalRep.sourceValue.fileNameObj);
+}
+
+void DupSourceInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr)
+{
+    dupPtr->internalRep.sourceValue = srcPtr->internalRep.sourceValue;
+    Jim_IncrRefCount(dupPtr->internalRep.sourceValue.fileNameObj);
+}
+
+static void JimSetSourceInfo(Jim_Interp *interp, Jim_Obj *objPtr,
+    Jim_Obj *fileNameObj, int lineNumber)
+{
+    JimPanic((Jim_IsShared(objPtr), "JimSetSourceInfo called with shared object"));
+    JimPanic((objPtr->typePtr != NULL, "JimSetSourceInfo called with typed object"));
+    Jim_IncrRefCount(fileNameObj);
+    objPtr->internalRep.sourceValue.fileNameObj = fileNameObj;
+    objPtr->internalRep.sourceValue.lineNumber = lineNumber;
+    objPtr->typePtr = &sourceObjType;
+}
+
+/* -----------------------------------------------------------------------------
+ * ScriptLine Object
+ *
+ * This object is used only in the Script internal represenation.
+ * For each line of the script, it holds the number of tokens on the line
+ * and the source line number.
+ */
+static const Jim_ObjType scriptLineObjType = {
+    "scriptline",
+    NULL,
+    NULL,
+    NULL,
+    JIM_NONE,
+};
+
+static Jim_Obj *JimNewScriptLineObj(Jim_Interp *interp, int argc, int line)
+{
+    Jim_Obj *objPtr;
+
+#ifdef DEBUG_SHOW_SCRIPT
+    char buf[100];
+    snprintf(buf, sizeof(buf), "line=%d, argc=%d", line, argc);
+    objPtr = Jim_NewStringObj(interp, buf, -1);
+#else
+    objPtr = Jim_NewEmptyStringObj(interp);
+#endif
+    objPtr->typePtr = &scriptLineObjType;
+    objPtr->internalRep.scriptLineValue.argc = argc;
+    objPtr->internalRep.scriptLineValue.line = line;
+
+    return objPtr;
+}
+
+/* -----------------------------------------------------------------------------
+ * Script Object
+ *
+ * This object holds the parsed internal representation of a script.
+ * This representation is help within an allocated ScriptObj (see below)
+ */
+static void FreeScriptInternalRep(Jim_Interp *interp, Jim_Obj *objPtr);
+static void DupScriptInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr);
+static int JimSetScriptFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr);
+static int JimParseCheckMissing(Jim_Interp *interp, int ch);
 
 static const Jim_ObjType scriptObjType = {
     "script",
@@ -3290,10 +4050,9 @@ typedef struct ScriptObj
     int linenr;                 /* Line number of the current line */
 } ScriptObj;
 
-void FreeScriptInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
+static void JimDecrScriptRefCount(Jim_Interp *interp, struct ScriptObj *script)
 {
     int i;
-    struct ScriptObj *script = (void *)objPtr->internalRep.ptr;
 
     if (--script->inUse != 0)
         return;
@@ -3305,6 +4064,11 @@ void FreeScriptInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
     Jim_Free(script);
 }
 
+void FreeScriptInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    JimDecrScriptRefCount(interp, (void *)objPtr->internalRep.ptr);
+}
+
 void DupScriptInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr)
 {
     JIM_NOTUSED(interp);
@@ -3424,7 +4188,7 @@ static Jim_Obj *JimMakeScriptObj(Jim_Interp *interp, const ParseToken *t)
     if (t->type == JIM_TT_ESC && memchr(t->token, '\\', t->len) != NULL) {
         /* Convert backlash escapes. The result will never be longer than the original */
         int len = t->len;
-        char *str = Jim_Alloc(len + 1);
+        char *str = JimAllocCategory(len + 1, JIM_MEM_STRING);
         len = JimEscape(str, t->token, len);
         objPtr = Jim_NewStringObjNoAlloc(interp, str, len);
     }
@@ -3475,7 +4239,7 @@ static void ScriptObjAddTokens(Jim_Interp *interp, struct ScriptObj *script,
     }
     linenr = script->firstline = tokenlist->list[0].line;
 
-    token = script->token = Jim_Alloc(sizeof(ScriptToken) * count);
+    token = script->token = JimAllocCategory(sizeof(ScriptToken) * count, JIM_MEM_SCRIPT);
 
     /* This is the first token for the current command */
     linefirst = token++;
@@ -3600,7 +4364,7 @@ static void SubstObjAddTokens(Jim_Interp *interp, struct ScriptObj *script,
     int i;
     struct ScriptToken *token;
 
-    token = script->token = Jim_Alloc(sizeof(ScriptToken) * tokenlist->count);
+    token = script->token = JimAllocCategory(sizeof(ScriptToken) * tokenlist->count, JIM_MEM_SCRIPT);
 
     for (i = 0; i < tokenlist->count; i++) {
         const ParseToken *t = &tokenlist->list[i];
@@ -3615,26 +4379,226 @@ static void SubstObjAddTokens(Jim_Interp *interp, struct ScriptObj *script,
     script->len = i;
 }
 
-/* This method takes the string representation of an object
- * as a Tcl script, and generates the pre-parsed internal representation
- * of the script.
+/* -----------------------------------------------------------------------------
+ * Parse cache
  *
- * On parse error, sets an error message and returns JIM_ERR
- * (Note: the object is still converted to a script, even if an error occurs)
- */
-static int JimSetScriptFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr)
-{
-    int scriptTextLen;
+ * Scripts built at runtime (eval "$cmd $arg", event handlers, etc.) tend to
+ * be converted from fresh string objects over and over. Successfully parsed
+ * scripts are kept in a small LRU cache keyed by content, filename and
+ * starting line so that the same text is only tokenised once. The ScriptObj
+ * is shared (via inUse) between the cache and every object using it, which
+ * is safe since a ScriptObj is never modified once created.
+ * ---------------------------------------------------------------------------*/
+#define JIM_PARSE_CACHE_SIZE 256        /* Maximum number of cached scripts */
+#define JIM_PARSE_CACHE_MAX_LEN 16384   /* Longer scripts aren't worth keeping */
+
+typedef struct JimParseCacheEntry {
+    char *text;                 /* Copy of the script text (or borrowed for lookups) */
+    int len;                    /* Length of text */
+    int line;                   /* Starting line number */
+    unsigned int hash;          /* Hash of text */
+    struct ScriptObj *script;   /* The cache holds one reference */
+    struct JimParseCacheEntry *prev, *next; /* LRU list, most recently used first */
+} JimParseCacheEntry;
+
+struct JimParseCache {
+    Jim_HashTable table;        /* Keys are JimParseCacheEntry *, no values */
+    JimParseCacheEntry *head;   /* Most recently used */
+    JimParseCacheEntry *tail;   /* Least recently used */
+    long hits;
+    long misses;
+    long diskhits;              /* Scripts loaded from .jimc files (JIM_SCRIPT_CACHE only) */
+    long diskmisses;
+};
+
+static unsigned int JimParseCacheHashFunction(const void *key)
+{
+    const JimParseCacheEntry *e = key;
+
+    return e->hash ^ (unsigned int)e->line;
+}
+
+static int JimParseCacheKeyCompare(void *privdata, const void *key1, const void *key2)
+{
+    const JimParseCacheEntry *e1 = key1;
+    const JimParseCacheEntry *e2 = key2;
+
+    JIM_NOTUSED(privdata);
+
+    return e1->len == e2->len && e1->line == e2->line && e1->hash == e2->hash
+        && memcmp(e1->text, e2->text, e1->len) == 0
+        && Jim_StringEqObj(e1->script->fileNameObj, e2->script->fileNameObj);
+}
+
+static const Jim_HashTableType JimParseCacheHashTableType = {
+    JimParseCacheHashFunction,  /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    JimParseCacheKeyCompare,    /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+static void JimParseCacheUnlink(struct JimParseCache *cache, JimParseCacheEntry *e)
+{
+    if (e->prev) {
+        e->prev->next = e->next;
+    }
+    else {
+        cache->head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    }
+    else {
+        cache->tail = e->prev;
+    }
+}
+
+static void JimParseCacheLinkHead(struct JimParseCache *cache, JimParseCacheEntry *e)
+{
+    e->prev = NULL;
+    e->next = cache->head;
+    if (cache->head) {
+        cache->head->prev = e;
+    }
+    else {
+        cache->tail = e;
+    }
+    cache->head = e;
+}
+
+static void JimParseCacheRemove(Jim_Interp *interp, struct JimParseCache *cache, JimParseCacheEntry *e)
+{
+    Jim_DeleteHashEntry(&cache->table, e);
+    JimParseCacheUnlink(cache, e);
+    JimDecrScriptRefCount(interp, e->script);
+    Jim_Free(e->text);
+    Jim_Free(e);
+}
+
+static void JimFreeParseCache(Jim_Interp *interp)
+{
+    struct JimParseCache *cache = interp->parseCache;
+
+    if (cache) {
+        while (cache->head) {
+            JimParseCacheRemove(interp, cache, cache->head);
+        }
+        Jim_FreeHashTable(&cache->table);
+        Jim_Free(cache);
+        interp->parseCache = NULL;
+    }
+}
+
+static struct JimParseCache *JimGetParseCache(Jim_Interp *interp)
+{
+    struct JimParseCache *cache = interp->parseCache;
+
+    if (cache == NULL) {
+        cache = interp->parseCache = Jim_Alloc(sizeof(*cache));
+        memset(cache, 0, sizeof(*cache));
+        Jim_InitHashTable(&cache->table, &JimParseCacheHashTableType, NULL);
+    }
+    return cache;
+}
+
+/**
+ * Returns a new reference to a cached script for the given text, filename and line,
+ * or NULL if there is none.
+ */
+static struct ScriptObj *JimParseCacheGet(Jim_Interp *interp, const char *text, int len,
+    Jim_Obj *fileNameObj, int line, unsigned int hash)
+{
+    struct JimParseCache *cache = JimGetParseCache(interp);
+    JimParseCacheEntry key;
+    struct ScriptObj keyscript;
+    Jim_HashEntry *he;
+
+    key.text = (char *)text;
+    key.len = len;
+    key.line = line;
+    key.hash = hash;
+    keyscript.fileNameObj = fileNameObj;
+    key.script = &keyscript;
+
+    he = Jim_FindHashEntry(&cache->table, &key);
+    if (he == NULL) {
+        cache->misses++;
+        return NULL;
+    }
+    else {
+        JimParseCacheEntry *e = (JimParseCacheEntry *)Jim_GetHashEntryKey(he);
+
+        cache->hits++;
+        if (e != cache->head) {
+            JimParseCacheUnlink(cache, e);
+            JimParseCacheLinkHead(cache, e);
+        }
+        e->script->inUse++;
+        return e->script;
+    }
+}
+
+static void JimParseCacheAdd(Jim_Interp *interp, const char *text, int len, int line,
+    unsigned int hash, struct ScriptObj *script)
+{
+    struct JimParseCache *cache = interp->parseCache;
+    JimParseCacheEntry *e = Jim_Alloc(sizeof(*e));
+
+    e->text = Jim_Alloc(len + 1);
+    memcpy(e->text, text, len);
+    e->text[len] = 0;
+    e->len = len;
+    e->line = line;
+    e->hash = hash;
+    e->script = script;
+    script->inUse++;
+
+    Jim_AddHashEntry(&cache->table, e, NULL);
+    JimParseCacheLinkHead(cache, e);
+
+    if (Jim_GetHashTableUsed(&cache->table) > JIM_PARSE_CACHE_SIZE) {
+        JimParseCacheRemove(interp, cache, cache->tail);
+    }
+}
+
+/* This method takes the string representation of an object
+ * as a Tcl script, and generates the pre-parsed internal representation
+ * of the script.
+ *
+ * On parse error, sets an error message and returns JIM_ERR
+ * (Note: the object is still converted to a script, even if an error occurs)
+ */
+static int JimSetScriptFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr)
+{
+    int scriptTextLen;
     const char *scriptText = Jim_GetString(objPtr, &scriptTextLen);
     struct JimParserCtx parser;
     struct ScriptObj *script;
     ParseTokenList tokenlist;
+    Jim_Obj *fileNameObj = interp->emptyObj;
+    unsigned int hash = 0;
     int line = 1;
     int retcode = JIM_OK;
 
+    JimTraceShimmer(interp, objPtr, &scriptObjType);
+
     /* Try to get information about filename / line number */
     if (objPtr->typePtr == &sourceObjType) {
         line = objPtr->internalRep.sourceValue.lineNumber;
+        fileNameObj = objPtr->internalRep.sourceValue.fileNameObj;
+    }
+
+    if (scriptTextLen <= JIM_PARSE_CACHE_MAX_LEN) {
+        hash = Jim_GenHashFunction((const unsigned char *)scriptText, scriptTextLen);
+        script = JimParseCacheGet(interp, scriptText, scriptTextLen, fileNameObj, line, hash);
+        if (script) {
+            Jim_FreeIntRep(interp, objPtr);
+            Jim_SetIntRepPtr(objPtr, script);
+            objPtr->typePtr = &scriptObjType;
+            return JIM_OK;
+        }
     }
 
     /* Initially parse the script into tokens (in tokenlist) */
@@ -3653,15 +4617,10 @@ static int JimSetScriptFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr)
     ScriptAddToken(&tokenlist, scriptText + scriptTextLen, 0, JIM_TT_EOF, 0);
 
     /* Create the "real" script tokens from the parsed tokens */
-    script = Jim_Alloc(sizeof(*script));
+    script = JimAllocCategory(sizeof(*script), JIM_MEM_SCRIPT);
     memset(script, 0, sizeof(*script));
     script->inUse = 1;
-    if (objPtr->typePtr == &sourceObjType) {
-        script->fileNameObj = objPtr->internalRep.sourceValue.fileNameObj;
-    }
-    else {
-        script->fileNameObj = interp->emptyObj;
-    }
+    script->fileNameObj = fileNameObj;
     script->linenr = parser.missing.line;
     Jim_IncrRefCount(script->fileNameObj);
 
@@ -3670,6 +4629,11 @@ static int JimSetScriptFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr)
     /* No longer need the token list */
     ScriptTokenListFree(&tokenlist);
 
+    /* Scripts with parse errors are not cached so that the error is always reported */
+    if (retcode == JIM_OK && scriptTextLen <= JIM_PARSE_CACHE_MAX_LEN) {
+        JimParseCacheAdd(interp, scriptText, scriptTextLen, line, hash, script);
+    }
+
     /* Free the old internal rep and set the new one. */
     Jim_FreeIntRep(interp, objPtr);
     Jim_SetIntRepPtr(objPtr, script);
@@ -3708,9 +4672,35 @@ static void JimIncrCmdRefCount(Jim_Cmd *cmdPtr)
     cmdPtr->inUse++;
 }
 
+/* The value cached by a command object for this command. It changes if either
+ * the interp proc epoch or the command's own epoch is incremented.
+ */
+#define JimCmdEpoch(interp, cmdPtr) ((interp)->procEpoch + (cmdPtr)->cmdEpoch)
+
+/* Invalidates any cached lookups which resolved to this command */
+#define JimInvalidateCmd(cmdPtr) (cmdPtr)->cmdEpoch++
+
+/* A cached lookup keeps the Jim_Cmd structure allocated so that it can be
+ * validated, but does not keep the command itself alive.
+ */
+static void JimIncrCmdCacheRef(Jim_Cmd *cmdPtr)
+{
+    cmdPtr->cacheRefs++;
+}
+
+static void JimDecrCmdCacheRef(Jim_Cmd *cmdPtr)
+{
+    if (--cmdPtr->cacheRefs == 0 && cmdPtr->inUse == 0) {
+        Jim_Free(cmdPtr);
+    }
+}
+
 static void JimDecrCmdRefCount(Jim_Interp *interp, Jim_Cmd *cmdPtr)
 {
     if (--cmdPtr->inUse == 0) {
+        /* Freeing the body may release cached lookups of this same command */
+        JimIncrCmdCacheRef(cmdPtr);
+        JimInvalidateCmd(cmdPtr);
         if (cmdPtr->isproc) {
             Jim_DecrRefCount(interp, cmdPtr->u.proc.argListObjPtr);
             Jim_DecrRefCount(interp, cmdPtr->u.proc.bodyObjPtr);
@@ -3730,7 +4720,7 @@ static void JimDecrCmdRefCount(Jim_Interp *interp, Jim_Cmd *cmdPtr)
             /* Delete any pushed command too */
             JimDecrCmdRefCount(interp, cmdPtr->prevCmd);
         }
-        Jim_Free(cmdPtr);
+        JimDecrCmdCacheRef(cmdPtr);
     }
 }
 
@@ -3763,6 +4753,8 @@ static const Jim_HashTableType JimVariablesHashTableType = {
  */
 static void JimCommandsHT_ValDestructor(void *interp, void *val)
 {
+    /* The command is no longer reachable by this name */
+    JimInvalidateCmd((Jim_Cmd *)val);
     JimDecrCmdRefCount(interp, val);
 }
 
@@ -3865,25 +4857,20 @@ static int JimCreateCommand(Jim_Interp *interp, const char *name, Jim_Cmd *cmd)
      * proc, we stash a reference to the old proc here.
      */
     Jim_HashEntry *he = Jim_FindHashEntry(&interp->commands, name);
-    if (he) {
-        /* There was an old cmd with the same name,
-         * so this requires a 'proc epoch' update. */
-
-        /* If a procedure with the same name didn't exist there is no need
-         * to increment the 'proc epoch' because creation of a new procedure
-         * can never affect existing cached commands. We don't do
-         * negative caching. */
-        Jim_InterpIncrProcEpoch(interp);
-    }
 
+    /* Only lookups of an old cmd with the same name become stale.
+     * Creation of a new command can never affect other cached
+     * commands since we don't do negative caching.
+     */
     if (he && interp->local) {
         /* Push this command over the top of the previous one */
         cmd->prevCmd = Jim_GetHashEntryVal(he);
+        JimInvalidateCmd(cmd->prevCmd);
         Jim_SetHashVal(&interp->commands, he, cmd);
     }
     else {
         if (he) {
-            /* Replace the existing command */
+            /* Replace the existing command. This invalidates it. */
             Jim_DeleteHashEntry(&interp->commands, name);
         }
 
@@ -3978,13 +4965,24 @@ static void JimUpdateProcNamespace(Jim_Interp *interp, Jim_Cmd *cmdPtr, const ch
         /* XXX: Really need JimNamespaceSplit() */
         const char *pt = strrchr(cmdname, ':');
         if (pt && pt != cmdname && pt[-1] == ':') {
+            const char *sep = cmdname;
+
             Jim_DecrRefCount(interp, cmdPtr->u.proc.nsObj);
             cmdPtr->u.proc.nsObj = Jim_NewStringObj(interp, cmdname, pt - cmdname - 1);
             Jim_IncrRefCount(cmdPtr->u.proc.nsObj);
 
-            if (Jim_FindHashEntry(&interp->commands, pt + 1)) {
-                /* This commands shadows a global command, so a proc epoch update is required */
-                Jim_InterpIncrProcEpoch(interp);
+            /* a::b::cmd may shadow the global commands b::cmd and cmd
+             * (as seen from a and a::b respectively), so cached lookups
+             * of those commands are no longer valid.
+             */
+            while ((sep = strstr(sep, "::")) != NULL) {
+                Jim_HashEntry *he;
+
+                sep += 2;
+                he = Jim_FindHashEntry(&interp->commands, sep);
+                if (he) {
+                    JimInvalidateCmd((Jim_Cmd *)Jim_GetHashEntryVal(he));
+                }
             }
         }
     }
@@ -4087,9 +5085,6 @@ int Jim_DeleteCommand(Jim_Interp *interp, const char *name)
         Jim_SetResultFormatted(interp, "can't delete \"%s\": command doesn't exist", name);
         ret = JIM_ERR;
     }
-    else {
-        Jim_InterpIncrProcEpoch(interp);
-    }
 
     JimFreeQualifiedName(interp, qualifiedNameObj);
 
@@ -4128,12 +5123,9 @@ int Jim_RenameCommand(Jim_Interp *interp, const char *oldName, const char *newNa
         JimUpdateProcNamespace(interp, cmdPtr, fqnew);
         Jim_AddHashEntry(&interp->commands, fqnew, cmdPtr);
 
-        /* Now remove the old name */
+        /* Now remove the old name. This invalidates lookups by the old name. */
         Jim_DeleteHashEntry(&interp->commands, fqold);
 
-        /* Increment the epoch */
-        Jim_InterpIncrProcEpoch(interp);
-
         ret = JIM_OK;
     }
 
@@ -4150,6 +5142,7 @@ int Jim_RenameCommand(Jim_Interp *interp, const char *oldName, const char *newNa
 static void FreeCommandInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
 {
     Jim_DecrRefCount(interp, objPtr->internalRep.cmdValue.nsObj);
+    JimDecrCmdCacheRef(objPtr->internalRep.cmdValue.cmdPtr);
 }
 
 static void DupCommandInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr)
@@ -4157,6 +5150,7 @@ static void DupCommandInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *
     dupPtr->internalRep.cmdValue = srcPtr->internalRep.cmdValue;
     dupPtr->typePtr = srcPtr->typePtr;
     Jim_IncrRefCount(dupPtr->internalRep.cmdValue.nsObj);
+    JimIncrCmdCacheRef(dupPtr->internalRep.cmdValue.cmdPtr);
 }
 
 static const Jim_ObjType commandObjType = {
@@ -4179,16 +5173,17 @@ Jim_Cmd *Jim_GetCommand(Jim_Interp *interp, Jim_Obj *objPtr, int flags)
 {
     Jim_Cmd *cmd;
 
-    /* In order to be valid, the proc epoch must match and
+    /* In order to be valid, the epoch of the cached command must match and
      * the lookup must have occurred in the same namespace
      */
     if (objPtr->typePtr != &commandObjType ||
-            objPtr->internalRep.cmdValue.procEpoch != interp->procEpoch
+            objPtr->internalRep.cmdValue.procEpoch != JimCmdEpoch(interp, objPtr->internalRep.cmdValue.cmdPtr)
 #ifdef jim_ext_namespace
             || !Jim_StringEqObj(objPtr->internalRep.cmdValue.nsObj, interp->framePtr->nsObj)
 #endif
         ) {
         /* Not cached or out of date, so lookup */
+        JimTraceShimmer(interp, objPtr, &commandObjType);
 
         /* Do we need to try the local namespace? */
         const char *name = Jim_String(objPtr);
@@ -4227,8 +5222,9 @@ found:
         /* Free the old internal repr and set the new one. */
         Jim_FreeIntRep(interp, objPtr);
         objPtr->typePtr = &commandObjType;
-        objPtr->internalRep.cmdValue.procEpoch = interp->procEpoch;
+        objPtr->internalRep.cmdValue.procEpoch = JimCmdEpoch(interp, cmd);
         objPtr->internalRep.cmdValue.cmdPtr = cmd;
+        JimIncrCmdCacheRef(cmd);
         objPtr->internalRep.cmdValue.nsObj = interp->framePtr->nsObj;
         Jim_IncrRefCount(interp->framePtr->nsObj);
     }
@@ -4310,6 +5306,7 @@ static int SetVariableFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr)
         return JIM_ERR;
     }
 
+    JimTraceShimmer(interp, objPtr, &variableObjType);
 
     varName = Jim_GetString(objPtr, &len);
 
@@ -4909,7 +5906,7 @@ static Jim_CallFrame *JimCreateCallFrame(Jim_Interp *interp, Jim_CallFrame *pare
         cf->tailcallCmd = NULL;
     }
     else {
-        cf = Jim_Alloc(sizeof(*cf));
+        cf = JimAllocCategory(sizeof(*cf), JIM_MEM_CALLFRAME);
         memset(cf, 0, sizeof(*cf));
 
         Jim_InitHashTable(&cf->vars, &JimVariablesHashTableType, interp);
@@ -4946,6 +5943,7 @@ static int JimDeleteLocalProcs(Jim_Interp *interp, Jim_Stack *localCommands)
                     cmd->prevCmd = NULL;
 
                     /* Delete the old command */
+                    JimInvalidateCmd(cmd);
                     JimDecrCmdRefCount(interp, cmd);
 
                     /* And restore the original */
@@ -4953,7 +5951,6 @@ static int JimDeleteLocalProcs(Jim_Interp *interp, Jim_Stack *localCommands)
                 }
                 else {
                     Jim_DeleteHashEntry(ht, fqname);
-                    Jim_InterpIncrProcEpoch(interp);
                 }
             }
             Jim_DecrRefCount(interp, cmdNameObj);
@@ -5484,12 +6481,19 @@ void Jim_FreeInterp(Jim_Interp *i)
 
     Jim_Obj *objPtr, *nextObjPtr;
 
+#ifdef JIM_COROUTINES
+    /* Suspended coroutines still hold call frames, so unwind them first */
+    JimKillCoroutines(i);
+#endif
+
     /* Free the active call frames list - must be done before i->commands is destroyed */
     for (cf = i->framePtr; cf; cf = cfx) {
         cfx = cf->parent;
         JimFreeCallFrame(i, cf, JIM_FCF_FULL);
     }
 
+    JimFreeParseCache(i);
+
     Jim_DecrRefCount(i, i->emptyObj);
     Jim_DecrRefCount(i, i->trueObj);
     Jim_DecrRefCount(i, i->falseObj);
@@ -5506,6 +6510,13 @@ void Jim_FreeInterp(Jim_Interp *i)
 #endif
     Jim_FreeHashTable(&i->packages);
     Jim_Free(i->prngState);
+    Jim_Free(i->exprStack);
+    Jim_Free(i->exprValues);
+    Jim_Free(i->jitStats);
+    JimFreeProfiler(i->profiler);
+#ifdef JIM_DEBUG_COMMAND
+    JimFreeShimmerTrace(i);
+#endif
     Jim_FreeHashTable(&i->assocData);
 
     /* Check that the live object list is empty, otherwise
@@ -5777,10 +6788,11 @@ static const Jim_ObjType coercedDoubleObjType = {
 };
 
 
-static void UpdateStringOfInt(struct Jim_Obj *objPtr)
+/* Formats wideValue into buf, which must have room for JIM_INTEGER_SPACE + 1 bytes.
+ * Returns the length, not including the null terminator.
+ */
+static int JimWideToString(char *buf, jim_wide wideValue)
 {
-    char buf[JIM_INTEGER_SPACE + 1];
-    jim_wide wideValue = JimWideValue(objPtr);
     int pos = 0;
 
     if (wideValue == 0) {
@@ -5812,7 +6824,14 @@ static void UpdateStringOfInt(struct Jim_Obj *objPtr)
         }
     }
     buf[pos] = 0;
+    return pos;
+}
+
+static void UpdateStringOfInt(struct Jim_Obj *objPtr)
+{
+    char buf[JIM_INTEGER_SPACE + 1];
 
+    JimWideToString(buf, JimWideValue(objPtr));
     JimSetStringBytes(objPtr, buf);
 }
 
@@ -5827,6 +6846,8 @@ static int SetIntFromAny(Jim_Interp *interp, Jim_Obj *objPtr, int flags)
         return JIM_OK;
     }
 
+    JimTraceShimmer(interp, objPtr, &intObjType);
+
     /* Get the string representation */
     str = Jim_String(objPtr);
     /* Try to convert into a jim_wide */
@@ -5974,6 +6995,8 @@ static int SetDoubleFromAny(Jim_Interp *interp, Jim_Obj *objPtr)
     jim_wide wideValue;
     const char *str;
 
+    JimTraceShimmer(interp, objPtr, &doubleObjType);
+
     /* Preserve the string representation.
      * Needed so we can convert back to int without loss
      */
@@ -6044,6 +7067,246 @@ Jim_Obj *Jim_NewDoubleObj(Jim_Interp *interp, double doubleValue)
     return objPtr;
 }
 
+/* -----------------------------------------------------------------------------
+ * Range object
+ * ---------------------------------------------------------------------------*/
+
+/* [range] returns a lazy list of integers which stores only the start, step and length.
+ * llength, lindex, foreach, lmap and lassign use the range directly, while any
+ * other list operation converts it to a real list via SetListFromAny().
+ */
+static void UpdateStringOfRange(struct Jim_Obj *objPtr);
+
+static const Jim_ObjType rangeObjType = {
+    "range",
+    NULL,
+    NULL,
+    UpdateStringOfRange,
+    JIM_TYPE_NONE,
+};
+
+static Jim_Obj *JimNewRangeObj(Jim_Interp *interp, jim_wide start, int step, int len)
+{
+    Jim_Obj *objPtr;
+
+    objPtr = Jim_NewObj(interp);
+    objPtr->typePtr = &rangeObjType;
+    objPtr->bytes = NULL;
+    objPtr->internalRep.rangeValue.start = start;
+    objPtr->internalRep.rangeValue.step = step;
+    objPtr->internalRep.rangeValue.len = len;
+    return objPtr;
+}
+
+static void UpdateStringOfRange(struct Jim_Obj *objPtr)
+{
+    jim_wide value = objPtr->internalRep.rangeValue.start;
+    int step = objPtr->internalRep.rangeValue.step;
+    int len = objPtr->internalRep.rangeValue.len;
+    int maxLen = JIM_INTEGER_SPACE * 4;
+    char *buf = Jim_Alloc(maxLen);
+    int pos = 0;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        /* Room for a separator, the number and the null terminator */
+        if (pos + JIM_INTEGER_SPACE + 2 > maxLen) {
+            maxLen *= 2;
+            buf = Jim_Realloc(buf, maxLen);
+        }
+        if (i) {
+            buf[pos++] = ' ';
+        }
+        pos += JimWideToString(buf + pos, value);
+        value += step;
+    }
+    buf[pos] = 0;
+
+    objPtr->bytes = buf;
+    objPtr->length = pos;
+}
+
+/**
+ * Returns a new integer object for element idx of the range, or NULL if out of range.
+ * As with Jim_ListGetIndex(), a negative index is relative to the end.
+ */
+static Jim_Obj *JimRangeGetIndex(Jim_Interp *interp, Jim_Obj *rangeObjPtr, int idx)
+{
+    int len = rangeObjPtr->internalRep.rangeValue.len;
+
+    if (idx < 0) {
+        idx += len;
+    }
+    if (idx < 0 || idx >= len) {
+        return NULL;
+    }
+    return Jim_NewIntObj(interp, rangeObjPtr->internalRep.rangeValue.start +
+        (jim_wide)idx * rangeObjPtr->internalRep.rangeValue.step);
+}
+
+/* -----------------------------------------------------------------------------
+ * Frozen object
+ * ---------------------------------------------------------------------------*/
+
+/* [freeze] makes a deep, immutable copy of a string, list or dict which is allocated
+ * outside any interpreter and is reference counted atomically, so that objects in
+ * several interpreters (even on different threads) can refer to the same frozen value
+ * without copying it. Each referring object only holds the frozen value and a cache
+ * of objects for the elements which have been accessed.
+ *
+ * As with ranges, llength, lindex, foreach, lmap, dict get, dict exists and dict size
+ * use the frozen value directly. Any other list or dict operation converts the object
+ * to a real list, whose elements still refer to the frozen elements.
+ */
+enum {
+    JIM_FROZEN_STRING,
+    JIM_FROZEN_LIST,
+    JIM_FROZEN_DICT
+};
+
+typedef struct JimFrozen {
+    int refCount;               /* Modified atomically */
+    int type;                   /* JIM_FROZEN_... */
+    int canonical;              /* 1 if bytes is the canonical list rep of the elements */
+    int length;                 /* Length of bytes */
+    char *bytes;                /* The string rep */
+    int len;                    /* Number of elements (for a dict, keys and values) */
+    struct JimFrozen **ele;     /* The elements */
+    Jim_HashTable index;        /* For a dict, maps each key to the index of its value */
+} JimFrozen;
+
+#ifdef __ATOMIC_ACQ_REL
+#define JimFrozenRetain(F) __atomic_add_fetch(&(F)->refCount, 1, __ATOMIC_RELAXED)
+#define JimFrozenDecr(F) __atomic_sub_fetch(&(F)->refCount, 1, __ATOMIC_ACQ_REL)
+#else
+#define JimFrozenRetain(F) ++(F)->refCount
+#define JimFrozenDecr(F) --(F)->refCount
+#endif
+
+static void FreeFrozenInternalRep(Jim_Interp *interp, Jim_Obj *objPtr);
+static void DupFrozenInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr);
+static void UpdateStringOfFrozen(struct Jim_Obj *objPtr);
+
+/* internalRep.twoPtrValue.ptr1 is the JimFrozen and ptr2 is the element cache, or NULL */
+static const Jim_ObjType frozenObjType = {
+    "frozen",
+    FreeFrozenInternalRep,
+    DupFrozenInternalRep,
+    UpdateStringOfFrozen,
+    JIM_TYPE_NONE,
+};
+
+#define JimFrozenValue(O) ((JimFrozen *)(O)->internalRep.twoPtrValue.ptr1)
+#define JimFrozenCache(O) (O)->internalRep.twoPtrValue.ptr2
+
+/* Returns 1 if objPtr is a frozen list or dict */
+#define JimIsFrozenList(O) ((O)->typePtr == &frozenObjType && JimFrozenValue(O)->type != JIM_FROZEN_STRING)
+
+static void JimFrozenRelease(JimFrozen *frozenPtr)
+{
+    int i;
+
+    if (JimFrozenDecr(frozenPtr) > 0) {
+        return;
+    }
+    for (i = 0; i < frozenPtr->len; i++) {
+        JimFrozenRelease(frozenPtr->ele[i]);
+    }
+    if (frozenPtr->type == JIM_FROZEN_DICT) {
+        Jim_FreeHashTable(&frozenPtr->index);
+    }
+    Jim_Free(frozenPtr->ele);
+    Jim_Free(frozenPtr->bytes);
+    Jim_Free(frozenPtr);
+}
+
+/* Returns a new object referring to frozenPtr. Takes ownership of the caller's reference. */
+static Jim_Obj *JimNewFrozenObj(Jim_Interp *interp, JimFrozen *frozenPtr)
+{
+    Jim_Obj *objPtr = Jim_NewObj(interp);
+
+    objPtr->typePtr = &frozenObjType;
+    objPtr->bytes = NULL;
+    objPtr->internalRep.twoPtrValue.ptr1 = frozenPtr;
+    objPtr->internalRep.twoPtrValue.ptr2 = NULL;
+    return objPtr;
+}
+
+static void FreeFrozenInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    Jim_Obj **cache = JimFrozenCache(objPtr);
+
+    if (cache) {
+        int i;
+
+        for (i = 0; i < JimFrozenValue(objPtr)->len; i++) {
+            if (cache[i]) {
+                Jim_DecrRefCount(interp, cache[i]);
+            }
+        }
+        Jim_Free(cache);
+    }
+    JimFrozenRelease(JimFrozenValue(objPtr));
+}
+
+static void DupFrozenInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr)
+{
+    JIM_NOTUSED(interp);
+
+    JimFrozenRetain(JimFrozenValue(srcPtr));
+    dupPtr->internalRep.twoPtrValue.ptr1 = JimFrozenValue(srcPtr);
+    dupPtr->internalRep.twoPtrValue.ptr2 = NULL;
+    dupPtr->typePtr = &frozenObjType;
+}
+
+static void UpdateStringOfFrozen(struct Jim_Obj *objPtr)
+{
+    JimFrozen *frozenPtr = JimFrozenValue(objPtr);
+
+    objPtr->bytes = Jim_Alloc(frozenPtr->length + 1);
+    memcpy(objPtr->bytes, frozenPtr->bytes, frozenPtr->length + 1);
+    objPtr->length = frozenPtr->length;
+}
+
+/**
+ * Returns the object for element idx of the frozen list or dict, which must be in range.
+ * The object is created on first use and owned by objPtr.
+ */
+static Jim_Obj *JimFrozenElement(Jim_Interp *interp, Jim_Obj *objPtr, int idx)
+{
+    JimFrozen *frozenPtr = JimFrozenValue(objPtr);
+    Jim_Obj **cache = JimFrozenCache(objPtr);
+
+    if (cache == NULL) {
+        cache = Jim_Alloc(sizeof(*cache) * frozenPtr->len);
+        memset(cache, 0, sizeof(*cache) * frozenPtr->len);
+        JimFrozenCache(objPtr) = cache;
+    }
+    if (cache[idx] == NULL) {
+        JimFrozenRetain(frozenPtr->ele[idx]);
+        cache[idx] = JimNewFrozenObj(interp, frozenPtr->ele[idx]);
+        Jim_IncrRefCount(cache[idx]);
+    }
+    return cache[idx];
+}
+
+/**
+ * Returns element idx of the frozen list or dict, or NULL if out of range.
+ * As with Jim_ListGetIndex(), a negative index is relative to the end.
+ */
+static Jim_Obj *JimFrozenGetIndex(Jim_Interp *interp, Jim_Obj *objPtr, int idx)
+{
+    int len = JimFrozenValue(objPtr)->len;
+
+    if (idx < 0) {
+        idx += len;
+    }
+    if (idx < 0 || idx >= len) {
+        return NULL;
+    }
+    return JimFrozenElement(interp, objPtr, idx);
+}
+
 /* -----------------------------------------------------------------------------
  * List object
  * ---------------------------------------------------------------------------*/
@@ -6066,6 +7329,47 @@ static const Jim_ObjType listObjType = {
     JIM_TYPE_NONE,
 };
 
+static unsigned int JimObjectHTHashFunction(const void *key);
+static int JimObjectHTKeyCompare(void *privdata, const void *key1, const void *key2);
+
+/* Maps objects to their slot in a vector of objects which owns them, so the
+ * keys and values are not reference counted. Used for the list membership
+ * index and the switch table.
+ */
+static const Jim_HashTableType JimObjectSlotHashTableType = {
+    JimObjectHTHashFunction,    /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    JimObjectHTKeyCompare,      /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+/* Large lists which are searched repeatedly for exact matches get a membership index.
+ * See JimListFindExact()
+ */
+struct Jim_ListIndex {
+    int searches;               /* Number of searches so far */
+    int built;                  /* Set once the hash table has been built */
+    Jim_HashTable ht;           /* Maps each element to its first slot in the elements vector */
+};
+
+/* Frees the membership index of the list, if any.
+ * This must be done whenever the elements of the list change.
+ */
+static void JimListFreeIndex(Jim_Obj *listPtr)
+{
+    struct Jim_ListIndex *index = listPtr->internalRep.listValue.index;
+
+    if (index) {
+        if (index->built) {
+            Jim_FreeHashTable(&index->ht);
+        }
+        Jim_Free(index);
+        listPtr->internalRep.listValue.index = NULL;
+    }
+}
+
 void FreeListInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
 {
     int i;
@@ -6074,6 +7378,7 @@ void FreeListInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
         Jim_DecrRefCount(interp, objPtr->internalRep.listValue.ele[i]);
     }
     Jim_Free(objPtr->internalRep.listValue.ele);
+    JimListFreeIndex(objPtr);
 }
 
 void DupListInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr)
@@ -6084,8 +7389,9 @@ void DupListInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr)
 
     dupPtr->internalRep.listValue.len = srcPtr->internalRep.listValue.len;
     dupPtr->internalRep.listValue.maxLen = srcPtr->internalRep.listValue.maxLen;
+    dupPtr->internalRep.listValue.index = NULL;
     dupPtr->internalRep.listValue.ele =
-        Jim_Alloc(sizeof(Jim_Obj *) * srcPtr->internalRep.listValue.maxLen);
+        JimAllocCategory(sizeof(Jim_Obj *) * srcPtr->internalRep.listValue.maxLen, JIM_MEM_LIST);
     memcpy(dupPtr->internalRep.listValue.ele, srcPtr->internalRep.listValue.ele,
         sizeof(Jim_Obj *) * srcPtr->internalRep.listValue.len);
     for (i = 0; i < dupPtr->internalRep.listValue.len; i++) {
@@ -6293,7 +7599,7 @@ static void JimMakeListStringRep(Jim_Obj *objPtr, Jim_Obj **objv, int objc)
     bufLen++;
 
     /* Generate the string rep. */
-    p = objPtr->bytes = Jim_Alloc(bufLen + 1);
+    p = objPtr->bytes = JimAllocCategory(bufLen + 1, JIM_MEM_STRING);
     realLength = 0;
     for (i = 0; i < objc; i++) {
         int len, qlen;
@@ -6354,6 +7660,53 @@ static int SetListFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr)
         return JIM_OK;
     }
 
+    JimTraceShimmer(interp, objPtr, &listObjType);
+
+    /* A range is expanded directly, without going via the string rep */
+    if (objPtr->typePtr == &rangeObjType) {
+        jim_wide value = objPtr->internalRep.rangeValue.start;
+        int step = objPtr->internalRep.rangeValue.step;
+        int len = objPtr->internalRep.rangeValue.len;
+        int i;
+
+        objPtr->typePtr = &listObjType;
+        objPtr->internalRep.listValue.ele = JimAllocCategory(sizeof(Jim_Obj *) * len, JIM_MEM_LIST);
+        objPtr->internalRep.listValue.len = len;
+        objPtr->internalRep.listValue.maxLen = len;
+        objPtr->internalRep.listValue.index = NULL;
+        for (i = 0; i < len; i++) {
+            Jim_Obj *elemObjPtr = Jim_NewIntObj(interp, value);
+
+            Jim_IncrRefCount(elemObjPtr);
+            objPtr->internalRep.listValue.ele[i] = elemObjPtr;
+            value += step;
+        }
+        return JIM_OK;
+    }
+
+    /* A frozen list or dict becomes a list of its (frozen) elements, without going via the string rep */
+    if (JimIsFrozenList(objPtr)) {
+        int len = JimFrozenValue(objPtr)->len;
+        Jim_Obj **ele = JimAllocCategory(sizeof(*ele) * len, JIM_MEM_LIST);
+        int i;
+
+        if (objPtr->bytes == NULL && !JimFrozenValue(objPtr)->canonical) {
+            /* The list may not regenerate the same string rep */
+            Jim_String(objPtr);
+        }
+        for (i = 0; i < len; i++) {
+            ele[i] = JimFrozenElement(interp, objPtr, i);
+            Jim_IncrRefCount(ele[i]);
+        }
+        Jim_FreeIntRep(interp, objPtr);
+        objPtr->typePtr = &listObjType;
+        objPtr->internalRep.listValue.ele = ele;
+        objPtr->internalRep.listValue.len = len;
+        objPtr->internalRep.listValue.maxLen = len;
+        objPtr->internalRep.listValue.index = NULL;
+        return JIM_OK;
+    }
+
     /* Optimise dict -> list for object with no string rep. Note that this may only save a little time, but
      * it also preserves any source location of the dict elements
      * which can be very useful
@@ -6374,6 +7727,7 @@ static int SetListFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr)
         objPtr->internalRep.listValue.len = len;
         objPtr->internalRep.listValue.maxLen = len;
         objPtr->internalRep.listValue.ele = listObjPtrPtr;
+        objPtr->internalRep.listValue.index = NULL;
 
         return JIM_OK;
     }
@@ -6399,6 +7753,7 @@ static int SetListFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr)
     objPtr->internalRep.listValue.len = 0;
     objPtr->internalRep.listValue.maxLen = 0;
     objPtr->internalRep.listValue.ele = NULL;
+    objPtr->internalRep.listValue.index = NULL;
 
     /* Convert into a list */
     if (strLen) {
@@ -6428,6 +7783,7 @@ Jim_Obj *Jim_NewListObj(Jim_Interp *interp, Jim_Obj *const *elements, int len)
     objPtr->internalRep.listValue.ele = NULL;
     objPtr->internalRep.listValue.len = 0;
     objPtr->internalRep.listValue.maxLen = 0;
+    objPtr->internalRep.listValue.index = NULL;
 
     if (len) {
         ListInsertElements(objPtr, 0, len, elements);
@@ -6436,6 +7792,55 @@ Jim_Obj *Jim_NewListObj(Jim_Interp *interp, Jim_Obj *const *elements, int len)
     return objPtr;
 }
 
+/* Lists with at least this many elements may get a membership index */
+#define JIM_LIST_INDEX_MIN_LEN 16
+/* ... once they have been searched this many times */
+#define JIM_LIST_INDEX_SEARCHES 3
+
+/* Returns the position of the first element of the list equal to 'objPtr', or -1 if none.
+ *
+ * Large lists get a membership index after a few searches, after which
+ * each search is a hash lookup rather than a linear scan.
+ */
+static int JimListFindExact(Jim_Interp *interp, Jim_Obj *listObjPtr, Jim_Obj *objPtr)
+{
+    struct Jim_ListIndex *index;
+    Jim_Obj **ele;
+    int len, i;
+
+    len = Jim_ListLength(interp, listObjPtr);
+    ele = listObjPtr->internalRep.listValue.ele;
+    index = listObjPtr->internalRep.listValue.index;
+
+    if (index == NULL && len >= JIM_LIST_INDEX_MIN_LEN) {
+        index = Jim_Alloc(sizeof(*index));
+        index->searches = 0;
+        index->built = 0;
+        listObjPtr->internalRep.listValue.index = index;
+    }
+    if (index && !index->built && ++index->searches >= JIM_LIST_INDEX_SEARCHES) {
+        Jim_InitHashTable(&index->ht, &JimObjectSlotHashTableType, NULL);
+        Jim_ExpandHashTable(&index->ht, len);
+        /* Adding fails for duplicate elements, leaving the first one */
+        for (i = 0; i < len; i++) {
+            Jim_AddHashEntry(&index->ht, ele[i], &ele[i]);
+        }
+        index->built = 1;
+    }
+
+    if (index && index->built) {
+        Jim_HashEntry *he = Jim_FindHashEntry(&index->ht, objPtr);
+
+        return he ? (Jim_Obj **)Jim_GetHashEntryVal(he) - ele : -1;
+    }
+    for (i = 0; i < len; i++) {
+        if (Jim_StringEqObj(ele[i], objPtr)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 /* Return a vector of Jim_Obj with the elements of a Jim list, and the
  * length of the vector. Note that the user of this function should make
  * sure that the list object can't shimmer while the vector returned
@@ -6463,9 +7868,8 @@ static int JimSign(jim_wide w)
 
 /* ListSortElements type values */
 struct lsort_info {
-    jmp_buf jmpbuf;
     Jim_Obj *command;
-    Jim_Interp *interp;
+    Jim_Obj *key;
     enum {
         JIM_LSORT_ASCII,
         JIM_LSORT_NOCASE,
@@ -6477,171 +7881,546 @@ struct lsort_info {
     int index;
     int indexed;
     int unique;
-    int (*subfn)(Jim_Obj **, Jim_Obj **);
+    int rc;             /* Set if a -command comparison fails */
+};
+
+/* An element being sorted along with its sort key, which is only extracted once */
+struct lsort_elem {
+    Jim_Obj *objPtr;    /* The list element */
+    Jim_Obj *keyObj;    /* The element, or the result of -index and/or -key */
+    union {
+        jim_wide w;
+        unsigned jim_wide u;
+        double d;
+        struct {
+            const char *str;
+            int len;
+        } s;
+    } key;
 };
 
-static struct lsort_info *sort_info;
+/* Runs shorter than this are extended with an insertion sort before merging */
+#define JIM_LSORT_MIN_RUN 32
 
-static int ListSortIndexHelper(Jim_Obj **lhsObj, Jim_Obj **rhsObj)
+/* Integer lists at least this long are radix sorted */
+#define JIM_LSORT_RADIX_MIN 64
+
+static int ListSortCommand(Jim_Interp *interp, struct lsort_info *info, Jim_Obj *lhsObj, Jim_Obj *rhsObj)
 {
-    Jim_Obj *lObj, *rObj;
+    Jim_Obj *compare_script;
+    int rc;
+
+    jim_wide ret = 0;
+
+    if (info->rc != JIM_OK) {
+        /* A previous comparison failed, so just let the sort run down */
+        return 0;
+    }
+
+    /* This must be a valid list */
+    compare_script = Jim_DuplicateObj(interp, info->command);
+    Jim_ListAppendElement(interp, compare_script, lhsObj);
+    Jim_ListAppendElement(interp, compare_script, rhsObj);
 
-    if (Jim_ListIndex(sort_info->interp, *lhsObj, sort_info->index, &lObj, JIM_ERRMSG) != JIM_OK ||
-        Jim_ListIndex(sort_info->interp, *rhsObj, sort_info->index, &rObj, JIM_ERRMSG) != JIM_OK) {
-        longjmp(sort_info->jmpbuf, JIM_ERR);
+    rc = Jim_EvalObj(interp, compare_script);
+
+    if (rc != JIM_OK || Jim_GetWide(interp, Jim_GetResult(interp), &ret) != JIM_OK) {
+        info->rc = (rc == JIM_OK) ? JIM_ERR : rc;
+        return 0;
     }
-    return sort_info->subfn(&lObj, &rObj);
+
+    return JimSign(ret);
 }
 
-/* Sort the internal rep of a list. */
-static int ListSortString(Jim_Obj **lhsObj, Jim_Obj **rhsObj)
+static int ListSortCompare(Jim_Interp *interp, struct lsort_info *info,
+    const struct lsort_elem *lhs, const struct lsort_elem *rhs)
 {
-    return Jim_StringCompareObj(sort_info->interp, *lhsObj, *rhsObj, 0) * sort_info->order;
+    int ret;
+
+    switch (info->type) {
+        case JIM_LSORT_ASCII:
+            ret = JimStringCompare(lhs->key.s.str, lhs->key.s.len, rhs->key.s.str, rhs->key.s.len);
+            break;
+        case JIM_LSORT_NOCASE:
+            ret = JimStringCompareLen(lhs->key.s.str, rhs->key.s.str, -1, 1);
+            break;
+        case JIM_LSORT_INTEGER:
+            ret = (lhs->key.w > rhs->key.w) - (lhs->key.w < rhs->key.w);
+            break;
+        case JIM_LSORT_REAL:
+            ret = (lhs->key.d > rhs->key.d) - (lhs->key.d < rhs->key.d);
+            break;
+        case JIM_LSORT_COMMAND:
+            ret = ListSortCommand(interp, info, lhs->keyObj, rhs->keyObj);
+            break;
+        default:
+            ret = 0;          /* avoid warning */
+            JimPanic((1, "ListSort called with invalid sort type"));
+    }
+    return ret * info->order;
 }
 
-static int ListSortStringNoCase(Jim_Obj **lhsObj, Jim_Obj **rhsObj)
+/**
+ * Fills in v[] with the elements and their sort keys.
+ * Each key holds a reference which the caller must release on success.
+ */
+static int ListSortKeys(Jim_Interp *interp, struct lsort_info *info, Jim_Obj **ele, struct lsort_elem *v, int len)
 {
-    return Jim_StringCompareObj(sort_info->interp, *lhsObj, *rhsObj, 1) * sort_info->order;
+    int i;
+    int rc = JIM_OK;
+
+    for (i = 0; i < len; i++) {
+        Jim_Obj *keyObj = ele[i];
+
+        if (info->indexed && Jim_ListIndex(interp, keyObj, info->index, &keyObj, JIM_ERRMSG) != JIM_OK) {
+            rc = JIM_ERR;
+            break;
+        }
+        if (info->key) {
+            Jim_Obj *key_script = Jim_DuplicateObj(interp, info->key);
+
+            Jim_ListAppendElement(interp, key_script, keyObj);
+            rc = Jim_EvalObj(interp, key_script);
+            if (rc != JIM_OK) {
+                break;
+            }
+            keyObj = Jim_GetResult(interp);
+        }
+        Jim_IncrRefCount(keyObj);
+        v[i].objPtr = ele[i];
+        v[i].keyObj = keyObj;
+
+        switch (info->type) {
+            case JIM_LSORT_ASCII:
+            case JIM_LSORT_NOCASE:
+                v[i].key.s.str = Jim_GetString(keyObj, &v[i].key.s.len);
+                break;
+            case JIM_LSORT_INTEGER:
+                rc = Jim_GetWide(interp, keyObj, &v[i].key.w);
+                break;
+            case JIM_LSORT_REAL:
+                rc = Jim_GetDouble(interp, keyObj, &v[i].key.d);
+                break;
+            default:
+                break;
+        }
+        if (rc != JIM_OK) {
+            i++;
+            break;
+        }
+    }
+    if (rc != JIM_OK) {
+        while (i-- > 0) {
+            Jim_DecrRefCount(interp, v[i].keyObj);
+        }
+    }
+    return rc;
 }
 
-static int ListSortInteger(Jim_Obj **lhsObj, Jim_Obj **rhsObj)
+/**
+ * Insertion sort of v[start,end) into the already sorted v[lo,start).
+ * A binary search keeps the number of (possibly expensive) comparisons down.
+ */
+static void ListSortInsertion(Jim_Interp *interp, struct lsort_info *info, struct lsort_elem *v,
+    int lo, int start, int end)
 {
-    jim_wide lhs = 0, rhs = 0;
+    int i;
 
-    if (Jim_GetWide(sort_info->interp, *lhsObj, &lhs) != JIM_OK ||
-        Jim_GetWide(sort_info->interp, *rhsObj, &rhs) != JIM_OK) {
-        longjmp(sort_info->jmpbuf, JIM_ERR);
-    }
+    for (i = start; i < end; i++) {
+        struct lsort_elem tmp = v[i];
+        int l = lo;
+        int h = i;
 
-    return JimSign(lhs - rhs) * sort_info->order;
+        /* Find the position after any equal elements, to keep the sort stable */
+        while (l < h) {
+            int m = l + (h - l) / 2;
+
+            if (ListSortCompare(interp, info, &tmp, &v[m]) < 0) {
+                h = m;
+            }
+            else {
+                l = m + 1;
+            }
+        }
+        memmove(&v[l + 1], &v[l], (i - l) * sizeof(*v));
+        v[l] = tmp;
+    }
 }
 
-static int ListSortReal(Jim_Obj **lhsObj, Jim_Obj **rhsObj)
+/**
+ * Finds the natural run starting at v[lo] and returns the index just past it.
+ * Strictly descending runs are reversed (which keeps the sort stable)
+ * and short runs are extended to JIM_LSORT_MIN_RUN elements.
+ */
+static int ListSortRun(Jim_Interp *interp, struct lsort_info *info, struct lsort_elem *v, int lo, int len)
 {
-    double lhs = 0, rhs = 0;
+    int hi = lo + 1;
 
-    if (Jim_GetDouble(sort_info->interp, *lhsObj, &lhs) != JIM_OK ||
-        Jim_GetDouble(sort_info->interp, *rhsObj, &rhs) != JIM_OK) {
-        longjmp(sort_info->jmpbuf, JIM_ERR);
+    if (hi == len) {
+        return hi;
     }
-    if (lhs == rhs) {
-        return 0;
+    if (ListSortCompare(interp, info, &v[hi], &v[lo]) < 0) {
+        int i, j;
+
+        while (hi + 1 < len && ListSortCompare(interp, info, &v[hi + 1], &v[hi]) < 0) {
+            hi++;
+        }
+        for (i = lo, j = hi; i < j; i++, j--) {
+            struct lsort_elem tmp = v[i];
+            v[i] = v[j];
+            v[j] = tmp;
+        }
     }
-    if (lhs > rhs) {
-        return sort_info->order;
+    else {
+        while (hi + 1 < len && ListSortCompare(interp, info, &v[hi + 1], &v[hi]) >= 0) {
+            hi++;
+        }
+    }
+    hi++;
+
+    if (hi - lo < JIM_LSORT_MIN_RUN) {
+        int end = (len - lo < JIM_LSORT_MIN_RUN) ? len : lo + JIM_LSORT_MIN_RUN;
+
+        ListSortInsertion(interp, info, v, lo, hi, end);
+        hi = end;
     }
-    return -sort_info->order;
+    return hi;
 }
 
-static int ListSortCommand(Jim_Obj **lhsObj, Jim_Obj **rhsObj)
+/* Merges the adjacent sorted ranges v[lo,mid) and v[mid,hi) using tmp as scratch space */
+static void ListSortMerge(Jim_Interp *interp, struct lsort_info *info, struct lsort_elem *v,
+    int lo, int mid, int hi, struct lsort_elem *tmp)
 {
-    Jim_Obj *compare_script;
-    int rc;
+    int i = 0;
+    int j = mid;
+    int k = lo;
+    int n = mid - lo;
 
-    jim_wide ret = 0;
+    /* Nothing to do if the ranges are already in order, as with presorted input */
+    if (ListSortCompare(interp, info, &v[mid - 1], &v[mid]) <= 0) {
+        return;
+    }
 
-    /* This must be a valid list */
-    compare_script = Jim_DuplicateObj(sort_info->interp, sort_info->command);
-    Jim_ListAppendElement(sort_info->interp, compare_script, *lhsObj);
-    Jim_ListAppendElement(sort_info->interp, compare_script, *rhsObj);
+    memcpy(tmp, v + lo, n * sizeof(*tmp));
+    while (i < n && j < hi) {
+        /* Only take from the right if strictly less, to keep the sort stable */
+        if (ListSortCompare(interp, info, &v[j], &tmp[i]) < 0) {
+            v[k++] = v[j++];
+        }
+        else {
+            v[k++] = tmp[i++];
+        }
+    }
+    while (i < n) {
+        v[k++] = tmp[i++];
+    }
+}
 
-    rc = Jim_EvalObj(sort_info->interp, compare_script);
+/**
+ * Stable natural merge sort.
+ * Existing ascending and descending runs are found first and then merged pairwise,
+ * so presorted (or reverse sorted) input only requires a linear number of comparisons.
+ */
+static void ListSortMergeSort(Jim_Interp *interp, struct lsort_info *info, struct lsort_elem *v, int len)
+{
+    /* All runs except the last have at least JIM_LSORT_MIN_RUN elements */
+    int *runs = Jim_Alloc(sizeof(*runs) * (len / JIM_LSORT_MIN_RUN + 2));
+    struct lsort_elem *tmp;
+    int nruns = 0;
+    int lo = 0;
 
-    if (rc != JIM_OK || Jim_GetWide(sort_info->interp, Jim_GetResult(sort_info->interp), &ret) != JIM_OK) {
-        longjmp(sort_info->jmpbuf, rc);
+    while (lo < len) {
+        runs[nruns++] = lo;
+        lo = ListSortRun(interp, info, v, lo, len);
     }
+    runs[nruns] = len;
+
+    if (nruns > 1) {
+        tmp = Jim_Alloc(sizeof(*tmp) * len);
+        while (nruns > 1) {
+            int r;
+            int out = 0;
 
-    return JimSign(ret) * sort_info->order;
+            for (r = 0; r < nruns; r += 2) {
+                if (r + 1 < nruns) {
+                    ListSortMerge(interp, info, v, runs[r], runs[r + 1], runs[r + 2], tmp);
+                }
+                runs[out++] = runs[r];
+            }
+            nruns = out;
+            runs[nruns] = len;
+        }
+        Jim_Free(tmp);
+    }
+    Jim_Free(runs);
 }
 
-/* Remove duplicate elements from the (sorted) list in-place, according to the
- * comparison function, comp.
- *
- * Note that the last unique value is kept, not the first
+/**
+ * Stable LSD radix sort on integer keys, one byte at a time.
+ * Passes where every key has the same byte are skipped,
+ * so small values only need one or two passes.
  */
-static void ListRemoveDuplicates(Jim_Obj *listObjPtr, int (*comp)(Jim_Obj **lhs, Jim_Obj **rhs))
+static void ListSortRadix(struct lsort_info *info, struct lsort_elem *v, int len)
+{
+    struct lsort_elem *tmp;
+    struct lsort_elem *src = v;
+    struct lsort_elem *dst;
+    unsigned jim_wide mask;
+    int count[sizeof(jim_wide)][256];
+    int sorted = 1;
+    int pass;
+    int i;
+
+    /* Flip the sign bit so that unsigned order is signed order, and invert all bits if decreasing.
+     * Count all the digits at the same time, and note if the input is already in order.
+     */
+    mask = (unsigned jim_wide)1 << (sizeof(jim_wide) * 8 - 1);
+    if (info->order < 0) {
+        mask = ~mask;
+    }
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < len; i++) {
+        unsigned jim_wide u = v[i].key.u ^ mask;
+
+        v[i].key.u = u;
+        if (i && u < v[i - 1].key.u) {
+            sorted = 0;
+        }
+        for (pass = 0; pass < (int)sizeof(jim_wide); pass++) {
+            count[pass][(u >> (pass * 8)) & 0xff]++;
+        }
+    }
+    if (sorted) {
+        goto done;
+    }
+
+    tmp = Jim_Alloc(sizeof(*tmp) * len);
+    dst = tmp;
+    for (pass = 0; pass < (int)sizeof(jim_wide); pass++) {
+        struct lsort_elem *swap;
+        int shift = pass * 8;
+        int pos = 0;
+
+        if (count[pass][(src[0].key.u >> shift) & 0xff] == len) {
+            continue;
+        }
+        for (i = 0; i < 256; i++) {
+            int c = count[pass][i];
+            count[pass][i] = pos;
+            pos += c;
+        }
+        for (i = 0; i < len; i++) {
+            dst[count[pass][(src[i].key.u >> shift) & 0xff]++] = src[i];
+        }
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != v) {
+        memcpy(v, src, sizeof(*v) * len);
+    }
+    Jim_Free(tmp);
+
+done:
+    /* Restore the original keys */
+    for (i = 0; i < len; i++) {
+        v[i].key.u ^= mask;
+    }
+}
+
+/* Sorts v[] with the most suitable algorithm for the sort type */
+static void ListSortRange(Jim_Interp *interp, struct lsort_info *info, struct lsort_elem *v, int len)
+{
+    if (info->type == JIM_LSORT_INTEGER && len >= JIM_LSORT_RADIX_MIN) {
+        ListSortRadix(info, v, len);
+    }
+    else {
+        ListSortMergeSort(interp, info, v, len);
+    }
+}
+
+#ifdef JIM_THREADS
+/* Lists at least this long with a builtin comparison are sorted in parallel */
+#ifndef JIM_LSORT_PARALLEL_MIN
+#define JIM_LSORT_PARALLEL_MIN 100000
+#endif
+
+/* The maximum number of threads used by a parallel sort */
+#ifndef JIM_LSORT_MAX_THREADS
+#define JIM_LSORT_MAX_THREADS 16
+#endif
+
+/* Either sorts v[lo,hi) or merges the sorted ranges v[lo,mid) and v[mid,hi) */
+struct lsort_job {
+    struct lsort_info *info;
+    struct lsort_elem *v;
+    struct lsort_elem *tmp;
+    int merge;
+    int lo;
+    int mid;
+    int hi;
+    pthread_t thread;
+    int started;
+};
+
+/* Note that the builtin comparisons never touch the interpreter, so none is passed */
+static void *ListSortJob(void *arg)
+{
+    struct lsort_job *job = arg;
+
+    if (job->merge) {
+        /* Each merge uses its own part of the scratch space */
+        ListSortMerge(NULL, job->info, job->v, job->lo, job->mid, job->hi, job->tmp + job->lo);
+    }
+    else {
+        ListSortRange(NULL, job->info, job->v + job->lo, job->hi - job->lo);
+    }
+    return NULL;
+}
+
+/* Runs the jobs concurrently, using the current thread for the last one */
+static void ListSortRunJobs(struct lsort_job *jobs, int njobs)
 {
-    int src;
-    int dst = 0;
-    Jim_Obj **ele = listObjPtr->internalRep.listValue.ele;
+    int i;
 
-    for (src = 1; src < listObjPtr->internalRep.listValue.len; src++) {
-        if (comp(&ele[dst], &ele[src]) == 0) {
-            /* Match, so replace the dest with the current source */
-            Jim_DecrRefCount(sort_info->interp, ele[dst]);
+    for (i = 0; i < njobs - 1; i++) {
+        jobs[i].started = (pthread_create(&jobs[i].thread, NULL, ListSortJob, &jobs[i]) == 0);
+        if (!jobs[i].started) {
+            ListSortJob(&jobs[i]);
         }
-        else {
-            /* No match, so keep the current source and move to the next destination */
-            dst++;
+    }
+    ListSortJob(&jobs[njobs - 1]);
+    for (i = 0; i < njobs - 1; i++) {
+        if (jobs[i].started) {
+            pthread_join(jobs[i].thread, NULL);
         }
-        ele[dst] = ele[src];
     }
-    /* At end of list, keep the final element */
-    ele[++dst] = ele[src];
+}
+
+/**
+ * Sorts large lists by sorting equal partitions concurrently and then
+ * merging adjacent partitions pairwise, also concurrently.
+ * Since the sort is stable, the result is identical to a serial sort.
+ *
+ * Returns 0 if the list was not sorted because it is not suitable.
+ */
+static int ListSortParallel(struct lsort_info *info, struct lsort_elem *v, int len)
+{
+    struct lsort_job jobs[JIM_LSORT_MAX_THREADS];
+    int bounds[JIM_LSORT_MAX_THREADS + 1];
+    struct lsort_elem *tmp;
+    long ncpus = 1;
+    int nparts;
+    int i;
+
+    if (info->type == JIM_LSORT_COMMAND || len < JIM_LSORT_PARALLEL_MIN) {
+        return 0;
+    }
+#ifdef _SC_NPROCESSORS_ONLN
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    nparts = (ncpus > JIM_LSORT_MAX_THREADS) ? JIM_LSORT_MAX_THREADS : (int)ncpus;
+    if (nparts < 2) {
+        return 0;
+    }
 
-    /* Set the new length */
-    listObjPtr->internalRep.listValue.len = dst;
+    memset(jobs, 0, sizeof(jobs));
+    for (i = 0; i <= nparts; i++) {
+        bounds[i] = (int)((jim_wide)len * i / nparts);
+    }
+    for (i = 0; i < nparts; i++) {
+        jobs[i].info = info;
+        jobs[i].v = v;
+        jobs[i].merge = 0;
+        jobs[i].lo = bounds[i];
+        jobs[i].hi = bounds[i + 1];
+    }
+    ListSortRunJobs(jobs, nparts);
+
+    tmp = Jim_Alloc(sizeof(*tmp) * len);
+    while (nparts > 1) {
+        int njobs = 0;
+        int out = 0;
+
+        for (i = 0; i < nparts; i += 2) {
+            if (i + 1 < nparts) {
+                jobs[njobs].info = info;
+                jobs[njobs].v = v;
+                jobs[njobs].tmp = tmp;
+                jobs[njobs].merge = 1;
+                jobs[njobs].lo = bounds[i];
+                jobs[njobs].mid = bounds[i + 1];
+                jobs[njobs].hi = bounds[i + 2];
+                njobs++;
+            }
+            bounds[out++] = bounds[i];
+        }
+        nparts = out;
+        bounds[nparts] = len;
+        ListSortRunJobs(jobs, njobs);
+    }
+    Jim_Free(tmp);
+    return 1;
 }
+#endif
 
 /* Sort a list *in place*. MUST be called with a non-shared list. */
 static int ListSortElements(Jim_Interp *interp, Jim_Obj *listObjPtr, struct lsort_info *info)
 {
-    struct lsort_info *prev_info;
-
-    typedef int (qsort_comparator) (const void *, const void *);
-    int (*fn) (Jim_Obj **, Jim_Obj **);
-    Jim_Obj **vector;
+    struct lsort_elem *v;
+    Jim_Obj **ele;
     int len;
     int rc;
+    int i;
+    int n;
 
     JimPanic((Jim_IsShared(listObjPtr), "ListSortElements called with shared object"));
     SetListFromAny(interp, listObjPtr);
+    JimListFreeIndex(listObjPtr);
 
-    /* Allow lsort to be called reentrantly */
-    prev_info = sort_info;
-    sort_info = info;
-
-    vector = listObjPtr->internalRep.listValue.ele;
+    ele = listObjPtr->internalRep.listValue.ele;
     len = listObjPtr->internalRep.listValue.len;
-    switch (info->type) {
-        case JIM_LSORT_ASCII:
-            fn = ListSortString;
-            break;
-        case JIM_LSORT_NOCASE:
-            fn = ListSortStringNoCase;
-            break;
-        case JIM_LSORT_INTEGER:
-            fn = ListSortInteger;
-            break;
-        case JIM_LSORT_REAL:
-            fn = ListSortReal;
-            break;
-        case JIM_LSORT_COMMAND:
-            fn = ListSortCommand;
-            break;
-        default:
-            fn = NULL;          /* avoid warning */
-            JimPanic((1, "ListSort called with invalid sort type"));
+    if (len == 0) {
+        return JIM_OK;
     }
 
-    if (info->indexed) {
-        /* Need to interpose a "list index" function */
-        info->subfn = fn;
-        fn = ListSortIndexHelper;
+    /* Extract all the keys up front so that each one is only converted (or evaluated) once */
+    v = Jim_Alloc(sizeof(*v) * len);
+    rc = ListSortKeys(interp, info, ele, v, len);
+    if (rc != JIM_OK) {
+        Jim_Free(v);
+        return rc;
     }
 
-    if ((rc = setjmp(info->jmpbuf)) == 0) {
-        qsort(vector, len, sizeof(Jim_Obj *), (qsort_comparator *) fn);
+    info->rc = JIM_OK;
+#ifdef JIM_THREADS
+    if (!ListSortParallel(info, v, len))
+#endif
+    {
+        ListSortRange(interp, info, v, len);
+    }
 
-        if (info->unique && len > 1) {
-            ListRemoveDuplicates(listObjPtr, fn);
+    /* Store the sorted elements back into the list.
+     * With -unique, only the last of each run of equal elements is kept.
+     */
+    for (i = 0, n = 0; i < len; i++) {
+        if (info->unique && i + 1 < len && ListSortCompare(interp, info, &v[i], &v[i + 1]) == 0) {
+            Jim_DecrRefCount(interp, v[i].objPtr);
+        }
+        else {
+            ele[n++] = v[i].objPtr;
         }
+    }
+    listObjPtr->internalRep.listValue.len = n;
 
-        Jim_InvalidateStringRep(listObjPtr);
+    for (i = 0; i < len; i++) {
+        Jim_DecrRefCount(interp, v[i].keyObj);
     }
-    sort_info = prev_info;
+    Jim_Free(v);
 
-    return rc;
+    Jim_InvalidateStringRep(listObjPtr);
+
+    return info->rc;
 }
 
 /* This is the low-level function to insert elements into a list.
@@ -6661,6 +8440,8 @@ static void ListInsertElements(Jim_Obj *listPtr, int idx, int elemc, Jim_Obj *co
     int i;
     Jim_Obj **point;
 
+    JimListFreeIndex(listPtr);
+
     if (requiredLen > listPtr->internalRep.listValue.maxLen) {
         if (requiredLen < 2) {
             /* Don't do allocations of under 4 pointers. */
@@ -6670,8 +8451,8 @@ static void ListInsertElements(Jim_Obj *listPtr, int idx, int elemc, Jim_Obj *co
             requiredLen *= 2;
         }
 
-        listPtr->internalRep.listValue.ele = Jim_Realloc(listPtr->internalRep.listValue.ele,
-            sizeof(Jim_Obj *) * requiredLen);
+        listPtr->internalRep.listValue.ele = JimReallocCategory(listPtr->internalRep.listValue.ele,
+            sizeof(Jim_Obj *) * requiredLen, JIM_MEM_LIST);
 
         listPtr->internalRep.listValue.maxLen = requiredLen;
     }
@@ -6727,6 +8508,18 @@ int Jim_ListLength(Jim_Interp *interp, Jim_Obj *objPtr)
     return objPtr->internalRep.listValue.len;
 }
 
+/* Like Jim_ListLength(), but a range or frozen list is not converted to a list */
+static int JimListOrRangeLength(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    if (objPtr->typePtr == &rangeObjType) {
+        return objPtr->internalRep.rangeValue.len;
+    }
+    if (JimIsFrozenList(objPtr)) {
+        return JimFrozenValue(objPtr)->len;
+    }
+    return Jim_ListLength(interp, objPtr);
+}
+
 void Jim_ListInsertElements(Jim_Interp *interp, Jim_Obj *listPtr, int idx,
     int objc, Jim_Obj *const *objVec)
 {
@@ -6777,6 +8570,7 @@ static int ListSetIndex(Jim_Interp *interp, Jim_Obj *listPtr, int idx,
     }
     if (idx < 0)
         idx = listPtr->internalRep.listValue.len + idx;
+    JimListFreeIndex(listPtr);
     Jim_DecrRefCount(interp, listPtr->internalRep.listValue.ele[idx]);
     listPtr->internalRep.listValue.ele[idx] = newObjPtr;
     Jim_IncrRefCount(newObjPtr);
@@ -6808,6 +8602,8 @@ int Jim_ListSetIndex(Jim_Interp *interp, Jim_Obj *varNamePtr,
             objPtr = Jim_DuplicateObj(interp, objPtr);
             ListSetIndex(interp, listObjPtr, idx, objPtr, JIM_NONE);
         }
+        /* The element may be modified in place */
+        JimListFreeIndex(listObjPtr);
         Jim_InvalidateStringRep(listObjPtr);
     }
     if (Jim_GetIndex(interp, indexv[indexc - 1], &idx) != JIM_OK)
@@ -6872,7 +8668,7 @@ Jim_Obj *Jim_ConcatObj(Jim_Interp *interp, int objc, Jim_Obj *const *objv)
         if (objc)
             len += objc - 1;
         /* Create the string rep, and a string object holding it. */
-        p = bytes = Jim_Alloc(len + 1);
+        p = bytes = JimAllocCategory(len + 1, JIM_MEM_STRING);
         for (i = 0; i < objc; i++) {
             const char *s = Jim_GetString(objv[i], &objLen);
 
@@ -7002,7 +8798,7 @@ void DupDictInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr)
 
     /* Create a new hash table */
     ht = srcPtr->internalRep.ptr;
-    dupHt = Jim_Alloc(sizeof(*dupHt));
+    dupHt = JimAllocCategory(sizeof(*dupHt), JIM_MEM_HASH);
     Jim_InitHashTable(dupHt, &JimDictHashTableType, interp);
     if (ht->size != 0)
         Jim_ExpandHashTable(dupHt, ht->size);
@@ -7058,6 +8854,8 @@ static int SetDictFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr)
         return JIM_OK;
     }
 
+    JimTraceShimmer(interp, objPtr, &dictObjType);
+
     if (Jim_IsList(objPtr) && Jim_IsShared(objPtr)) {
         /* A shared list, so get the string representation now to avoid
          * changing the order in case of fast conversion to dict.
@@ -7076,7 +8874,7 @@ static int SetDictFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr)
         Jim_HashTable *ht;
         int i;
 
-        ht = Jim_Alloc(sizeof(*ht));
+        ht = JimAllocCategory(sizeof(*ht), JIM_MEM_HASH);
         Jim_InitHashTable(ht, &JimDictHashTableType, interp);
 
         for (i = 0; i < listlen; i += 2) {
@@ -7137,7 +8935,7 @@ Jim_Obj *Jim_NewDictObj(Jim_Interp *interp, Jim_Obj *const *elements, int len)
     objPtr = Jim_NewObj(interp);
     objPtr->typePtr = &dictObjType;
     objPtr->bytes = NULL;
-    objPtr->internalRep.ptr = Jim_Alloc(sizeof(Jim_HashTable));
+    objPtr->internalRep.ptr = JimAllocCategory(sizeof(Jim_HashTable), JIM_MEM_HASH);
     Jim_InitHashTable(objPtr->internalRep.ptr, &JimDictHashTableType, interp);
     for (i = 0; i < len; i += 2)
         DictAddElement(interp, objPtr, elements[i], elements[i + 1]);
@@ -7155,7 +8953,22 @@ int Jim_DictKey(Jim_Interp *interp, Jim_Obj *dictPtr, Jim_Obj *keyPtr,
     Jim_HashEntry *he;
     Jim_HashTable *ht;
 
-    if (SetDictFromAny(interp, dictPtr) != JIM_OK) {
+    if (dictPtr->typePtr == &frozenObjType && JimFrozenValue(dictPtr)->type == JIM_FROZEN_DICT) {
+        /* Look up the key directly in the frozen dict */
+        JimFrozen key;
+
+        key.bytes = (char *)Jim_GetString(keyPtr, &key.length);
+        if ((he = Jim_FindHashEntry(&JimFrozenValue(dictPtr)->index, &key)) == NULL) {
+            if (flags & JIM_ERRMSG) {
+                Jim_SetResultFormatted(interp, "key \"%#s\" not known in dictionary", keyPtr);
+            }
+            return JIM_ERR;
+        }
+        *objPtrPtr = JimFrozenElement(interp, dictPtr, he->u.intval);
+        return JIM_OK;
+    }
+
+    if (SetDictFromAny(interp, dictPtr) != JIM_OK) {
         return -1;
     }
     ht = dictPtr->internalRep.ptr;
@@ -7292,6 +9105,410 @@ int Jim_SetDictKeysVector(Jim_Interp *interp, Jim_Obj *varNamePtr,
     return JIM_ERR;
 }
 
+/* -----------------------------------------------------------------------------
+ * Freezing objects
+ * ---------------------------------------------------------------------------*/
+
+static unsigned int JimFrozenHTHashFunction(const void *key)
+{
+    const JimFrozen *frozenPtr = key;
+
+    return Jim_GenHashFunction((const unsigned char *)frozenPtr->bytes, frozenPtr->length);
+}
+
+static int JimFrozenHTKeyCompare(void *privdata, const void *key1, const void *key2)
+{
+    const JimFrozen *f1 = key1;
+    const JimFrozen *f2 = key2;
+
+    JIM_NOTUSED(privdata);
+    return f1->length == f2->length && memcmp(f1->bytes, f2->bytes, f1->length) == 0;
+}
+
+/* The keys are owned by the frozen dict, and the values are element indexes */
+static const Jim_HashTableType JimFrozenHashTableType = {
+    JimFrozenHTHashFunction,    /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    JimFrozenHTKeyCompare,      /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+/* Returns a new frozen copy of objPtr, with a reference count of 1.
+ * Lists and dicts are frozen recursively. Anything else is frozen as a string.
+ */
+static JimFrozen *JimFreeze(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    JimFrozen *frozenPtr;
+    Jim_Obj **ele = NULL;
+    const char *str;
+    int i;
+
+    if (objPtr->typePtr == &frozenObjType) {
+        frozenPtr = JimFrozenValue(objPtr);
+        JimFrozenRetain(frozenPtr);
+        return frozenPtr;
+    }
+
+    frozenPtr = Jim_Alloc(sizeof(*frozenPtr));
+    frozenPtr->refCount = 1;
+    frozenPtr->type = JIM_FROZEN_STRING;
+    frozenPtr->canonical = (objPtr->bytes == NULL);
+    frozenPtr->len = 0;
+    frozenPtr->ele = NULL;
+
+    if (objPtr->typePtr == &listObjType) {
+        frozenPtr->type = JIM_FROZEN_LIST;
+        frozenPtr->len = objPtr->internalRep.listValue.len;
+        ele = objPtr->internalRep.listValue.ele;
+    }
+    else if (objPtr->typePtr == &dictObjType) {
+        frozenPtr->type = JIM_FROZEN_DICT;
+        ele = JimDictPairs(objPtr, &frozenPtr->len);
+    }
+
+    str = Jim_GetString(objPtr, &frozenPtr->length);
+    frozenPtr->bytes = Jim_Alloc(frozenPtr->length + 1);
+    memcpy(frozenPtr->bytes, str, frozenPtr->length + 1);
+
+    if (frozenPtr->len) {
+        frozenPtr->ele = Jim_Alloc(sizeof(*frozenPtr->ele) * frozenPtr->len);
+        for (i = 0; i < frozenPtr->len; i++) {
+            frozenPtr->ele[i] = JimFreeze(interp, ele[i]);
+        }
+    }
+    if (frozenPtr->type == JIM_FROZEN_DICT) {
+        Jim_InitHashTable(&frozenPtr->index, &JimFrozenHashTableType, NULL);
+        Jim_ExpandHashTable(&frozenPtr->index, frozenPtr->len / 2);
+        for (i = 0; i < frozenPtr->len; i += 2) {
+            /* Keys in a dict are unique */
+            Jim_HashEntry *he = JimInsertHashEntry(&frozenPtr->index, frozenPtr->ele[i], 0);
+
+            he->key = frozenPtr->ele[i];
+            he->u.intval = i + 1;
+        }
+        Jim_Free(ele);
+    }
+    return frozenPtr;
+}
+
+/**
+ * Returns a new object holding a frozen copy of objPtr.
+ * If objPtr is already frozen, the frozen value is shared rather than copied.
+ */
+Jim_Obj *Jim_FreezeObj(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    return JimNewFrozenObj(interp, JimFreeze(interp, objPtr));
+}
+
+/**
+ * If objPtr (which may belong to another interpreter) is frozen, returns a new object
+ * in interp which shares the same frozen value. Otherwise returns NULL.
+ */
+Jim_Obj *Jim_ShareFrozenObj(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    if (objPtr->typePtr != &frozenObjType) {
+        return NULL;
+    }
+    JimFrozenRetain(JimFrozenValue(objPtr));
+    return JimNewFrozenObj(interp, JimFrozenValue(objPtr));
+}
+
+/* -----------------------------------------------------------------------------
+ * Serialization
+ * ---------------------------------------------------------------------------*/
+
+/* [serialize] encodes a value as a tree of tagged items, without generating or
+ * parsing the string rep of lists and dicts. All numbers are big-endian.
+ *
+ *   header:  'J' version
+ *   string:  's' length(4) bytes
+ *   integer: 'i' value(8)
+ *   double:  'd' IEEE-754 value(8)
+ *   list:    'l' count(4) item...
+ *   dict:    'm' count(4) key value...  (count is the number of pairs)
+ *
+ * Integers and doubles are only encoded as such if doing so preserves their
+ * string rep. Lists and dicts are always encoded as such, so their string rep may be
+ * normalised.
+ */
+#define JIM_SERIALIZE_VERSION 1
+
+static int JimSerializeTag(Jim_Obj *objPtr)
+{
+    if (objPtr->typePtr == &intObjType) {
+        char buf[JIM_INTEGER_SPACE + 1];
+
+        if (objPtr->bytes == NULL) {
+            return 'i';
+        }
+        /* Only if the string rep is canonical */
+        if (JimWideToString(buf, JimWideValue(objPtr)) == objPtr->length && strcmp(buf, objPtr->bytes) == 0) {
+            return 'i';
+        }
+    }
+    else if (objPtr->typePtr == &doubleObjType && objPtr->bytes == NULL) {
+        return 'd';
+    }
+    else if (objPtr->typePtr == &listObjType || objPtr->typePtr == &rangeObjType) {
+        return 'l';
+    }
+    else if (objPtr->typePtr == &dictObjType) {
+        return 'm';
+    }
+    return 's';
+}
+
+/* Returns the number of bytes needed to serialize objPtr (without the header) */
+static jim_wide JimSerializedLength(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    jim_wide len = 5;
+    Jim_HashTableIterator htiter;
+    Jim_HashEntry *he;
+    int i;
+
+    switch (JimSerializeTag(objPtr)) {
+        case 'i':
+        case 'd':
+            return 9;
+        case 'l':
+            if (objPtr->typePtr == &rangeObjType) {
+                return len + (jim_wide)9 * objPtr->internalRep.rangeValue.len;
+            }
+            for (i = 0; i < objPtr->internalRep.listValue.len; i++) {
+                len += JimSerializedLength(interp, objPtr->internalRep.listValue.ele[i]);
+            }
+            return len;
+        case 'm':
+            JimInitHashTableIterator(objPtr->internalRep.ptr, &htiter);
+            while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
+                len += JimSerializedLength(interp, Jim_GetHashEntryKey(he));
+                len += JimSerializedLength(interp, Jim_GetHashEntryVal(he));
+            }
+            return len;
+        default:
+            return len + Jim_Length(objPtr);
+    }
+}
+
+static unsigned char *JimSerializeInt(unsigned char *p, int tag, jim_wide value)
+{
+    unsigned long long u = (unsigned long long)value;
+    int i;
+
+    *p++ = tag;
+    for (i = 56; i >= 0; i -= 8) {
+        *p++ = (unsigned char)(u >> i);
+    }
+    return p;
+}
+
+static unsigned char *JimSerializeCount(unsigned char *p, int tag, int count)
+{
+    *p++ = tag;
+    *p++ = (unsigned char)(count >> 24);
+    *p++ = (unsigned char)(count >> 16);
+    *p++ = (unsigned char)(count >> 8);
+    *p++ = (unsigned char)count;
+    return p;
+}
+
+/* Writes the serialized objPtr to p, which has enough room, and returns the next position */
+static unsigned char *JimSerialize(Jim_Interp *interp, unsigned char *p, Jim_Obj *objPtr)
+{
+    Jim_HashTableIterator htiter;
+    Jim_HashEntry *he;
+    jim_wide wideValue;
+    const char *str;
+    int len;
+    int i;
+
+    switch (JimSerializeTag(objPtr)) {
+        case 'i':
+            return JimSerializeInt(p, 'i', JimWideValue(objPtr));
+        case 'd':
+            memcpy(&wideValue, &objPtr->internalRep.doubleValue, sizeof(wideValue));
+            return JimSerializeInt(p, 'd', wideValue);
+        case 'l':
+            if (objPtr->typePtr == &rangeObjType) {
+                wideValue = objPtr->internalRep.rangeValue.start;
+                len = objPtr->internalRep.rangeValue.len;
+                p = JimSerializeCount(p, 'l', len);
+                for (i = 0; i < len; i++) {
+                    p = JimSerializeInt(p, 'i', wideValue);
+                    wideValue += objPtr->internalRep.rangeValue.step;
+                }
+                return p;
+            }
+            p = JimSerializeCount(p, 'l', objPtr->internalRep.listValue.len);
+            for (i = 0; i < objPtr->internalRep.listValue.len; i++) {
+                p = JimSerialize(interp, p, objPtr->internalRep.listValue.ele[i]);
+            }
+            return p;
+        case 'm':
+            p = JimSerializeCount(p, 'm', ((Jim_HashTable *)objPtr->internalRep.ptr)->used);
+            JimInitHashTableIterator(objPtr->internalRep.ptr, &htiter);
+            while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
+                p = JimSerialize(interp, p, Jim_GetHashEntryKey(he));
+                p = JimSerialize(interp, p, Jim_GetHashEntryVal(he));
+            }
+            return p;
+        default:
+            str = Jim_GetString(objPtr, &len);
+            p = JimSerializeCount(p, 's', len);
+            memcpy(p, str, len);
+            return p + len;
+    }
+}
+
+/**
+ * Returns a new (binary) string object containing the serialized form of objPtr,
+ * or NULL with an error in the interpreter result if it is too large.
+ */
+Jim_Obj *Jim_SerializeObj(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    jim_wide len = 2 + JimSerializedLength(interp, objPtr);
+    unsigned char *buf;
+    unsigned char *p;
+
+    if (len > INT_MAX) {
+        Jim_SetResultString(interp, "value too large to serialize", -1);
+        return NULL;
+    }
+    buf = Jim_Alloc(len + 1);
+    buf[0] = 'J';
+    buf[1] = JIM_SERIALIZE_VERSION;
+    p = JimSerialize(interp, buf + 2, objPtr);
+    JimPanic((p != buf + len, "Jim_SerializeObj() length mismatch"));
+    *p = 0;
+    return Jim_NewStringObjNoAlloc(interp, (char *)buf, len);
+}
+
+struct JimDeserializer {
+    const unsigned char *p;     /* Next byte to decode */
+    const unsigned char *end;   /* End of the data */
+    int depth;                  /* Current list/dict nesting depth */
+};
+
+static int JimDeserializeCount(struct JimDeserializer *ds)
+{
+    unsigned int count;
+
+    if (ds->end - ds->p < 4) {
+        return -1;
+    }
+    count = ((unsigned int)ds->p[0] << 24) | (ds->p[1] << 16) | (ds->p[2] << 8) | ds->p[3];
+    ds->p += 4;
+    /* The count can't exceed the remaining data */
+    if (count > (unsigned int)(ds->end - ds->p)) {
+        return -1;
+    }
+    return count;
+}
+
+/* Returns the next decoded object, or NULL if the data is invalid */
+static Jim_Obj *JimDeserialize(Jim_Interp *interp, struct JimDeserializer *ds)
+{
+    Jim_Obj **ele;
+    Jim_Obj *objPtr = NULL;
+    unsigned long long u = 0;
+    jim_wide wideValue;
+    double doubleValue;
+    int count;
+    int tag;
+    int i;
+
+    if (ds->p == ds->end) {
+        return NULL;
+    }
+    tag = *ds->p++;
+    switch (tag) {
+        case 'i':
+        case 'd':
+            if (ds->end - ds->p < 8) {
+                return NULL;
+            }
+            for (i = 0; i < 8; i++) {
+                u = (u << 8) | *ds->p++;
+            }
+            wideValue = (jim_wide)u;
+            if (tag == 'i') {
+                return Jim_NewIntObj(interp, wideValue);
+            }
+            memcpy(&doubleValue, &wideValue, sizeof(doubleValue));
+            return Jim_NewDoubleObj(interp, doubleValue);
+
+        case 's':
+            count = JimDeserializeCount(ds);
+            if (count < 0) {
+                return NULL;
+            }
+            objPtr = Jim_NewStringObj(interp, (const char *)ds->p, count);
+            ds->p += count;
+            return objPtr;
+
+        case 'l':
+        case 'm':
+            count = JimDeserializeCount(ds);
+            if (count < 0 || ds->depth == interp->maxEvalDepth) {
+                return NULL;
+            }
+            if (tag == 'm') {
+                if (count > (ds->end - ds->p) / 2) {
+                    return NULL;
+                }
+                count *= 2;
+            }
+            ele = Jim_Alloc(sizeof(*ele) * (count + 1));
+            ds->depth++;
+            for (i = 0; i < count; i++) {
+                ele[i] = JimDeserialize(interp, ds);
+                if (ele[i] == NULL) {
+                    break;
+                }
+                Jim_IncrRefCount(ele[i]);
+            }
+            ds->depth--;
+            if (i == count) {
+                objPtr = (tag == 'l') ? Jim_NewListObj(interp, ele, count) : Jim_NewDictObj(interp, ele, count);
+            }
+            /* The container now holds its own references (and any duplicate keys are discarded) */
+            while (i--) {
+                Jim_DecrRefCount(interp, ele[i]);
+            }
+            Jim_Free(ele);
+            return objPtr;
+    }
+    return NULL;
+}
+
+/**
+ * Decodes a value serialized by Jim_SerializeObj() and returns a new object,
+ * or NULL with an error in the interpreter result if the data is invalid.
+ */
+Jim_Obj *Jim_DeserializeObj(Jim_Interp *interp, const char *buf, int len)
+{
+    struct JimDeserializer ds;
+    Jim_Obj *objPtr = NULL;
+
+    ds.p = (const unsigned char *)buf + 2;
+    ds.end = (const unsigned char *)buf + len;
+    ds.depth = 0;
+
+    if (len > 2 && buf[0] == 'J' && buf[1] == JIM_SERIALIZE_VERSION) {
+        objPtr = JimDeserialize(interp, &ds);
+    }
+    if (objPtr && ds.p != ds.end) {
+        Jim_FreeNewObj(interp, objPtr);
+        objPtr = NULL;
+    }
+    if (objPtr == NULL) {
+        Jim_SetResultString(interp, "invalid serialized data", -1);
+    }
+    return objPtr;
+}
+
 /* -----------------------------------------------------------------------------
  * Index object
  * ---------------------------------------------------------------------------*/
@@ -7330,6 +9547,8 @@ static int SetIndexFromAny(Jim_Interp *interp, Jim_Obj *objPtr)
     const char *str;
     char *endptr;
 
+    JimTraceShimmer(interp, objPtr, &indexObjType);
+
     /* Get the string representation */
     str = Jim_String(objPtr);
 
@@ -7455,6 +9674,8 @@ static int SetReturnCodeFromAny(Jim_Interp *interp, Jim_Obj *objPtr)
     int returnCode;
     jim_wide wideValue;
 
+    JimTraceShimmer(interp, objPtr, &returnCodeObjType);
+
     /* Try to convert into an integer */
     if (JimGetWideNoErr(interp, objPtr, &wideValue) != JIM_ERR)
         returnCode = (int)wideValue;
@@ -8063,16 +10284,7 @@ static int JimExprOpBin(Jim_Interp *interp, struct JimExprState *e)
 
 static int JimSearchList(Jim_Interp *interp, Jim_Obj *listObjPtr, Jim_Obj *valObj)
 {
-    int listlen;
-    int i;
-
-    listlen = Jim_ListLength(interp, listObjPtr);
-    for (i = 0; i < listlen; i++) {
-        if (Jim_StringEqObj(Jim_ListGetIndex(interp, listObjPtr, i), valObj)) {
-            return 1;
-        }
-    }
-    return 0;
+    return JimListFindExact(interp, listObjPtr, valObj) >= 0;
 }
 
 static int JimExprOpStrBin(Jim_Interp *interp, struct JimExprState *e)
@@ -8582,8 +10794,11 @@ typedef struct ExprByteCode
     ScriptToken *token;         /* Tokens array. */
     int len;                    /* Length as number of tokens. */
     int inUse;                  /* Used for sharing. */
+    struct JimExprProg *prog;   /* Compiled numeric program, or NULL. See JimExprCompileProg() */
 } ExprByteCode;
 
+static void JimExprFreeProg(struct JimExprProg *prog);
+
 static void ExprFreeByteCode(Jim_Interp *interp, ExprByteCode * expr)
 {
     int i;
@@ -8591,6 +10806,7 @@ static void ExprFreeByteCode(Jim_Interp *interp, ExprByteCode * expr)
     for (i = 0; i < expr->len; i++) {
         Jim_DecrRefCount(interp, expr->token[i].objPtr);
     }
+    JimExprFreeProg(expr->prog);
     Jim_Free(expr->token);
     Jim_Free(expr);
 }
@@ -8920,9 +11136,10 @@ static ExprByteCode *ExprCreateByteCode(Jim_Interp *interp, const ParseTokenList
     /* -1 for EOL */
     int count = tokenlist->count - 1;
 
-    expr = Jim_Alloc(sizeof(*expr));
+    expr = JimAllocCategory(sizeof(*expr), JIM_MEM_EXPR);
     expr->inUse = 1;
     expr->len = 0;
+    expr->prog = NULL;
 
     Jim_InitStack(&stack);
 
@@ -8942,7 +11159,7 @@ static ExprByteCode *ExprCreateByteCode(Jim_Interp *interp, const ParseTokenList
         }
     }
 
-    expr->token = Jim_Alloc(sizeof(ScriptToken) * count);
+    expr->token = JimAllocCategory(sizeof(ScriptToken) * count, JIM_MEM_EXPR);
 
     for (i = 0; i < tokenlist->count && ok; i++) {
         ParseToken *t = &tokenlist->list[i];
@@ -9099,1011 +11316,3043 @@ strexpr:
     return expr;
 }
 
+/* -----------------------------------------------------------------------------
+ * Compiled numeric expressions
+ *
+ * Expressions which consist only of numeric constants, simple variables
+ * and arithmetic operators are additionally compiled into a program
+ * which operates on unboxed ints and doubles, so that no intermediate
+ * objects are created. Constant subexpressions are folded at compile time.
+ *
+ * JimExprRun() simply gives up on anything it can't handle, such as a
+ * non-numeric operand, a missing variable or a division by zero.
+ * Since running such a program has no side effects, the caller then
+ * evaluates the expression bytecode as usual to produce the proper
+ * result or error.
+ * ---------------------------------------------------------------------------*/
+
+/* After this many more failures than successes a program is no longer used */
+#define JIM_EXPR_MAX_MISSES 16
 
-/* This method takes the string representation of an expression
- * and generates a program for the Expr's stack-based VM. */
-static int SetExprFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr)
+enum
 {
-    int exprTextLen;
-    const char *exprText;
-    struct JimParserCtx parser;
-    struct ExprByteCode *expr;
-    ParseTokenList tokenlist;
-    int line;
-    Jim_Obj *fileNameObj;
-    int rc = JIM_ERR;
+    JIM_EXPRINST_INT,           /* Push an int constant */
+    JIM_EXPRINST_DOUBLE,        /* Push a double constant */
+    JIM_EXPRINST_VAR,           /* Push the value of a variable */
+    JIM_EXPRINST_ADD,
+    JIM_EXPRINST_SUB,
+    JIM_EXPRINST_MUL,
+    JIM_EXPRINST_DIV,
+    JIM_EXPRINST_POW,
+    JIM_EXPRINST_LT,
+    JIM_EXPRINST_GT,
+    JIM_EXPRINST_LTE,
+    JIM_EXPRINST_GTE,
+    JIM_EXPRINST_EQ,
+    JIM_EXPRINST_NE,
+    JIM_EXPRINST_MOD,
+    JIM_EXPRINST_LSHIFT,
+    JIM_EXPRINST_RSHIFT,
+    JIM_EXPRINST_ROTL,
+    JIM_EXPRINST_ROTR,
+    JIM_EXPRINST_BITAND,
+    JIM_EXPRINST_BITXOR,
+    JIM_EXPRINST_BITOR,
+    JIM_EXPRINST_NOT,
+    JIM_EXPRINST_BITNOT,
+    JIM_EXPRINST_NEG,
+    JIM_EXPRINST_PLUS,
+    JIM_EXPRINST_INTFN,
+    JIM_EXPRINST_ABS,
+    JIM_EXPRINST_DOUBLEFN,
+    JIM_EXPRINST_ROUND,
+    JIM_EXPRINST_MATHFN,        /* Apply a double -> double library function */
+    JIM_EXPRINST_ANDL,          /* The lazy operators jump to 'target' to skip their RHS */
+    JIM_EXPRINST_ORL,
+    JIM_EXPRINST_ANDORR,
+    JIM_EXPRINST_TERNL,
+    JIM_EXPRINST_COLONL,
+    JIM_EXPRINST_END
+};
 
-    /* Try to get information about filename / line number */
-    if (objPtr->typePtr == &sourceObjType) {
-        fileNameObj = objPtr->internalRep.sourceValue.fileNameObj;
-        line = objPtr->internalRep.sourceValue.lineNumber;
+typedef struct JimExprValue
+{
+    int isdouble;
+    Jim_Obj *objPtr;            /* The operand this value came from, or NULL if computed */
+    union {
+        jim_wide w;
+        double d;
+    } u;
+} JimExprValue;
+
+typedef struct JimExprInst
+{
+    int op;                     /* JIM_EXPRINST_... */
+    int target;                 /* For the lazy operators, the instruction to jump to */
+    Jim_Obj *objPtr;            /* Constant or variable name */
+    union {
+        jim_wide w;
+        double d;
+        double (*fn)(double);
+    } u;
+} JimExprInst;
+
+typedef struct JimExprProg
+{
+    JimExprInst *inst;
+    int stackLen;               /* Maximum stack depth required */
+    int misses;                 /* Failures, less successes */
+#ifdef JIM_JIT
+    int runs;                   /* Successful runs, until the program is hot */
+    int nativeMisses;           /* As for misses, for the native code */
+    int (*native)(Jim_Interp *interp, jim_wide *slots);
+    void *code;                 /* The native code pages */
+    size_t codeLen;
+#endif
+} JimExprProg;
+
+/* Classifies an operand in the same way as the generic operators */
+static int JimExprGetValue(Jim_Interp *interp, Jim_Obj *objPtr, JimExprValue *v)
+{
+    v->objPtr = objPtr;
+    if ((objPtr->typePtr != &doubleObjType || objPtr->bytes) && JimGetWideNoErr(interp, objPtr, &v->u.w) == JIM_OK) {
+        v->isdouble = 0;
+        return JIM_OK;
     }
-    else {
-        fileNameObj = interp->emptyObj;
-        line = 1;
+    if (Jim_GetDouble(interp, objPtr, &v->u.d) == JIM_OK) {
+        v->isdouble = 1;
+        return JIM_OK;
     }
-    Jim_IncrRefCount(fileNameObj);
+    return JIM_ERR;
+}
 
-    exprText = Jim_GetString(objPtr, &exprTextLen);
+/* Note that these macros operate on the value stack of JimExprRun() */
+#define JimExprToDouble(V) do { \
+        if (!(V)->isdouble) { \
+            (V)->u.d = (double)(V)->u.w; \
+            (V)->isdouble = 1; \
+        } \
+    } while (0)
+
+/* As per ExprBool() */
+#define JimExprTrue(V) ((V)->isdouble ? (V)->u.d != 0 : (long)(V)->u.w != 0)
+
+#define JimExprSetInt(V, W) do { \
+        jim_wide w_ = (W); \
+        (V)->isdouble = 0; \
+        (V)->objPtr = NULL; \
+        (V)->u.w = w_; \
+    } while (0)
+
+#define JimExprArith(OPER) do { \
+        sp--; \
+        if (!sp[-1].isdouble && !sp[0].isdouble) { \
+            sp[-1].u.w = sp[-1].u.w OPER sp[0].u.w; \
+        } \
+        else { \
+            JimExprToDouble(&sp[-1]); \
+            JimExprToDouble(&sp[0]); \
+            sp[-1].u.d = sp[-1].u.d OPER sp[0].u.d; \
+        } \
+        sp[-1].objPtr = NULL; \
+    } while (0)
+
+#define JimExprCompare(OPER) do { \
+        sp--; \
+        if (!sp[-1].isdouble && !sp[0].isdouble) { \
+            JimExprSetInt(&sp[-1], sp[-1].u.w OPER sp[0].u.w); \
+        } \
+        else { \
+            JimExprToDouble(&sp[-1]); \
+            JimExprToDouble(&sp[0]); \
+            JimExprSetInt(&sp[-1], sp[-1].u.d OPER sp[0].u.d); \
+        } \
+    } while (0)
+
+#define JimExprIntBin(OPER) do { \
+        sp--; \
+        if (sp[-1].isdouble || sp[0].isdouble) { \
+            goto giveup; \
+        } \
+        JimExprSetInt(&sp[-1], sp[-1].u.w OPER sp[0].u.w); \
+    } while (0)
+
+/* Dispatch with computed goto where the compiler supports it */
+#if defined(__GNUC__) && !defined(JIM_EXPR_NO_COMPUTED_GOTO)
+#define JIM_EXPR_COMPUTED_GOTO
+#define JIM_EXPR_CASE(X) l_##X
+#define JIM_EXPR_NEXT() goto *labels[(++inst)->op]
+#define JIM_EXPR_JUMP(T) do { inst = prog + (T); goto *labels[inst->op]; } while (0)
+#else
+#define JIM_EXPR_CASE(X) case JIM_EXPRINST_##X
+#define JIM_EXPR_NEXT() inst++; continue
+#define JIM_EXPR_JUMP(T) inst = prog + (T); continue
+#endif
 
-    /* Initially tokenise the expression into tokenlist */
-    ScriptTokenListInit(&tokenlist);
+/**
+ * Runs the compiled program 'prog' with the given value stack.
+ *
+ * Returns JIM_OK and stores the value in *resultPtr on success,
+ * or JIM_ERR if the program can't be evaluated this way.
+ */
+static int JimExprRun(Jim_Interp *interp, const JimExprInst *prog, JimExprValue *stack, JimExprValue *resultPtr)
+{
+#ifdef JIM_EXPR_COMPUTED_GOTO
+    /* Must be in the same order as JIM_EXPRINST_... */
+    static const void *const labels[] = {
+        &&l_INT, &&l_DOUBLE, &&l_VAR, &&l_ADD, &&l_SUB, &&l_MUL, &&l_DIV, &&l_POW,
+        &&l_LT, &&l_GT, &&l_LTE, &&l_GTE, &&l_EQ, &&l_NE, &&l_MOD, &&l_LSHIFT,
+        &&l_RSHIFT, &&l_ROTL, &&l_ROTR, &&l_BITAND, &&l_BITXOR, &&l_BITOR, &&l_NOT,
+        &&l_BITNOT, &&l_NEG, &&l_PLUS, &&l_INTFN, &&l_ABS, &&l_DOUBLEFN, &&l_ROUND,
+        &&l_MATHFN, &&l_ANDL, &&l_ORL, &&l_ANDORR, &&l_TERNL, &&l_COLONL, &&l_END
+    };
+#endif
+    const JimExprInst *inst = prog;
+    JimExprValue *sp = stack;
+    Jim_Obj *objPtr;
+    jim_wide wA, wB;
 
-    JimParserInit(&parser, exprText, exprTextLen, line);
-    while (!parser.eof) {
-        if (JimParseExpression(&parser) != JIM_OK) {
-            ScriptTokenListFree(&tokenlist);
-          invalidexpr:
-            Jim_SetResultFormatted(interp, "syntax error in expression: \"%#s\"", objPtr);
-            expr = NULL;
-            goto err;
+#ifdef JIM_EXPR_COMPUTED_GOTO
+    goto *labels[inst->op];
+#else
+    for (;;) switch (inst->op) {
+#endif
+    JIM_EXPR_CASE(INT):
+        sp->isdouble = 0;
+        sp->objPtr = inst->objPtr;
+        sp->u.w = inst->u.w;
+        sp++;
+        JIM_EXPR_NEXT();
+
+    JIM_EXPR_CASE(DOUBLE):
+        sp->isdouble = 1;
+        sp->objPtr = inst->objPtr;
+        sp->u.d = inst->u.d;
+        sp++;
+        JIM_EXPR_NEXT();
+
+    JIM_EXPR_CASE(VAR):
+        objPtr = Jim_GetVariable(interp, inst->objPtr, JIM_NONE);
+        if (objPtr == NULL || JimExprGetValue(interp, objPtr, sp) != JIM_OK) {
+            goto giveup;
+        }
+        sp++;
+        JIM_EXPR_NEXT();
+
+    JIM_EXPR_CASE(ADD):
+        JimExprArith(+);
+        JIM_EXPR_NEXT();
+
+    JIM_EXPR_CASE(SUB):
+        JimExprArith(-);
+        JIM_EXPR_NEXT();
+
+    JIM_EXPR_CASE(MUL):
+        JimExprArith(*);
+        JIM_EXPR_NEXT();
+
+    JIM_EXPR_CASE(DIV):
+        sp--;
+        if (!sp[-1].isdouble && !sp[0].isdouble) {
+            /* Rounds towards negative infinity, as per JimExprOpBin() */
+            wA = sp[-1].u.w;
+            wB = sp[0].u.w;
+            if (wB == 0) {
+                goto giveup;
+            }
+            if (wB < 0) {
+                wB = -wB;
+                wA = -wA;
+            }
+            JimExprSetInt(&sp[-1], wA / wB);
+            if (wA % wB < 0) {
+                sp[-1].u.w--;
+            }
         }
+        else {
+            JimExprToDouble(&sp[-1]);
+            JimExprToDouble(&sp[0]);
+            if (sp[0].u.d == 0) {
+                goto giveup;
+            }
+            sp[-1].u.d /= sp[0].u.d;
+            sp[-1].objPtr = NULL;
+        }
+        JIM_EXPR_NEXT();
 
-        ScriptAddToken(&tokenlist, parser.tstart, parser.tend - parser.tstart + 1, parser.tt,
-            parser.tline);
-    }
-
-#ifdef DEBUG_SHOW_EXPR_TOKENS
-    {
-        int i;
-        printf("==== Expr Tokens (%s) ====\n", Jim_String(fileNameObj));
-        for (i = 0; i < tokenlist.count; i++) {
-            printf("[%2d]@%d %s '%.*s'\n", i, tokenlist.list[i].line, jim_tt_name(tokenlist.list[i].type),
-                tokenlist.list[i].len, tokenlist.list[i].token);
+    JIM_EXPR_CASE(POW):
+        sp--;
+        if (!sp[-1].isdouble && !sp[0].isdouble) {
+            JimExprSetInt(&sp[-1], JimPowWide(sp[-1].u.w, sp[0].u.w));
         }
-    }
+        else {
+#ifdef JIM_MATH_FUNCTIONS
+            JimExprToDouble(&sp[-1]);
+            JimExprToDouble(&sp[0]);
+            sp[-1].u.d = pow(sp[-1].u.d, sp[0].u.d);
+            sp[-1].objPtr = NULL;
+#else
+            goto giveup;
 #endif
+        }
+        JIM_EXPR_NEXT();
 
-    if (JimParseCheckMissing(interp, parser.missing.ch) == JIM_ERR) {
-        ScriptTokenListFree(&tokenlist);
-        Jim_DecrRefCount(interp, fileNameObj);
-        return JIM_ERR;
-    }
+    JIM_EXPR_CASE(LT):
+        JimExprCompare(<);
+        JIM_EXPR_NEXT();
 
-    /* Now create the expression bytecode from the tokenlist */
-    expr = ExprCreateByteCode(interp, &tokenlist, fileNameObj);
+    JIM_EXPR_CASE(GT):
+        JimExprCompare(>);
+        JIM_EXPR_NEXT();
 
-    /* No longer need the token list */
-    ScriptTokenListFree(&tokenlist);
+    JIM_EXPR_CASE(LTE):
+        JimExprCompare(<=);
+        JIM_EXPR_NEXT();
 
-    if (!expr) {
-        goto err;
-    }
+    JIM_EXPR_CASE(GTE):
+        JimExprCompare(>=);
+        JIM_EXPR_NEXT();
 
-#ifdef DEBUG_SHOW_EXPR
-    {
-        int i;
+    JIM_EXPR_CASE(EQ):
+        JimExprCompare(==);
+        JIM_EXPR_NEXT();
 
-        printf("==== Expr ====\n");
-        for (i = 0; i < expr->len; i++) {
-            ScriptToken *t = &expr->token[i];
+    JIM_EXPR_CASE(NE):
+        JimExprCompare(!=);
+        JIM_EXPR_NEXT();
 
-            printf("[%2d] %s '%s'\n", i, jim_tt_name(t->type), Jim_String(t->objPtr));
+    JIM_EXPR_CASE(MOD):
+        sp--;
+        if (sp[-1].isdouble || sp[0].isdouble || sp[0].u.w == 0) {
+            goto giveup;
         }
-    }
-#endif
-
-    /* Check program correctness. */
-    if (ExprCheckCorrectness(expr) != JIM_OK) {
-        ExprFreeByteCode(interp, expr);
-        goto invalidexpr;
-    }
+        else {
+            /* The remainder has the same sign as the divisor, as per JimExprOpIntBin() */
+            int negative = 0;
+
+            wA = sp[-1].u.w;
+            wB = sp[0].u.w;
+            if (wB < 0) {
+                wB = -wB;
+                wA = -wA;
+                negative = 1;
+            }
+            wA %= wB;
+            if (wA < 0) {
+                wA += wB;
+            }
+            JimExprSetInt(&sp[-1], negative ? -wA : wA);
+        }
+        JIM_EXPR_NEXT();
 
-    rc = JIM_OK;
+    JIM_EXPR_CASE(LSHIFT):
+        JimExprIntBin(<<);
+        JIM_EXPR_NEXT();
 
-  err:
-    /* Free the old internal rep and set the new one. */
-    Jim_DecrRefCount(interp, fileNameObj);
-    Jim_FreeIntRep(interp, objPtr);
-    Jim_SetIntRepPtr(objPtr, expr);
-    objPtr->typePtr = &exprObjType;
-    return rc;
-}
+    JIM_EXPR_CASE(RSHIFT):
+        JimExprIntBin(>>);
+        JIM_EXPR_NEXT();
 
-static ExprByteCode *JimGetExpression(Jim_Interp *interp, Jim_Obj *objPtr)
-{
-    if (objPtr->typePtr != &exprObjType) {
-        if (SetExprFromAny(interp, objPtr) != JIM_OK) {
-            return NULL;
+    JIM_EXPR_CASE(ROTL):
+    JIM_EXPR_CASE(ROTR):
+        sp--;
+        if (sp[-1].isdouble || sp[0].isdouble) {
+            goto giveup;
         }
-    }
-    return (ExprByteCode *) Jim_GetIntRepPtr(objPtr);
-}
+        else {
+            unsigned long uA = (unsigned long)sp[-1].u.w;
+            unsigned long uB = (unsigned long)sp[0].u.w;
+            const unsigned int S = sizeof(unsigned long) * 8;
 
-#ifdef JIM_OPTIMIZATION
-static Jim_Obj *JimExprIntValOrVar(Jim_Interp *interp, const ScriptToken *token)
-{
-    if (token->type == JIM_TT_EXPR_INT)
-        return token->objPtr;
-    else if (token->type == JIM_TT_VAR)
-        return Jim_GetVariable(interp, token->objPtr, JIM_NONE);
-    else if (token->type == JIM_TT_DICTSUGAR)
-        return JimExpandDictSugar(interp, token->objPtr);
-    else
-        return NULL;
-}
-#endif
+            uB %= S;
+            if (inst->op == JIM_EXPRINST_ROTR) {
+                uB = S - uB;
+            }
+            JimExprSetInt(&sp[-1], (unsigned long)(uA << uB) | (uA >> (S - uB)));
+        }
+        JIM_EXPR_NEXT();
 
-/* -----------------------------------------------------------------------------
- * Expressions evaluation.
- * Jim uses a specialized stack-based virtual machine for expressions,
- * that takes advantage of the fact that expr's operators
- * can't be redefined.
- *
- * Jim_EvalExpression() uses the bytecode compiled by
- * SetExprFromAny() method of the "expression" object.
- *
- * On success a Tcl Object containing the result of the evaluation
- * is stored into expResultPtrPtr (having refcount of 1), and JIM_OK is
- * returned.
- * On error the function returns a retcode != to JIM_OK and set a suitable
- * error on the interp.
- * ---------------------------------------------------------------------------*/
-#define JIM_EE_STATICSTACK_LEN 10
+    JIM_EXPR_CASE(BITAND):
+        JimExprIntBin(&);
+        JIM_EXPR_NEXT();
 
-int Jim_EvalExpression(Jim_Interp *interp, Jim_Obj *exprObjPtr, Jim_Obj **exprResultPtrPtr)
-{
-    ExprByteCode *expr;
-    Jim_Obj *staticStack[JIM_EE_STATICSTACK_LEN];
-    int i;
-    int retcode = JIM_OK;
-    struct JimExprState e;
+    JIM_EXPR_CASE(BITXOR):
+        JimExprIntBin(^);
+        JIM_EXPR_NEXT();
 
-    expr = JimGetExpression(interp, exprObjPtr);
-    if (!expr) {
-        return JIM_ERR;         /* error in expression. */
-    }
+    JIM_EXPR_CASE(BITOR):
+        JimExprIntBin(|);
+        JIM_EXPR_NEXT();
 
-#ifdef JIM_OPTIMIZATION
-    /* Check for one of the following common expressions used by while/for
-     *
-     *   CONST
-     *   $a
-     *   !$a
-     *   $a < CONST, $a < $b
-     *   $a <= CONST, $a <= $b
-     *   $a > CONST, $a > $b
-     *   $a >= CONST, $a >= $b
-     *   $a != CONST, $a != $b
-     *   $a == CONST, $a == $b
-     */
-    {
-        Jim_Obj *objPtr;
+    JIM_EXPR_CASE(NOT):
+        JimExprSetInt(&sp[-1], sp[-1].isdouble ? !sp[-1].u.d : !sp[-1].u.w);
+        JIM_EXPR_NEXT();
 
-        /* STEP 1 -- Check if there are the conditions to run the specialized
-         * version of while */
+    JIM_EXPR_CASE(BITNOT):
+        if (sp[-1].isdouble) {
+            goto giveup;
+        }
+        JimExprSetInt(&sp[-1], ~sp[-1].u.w);
+        JIM_EXPR_NEXT();
 
-        switch (expr->len) {
-            case 1:
-                objPtr = JimExprIntValOrVar(interp, &expr->token[0]);
-                if (objPtr) {
-                    Jim_IncrRefCount(objPtr);
-                    *exprResultPtrPtr = objPtr;
-                    return JIM_OK;
-                }
-                break;
+    JIM_EXPR_CASE(NEG):
+        if (sp[-1].isdouble) {
+            sp[-1].u.d = -sp[-1].u.d;
+        }
+        else {
+            sp[-1].u.w = -sp[-1].u.w;
+        }
+        sp[-1].objPtr = NULL;
+        JIM_EXPR_NEXT();
 
-            case 2:
-                if (expr->token[1].type == JIM_EXPROP_NOT) {
-                    objPtr = JimExprIntValOrVar(interp, &expr->token[0]);
+    JIM_EXPR_CASE(PLUS):
+        /* The result is a new (canonical) value */
+        sp[-1].objPtr = NULL;
+        JIM_EXPR_NEXT();
 
-                    if (objPtr && JimIsWide(objPtr)) {
-                        *exprResultPtrPtr = JimWideValue(objPtr) ? interp->falseObj : interp->trueObj;
-                        Jim_IncrRefCount(*exprResultPtrPtr);
-                        return JIM_OK;
-                    }
-                }
-                break;
+    JIM_EXPR_CASE(INTFN):
+        if (sp[-1].isdouble) {
+            JimExprSetInt(&sp[-1], sp[-1].u.d);
+        }
+        sp[-1].objPtr = NULL;
+        JIM_EXPR_NEXT();
 
-            case 3:
-                objPtr = JimExprIntValOrVar(interp, &expr->token[0]);
-                if (objPtr && JimIsWide(objPtr)) {
-                    Jim_Obj *objPtr2 = JimExprIntValOrVar(interp, &expr->token[1]);
-                    if (objPtr2 && JimIsWide(objPtr2)) {
-                        jim_wide wideValueA = JimWideValue(objPtr);
-                        jim_wide wideValueB = JimWideValue(objPtr2);
-                        int cmpRes;
-                        switch (expr->token[2].type) {
-                            case JIM_EXPROP_LT:
-                                cmpRes = wideValueA < wideValueB;
-                                break;
-                            case JIM_EXPROP_LTE:
-                                cmpRes = wideValueA <= wideValueB;
-                                break;
-                            case JIM_EXPROP_GT:
-                                cmpRes = wideValueA > wideValueB;
-                                break;
-                            case JIM_EXPROP_GTE:
-                                cmpRes = wideValueA >= wideValueB;
-                                break;
-                            case JIM_EXPROP_NUMEQ:
-                                cmpRes = wideValueA == wideValueB;
-                                break;
-                            case JIM_EXPROP_NUMNE:
-                                cmpRes = wideValueA != wideValueB;
-                                break;
-                            default:
-                                goto noopt;
-                        }
-                        *exprResultPtrPtr = cmpRes ? interp->trueObj : interp->falseObj;
-                        Jim_IncrRefCount(*exprResultPtrPtr);
-                        return JIM_OK;
-                    }
-                }
-                break;
+    JIM_EXPR_CASE(ABS):
+        if (sp[-1].isdouble) {
+            sp[-1].u.d = sp[-1].u.d >= 0 ? sp[-1].u.d : -sp[-1].u.d;
         }
-    }
-noopt:
-#endif
+        else {
+            sp[-1].u.w = sp[-1].u.w >= 0 ? sp[-1].u.w : -sp[-1].u.w;
+        }
+        sp[-1].objPtr = NULL;
+        JIM_EXPR_NEXT();
 
-    /* In order to avoid that the internal repr gets freed due to
-     * shimmering of the exprObjPtr's object, we make the internal rep
-     * shared. */
-    expr->inUse++;
+    JIM_EXPR_CASE(DOUBLEFN):
+        JimExprToDouble(&sp[-1]);
+        sp[-1].objPtr = NULL;
+        JIM_EXPR_NEXT();
 
-    /* The stack-based expr VM itself */
+    JIM_EXPR_CASE(ROUND):
+        if (sp[-1].isdouble) {
+            JimExprSetInt(&sp[-1], sp[-1].u.d < 0 ? (sp[-1].u.d - 0.5) : (sp[-1].u.d + 0.5));
+        }
+        sp[-1].objPtr = NULL;
+        JIM_EXPR_NEXT();
 
-    /* Stack allocation. Expr programs have the feature that
-     * a program of length N can't require a stack longer than
-     * N. */
-    if (expr->len > JIM_EE_STATICSTACK_LEN)
-        e.stack = Jim_Alloc(sizeof(Jim_Obj *) * expr->len);
-    else
-        e.stack = staticStack;
+    JIM_EXPR_CASE(MATHFN):
+        JimExprToDouble(&sp[-1]);
+        sp[-1].u.d = inst->u.fn(sp[-1].u.d);
+        sp[-1].objPtr = NULL;
+        JIM_EXPR_NEXT();
 
-    e.stacklen = 0;
+    JIM_EXPR_CASE(ANDL):
+        if (!JimExprTrue(&sp[-1])) {
+            JimExprSetInt(&sp[-1], 0);
+            JIM_EXPR_JUMP(inst->target);
+        }
+        sp--;
+        JIM_EXPR_NEXT();
 
-    /* Execute every instruction */
-    for (i = 0; i < expr->len && retcode == JIM_OK; i++) {
-        Jim_Obj *objPtr;
+    JIM_EXPR_CASE(ORL):
+        if (JimExprTrue(&sp[-1])) {
+            JimExprSetInt(&sp[-1], 1);
+            JIM_EXPR_JUMP(inst->target);
+        }
+        sp--;
+        JIM_EXPR_NEXT();
 
-        switch (expr->token[i].type) {
-            case JIM_TT_EXPR_INT:
-            case JIM_TT_EXPR_DOUBLE:
-            case JIM_TT_STR:
-                ExprPush(&e, expr->token[i].objPtr);
-                break;
+    JIM_EXPR_CASE(ANDORR):
+        JimExprSetInt(&sp[-1], JimExprTrue(&sp[-1]));
+        JIM_EXPR_NEXT();
 
-            case JIM_TT_VAR:
-                objPtr = Jim_GetVariable(interp, expr->token[i].objPtr, JIM_ERRMSG);
-                if (objPtr) {
-                    ExprPush(&e, objPtr);
-                }
-                else {
-                    retcode = JIM_ERR;
-                }
-                break;
+    JIM_EXPR_CASE(TERNL):
+        /* The condition stays on the stack for COLONL */
+        if (!JimExprTrue(&sp[-1])) {
+            JimExprSetInt(sp, 0);
+            sp++;
+            JIM_EXPR_JUMP(inst->target);
+        }
+        JIM_EXPR_NEXT();
 
-            case JIM_TT_DICTSUGAR:
-                objPtr = JimExpandDictSugar(interp, expr->token[i].objPtr);
-                if (objPtr) {
-                    ExprPush(&e, objPtr);
-                }
-                else {
-                    retcode = JIM_ERR;
-                }
-                break;
+    JIM_EXPR_CASE(COLONL):
+        sp -= 2;
+        if (JimExprTrue(&sp[0])) {
+            sp[0] = sp[1];
+            sp++;
+            JIM_EXPR_JUMP(inst->target);
+        }
+        JIM_EXPR_NEXT();
 
-            case JIM_TT_ESC:
-                retcode = Jim_SubstObj(interp, expr->token[i].objPtr, &objPtr, JIM_NONE);
-                if (retcode == JIM_OK) {
-                    ExprPush(&e, objPtr);
-                }
-                break;
+    JIM_EXPR_CASE(END):
+        *resultPtr = sp[-1];
+        return JIM_OK;
+#ifndef JIM_EXPR_COMPUTED_GOTO
+    }
+#endif
 
-            case JIM_TT_CMD:
-                retcode = Jim_EvalObj(interp, expr->token[i].objPtr);
-                if (retcode == JIM_OK) {
-                    ExprPush(&e, Jim_GetResult(interp));
-                }
-                break;
+  giveup:
+    return JIM_ERR;
+}
 
-            default:{
-                    /* Find and execute the operation */
-                    e.skip = 0;
-                    e.opcode = expr->token[i].type;
+#undef JimExprToDouble
+#undef JimExprTrue
+#undef JimExprSetInt
+#undef JimExprArith
+#undef JimExprCompare
+#undef JimExprIntBin
+#undef JIM_EXPR_CASE
+#undef JIM_EXPR_NEXT
+#undef JIM_EXPR_JUMP
 
-                    retcode = JimExprOperatorInfoByOpcode(e.opcode)->funcop(interp, &e);
-                    /* Skip some opcodes if necessary */
-                    i += e.skip;
-                    continue;
-                }
-        }
-    }
-
-    expr->inUse--;
+/**
+ * If the operator just added at inst[*pcPtr - 1] has only constant operands,
+ * replaces them all with the constant result.
+ *
+ * Instructions before 'barrier' can't be touched because a jump lands there.
+ */
+static void JimExprFoldConstants(Jim_Interp *interp, JimExprInst *inst, int *pcPtr, int arity, int barrier)
+{
+    JimExprInst code[4];
+    JimExprValue stack[2];
+    JimExprValue result;
+    int first = *pcPtr - 1 - arity;
+    int i;
 
-    if (retcode == JIM_OK) {
-        *exprResultPtrPtr = ExprPop(&e);
+    if (first < barrier) {
+        return;
     }
-    else {
-        for (i = 0; i < e.stacklen; i++) {
-            Jim_DecrRefCount(interp, e.stack[i]);
+    for (i = first; i < *pcPtr - 1; i++) {
+        if (inst[i].op != JIM_EXPRINST_INT && inst[i].op != JIM_EXPRINST_DOUBLE) {
+            return;
         }
     }
-    if (e.stack != staticStack) {
-        Jim_Free(e.stack);
+    memcpy(code, &inst[first], sizeof(*inst) * (arity + 1));
+    code[arity + 1].op = JIM_EXPRINST_END;
+
+    /* If evaluation fails (e.g. 1/0), leave it for the generic engine to report at runtime */
+    if (JimExprRun(interp, code, stack, &result) == JIM_OK) {
+        inst[first].op = result.isdouble ? JIM_EXPRINST_DOUBLE : JIM_EXPRINST_INT;
+        inst[first].objPtr = NULL;
+        inst[first].u.w = 0;
+        if (result.isdouble) {
+            inst[first].u.d = result.u.d;
+        }
+        else {
+            inst[first].u.w = result.u.w;
+        }
+        *pcPtr = first + 1;
     }
-    return retcode;
 }
 
-int Jim_GetBoolFromExpr(Jim_Interp *interp, Jim_Obj *exprObjPtr, int *boolPtr)
-{
-    int retcode;
-    jim_wide wideValue;
-    double doubleValue;
-    Jim_Obj *exprResultPtr;
+/**
+ * Compiles the (already verified) expression bytecode into a program for JimExprRun().
+ *
+ * Returns NULL if the expression uses anything other than numeric constants,
+ * simple variables and the numeric operators.
+ */
+static JimExprProg *JimExprCompileProg(Jim_Interp *interp, ExprByteCode *expr)
+{
+    JimExprProg *prog = NULL;
+    JimExprInst *inst;
+    int *tokenPc;
+    char *target;
+    int pc = 0;
+    int barrier = 0;
+    int i;
 
-    retcode = Jim_EvalExpression(interp, exprObjPtr, &exprResultPtr);
-    if (retcode != JIM_OK)
-        return retcode;
+    inst = Jim_Alloc(sizeof(*inst) * (expr->len + 1));
+    /* Maps each token to the instruction which implements it */
+    tokenPc = Jim_Alloc(sizeof(*tokenPc) * (expr->len + 1));
+    /* Which tokens are the destination of a jump */
+    target = Jim_Alloc(expr->len + 1);
+    memset(target, 0, expr->len + 1);
 
-    if (JimGetWideNoErr(interp, exprResultPtr, &wideValue) != JIM_OK) {
-        if (Jim_GetDouble(interp, exprResultPtr, &doubleValue) != JIM_OK) {
-            Jim_DecrRefCount(interp, exprResultPtr);
-            return JIM_ERR;
+    for (i = 0; i < expr->len; i++) {
+        if (JimExprOperatorInfoByOpcode(expr->token[i].type)->lazy == LAZY_LEFT) {
+            jim_wide t;
+
+            if (i == 0 || expr->token[i - 1].type != JIM_TT_EXPR_INT) {
+                goto out;
+            }
+            t = i + JimWideValue(expr->token[i - 1].objPtr) + 1;
+            if (t <= i || t > expr->len) {
+                goto out;
+            }
+            target[t] = 1;
         }
-        else {
-            Jim_DecrRefCount(interp, exprResultPtr);
-            *boolPtr = doubleValue != 0;
-            return JIM_OK;
+    }
+
+    for (i = 0; i < expr->len; i++) {
+        const ScriptToken *t = &expr->token[i];
+        JimExprInst *in = &inst[pc];
+        JimExprValue v;
+        int arity;
+
+        tokenPc[i] = pc;
+        if (target[i]) {
+            barrier = pc;
+        }
+        in->objPtr = NULL;
+        in->target = -1;
+
+        switch (t->type) {
+            case JIM_TT_EXPR_INT:
+                if (i + 1 < expr->len && JimExprOperatorInfoByOpcode(t[1].type)->lazy == LAZY_LEFT) {
+                    /* This is the skip count for the lazy operator */
+                    continue;
+                }
+                /* fall through */
+            case JIM_TT_EXPR_DOUBLE:
+            case JIM_TT_STR:
+                if (JimExprGetValue(interp, t->objPtr, &v) != JIM_OK) {
+                    goto out;
+                }
+                in->objPtr = t->objPtr;
+                if (v.isdouble) {
+                    in->op = JIM_EXPRINST_DOUBLE;
+                    in->u.d = v.u.d;
+                }
+                else {
+                    in->op = JIM_EXPRINST_INT;
+                    in->u.w = v.u.w;
+                }
+                pc++;
+                continue;
+
+            case JIM_TT_VAR:
+                in->op = JIM_EXPRINST_VAR;
+                in->objPtr = t->objPtr;
+                pc++;
+                continue;
+
+            case JIM_EXPROP_LOGICAND_LEFT:
+            case JIM_EXPROP_LOGICOR_LEFT:
+            case JIM_EXPROP_TERNARY_LEFT:
+            case JIM_EXPROP_COLON_LEFT:
+                in->op = t->type == JIM_EXPROP_LOGICAND_LEFT ? JIM_EXPRINST_ANDL :
+                    t->type == JIM_EXPROP_LOGICOR_LEFT ? JIM_EXPRINST_ORL :
+                    t->type == JIM_EXPROP_TERNARY_LEFT ? JIM_EXPRINST_TERNL : JIM_EXPRINST_COLONL;
+                /* For now, the token index. Resolved below. */
+                in->target = i + JimWideValue(t[-1].objPtr) + 1;
+                pc++;
+                continue;
+
+            case JIM_EXPROP_LOGICAND_RIGHT:
+            case JIM_EXPROP_LOGICOR_RIGHT:
+                in->op = JIM_EXPRINST_ANDORR;
+                pc++;
+                continue;
+
+            case JIM_EXPROP_TERNARY_RIGHT:
+            case JIM_EXPROP_COLON_RIGHT:
+                /* Nothing to do */
+                continue;
+
+            case JIM_EXPROP_ADD: in->op = JIM_EXPRINST_ADD; break;
+            case JIM_EXPROP_SUB: in->op = JIM_EXPRINST_SUB; break;
+            case JIM_EXPROP_MUL: in->op = JIM_EXPRINST_MUL; break;
+            case JIM_EXPROP_DIV: in->op = JIM_EXPRINST_DIV; break;
+            case JIM_EXPROP_POW: in->op = JIM_EXPRINST_POW; break;
+            case JIM_EXPROP_LT: in->op = JIM_EXPRINST_LT; break;
+            case JIM_EXPROP_GT: in->op = JIM_EXPRINST_GT; break;
+            case JIM_EXPROP_LTE: in->op = JIM_EXPRINST_LTE; break;
+            case JIM_EXPROP_GTE: in->op = JIM_EXPRINST_GTE; break;
+            case JIM_EXPROP_NUMEQ: in->op = JIM_EXPRINST_EQ; break;
+            case JIM_EXPROP_NUMNE: in->op = JIM_EXPRINST_NE; break;
+            case JIM_EXPROP_MOD: in->op = JIM_EXPRINST_MOD; break;
+            case JIM_EXPROP_LSHIFT: in->op = JIM_EXPRINST_LSHIFT; break;
+            case JIM_EXPROP_RSHIFT: in->op = JIM_EXPRINST_RSHIFT; break;
+            case JIM_EXPROP_ROTL: in->op = JIM_EXPRINST_ROTL; break;
+            case JIM_EXPROP_ROTR: in->op = JIM_EXPRINST_ROTR; break;
+            case JIM_EXPROP_BITAND: in->op = JIM_EXPRINST_BITAND; break;
+            case JIM_EXPROP_BITXOR: in->op = JIM_EXPRINST_BITXOR; break;
+            case JIM_EXPROP_BITOR: in->op = JIM_EXPRINST_BITOR; break;
+            case JIM_EXPROP_NOT: in->op = JIM_EXPRINST_NOT; break;
+            case JIM_EXPROP_BITNOT: in->op = JIM_EXPRINST_BITNOT; break;
+            case JIM_EXPROP_UNARYMINUS: in->op = JIM_EXPRINST_NEG; break;
+            case JIM_EXPROP_UNARYPLUS: in->op = JIM_EXPRINST_PLUS; break;
+            case JIM_EXPROP_FUNC_INT: in->op = JIM_EXPRINST_INTFN; break;
+            case JIM_EXPROP_FUNC_ABS: in->op = JIM_EXPRINST_ABS; break;
+            case JIM_EXPROP_FUNC_DOUBLE: in->op = JIM_EXPRINST_DOUBLEFN; break;
+            case JIM_EXPROP_FUNC_ROUND: in->op = JIM_EXPRINST_ROUND; break;
+#ifdef JIM_MATH_FUNCTIONS
+            case JIM_EXPROP_FUNC_POW: in->op = JIM_EXPRINST_POW; break;
+            case JIM_EXPROP_FUNC_SIN: in->op = JIM_EXPRINST_MATHFN; in->u.fn = sin; break;
+            case JIM_EXPROP_FUNC_COS: in->op = JIM_EXPRINST_MATHFN; in->u.fn = cos; break;
+            case JIM_EXPROP_FUNC_TAN: in->op = JIM_EXPRINST_MATHFN; in->u.fn = tan; break;
+            case JIM_EXPROP_FUNC_ASIN: in->op = JIM_EXPRINST_MATHFN; in->u.fn = asin; break;
+            case JIM_EXPROP_FUNC_ACOS: in->op = JIM_EXPRINST_MATHFN; in->u.fn = acos; break;
+            case JIM_EXPROP_FUNC_ATAN: in->op = JIM_EXPRINST_MATHFN; in->u.fn = atan; break;
+            case JIM_EXPROP_FUNC_SINH: in->op = JIM_EXPRINST_MATHFN; in->u.fn = sinh; break;
+            case JIM_EXPROP_FUNC_COSH: in->op = JIM_EXPRINST_MATHFN; in->u.fn = cosh; break;
+            case JIM_EXPROP_FUNC_TANH: in->op = JIM_EXPRINST_MATHFN; in->u.fn = tanh; break;
+            case JIM_EXPROP_FUNC_CEIL: in->op = JIM_EXPRINST_MATHFN; in->u.fn = ceil; break;
+            case JIM_EXPROP_FUNC_FLOOR: in->op = JIM_EXPRINST_MATHFN; in->u.fn = floor; break;
+            case JIM_EXPROP_FUNC_EXP: in->op = JIM_EXPRINST_MATHFN; in->u.fn = exp; break;
+            case JIM_EXPROP_FUNC_LOG: in->op = JIM_EXPRINST_MATHFN; in->u.fn = log; break;
+            case JIM_EXPROP_FUNC_LOG10: in->op = JIM_EXPRINST_MATHFN; in->u.fn = log10; break;
+            case JIM_EXPROP_FUNC_SQRT: in->op = JIM_EXPRINST_MATHFN; in->u.fn = sqrt; break;
+#endif
+            default:
+                /* String operators, rand(), command substitution, etc. */
+                goto out;
         }
+
+        /* A non-lazy operator */
+        arity = JimExprOperatorInfoByOpcode(t->type)->arity;
+        pc++;
+        if (pc - 1 - arity < 0) {
+            goto out;
+        }
+        JimExprFoldConstants(interp, inst, &pc, arity, barrier);
     }
-    *boolPtr = wideValue != 0;
+    tokenPc[expr->len] = pc;
+    inst[pc].op = JIM_EXPRINST_END;
 
-    Jim_DecrRefCount(interp, exprResultPtr);
-    return JIM_OK;
+    /* Now resolve jumps to instructions */
+    for (i = 0; i < pc; i++) {
+        if (inst[i].target >= 0) {
+            inst[i].target = tokenPc[inst[i].target];
+        }
+    }
+
+    prog = Jim_Alloc(sizeof(*prog));
+    memset(prog, 0, sizeof(*prog));
+    prog->inst = inst;
+    prog->stackLen = expr->len + 1;
+    inst = NULL;
+
+  out:
+    Jim_Free(inst);
+    Jim_Free(tokenPc);
+    Jim_Free(target);
+    return prog;
 }
 
+#ifdef JIM_JIT
 /* -----------------------------------------------------------------------------
- * ScanFormat String Object
+ * Native code for compiled numeric expressions (x86-64, System V ABI)
+ *
+ * Once a program has run JIM_JIT_THRESHOLD times, each instruction is
+ * translated into a fixed native code template. Values live in a frame
+ * of int slots, one per stack position. The stack depth at each
+ * instruction is known at compile time, so every slot has a fixed
+ * address. Only int programs with an int result are translated.
+ * Any variable which is not an int fails the type guard, and
+ * JimExprRun() is then used instead.
  * ---------------------------------------------------------------------------*/
 
-/* This Jim_Obj will held a parsed representation of a format string passed to
- * the Jim_ScanString command. For error diagnostics, the scanformat string has
- * to be parsed in its entirely first and then, if correct, can be used for
- * scanning. To avoid endless re-parsing, the parsed representation will be
- * stored in an internal representation and re-used for performance reason. */
+#define JIM_JIT_THRESHOLD 64
+#define JIM_JIT_MAX_SLOTS 64
 
-/* A ScanFmtPartDescr will held the information of /one/ part of the whole
- * scanformat string. This part will later be used to extract information
- * out from the string to be parsed by Jim_ScanString */
+/* The largest native template, in bytes */
+#define JIM_JIT_MAX_TEMPLATE 128
 
-typedef struct ScanFmtPartDescr
+struct JimJitStats
 {
-    char *arg;                  /* Specification of a CHARSET conversion */
-    char *prefix;               /* Prefix to be scanned literally before conversion */
-    size_t width;               /* Maximal width of input to be converted */
-    int pos;                    /* -1 - no assign, 0 - natural pos, >0 - XPG3 pos */
-    char type;                  /* Type of conversion (e.g. c, d, f) */
-    char modifier;              /* Modify type (e.g. l - long, h - short */
-} ScanFmtPartDescr;
+    long compiled;              /* Programs translated to native code */
+    long rejected;              /* Hot programs which couldn't be translated */
+    long codeBytes;             /* Total native code size */
+    long runs;                  /* Native evaluations */
+    long guardFails;            /* Native evaluations which fell back to JimExprRun() */
+};
 
-/* The ScanFmtStringObj will hold the internal representation of a scanformat
- * string parsed and separated in part descriptions. Furthermore it contains
- * the original string representation of the scanformat string to allow for
- * fast update of the Jim_Obj's string representation part.
- *
- * As an add-on the internal object representation adds some scratch pad area
- * for usage by Jim_ScanString to avoid endless allocating and freeing of
- * memory for purpose of string scanning.
- *
- * The error member points to a static allocated string in case of a mal-
- * formed scanformat string or it contains '0' (NULL) in case of a valid
- * parse representation.
- *
- * The whole memory of the internal representation is allocated as a single
- * area of memory that will be internally separated. So freeing and duplicating
- * of such an object is cheap */
+typedef int JimJitFunc(Jim_Interp *interp, jim_wide *slots);
 
-typedef struct ScanFmtStringObj
+typedef struct JimJitBuf
 {
-    jim_wide size;              /* Size of internal repr in bytes */
-    char *stringRep;            /* Original string representation */
-    size_t count;               /* Number of ScanFmtPartDescr contained */
-    size_t convCount;           /* Number of conversions that will assign */
-    size_t maxPos;              /* Max position index if XPG3 is used */
-    const char *error;          /* Ptr to error text (NULL if no error */
-    char *scratch;              /* Some scratch pad used by Jim_ScanString */
-    ScanFmtPartDescr descr[1];  /* The vector of partial descriptions */
-} ScanFmtStringObj;
-
+    unsigned char *code;
+    int len;
+} JimJitBuf;
 
-static void FreeScanFmtInternalRep(Jim_Interp *interp, Jim_Obj *objPtr);
-static void DupScanFmtInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr);
-static void UpdateStringOfScanFmt(Jim_Obj *objPtr);
+/* Loads an int variable into *widePtr. This is the type guard. */
+static int JimJitGetInt(Jim_Interp *interp, Jim_Obj *nameObjPtr, jim_wide *widePtr)
+{
+    Jim_Obj *objPtr = Jim_GetVariable(interp, nameObjPtr, JIM_NONE);
+    JimExprValue v;
 
-static const Jim_ObjType scanFmtStringObjType = {
-    "scanformatstring",
-    FreeScanFmtInternalRep,
-    DupScanFmtInternalRep,
-    UpdateStringOfScanFmt,
-    JIM_TYPE_NONE,
-};
+    if (objPtr == NULL || JimExprGetValue(interp, objPtr, &v) != JIM_OK || v.isdouble) {
+        return 0;
+    }
+    *widePtr = v.u.w;
+    return 1;
+}
 
-void FreeScanFmtInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
+static void JimJitBytes(JimJitBuf *b, int n, ...)
 {
-    JIM_NOTUSED(interp);
-    Jim_Free((char *)objPtr->internalRep.ptr);
-    objPtr->internalRep.ptr = 0;
+    va_list ap;
+
+    va_start(ap, n);
+    while (n--) {
+        b->code[b->len++] = (unsigned char)va_arg(ap, int);
+    }
+    va_end(ap);
 }
 
-void DupScanFmtInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr)
+static void JimJitInt32(JimJitBuf *b, int value)
 {
-    size_t size = (size_t) ((ScanFmtStringObj *) srcPtr->internalRep.ptr)->size;
-    ScanFmtStringObj *newVec = (ScanFmtStringObj *) Jim_Alloc(size);
+    memcpy(b->code + b->len, &value, 4);
+    b->len += 4;
+}
 
-    JIM_NOTUSED(interp);
-    memcpy(newVec, srcPtr->internalRep.ptr, size);
-    dupPtr->internalRep.ptr = newVec;
-    dupPtr->typePtr = &scanFmtStringObjType;
+static void JimJitImm64(JimJitBuf *b, const void *src)
+{
+    memcpy(b->code + b->len, src, 8);
+    b->len += 8;
 }
 
-static void UpdateStringOfScanFmt(Jim_Obj *objPtr)
+/* Emits a 64 bit 'op reg, [rbx + 8 * slot]' or 'op [rbx + 8 * slot], reg' */
+static void JimJitSlot(JimJitBuf *b, int opcode, int reg, int slot)
 {
-    JimSetStringBytes(objPtr, ((ScanFmtStringObj *) objPtr->internalRep.ptr)->stringRep);
+    JimJitBytes(b, 3, 0x48, opcode, 0x83 | (reg << 3));
+    JimJitInt32(b, slot * 8);
 }
 
-/* SetScanFmtFromAny will parse a given string and create the internal
- * representation of the format specification. In case of an error
- * the error data member of the internal representation will be set
- * to an descriptive error text and the function will be left with
- * JIM_ERR to indicate unsucessful parsing (aka. malformed scanformat
- * specification */
+#define JIM_JIT_RAX 0
+#define JIM_JIT_RCX 1
+#define JIM_JIT_RDX 2
 
-static int SetScanFmtFromAny(Jim_Interp *interp, Jim_Obj *objPtr)
+#define JimJitLoad(B, REG, SLOT) JimJitSlot(B, 0x8b, REG, SLOT)
+#define JimJitStore(B, REG, SLOT) JimJitSlot(B, 0x89, REG, SLOT)
+
+/* mov qword [rbx + 8 * slot], imm32 */
+static void JimJitStoreImm(JimJitBuf *b, int slot, int value)
 {
-    ScanFmtStringObj *fmtObj;
-    char *buffer;
-    int maxCount, i, approxSize, lastPos = -1;
-    const char *fmt = objPtr->bytes;
-    int maxFmtLen = objPtr->length;
-    const char *fmtEnd = fmt + maxFmtLen;
-    int curr;
+    JimJitSlot(b, 0xc7, 0, slot);
+    JimJitInt32(b, value);
+}
 
-    Jim_FreeIntRep(interp, objPtr);
-    /* Count how many conversions could take place maximally */
-    for (i = 0, maxCount = 0; i < maxFmtLen; ++i)
-        if (fmt[i] == '%')
-            ++maxCount;
-    /* Calculate an approximation of the memory necessary */
-    approxSize = sizeof(ScanFmtStringObj)       /* Size of the container */
-        +(maxCount + 1) * sizeof(ScanFmtPartDescr)      /* Size of all partials */
-        +maxFmtLen * sizeof(char) + 3 + 1       /* Scratch + "%n" + '\0' */
-        + maxFmtLen * sizeof(char) + 1  /* Original stringrep */
-        + maxFmtLen * sizeof(char)      /* Arg for CHARSETs */
-        +(maxCount + 1) * sizeof(char)  /* '\0' for every partial */
-        +1;                     /* safety byte */
-    fmtObj = (ScanFmtStringObj *) Jim_Alloc(approxSize);
-    memset(fmtObj, 0, approxSize);
-    fmtObj->size = approxSize;
-    fmtObj->maxPos = 0;
-    fmtObj->scratch = (char *)&fmtObj->descr[maxCount + 1];
-    fmtObj->stringRep = fmtObj->scratch + maxFmtLen + 3 + 1;
-    memcpy(fmtObj->stringRep, fmt, maxFmtLen);
-    buffer = fmtObj->stringRep + maxFmtLen + 1;
-    objPtr->internalRep.ptr = fmtObj;
-    objPtr->typePtr = &scanFmtStringObjType;
-    for (i = 0, curr = 0; fmt < fmtEnd; ++fmt) {
-        int width = 0, skip;
-        ScanFmtPartDescr *descr = &fmtObj->descr[curr];
+/* Emits a conditional (0x0f 0x8X) or unconditional (0xe9) jump with
+ * a rel32 displacement to be fixed up later. Returns the offset of the displacement.
+ */
+static int JimJitJump(JimJitBuf *b, int cc)
+{
+    if (cc) {
+        JimJitBytes(b, 2, 0x0f, cc);
+    }
+    else {
+        JimJitBytes(b, 1, 0xe9);
+    }
+    JimJitInt32(b, 0);
+    return b->len - 4;
+}
 
-        fmtObj->count++;
-        descr->width = 0;       /* Assume width unspecified */
-        /* Overread and store any "literal" prefix */
-        if (*fmt != '%' || fmt[1] == '%') {
-            descr->type = 0;
-            descr->prefix = &buffer[i];
-            for (; fmt < fmtEnd; ++fmt) {
-                if (*fmt == '%') {
-                    if (fmt[1] != '%')
-                        break;
-                    ++fmt;
+/**
+ * Translates prog to native code, or returns JIM_ERR if it can't be.
+ */
+static int JimJitCompile(Jim_Interp *interp, JimExprProg *prog)
+{
+    static const unsigned char prologue[] = {
+        0x53,                   /* push rbx */
+        0x41, 0x54,             /* push r12 */
+        0x48, 0x83, 0xec, 0x08, /* sub rsp, 8 (keep the stack aligned for calls) */
+        0x49, 0x89, 0xfc,       /* mov r12, rdi (interp) */
+        0x48, 0x89, 0xf3        /* mov rbx, rsi (slots) */
+    };
+    static const unsigned char epilogue[] = {
+        0x48, 0x83, 0xc4, 0x08, /* add rsp, 8 */
+        0x41, 0x5c,             /* pop r12 */
+        0x5b,                   /* pop rbx */
+        0xc3                    /* ret */
+    };
+    int (*getIntFunc)(Jim_Interp *, Jim_Obj *, jim_wide *) = JimJitGetInt;
+    jim_wide (*powFunc)(jim_wide, jim_wide) = JimPowWide;
+    JimJitBuf b;
+    int len;
+    int *depth;
+    int *offset;
+    int *fixupAt;
+    int *fixupTo;
+    int nfixups = 0;
+    int failOffset;
+    int pc;
+    int d;
+    int rc = JIM_ERR;
+    long pagesize;
+    size_t size;
+    void *code;
+    const JimExprInst *inst = prog->inst;
+
+    for (len = 0; inst[len].op != JIM_EXPRINST_END; len++) {
+    }
+
+    depth = Jim_Alloc(sizeof(*depth) * (len + 1));
+    offset = Jim_Alloc(sizeof(*offset) * (len + 1));
+    fixupAt = Jim_Alloc(sizeof(*fixupAt) * (len + 1) * 2);
+    fixupTo = Jim_Alloc(sizeof(*fixupTo) * (len + 1) * 2);
+    b.code = Jim_Alloc(sizeof(prologue) + (len + 2) * JIM_JIT_MAX_TEMPLATE);
+    b.len = 0;
+
+    /* Find the stack depth before each instruction. Since jumps are only
+     * conditional and forward, every instruction is also reached by falling
+     * through, so the depth at each jump target must agree with that.
+     */
+    for (pc = 0; pc <= len; pc++) {
+        depth[pc] = -1;
+    }
+    d = 0;
+    for (pc = 0; pc < len; pc++) {
+        int next = d;
+        int jumpDepth = -1;
+
+        if (depth[pc] >= 0 && depth[pc] != d) {
+            goto out;
+        }
+        depth[pc] = d;
+        switch (inst[pc].op) {
+            case JIM_EXPRINST_INT:
+            case JIM_EXPRINST_VAR:
+                next = d + 1;
+                break;
+            case JIM_EXPRINST_DOUBLE:
+            case JIM_EXPRINST_DOUBLEFN:
+            case JIM_EXPRINST_MATHFN:
+                /* Doubles are left to JimExprRun() */
+                goto out;
+            case JIM_EXPRINST_NOT:
+            case JIM_EXPRINST_BITNOT:
+            case JIM_EXPRINST_NEG:
+            case JIM_EXPRINST_PLUS:
+            case JIM_EXPRINST_INTFN:
+            case JIM_EXPRINST_ABS:
+            case JIM_EXPRINST_ROUND:
+            case JIM_EXPRINST_ANDORR:
+                break;
+            case JIM_EXPRINST_ANDL:
+            case JIM_EXPRINST_ORL:
+                next = d - 1;
+                jumpDepth = d;
+                break;
+            case JIM_EXPRINST_TERNL:
+                jumpDepth = d + 1;
+                break;
+            case JIM_EXPRINST_COLONL:
+                /* This passes an operand through, which must keep its string form */
+                if (inst[pc].target == len) {
+                    goto out;
                 }
-                buffer[i++] = *fmt;
+                next = d - 2;
+                jumpDepth = d - 1;
+                break;
+            default:
+                /* Binary operators */
+                next = d - 1;
+                break;
+        }
+        if (jumpDepth >= 0) {
+            if (jumpDepth > JIM_JIT_MAX_SLOTS) {
+                goto out;
             }
-            buffer[i++] = 0;
+            if (depth[inst[pc].target] >= 0 && depth[inst[pc].target] != jumpDepth) {
+                goto out;
+            }
+            depth[inst[pc].target] = jumpDepth;
         }
-        /* Skip the conversion introducing '%' sign */
-        ++fmt;
-        /* End reached due to non-conversion literal only? */
-        if (fmt >= fmtEnd)
-            goto done;
-        descr->pos = 0;         /* Assume "natural" positioning */
-        if (*fmt == '*') {
-            descr->pos = -1;    /* Okay, conversion will not be assigned */
-            ++fmt;
+        if (next > JIM_JIT_MAX_SLOTS || next < 0) {
+            goto out;
         }
-        else
-            fmtObj->convCount++;        /* Otherwise count as assign-conversion */
-        /* Check if next token is a number (could be width or pos */
-        if (sscanf(fmt, "%d%n", &width, &skip) == 1) {
-            fmt += skip;
-            /* Was the number a XPG3 position specifier? */
-            if (descr->pos != -1 && *fmt == '$') {
-                int prev;
+        d = next;
+    }
+    if (d != 1 || (depth[len] >= 0 && depth[len] != 1) || len == 0) {
+        goto out;
+    }
+    switch (inst[len - 1].op) {
+        case JIM_EXPRINST_INT:
+        case JIM_EXPRINST_VAR:
+        case JIM_EXPRINST_COLONL:
+            /* The result may be an operand, which must keep its string form */
+            goto out;
+    }
 
-                ++fmt;
-                descr->pos = width;
-                width = 0;
-                /* Look if "natural" postioning and XPG3 one was mixed */
-                if ((lastPos == 0 && descr->pos > 0)
-                    || (lastPos > 0 && descr->pos == 0)) {
-                    fmtObj->error = "cannot mix \"%\" and \"%n$\" conversion specifiers";
-                    return JIM_ERR;
+    memcpy(b.code, prologue, sizeof(prologue));
+    b.len = sizeof(prologue);
+
+    for (pc = 0; pc < len; pc++) {
+        const JimExprInst *in = &inst[pc];
+        /* The slot of the top of stack, before the instruction */
+        int t = depth[pc] - 1;
+
+        offset[pc] = b.len;
+
+        switch (in->op) {
+            case JIM_EXPRINST_INT:
+                JimJitBytes(&b, 2, 0x48, 0xb8);                 /* mov rax, imm64 */
+                JimJitImm64(&b, &in->u.w);
+                JimJitStore(&b, JIM_JIT_RAX, t + 1);
+                break;
+
+            case JIM_EXPRINST_VAR:
+                JimJitBytes(&b, 3, 0x4c, 0x89, 0xe7);           /* mov rdi, r12 */
+                JimJitBytes(&b, 2, 0x48, 0xbe);                 /* mov rsi, imm64 */
+                JimJitImm64(&b, &in->objPtr);
+                JimJitSlot(&b, 0x8d, JIM_JIT_RDX, t + 1);       /* lea rdx, slot */
+                JimJitBytes(&b, 2, 0x48, 0xb8);                 /* mov rax, JimJitGetInt */
+                JimJitImm64(&b, &getIntFunc);
+                JimJitBytes(&b, 2, 0xff, 0xd0);                 /* call rax */
+                JimJitBytes(&b, 2, 0x85, 0xc0);                 /* test eax, eax */
+                fixupTo[nfixups] = -1;
+                fixupAt[nfixups++] = JimJitJump(&b, 0x84);      /* je fail */
+                break;
+
+            case JIM_EXPRINST_NOT:
+            case JIM_EXPRINST_BITNOT:
+            case JIM_EXPRINST_NEG:
+            case JIM_EXPRINST_ABS:
+            case JIM_EXPRINST_ANDORR:
+                JimJitLoad(&b, JIM_JIT_RAX, t);
+                switch (in->op) {
+                    case JIM_EXPRINST_NOT:
+                        JimJitBytes(&b, 3, 0x48, 0x85, 0xc0);   /* test rax, rax */
+                        JimJitBytes(&b, 3, 0x0f, 0x94, 0xc0);   /* sete al */
+                        JimJitBytes(&b, 3, 0x0f, 0xb6, 0xc0);   /* movzx eax, al */
+                        break;
+                    case JIM_EXPRINST_ANDORR:
+                        JimJitBytes(&b, 3, 0x48, 0x85, 0xc0);   /* test rax, rax */
+                        JimJitBytes(&b, 3, 0x0f, 0x95, 0xc0);   /* setne al */
+                        JimJitBytes(&b, 3, 0x0f, 0xb6, 0xc0);   /* movzx eax, al */
+                        break;
+                    case JIM_EXPRINST_BITNOT:
+                        JimJitBytes(&b, 3, 0x48, 0xf7, 0xd0);   /* not rax */
+                        break;
+                    case JIM_EXPRINST_NEG:
+                        JimJitBytes(&b, 3, 0x48, 0xf7, 0xd8);   /* neg rax */
+                        break;
+                    case JIM_EXPRINST_ABS:
+                        JimJitBytes(&b, 3, 0x48, 0x89, 0xc1);   /* mov rcx, rax */
+                        JimJitBytes(&b, 3, 0x48, 0xf7, 0xd9);   /* neg rcx */
+                        JimJitBytes(&b, 3, 0x48, 0x85, 0xc0);   /* test rax, rax */
+                        JimJitBytes(&b, 4, 0x48, 0x0f, 0x48, 0xc1); /* cmovs rax, rcx */
+                        break;
                 }
-                /* Look if this position was already used */
-                for (prev = 0; prev < curr; ++prev) {
-                    if (fmtObj->descr[prev].pos == -1)
-                        continue;
-                    if (fmtObj->descr[prev].pos == descr->pos) {
-                        fmtObj->error =
-                            "variable is assigned by multiple \"%n$\" conversion specifiers";
-                        return JIM_ERR;
-                    }
+                JimJitStore(&b, JIM_JIT_RAX, t);
+                break;
+
+            case JIM_EXPRINST_PLUS:
+            case JIM_EXPRINST_INTFN:
+            case JIM_EXPRINST_ROUND:
+                /* No-ops on ints */
+                break;
+
+            case JIM_EXPRINST_ANDL:
+            case JIM_EXPRINST_ORL:
+            case JIM_EXPRINST_TERNL:
+                JimJitLoad(&b, JIM_JIT_RAX, t);
+                JimJitBytes(&b, 3, 0x48, 0x85, 0xc0);           /* test rax, rax */
+                /* Skip over the store and jump (11 + 5 bytes) if the lazy operand is needed */
+                JimJitBytes(&b, 2, in->op == JIM_EXPRINST_ORL ? 0x74 : 0x75, 16); /* je/jne */
+                if (in->op == JIM_EXPRINST_TERNL) {
+                    JimJitStoreImm(&b, t + 1, 0);
                 }
-                /* Try to find a width after the XPG3 specifier */
-                if (sscanf(fmt, "%d%n", &width, &skip) == 1) {
-                    descr->width = width;
-                    fmt += skip;
+                else {
+                    JimJitStoreImm(&b, t, in->op == JIM_EXPRINST_ORL);
                 }
-                if (descr->pos > 0 && (size_t) descr->pos > fmtObj->maxPos)
-                    fmtObj->maxPos = descr->pos;
-            }
-            else {
-                /* Number was not a XPG3, so it has to be a width */
-                descr->width = width;
-            }
+                fixupTo[nfixups] = in->target;
+                fixupAt[nfixups++] = JimJitJump(&b, 0);
+                break;
+
+            case JIM_EXPRINST_COLONL:
+                JimJitLoad(&b, JIM_JIT_RAX, t - 1);
+                JimJitBytes(&b, 3, 0x48, 0x85, 0xc0);           /* test rax, rax */
+                JimJitBytes(&b, 2, 0x74, 19);                   /* je over the move and jump */
+                JimJitLoad(&b, JIM_JIT_RCX, t);
+                JimJitStore(&b, JIM_JIT_RCX, t - 1);
+                fixupTo[nfixups] = in->target;
+                fixupAt[nfixups++] = JimJitJump(&b, 0);
+                break;
+
+            default:
+                /* Binary operators: rax = slot[t - 1] op rcx = slot[t] */
+                JimJitLoad(&b, JIM_JIT_RAX, t - 1);
+                JimJitLoad(&b, JIM_JIT_RCX, t);
+                switch (in->op) {
+                    case JIM_EXPRINST_ADD:
+                        JimJitBytes(&b, 3, 0x48, 0x01, 0xc8);   /* add rax, rcx */
+                        break;
+                    case JIM_EXPRINST_SUB:
+                        JimJitBytes(&b, 3, 0x48, 0x29, 0xc8);   /* sub rax, rcx */
+                        break;
+                    case JIM_EXPRINST_MUL:
+                        JimJitBytes(&b, 4, 0x48, 0x0f, 0xaf, 0xc1); /* imul rax, rcx */
+                        break;
+                    case JIM_EXPRINST_BITAND:
+                        JimJitBytes(&b, 3, 0x48, 0x21, 0xc8);   /* and rax, rcx */
+                        break;
+                    case JIM_EXPRINST_BITOR:
+                        JimJitBytes(&b, 3, 0x48, 0x09, 0xc8);   /* or rax, rcx */
+                        break;
+                    case JIM_EXPRINST_BITXOR:
+                        JimJitBytes(&b, 3, 0x48, 0x31, 0xc8);   /* xor rax, rcx */
+                        break;
+                    case JIM_EXPRINST_LSHIFT:
+                        JimJitBytes(&b, 3, 0x48, 0xd3, 0xe0);   /* shl rax, cl */
+                        break;
+                    case JIM_EXPRINST_RSHIFT:
+                        JimJitBytes(&b, 3, 0x48, 0xd3, 0xf8);   /* sar rax, cl */
+                        break;
+                    case JIM_EXPRINST_ROTL:
+                        JimJitBytes(&b, 3, 0x48, 0xd3, 0xc0);   /* rol rax, cl */
+                        break;
+                    case JIM_EXPRINST_ROTR:
+                        JimJitBytes(&b, 3, 0x48, 0xd3, 0xc8);   /* ror rax, cl */
+                        break;
+                    case JIM_EXPRINST_LT:
+                    case JIM_EXPRINST_GT:
+                    case JIM_EXPRINST_LTE:
+                    case JIM_EXPRINST_GTE:
+                    case JIM_EXPRINST_EQ:
+                    case JIM_EXPRINST_NE:
+                        JimJitBytes(&b, 3, 0x48, 0x39, 0xc8);   /* cmp rax, rcx */
+                        JimJitBytes(&b, 3, 0x0f,                /* setCC al */
+                            in->op == JIM_EXPRINST_LT ? 0x9c :
+                            in->op == JIM_EXPRINST_GT ? 0x9f :
+                            in->op == JIM_EXPRINST_LTE ? 0x9e :
+                            in->op == JIM_EXPRINST_GTE ? 0x9d :
+                            in->op == JIM_EXPRINST_EQ ? 0x94 : 0x95, 0xc0);
+                        JimJitBytes(&b, 3, 0x0f, 0xb6, 0xc0);   /* movzx eax, al */
+                        break;
+                    case JIM_EXPRINST_DIV:
+                        /* Rounds towards negative infinity, as per JimExprOpBin() */
+                        JimJitBytes(&b, 3, 0x48, 0x85, 0xc9);   /* test rcx, rcx */
+                        fixupTo[nfixups] = -1;
+                        fixupAt[nfixups++] = JimJitJump(&b, 0x84); /* je fail */
+                        JimJitBytes(&b, 2, 0x79, 6);            /* jns +6 */
+                        JimJitBytes(&b, 3, 0x48, 0xf7, 0xd9);   /* neg rcx */
+                        JimJitBytes(&b, 3, 0x48, 0xf7, 0xd8);   /* neg rax */
+                        JimJitBytes(&b, 2, 0x48, 0x99);         /* cqo */
+                        JimJitBytes(&b, 3, 0x48, 0xf7, 0xf9);   /* idiv rcx */
+                        JimJitBytes(&b, 3, 0x48, 0x85, 0xd2);   /* test rdx, rdx */
+                        JimJitBytes(&b, 2, 0x79, 3);            /* jns +3 */
+                        JimJitBytes(&b, 3, 0x48, 0xff, 0xc8);   /* dec rax */
+                        break;
+                    case JIM_EXPRINST_MOD:
+                        /* The remainder has the same sign as the divisor, as per JimExprOpIntBin() */
+                        JimJitBytes(&b, 3, 0x45, 0x31, 0xc0);   /* xor r8d, r8d */
+                        JimJitBytes(&b, 3, 0x48, 0x85, 0xc9);   /* test rcx, rcx */
+                        fixupTo[nfixups] = -1;
+                        fixupAt[nfixups++] = JimJitJump(&b, 0x84); /* je fail */
+                        JimJitBytes(&b, 2, 0x79, 12);           /* jns +12 */
+                        JimJitBytes(&b, 3, 0x48, 0xf7, 0xd9);   /* neg rcx */
+                        JimJitBytes(&b, 3, 0x48, 0xf7, 0xd8);   /* neg rax */
+                        JimJitBytes(&b, 6, 0x41, 0xb8, 1, 0, 0, 0); /* mov r8d, 1 */
+                        JimJitBytes(&b, 2, 0x48, 0x99);         /* cqo */
+                        JimJitBytes(&b, 3, 0x48, 0xf7, 0xf9);   /* idiv rcx */
+                        JimJitBytes(&b, 3, 0x48, 0x85, 0xd2);   /* test rdx, rdx */
+                        JimJitBytes(&b, 2, 0x79, 3);            /* jns +3 */
+                        JimJitBytes(&b, 3, 0x48, 0x01, 0xca);   /* add rdx, rcx */
+                        JimJitBytes(&b, 3, 0x45, 0x85, 0xc0);   /* test r8d, r8d */
+                        JimJitBytes(&b, 2, 0x74, 3);            /* je +3 */
+                        JimJitBytes(&b, 3, 0x48, 0xf7, 0xda);   /* neg rdx */
+                        JimJitBytes(&b, 3, 0x48, 0x89, 0xd0);   /* mov rax, rdx */
+                        break;
+                    case JIM_EXPRINST_POW:
+                        JimJitBytes(&b, 3, 0x48, 0x89, 0xc7);   /* mov rdi, rax */
+                        JimJitBytes(&b, 3, 0x48, 0x89, 0xce);   /* mov rsi, rcx */
+                        JimJitBytes(&b, 2, 0x48, 0xb8);         /* mov rax, JimPowWide */
+                        JimJitImm64(&b, &powFunc);
+                        JimJitBytes(&b, 2, 0xff, 0xd0);         /* call rax */
+                        break;
+                    default:
+                        goto out;
+                }
+                JimJitStore(&b, JIM_JIT_RAX, t - 1);
+                break;
         }
-        /* If positioning mode was undetermined yet, fix this */
-        if (lastPos == -1)
-            lastPos = descr->pos;
-        /* Handle CHARSET conversion type ... */
-        if (*fmt == '[') {
-            int swapped = 1, beg = i, end, j;
+    }
+
+    /* Success */
+    offset[len] = b.len;
+    JimJitBytes(&b, 5, 0xb8, 1, 0, 0, 0);                       /* mov eax, 1 */
+    memcpy(b.code + b.len, epilogue, sizeof(epilogue));
+    b.len += sizeof(epilogue);
+
+    /* Type guard or division by zero failure */
+    failOffset = b.len;
+    JimJitBytes(&b, 2, 0x31, 0xc0);                             /* xor eax, eax */
+    memcpy(b.code + b.len, epilogue, sizeof(epilogue));
+    b.len += sizeof(epilogue);
+
+    while (nfixups--) {
+        int to = fixupTo[nfixups] < 0 ? failOffset : offset[fixupTo[nfixups]];
+        int rel = to - (fixupAt[nfixups] + 4);
+
+        memcpy(b.code + fixupAt[nfixups], &rel, 4);
+    }
+
+    /* Copy the code to its own pages, which are never both writable and executable */
+#ifdef _SC_PAGESIZE
+    pagesize = sysconf(_SC_PAGESIZE);
+#else
+    pagesize = 4096;
+#endif
+    size = (b.len + pagesize - 1) / pagesize * pagesize;
+    code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (code == MAP_FAILED) {
+        goto out;
+    }
+    memcpy(code, b.code, b.len);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, size);
+        goto out;
+    }
+    prog->code = code;
+    prog->codeLen = size;
+    prog->native = (JimJitFunc *)code;
+    interp->jitStats->codeBytes += b.len;
+    rc = JIM_OK;
+
+  out:
+    if (rc == JIM_OK) {
+        interp->jitStats->compiled++;
+    }
+    else {
+        interp->jitStats->rejected++;
+    }
+    Jim_Free(b.code);
+    Jim_Free(depth);
+    Jim_Free(offset);
+    Jim_Free(fixupAt);
+    Jim_Free(fixupTo);
+    return rc;
+}
+
+/* Returns JIM_OK and stores the int result in *widePtr if the native code succeeds */
+static int JimJitRun(Jim_Interp *interp, JimExprProg *prog, jim_wide *widePtr)
+{
+    jim_wide slots[JIM_JIT_MAX_SLOTS];
+
+    interp->jitStats->runs++;
+    if (prog->native(interp, slots)) {
+        *widePtr = slots[0];
+        return JIM_OK;
+    }
+    interp->jitStats->guardFails++;
+    return JIM_ERR;
+}
+#endif /* JIM_JIT */
+
+static void JimExprFreeProg(JimExprProg *prog)
+{
+    if (prog) {
+#ifdef JIM_JIT
+        if (prog->code) {
+            munmap(prog->code, prog->codeLen);
+        }
+#endif
+        Jim_Free(prog->inst);
+        Jim_Free(prog);
+    }
+}
+
+/* This method takes the string representation of an expression
+ * and generates a program for the Expr's stack-based VM. */
+static int SetExprFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr)
+{
+    int exprTextLen;
+    const char *exprText;
+    struct JimParserCtx parser;
+    struct ExprByteCode *expr;
+    ParseTokenList tokenlist;
+    int line;
+    Jim_Obj *fileNameObj;
+    int rc = JIM_ERR;
+
+    JimTraceShimmer(interp, objPtr, &exprObjType);
+
+    /* Try to get information about filename / line number */
+    if (objPtr->typePtr == &sourceObjType) {
+        fileNameObj = objPtr->internalRep.sourceValue.fileNameObj;
+        line = objPtr->internalRep.sourceValue.lineNumber;
+    }
+    else {
+        fileNameObj = interp->emptyObj;
+        line = 1;
+    }
+    Jim_IncrRefCount(fileNameObj);
+
+    exprText = Jim_GetString(objPtr, &exprTextLen);
+
+    /* Initially tokenise the expression into tokenlist */
+    ScriptTokenListInit(&tokenlist);
+
+    JimParserInit(&parser, exprText, exprTextLen, line);
+    while (!parser.eof) {
+        if (JimParseExpression(&parser) != JIM_OK) {
+            ScriptTokenListFree(&tokenlist);
+          invalidexpr:
+            Jim_SetResultFormatted(interp, "syntax error in expression: \"%#s\"", objPtr);
+            expr = NULL;
+            goto err;
+        }
+
+        ScriptAddToken(&tokenlist, parser.tstart, parser.tend - parser.tstart + 1, parser.tt,
+            parser.tline);
+    }
+
+#ifdef DEBUG_SHOW_EXPR_TOKENS
+    {
+        int i;
+        printf("==== Expr Tokens (%s) ====\n", Jim_String(fileNameObj));
+        for (i = 0; i < tokenlist.count; i++) {
+            printf("[%2d]@%d %s '%.*s'\n", i, tokenlist.list[i].line, jim_tt_name(tokenlist.list[i].type),
+                tokenlist.list[i].len, tokenlist.list[i].token);
+        }
+    }
+#endif
+
+    if (JimParseCheckMissing(interp, parser.missing.ch) == JIM_ERR) {
+        ScriptTokenListFree(&tokenlist);
+        Jim_DecrRefCount(interp, fileNameObj);
+        return JIM_ERR;
+    }
+
+    /* Now create the expression bytecode from the tokenlist */
+    expr = ExprCreateByteCode(interp, &tokenlist, fileNameObj);
+
+    /* No longer need the token list */
+    ScriptTokenListFree(&tokenlist);
+
+    if (!expr) {
+        goto err;
+    }
+
+#ifdef DEBUG_SHOW_EXPR
+    {
+        int i;
+
+        printf("==== Expr ====\n");
+        for (i = 0; i < expr->len; i++) {
+            ScriptToken *t = &expr->token[i];
+
+            printf("[%2d] %s '%s'\n", i, jim_tt_name(t->type), Jim_String(t->objPtr));
+        }
+    }
+#endif
+
+    /* Check program correctness. */
+    if (ExprCheckCorrectness(expr) != JIM_OK) {
+        ExprFreeByteCode(interp, expr);
+        goto invalidexpr;
+    }
+
+    expr->prog = JimExprCompileProg(interp, expr);
+
+    rc = JIM_OK;
+
+  err:
+    /* Free the old internal rep and set the new one. */
+    Jim_DecrRefCount(interp, fileNameObj);
+    Jim_FreeIntRep(interp, objPtr);
+    Jim_SetIntRepPtr(objPtr, expr);
+    objPtr->typePtr = &exprObjType;
+    return rc;
+}
+
+static ExprByteCode *JimGetExpression(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    if (objPtr->typePtr != &exprObjType) {
+        if (SetExprFromAny(interp, objPtr) != JIM_OK) {
+            return NULL;
+        }
+    }
+    return (ExprByteCode *) Jim_GetIntRepPtr(objPtr);
+}
+
+#ifdef JIM_OPTIMIZATION
+static Jim_Obj *JimExprIntValOrVar(Jim_Interp *interp, const ScriptToken *token)
+{
+    if (token->type == JIM_TT_EXPR_INT)
+        return token->objPtr;
+    else if (token->type == JIM_TT_VAR)
+        return Jim_GetVariable(interp, token->objPtr, JIM_NONE);
+    else if (token->type == JIM_TT_DICTSUGAR)
+        return JimExpandDictSugar(interp, token->objPtr);
+    else
+        return NULL;
+}
+#endif
+
+/* -----------------------------------------------------------------------------
+ * Expressions evaluation.
+ * Jim uses a specialized stack-based virtual machine for expressions,
+ * that takes advantage of the fact that expr's operators
+ * can't be redefined.
+ *
+ * Jim_EvalExpression() uses the bytecode compiled by
+ * SetExprFromAny() method of the "expression" object.
+ *
+ * On success a Tcl Object containing the result of the evaluation
+ * is stored into expResultPtrPtr (having refcount of 1), and JIM_OK is
+ * returned.
+ * On error the function returns a retcode != to JIM_OK and set a suitable
+ * error on the interp.
+ * ---------------------------------------------------------------------------*/
+
+/* Initial size of the per-interp expression stack */
+#define JIM_EE_STACK_LEN 64
+
+/* Evaluates a compiled numeric program. See JimExprCompileProg() */
+static int JimExprEvalProg(Jim_Interp *interp, JimExprProg *prog, Jim_Obj **exprResultPtrPtr)
+{
+    JimExprValue result;
+
+#ifdef JIM_JIT
+    if (prog->native) {
+        jim_wide w;
+
+        if (JimJitRun(interp, prog, &w) == JIM_OK) {
+            if (prog->nativeMisses > 0) {
+                prog->nativeMisses--;
+            }
+            *exprResultPtrPtr = Jim_NewIntObj(interp, w);
+            Jim_IncrRefCount(*exprResultPtrPtr);
+            return JIM_OK;
+        }
+        if (++prog->nativeMisses >= JIM_EXPR_MAX_MISSES) {
+            /* The types have changed, so stop using it (the code is freed with the program) */
+            prog->native = NULL;
+        }
+    }
+#endif
+
+    if (prog->misses >= JIM_EXPR_MAX_MISSES) {
+        /* Almost always gives up, so don't bother */
+        return JIM_ERR;
+    }
+
+    /* The program can't be reentered, so a single stack is enough */
+    if (interp->exprValuesLen < prog->stackLen) {
+        interp->exprValuesLen = prog->stackLen + JIM_EE_STACK_LEN;
+        interp->exprValues = Jim_Realloc(interp->exprValues, sizeof(*interp->exprValues) * interp->exprValuesLen);
+    }
+
+    if (JimExprRun(interp, prog->inst, interp->exprValues, &result) != JIM_OK) {
+        prog->misses++;
+        return JIM_ERR;
+    }
+    if (prog->misses > 0) {
+        prog->misses--;
+    }
+#ifdef JIM_JIT
+    if (prog->runs < JIM_JIT_THRESHOLD && ++prog->runs == JIM_JIT_THRESHOLD) {
+        if (interp->jitStats == NULL) {
+            interp->jitStats = Jim_Alloc(sizeof(*interp->jitStats));
+            memset(interp->jitStats, 0, sizeof(*interp->jitStats));
+        }
+        JimJitCompile(interp, prog);
+    }
+#endif
+
+    if (result.objPtr) {
+        *exprResultPtrPtr = result.objPtr;
+    }
+    else if (result.isdouble) {
+        *exprResultPtrPtr = Jim_NewDoubleObj(interp, result.u.d);
+    }
+    else {
+        *exprResultPtrPtr = Jim_NewIntObj(interp, result.u.w);
+    }
+    Jim_IncrRefCount(*exprResultPtrPtr);
+    return JIM_OK;
+}
+
+int Jim_EvalExpression(Jim_Interp *interp, Jim_Obj *exprObjPtr, Jim_Obj **exprResultPtrPtr)
+{
+    ExprByteCode *expr;
+    int i;
+    int retcode = JIM_OK;
+    int sharedStack;
+    struct JimExprState e;
+
+    expr = JimGetExpression(interp, exprObjPtr);
+    if (!expr) {
+        return JIM_ERR;         /* error in expression. */
+    }
+
+#ifdef JIM_OPTIMIZATION
+    /* Check for one of the following common expressions used by while/for
+     *
+     *   CONST
+     *   $a
+     *   !$a
+     *   $a < CONST, $a < $b
+     *   $a <= CONST, $a <= $b
+     *   $a > CONST, $a > $b
+     *   $a >= CONST, $a >= $b
+     *   $a != CONST, $a != $b
+     *   $a == CONST, $a == $b
+     */
+    {
+        Jim_Obj *objPtr;
+
+        /* STEP 1 -- Check if there are the conditions to run the specialized
+         * version of while */
+
+        switch (expr->len) {
+            case 1:
+                objPtr = JimExprIntValOrVar(interp, &expr->token[0]);
+                if (objPtr) {
+                    Jim_IncrRefCount(objPtr);
+                    *exprResultPtrPtr = objPtr;
+                    return JIM_OK;
+                }
+                break;
+
+            case 2:
+                if (expr->token[1].type == JIM_EXPROP_NOT) {
+                    objPtr = JimExprIntValOrVar(interp, &expr->token[0]);
+
+                    if (objPtr && JimIsWide(objPtr)) {
+                        *exprResultPtrPtr = JimWideValue(objPtr) ? interp->falseObj : interp->trueObj;
+                        Jim_IncrRefCount(*exprResultPtrPtr);
+                        return JIM_OK;
+                    }
+                }
+                break;
+
+            case 3:
+                objPtr = JimExprIntValOrVar(interp, &expr->token[0]);
+                if (objPtr && JimIsWide(objPtr)) {
+                    Jim_Obj *objPtr2 = JimExprIntValOrVar(interp, &expr->token[1]);
+                    if (objPtr2 && JimIsWide(objPtr2)) {
+                        jim_wide wideValueA = JimWideValue(objPtr);
+                        jim_wide wideValueB = JimWideValue(objPtr2);
+                        int cmpRes;
+                        switch (expr->token[2].type) {
+                            case JIM_EXPROP_LT:
+                                cmpRes = wideValueA < wideValueB;
+                                break;
+                            case JIM_EXPROP_LTE:
+                                cmpRes = wideValueA <= wideValueB;
+                                break;
+                            case JIM_EXPROP_GT:
+                                cmpRes = wideValueA > wideValueB;
+                                break;
+                            case JIM_EXPROP_GTE:
+                                cmpRes = wideValueA >= wideValueB;
+                                break;
+                            case JIM_EXPROP_NUMEQ:
+                                cmpRes = wideValueA == wideValueB;
+                                break;
+                            case JIM_EXPROP_NUMNE:
+                                cmpRes = wideValueA != wideValueB;
+                                break;
+                            default:
+                                goto noopt;
+                        }
+                        *exprResultPtrPtr = cmpRes ? interp->trueObj : interp->falseObj;
+                        Jim_IncrRefCount(*exprResultPtrPtr);
+                        return JIM_OK;
+                    }
+                }
+                break;
+        }
+    }
+noopt:
+#endif
+
+    if (expr->prog && JimExprEvalProg(interp, expr->prog, exprResultPtrPtr) == JIM_OK) {
+        return JIM_OK;
+    }
+
+    /* In order to avoid that the internal repr gets freed due to
+     * shimmering of the exprObjPtr's object, we make the internal rep
+     * shared. */
+    expr->inUse++;
+
+    /* The stack-based expr VM itself */
+
+    /* Stack allocation. Expr programs have the feature that
+     * a program of length N can't require a stack longer than
+     * N.
+     *
+     * Nested evaluations (via command substitution) each take the
+     * next part of the per-interp stack. Only the outermost evaluation
+     * may grow it, since that moves the parts in use.
+     */
+    if (interp->exprStackTop == 0 && interp->exprStackLen < expr->len) {
+        interp->exprStackLen = expr->len + JIM_EE_STACK_LEN;
+        interp->exprStack = Jim_Realloc(interp->exprStack, sizeof(*interp->exprStack) * interp->exprStackLen);
+    }
+    sharedStack = (interp->exprStackLen - interp->exprStackTop >= expr->len);
+    if (sharedStack) {
+        e.stack = interp->exprStack + interp->exprStackTop;
+        interp->exprStackTop += expr->len;
+    }
+    else {
+        e.stack = Jim_Alloc(sizeof(Jim_Obj *) * expr->len);
+    }
+
+    e.stacklen = 0;
+
+    /* Execute every instruction */
+    for (i = 0; i < expr->len && retcode == JIM_OK; i++) {
+        Jim_Obj *objPtr;
+
+        switch (expr->token[i].type) {
+            case JIM_TT_EXPR_INT:
+            case JIM_TT_EXPR_DOUBLE:
+            case JIM_TT_STR:
+                ExprPush(&e, expr->token[i].objPtr);
+                break;
+
+            case JIM_TT_VAR:
+                objPtr = Jim_GetVariable(interp, expr->token[i].objPtr, JIM_ERRMSG);
+                if (objPtr) {
+                    ExprPush(&e, objPtr);
+                }
+                else {
+                    retcode = JIM_ERR;
+                }
+                break;
+
+            case JIM_TT_DICTSUGAR:
+                objPtr = JimExpandDictSugar(interp, expr->token[i].objPtr);
+                if (objPtr) {
+                    ExprPush(&e, objPtr);
+                }
+                else {
+                    retcode = JIM_ERR;
+                }
+                break;
+
+            case JIM_TT_ESC:
+                retcode = Jim_SubstObj(interp, expr->token[i].objPtr, &objPtr, JIM_NONE);
+                if (retcode == JIM_OK) {
+                    ExprPush(&e, objPtr);
+                }
+                break;
+
+            case JIM_TT_CMD:
+                retcode = Jim_EvalObj(interp, expr->token[i].objPtr);
+                if (retcode == JIM_OK) {
+                    ExprPush(&e, Jim_GetResult(interp));
+                }
+                break;
+
+            default:{
+                    /* Find and execute the operation */
+                    e.skip = 0;
+                    e.opcode = expr->token[i].type;
+
+                    retcode = JimExprOperatorInfoByOpcode(e.opcode)->funcop(interp, &e);
+                    /* Skip some opcodes if necessary */
+                    i += e.skip;
+                    continue;
+                }
+        }
+    }
+
+    expr->inUse--;
+
+    if (retcode == JIM_OK) {
+        *exprResultPtrPtr = ExprPop(&e);
+    }
+    else {
+        for (i = 0; i < e.stacklen; i++) {
+            Jim_DecrRefCount(interp, e.stack[i]);
+        }
+    }
+    if (sharedStack) {
+        interp->exprStackTop -= expr->len;
+    }
+    else {
+        Jim_Free(e.stack);
+    }
+    return retcode;
+}
+
+int Jim_GetBoolFromExpr(Jim_Interp *interp, Jim_Obj *exprObjPtr, int *boolPtr)
+{
+    int retcode;
+    jim_wide wideValue;
+    double doubleValue;
+    Jim_Obj *exprResultPtr;
+
+    retcode = Jim_EvalExpression(interp, exprObjPtr, &exprResultPtr);
+    if (retcode != JIM_OK)
+        return retcode;
+
+    if (JimGetWideNoErr(interp, exprResultPtr, &wideValue) != JIM_OK) {
+        if (Jim_GetDouble(interp, exprResultPtr, &doubleValue) != JIM_OK) {
+            Jim_DecrRefCount(interp, exprResultPtr);
+            return JIM_ERR;
+        }
+        else {
+            Jim_DecrRefCount(interp, exprResultPtr);
+            *boolPtr = doubleValue != 0;
+            return JIM_OK;
+        }
+    }
+    *boolPtr = wideValue != 0;
+
+    Jim_DecrRefCount(interp, exprResultPtr);
+    return JIM_OK;
+}
+
+/* -----------------------------------------------------------------------------
+ * ScanFormat String Object
+ * ---------------------------------------------------------------------------*/
+
+/* This Jim_Obj will held a parsed representation of a format string passed to
+ * the Jim_ScanString command. For error diagnostics, the scanformat string has
+ * to be parsed in its entirely first and then, if correct, can be used for
+ * scanning. To avoid endless re-parsing, the parsed representation will be
+ * stored in an internal representation and re-used for performance reason. */
+
+/* A ScanFmtPartDescr will held the information of /one/ part of the whole
+ * scanformat string. This part will later be used to extract information
+ * out from the string to be parsed by Jim_ScanString */
+
+typedef struct ScanFmtPartDescr
+{
+    char *arg;                  /* Specification of a CHARSET conversion */
+    char *prefix;               /* Prefix to be scanned literally before conversion */
+    size_t width;               /* Maximal width of input to be converted */
+    int pos;                    /* -1 - no assign, 0 - natural pos, >0 - XPG3 pos */
+    char type;                  /* Type of conversion (e.g. c, d, f) */
+    char modifier;              /* Modify type (e.g. l - long, h - short */
+} ScanFmtPartDescr;
+
+/* The ScanFmtStringObj will hold the internal representation of a scanformat
+ * string parsed and separated in part descriptions. Furthermore it contains
+ * the original string representation of the scanformat string to allow for
+ * fast update of the Jim_Obj's string representation part.
+ *
+ * As an add-on the internal object representation adds some scratch pad area
+ * for usage by Jim_ScanString to avoid endless allocating and freeing of
+ * memory for purpose of string scanning.
+ *
+ * The error member points to a static allocated string in case of a mal-
+ * formed scanformat string or it contains '0' (NULL) in case of a valid
+ * parse representation.
+ *
+ * The whole memory of the internal representation is allocated as a single
+ * area of memory that will be internally separated. So freeing and duplicating
+ * of such an object is cheap */
+
+typedef struct ScanFmtStringObj
+{
+    jim_wide size;              /* Size of internal repr in bytes */
+    char *stringRep;            /* Original string representation */
+    size_t count;               /* Number of ScanFmtPartDescr contained */
+    size_t convCount;           /* Number of conversions that will assign */
+    size_t maxPos;              /* Max position index if XPG3 is used */
+    const char *error;          /* Ptr to error text (NULL if no error */
+    char *scratch;              /* Some scratch pad used by Jim_ScanString */
+    ScanFmtPartDescr descr[1];  /* The vector of partial descriptions */
+} ScanFmtStringObj;
+
+
+static void FreeScanFmtInternalRep(Jim_Interp *interp, Jim_Obj *objPtr);
+static void DupScanFmtInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr);
+static void UpdateStringOfScanFmt(Jim_Obj *objPtr);
+
+static const Jim_ObjType scanFmtStringObjType = {
+    "scanformatstring",
+    FreeScanFmtInternalRep,
+    DupScanFmtInternalRep,
+    UpdateStringOfScanFmt,
+    JIM_TYPE_NONE,
+};
+
+void FreeScanFmtInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    JIM_NOTUSED(interp);
+    Jim_Free((char *)objPtr->internalRep.ptr);
+    objPtr->internalRep.ptr = 0;
+}
+
+void DupScanFmtInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr)
+{
+    size_t size = (size_t) ((ScanFmtStringObj *) srcPtr->internalRep.ptr)->size;
+    ScanFmtStringObj *newVec = (ScanFmtStringObj *) Jim_Alloc(size);
+
+    JIM_NOTUSED(interp);
+    memcpy(newVec, srcPtr->internalRep.ptr, size);
+    dupPtr->internalRep.ptr = newVec;
+    dupPtr->typePtr = &scanFmtStringObjType;
+}
+
+static void UpdateStringOfScanFmt(Jim_Obj *objPtr)
+{
+    JimSetStringBytes(objPtr, ((ScanFmtStringObj *) objPtr->internalRep.ptr)->stringRep);
+}
+
+/* SetScanFmtFromAny will parse a given string and create the internal
+ * representation of the format specification. In case of an error
+ * the error data member of the internal representation will be set
+ * to an descriptive error text and the function will be left with
+ * JIM_ERR to indicate unsucessful parsing (aka. malformed scanformat
+ * specification */
+
+static int SetScanFmtFromAny(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    ScanFmtStringObj *fmtObj;
+    char *buffer;
+    int maxCount, i, approxSize, lastPos = -1;
+    const char *fmt = objPtr->bytes;
+    int maxFmtLen = objPtr->length;
+    const char *fmtEnd = fmt + maxFmtLen;
+    int curr;
+
+    Jim_FreeIntRep(interp, objPtr);
+    /* Count how many conversions could take place maximally */
+    for (i = 0, maxCount = 0; i < maxFmtLen; ++i)
+        if (fmt[i] == '%')
+            ++maxCount;
+    /* Calculate an approximation of the memory necessary */
+    approxSize = sizeof(ScanFmtStringObj)       /* Size of the container */
+        +(maxCount + 1) * sizeof(ScanFmtPartDescr)      /* Size of all partials */
+        +maxFmtLen * sizeof(char) + 3 + 1       /* Scratch + "%n" + '\0' */
+        + maxFmtLen * sizeof(char) + 1  /* Original stringrep */
+        + maxFmtLen * sizeof(char)      /* Arg for CHARSETs */
+        +(maxCount + 1) * sizeof(char)  /* '\0' for every partial */
+        +1;                     /* safety byte */
+    fmtObj = (ScanFmtStringObj *) Jim_Alloc(approxSize);
+    memset(fmtObj, 0, approxSize);
+    fmtObj->size = approxSize;
+    fmtObj->maxPos = 0;
+    fmtObj->scratch = (char *)&fmtObj->descr[maxCount + 1];
+    fmtObj->stringRep = fmtObj->scratch + maxFmtLen + 3 + 1;
+    memcpy(fmtObj->stringRep, fmt, maxFmtLen);
+    buffer = fmtObj->stringRep + maxFmtLen + 1;
+    objPtr->internalRep.ptr = fmtObj;
+    objPtr->typePtr = &scanFmtStringObjType;
+    for (i = 0, curr = 0; fmt < fmtEnd; ++fmt) {
+        int width = 0, skip;
+        ScanFmtPartDescr *descr = &fmtObj->descr[curr];
+
+        fmtObj->count++;
+        descr->width = 0;       /* Assume width unspecified */
+        /* Overread and store any "literal" prefix */
+        if (*fmt != '%' || fmt[1] == '%') {
+            descr->type = 0;
+            descr->prefix = &buffer[i];
+            for (; fmt < fmtEnd; ++fmt) {
+                if (*fmt == '%') {
+                    if (fmt[1] != '%')
+                        break;
+                    ++fmt;
+                }
+                buffer[i++] = *fmt;
+            }
+            buffer[i++] = 0;
+        }
+        /* Skip the conversion introducing '%' sign */
+        ++fmt;
+        /* End reached due to non-conversion literal only? */
+        if (fmt >= fmtEnd)
+            goto done;
+        descr->pos = 0;         /* Assume "natural" positioning */
+        if (*fmt == '*') {
+            descr->pos = -1;    /* Okay, conversion will not be assigned */
+            ++fmt;
+        }
+        else
+            fmtObj->convCount++;        /* Otherwise count as assign-conversion */
+        /* Check if next token is a number (could be width or pos */
+        if (sscanf(fmt, "%d%n", &width, &skip) == 1) {
+            fmt += skip;
+            /* Was the number a XPG3 position specifier? */
+            if (descr->pos != -1 && *fmt == '$') {
+                int prev;
+
+                ++fmt;
+                descr->pos = width;
+                width = 0;
+                /* Look if "natural" postioning and XPG3 one was mixed */
+                if ((lastPos == 0 && descr->pos > 0)
+                    || (lastPos > 0 && descr->pos == 0)) {
+                    fmtObj->error = "cannot mix \"%\" and \"%n$\" conversion specifiers";
+                    return JIM_ERR;
+                }
+                /* Look if this position was already used */
+                for (prev = 0; prev < curr; ++prev) {
+                    if (fmtObj->descr[prev].pos == -1)
+                        continue;
+                    if (fmtObj->descr[prev].pos == descr->pos) {
+                        fmtObj->error =
+                            "variable is assigned by multiple \"%n$\" conversion specifiers";
+                        return JIM_ERR;
+                    }
+                }
+                /* Try to find a width after the XPG3 specifier */
+                if (sscanf(fmt, "%d%n", &width, &skip) == 1) {
+                    descr->width = width;
+                    fmt += skip;
+                }
+                if (descr->pos > 0 && (size_t) descr->pos > fmtObj->maxPos)
+                    fmtObj->maxPos = descr->pos;
+            }
+            else {
+                /* Number was not a XPG3, so it has to be a width */
+                descr->width = width;
+            }
+        }
+        /* If positioning mode was undetermined yet, fix this */
+        if (lastPos == -1)
+            lastPos = descr->pos;
+        /* Handle CHARSET conversion type ... */
+        if (*fmt == '[') {
+            int swapped = 1, beg = i, end, j;
+
+            descr->type = '[';
+            descr->arg = &buffer[i];
+            ++fmt;
+            if (*fmt == '^')
+                buffer[i++] = *fmt++;
+            if (*fmt == ']')
+                buffer[i++] = *fmt++;
+            while (*fmt && *fmt != ']')
+                buffer[i++] = *fmt++;
+            if (*fmt != ']') {
+                fmtObj->error = "unmatched [ in format string";
+                return JIM_ERR;
+            }
+            end = i;
+            buffer[i++] = 0;
+            /* In case a range fence was given "backwards", swap it */
+            while (swapped) {
+                swapped = 0;
+                for (j = beg + 1; j < end - 1; ++j) {
+                    if (buffer[j] == '-' && buffer[j - 1] > buffer[j + 1]) {
+                        char tmp = buffer[j - 1];
+
+                        buffer[j - 1] = buffer[j + 1];
+                        buffer[j + 1] = tmp;
+                        swapped = 1;
+                    }
+                }
+            }
+        }
+        else {
+            /* Remember any valid modifier if given */
+            if (strchr("hlL", *fmt) != 0)
+                descr->modifier = tolower((int)*fmt++);
+
+            descr->type = *fmt;
+            if (strchr("efgcsndoxui", *fmt) == 0) {
+                fmtObj->error = "bad scan conversion character";
+                return JIM_ERR;
+            }
+            else if (*fmt == 'c' && descr->width != 0) {
+                fmtObj->error = "field width may not be specified in %c " "conversion";
+                return JIM_ERR;
+            }
+            else if (*fmt == 'u' && descr->modifier == 'l') {
+                fmtObj->error = "unsigned wide not supported";
+                return JIM_ERR;
+            }
+        }
+        curr++;
+    }
+  done:
+    return JIM_OK;
+}
+
+/* Some accessor macros to allow lowlevel access to fields of internal repr */
+
+#define FormatGetCnvCount(_fo_) \
+    ((ScanFmtStringObj*)((_fo_)->internalRep.ptr))->convCount
+#define FormatGetMaxPos(_fo_) \
+    ((ScanFmtStringObj*)((_fo_)->internalRep.ptr))->maxPos
+#define FormatGetError(_fo_) \
+    ((ScanFmtStringObj*)((_fo_)->internalRep.ptr))->error
+
+/* JimScanAString is used to scan an unspecified string that ends with
+ * next WS, or a string that is specified via a charset.
+ *
+ */
+static Jim_Obj *JimScanAString(Jim_Interp *interp, const char *sdescr, const char *str)
+{
+    char *buffer = Jim_StrDup(str);
+    char *p = buffer;
+
+    while (*str) {
+        int c;
+        int n;
+
+        if (!sdescr && isspace(UCHAR(*str)))
+            break;              /* EOS via WS if unspecified */
+
+        n = utf8_tounicode(str, &c);
+        if (sdescr && !JimCharsetMatch(sdescr, c, JIM_CHARSET_SCAN))
+            break;
+        while (n--)
+            *p++ = *str++;
+    }
+    *p = 0;
+    return Jim_NewStringObjNoAlloc(interp, buffer, p - buffer);
+}
+
+/* ScanOneEntry will scan one entry out of the string passed as argument.
+ * It use the sscanf() function for this task. After extracting and
+ * converting of the value, the count of scanned characters will be
+ * returned of -1 in case of no conversion tool place and string was
+ * already scanned thru */
+
+static int ScanOneEntry(Jim_Interp *interp, const char *str, int pos, int strLen,
+    ScanFmtStringObj * fmtObj, long idx, Jim_Obj **valObjPtr)
+{
+    const char *tok;
+    const ScanFmtPartDescr *descr = &fmtObj->descr[idx];
+    size_t scanned = 0;
+    size_t anchor = pos;
+    int i;
+    Jim_Obj *tmpObj = NULL;
+
+    /* First pessimistically assume, we will not scan anything :-) */
+    *valObjPtr = 0;
+    if (descr->prefix) {
+        /* There was a prefix given before the conversion, skip it and adjust
+         * the string-to-be-parsed accordingly */
+        for (i = 0; pos < strLen && descr->prefix[i]; ++i) {
+            /* If prefix require, skip WS */
+            if (isspace(UCHAR(descr->prefix[i])))
+                while (pos < strLen && isspace(UCHAR(str[pos])))
+                    ++pos;
+            else if (descr->prefix[i] != str[pos])
+                break;          /* Prefix do not match here, leave the loop */
+            else
+                ++pos;          /* Prefix matched so far, next round */
+        }
+        if (pos >= strLen) {
+            return -1;          /* All of str consumed: EOF condition */
+        }
+        else if (descr->prefix[i] != 0)
+            return 0;           /* Not whole prefix consumed, no conversion possible */
+    }
+    /* For all but following conversion, skip leading WS */
+    if (descr->type != 'c' && descr->type != '[' && descr->type != 'n')
+        while (isspace(UCHAR(str[pos])))
+            ++pos;
+    /* Determine how much skipped/scanned so far */
+    scanned = pos - anchor;
+
+    /* %c is a special, simple case. no width */
+    if (descr->type == 'n') {
+        /* Return pseudo conversion means: how much scanned so far? */
+        *valObjPtr = Jim_NewIntObj(interp, anchor + scanned);
+    }
+    else if (pos >= strLen) {
+        /* Cannot scan anything, as str is totally consumed */
+        return -1;
+    }
+    else if (descr->type == 'c') {
+            int c;
+            scanned += utf8_tounicode(&str[pos], &c);
+            *valObjPtr = Jim_NewIntObj(interp, c);
+            return scanned;
+    }
+    else {
+        /* Processing of conversions follows ... */
+        if (descr->width > 0) {
+            /* Do not try to scan as fas as possible but only the given width.
+             * To ensure this, we copy the part that should be scanned. */
+            size_t sLen = utf8_strlen(&str[pos], strLen - pos);
+            size_t tLen = descr->width > sLen ? sLen : descr->width;
+
+            tmpObj = Jim_NewStringObjUtf8(interp, str + pos, tLen);
+            tok = tmpObj->bytes;
+        }
+        else {
+            /* As no width was given, simply refer to the original string */
+            tok = &str[pos];
+        }
+        switch (descr->type) {
+            case 'd':
+            case 'o':
+            case 'x':
+            case 'u':
+            case 'i':{
+                    char *endp; /* Position where the number finished */
+                    jim_wide w;
+
+                    int base = descr->type == 'o' ? 8
+                        : descr->type == 'x' ? 16 : descr->type == 'i' ? 0 : 10;
+
+                    /* Try to scan a number with the given base */
+                    if (base == 0) {
+                        w = jim_strtoull(tok, &endp);
+                    }
+                    else {
+                        w = strtoull(tok, &endp, base);
+                    }
+
+                    if (endp != tok) {
+                        /* There was some number sucessfully scanned! */
+                        *valObjPtr = Jim_NewIntObj(interp, w);
+
+                        /* Adjust the number-of-chars scanned so far */
+                        scanned += endp - tok;
+                    }
+                    else {
+                        /* Nothing was scanned. We have to determine if this
+                         * happened due to e.g. prefix mismatch or input str
+                         * exhausted */
+                        scanned = *tok ? 0 : -1;
+                    }
+                    break;
+                }
+            case 's':
+            case '[':{
+                    *valObjPtr = JimScanAString(interp, descr->arg, tok);
+                    scanned += Jim_Length(*valObjPtr);
+                    break;
+                }
+            case 'e':
+            case 'f':
+            case 'g':{
+                    char *endp;
+                    double value = strtod(tok, &endp);
+
+                    if (endp != tok) {
+                        /* There was some number sucessfully scanned! */
+                        *valObjPtr = Jim_NewDoubleObj(interp, value);
+                        /* Adjust the number-of-chars scanned so far */
+                        scanned += endp - tok;
+                    }
+                    else {
+                        /* Nothing was scanned. We have to determine if this
+                         * happened due to e.g. prefix mismatch or input str
+                         * exhausted */
+                        scanned = *tok ? 0 : -1;
+                    }
+                    break;
+                }
+        }
+        /* If a substring was allocated (due to pre-defined width) do not
+         * forget to free it */
+        if (tmpObj) {
+            Jim_FreeNewObj(interp, tmpObj);
+        }
+    }
+    return scanned;
+}
+
+/* Jim_ScanString is the workhorse of string scanning. It will scan a given
+ * string and returns all converted (and not ignored) values in a list back
+ * to the caller. If an error occured, a NULL pointer will be returned */
+
+Jim_Obj *Jim_ScanString(Jim_Interp *interp, Jim_Obj *strObjPtr, Jim_Obj *fmtObjPtr, int flags)
+{
+    size_t i, pos;
+    int scanned = 1;
+    const char *str = Jim_String(strObjPtr);
+    int strLen = Jim_Utf8Length(interp, strObjPtr);
+    Jim_Obj *resultList = 0;
+    Jim_Obj **resultVec = 0;
+    int resultc;
+    Jim_Obj *emptyStr = 0;
+    ScanFmtStringObj *fmtObj;
+
+    /* This should never happen. The format object should already be of the correct type */
+    JimPanic((fmtObjPtr->typePtr != &scanFmtStringObjType, "Jim_ScanString() for non-scan format"));
+
+    fmtObj = (ScanFmtStringObj *) fmtObjPtr->internalRep.ptr;
+    /* Check if format specification was valid */
+    if (fmtObj->error != 0) {
+        if (flags & JIM_ERRMSG)
+            Jim_SetResultString(interp, fmtObj->error, -1);
+        return 0;
+    }
+    /* Allocate a new "shared" empty string for all unassigned conversions */
+    emptyStr = Jim_NewEmptyStringObj(interp);
+    Jim_IncrRefCount(emptyStr);
+    /* Create a list and fill it with empty strings up to max specified XPG3 */
+    resultList = Jim_NewListObj(interp, NULL, 0);
+    if (fmtObj->maxPos > 0) {
+        for (i = 0; i < fmtObj->maxPos; ++i)
+            Jim_ListAppendElement(interp, resultList, emptyStr);
+        JimListGetElements(interp, resultList, &resultc, &resultVec);
+    }
+    /* Now handle every partial format description */
+    for (i = 0, pos = 0; i < fmtObj->count; ++i) {
+        ScanFmtPartDescr *descr = &(fmtObj->descr[i]);
+        Jim_Obj *value = 0;
+
+        /* Only last type may be "literal" w/o conversion - skip it! */
+        if (descr->type == 0)
+            continue;
+        /* As long as any conversion could be done, we will proceed */
+        if (scanned > 0)
+            scanned = ScanOneEntry(interp, str, pos, strLen, fmtObj, i, &value);
+        /* In case our first try results in EOF, we will leave */
+        if (scanned == -1 && i == 0)
+            goto eof;
+        /* Advance next pos-to-be-scanned for the amount scanned already */
+        pos += scanned;
+
+        /* value == 0 means no conversion took place so take empty string */
+        if (value == 0)
+            value = Jim_NewEmptyStringObj(interp);
+        /* If value is a non-assignable one, skip it */
+        if (descr->pos == -1) {
+            Jim_FreeNewObj(interp, value);
+        }
+        else if (descr->pos == 0)
+            /* Otherwise append it to the result list if no XPG3 was given */
+            Jim_ListAppendElement(interp, resultList, value);
+        else if (resultVec[descr->pos - 1] == emptyStr) {
+            /* But due to given XPG3, put the value into the corr. slot */
+            Jim_DecrRefCount(interp, resultVec[descr->pos - 1]);
+            Jim_IncrRefCount(value);
+            resultVec[descr->pos - 1] = value;
+        }
+        else {
+            /* Otherwise, the slot was already used - free obj and ERROR */
+            Jim_FreeNewObj(interp, value);
+            goto err;
+        }
+    }
+    Jim_DecrRefCount(interp, emptyStr);
+    return resultList;
+  eof:
+    Jim_DecrRefCount(interp, emptyStr);
+    Jim_FreeNewObj(interp, resultList);
+    return (Jim_Obj *)EOF;
+  err:
+    Jim_DecrRefCount(interp, emptyStr);
+    Jim_FreeNewObj(interp, resultList);
+    return 0;
+}
+
+/* -----------------------------------------------------------------------------
+ * Pseudo Random Number Generation
+ * ---------------------------------------------------------------------------*/
+/* Initialize the sbox with the numbers from 0 to 255 */
+static void JimPrngInit(Jim_Interp *interp)
+{
+#define PRNG_SEED_SIZE 256
+    int i;
+    unsigned int *seed;
+    time_t t = time(NULL);
+
+    interp->prngState = Jim_Alloc(sizeof(Jim_PrngState));
+
+    seed = Jim_Alloc(PRNG_SEED_SIZE * sizeof(*seed));
+    for (i = 0; i < PRNG_SEED_SIZE; i++) {
+        seed[i] = (rand() ^ t ^ clock());
+    }
+    JimPrngSeed(interp, (unsigned char *)seed, PRNG_SEED_SIZE * sizeof(*seed));
+    Jim_Free(seed);
+}
+
+/* Generates N bytes of random data */
+static void JimRandomBytes(Jim_Interp *interp, void *dest, unsigned int len)
+{
+    Jim_PrngState *prng;
+    unsigned char *destByte = (unsigned char *)dest;
+    unsigned int si, sj, x;
+
+    /* initialization, only needed the first time */
+    if (interp->prngState == NULL)
+        JimPrngInit(interp);
+    prng = interp->prngState;
+    /* generates 'len' bytes of pseudo-random numbers */
+    for (x = 0; x < len; x++) {
+        prng->i = (prng->i + 1) & 0xff;
+        si = prng->sbox[prng->i];
+        prng->j = (prng->j + si) & 0xff;
+        sj = prng->sbox[prng->j];
+        prng->sbox[prng->i] = sj;
+        prng->sbox[prng->j] = si;
+        *destByte++ = prng->sbox[(si + sj) & 0xff];
+    }
+}
+
+/* Re-seed the generator with user-provided bytes */
+static void JimPrngSeed(Jim_Interp *interp, unsigned char *seed, int seedLen)
+{
+    int i;
+    Jim_PrngState *prng;
+
+    /* initialization, only needed the first time */
+    if (interp->prngState == NULL)
+        JimPrngInit(interp);
+    prng = interp->prngState;
+
+    /* Set the sbox[i] with i */
+    for (i = 0; i < 256; i++)
+        prng->sbox[i] = i;
+    /* Now use the seed to perform a random permutation of the sbox */
+    for (i = 0; i < seedLen; i++) {
+        unsigned char t;
+
+        t = prng->sbox[i & 0xFF];
+        prng->sbox[i & 0xFF] = prng->sbox[seed[i]];
+        prng->sbox[seed[i]] = t;
+    }
+    prng->i = prng->j = 0;
 
-            descr->type = '[';
-            descr->arg = &buffer[i];
-            ++fmt;
-            if (*fmt == '^')
-                buffer[i++] = *fmt++;
-            if (*fmt == ']')
-                buffer[i++] = *fmt++;
-            while (*fmt && *fmt != ']')
-                buffer[i++] = *fmt++;
-            if (*fmt != ']') {
-                fmtObj->error = "unmatched [ in format string";
-                return JIM_ERR;
-            }
-            end = i;
-            buffer[i++] = 0;
-            /* In case a range fence was given "backwards", swap it */
-            while (swapped) {
-                swapped = 0;
-                for (j = beg + 1; j < end - 1; ++j) {
-                    if (buffer[j] == '-' && buffer[j - 1] > buffer[j + 1]) {
-                        char tmp = buffer[j - 1];
+    /* discard at least the first 256 bytes of stream.
+     * borrow the seed buffer for this
+     */
+    for (i = 0; i < 256; i += seedLen) {
+        JimRandomBytes(interp, seed, seedLen);
+    }
+}
 
-                        buffer[j - 1] = buffer[j + 1];
-                        buffer[j + 1] = tmp;
-                        swapped = 1;
-                    }
-                }
-            }
+/* [incr] */
+static int Jim_IncrCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    jim_wide wideValue, increment = 1;
+    Jim_Obj *intObjPtr;
+
+    if (argc != 2 && argc != 3) {
+        Jim_WrongNumArgs(interp, 1, argv, "varName ?increment?");
+        return JIM_ERR;
+    }
+    if (argc == 3) {
+        if (Jim_GetWide(interp, argv[2], &increment) != JIM_OK)
+            return JIM_ERR;
+    }
+    intObjPtr = Jim_GetVariable(interp, argv[1], JIM_UNSHARED);
+    if (!intObjPtr) {
+        /* Set missing variable to 0 */
+        wideValue = 0;
+    }
+    else if (Jim_GetWide(interp, intObjPtr, &wideValue) != JIM_OK) {
+        return JIM_ERR;
+    }
+    if (!intObjPtr || Jim_IsShared(intObjPtr)) {
+        intObjPtr = Jim_NewIntObj(interp, wideValue + increment);
+        if (Jim_SetVariable(interp, argv[1], intObjPtr) != JIM_OK) {
+            Jim_FreeNewObj(interp, intObjPtr);
+            return JIM_ERR;
         }
-        else {
-            /* Remember any valid modifier if given */
-            if (strchr("hlL", *fmt) != 0)
-                descr->modifier = tolower((int)*fmt++);
+    }
+    else {
+        /* Can do it the quick way */
+        Jim_InvalidateStringRep(intObjPtr);
+        JimWideValue(intObjPtr) = wideValue + increment;
 
-            descr->type = *fmt;
-            if (strchr("efgcsndoxui", *fmt) == 0) {
-                fmtObj->error = "bad scan conversion character";
-                return JIM_ERR;
-            }
-            else if (*fmt == 'c' && descr->width != 0) {
-                fmtObj->error = "field width may not be specified in %c " "conversion";
-                return JIM_ERR;
-            }
-            else if (*fmt == 'u' && descr->modifier == 'l') {
-                fmtObj->error = "unsigned wide not supported";
-                return JIM_ERR;
-            }
+        /* The following step is required in order to invalidate the
+         * string repr of "FOO" if the var name is on the form of "FOO(IDX)" */
+        if (argv[1]->typePtr != &variableObjType) {
+            /* Note that this can't fail since GetVariable already succeeded */
+            Jim_SetVariable(interp, argv[1], intObjPtr);
         }
-        curr++;
     }
-  done:
+    Jim_SetResult(interp, intObjPtr);
     return JIM_OK;
 }
 
-/* Some accessor macros to allow lowlevel access to fields of internal repr */
 
-#define FormatGetCnvCount(_fo_) \
-    ((ScanFmtStringObj*)((_fo_)->internalRep.ptr))->convCount
-#define FormatGetMaxPos(_fo_) \
-    ((ScanFmtStringObj*)((_fo_)->internalRep.ptr))->maxPos
-#define FormatGetError(_fo_) \
-    ((ScanFmtStringObj*)((_fo_)->internalRep.ptr))->error
+/* -----------------------------------------------------------------------------
+ * Profiler
+ * ---------------------------------------------------------------------------*/
 
-/* JimScanAString is used to scan an unspecified string that ends with
- * next WS, or a string that is specified via a charset.
- *
- */
-static Jim_Obj *JimScanAString(Jim_Interp *interp, const char *sdescr, const char *str)
+/* Calls from one command to another */
+typedef struct JimProfileCallee {
+    jim_wide calls;
+    jim_wide time;              /* Inclusive time of these calls, in ns */
+} JimProfileCallee;
+
+typedef struct JimProfileEntry {
+    const char *name;           /* The key of this entry */
+    jim_wide calls;
+    jim_wide inclusive;         /* ns, not counting recursive calls twice */
+    jim_wide exclusive;         /* ns, not including time in other commands */
+    int active;                 /* Invocations currently on the profile stack */
+    Jim_HashTable callees;      /* callee name -> JimProfileCallee */
+} JimProfileEntry;
+
+typedef struct JimProfileFrame {
+    JimProfileEntry *entry;
+    jim_wide serial;            /* Identifies the invocation */
+    jim_wide start;
+    jim_wide children;          /* Time spent in commands called from this one */
+} JimProfileFrame;
+
+struct JimProfiler {
+    int running;
+    Jim_HashTable entries;      /* command name -> JimProfileEntry */
+    JimProfileFrame *stack;
+    int depth;
+    int stackLen;
+    jim_wide serial;
+    int sampling;               /* The sampling profiler is running */
+    Jim_HashTable samples;      /* collapsed stack -> JimProfileSample */
+#ifdef HAVE_SETITIMER
+    struct sigaction oldAction; /* SIGPROF handler to restore */
+#endif
+};
+
+typedef struct JimProfileSample {
+    jim_wide count;
+} JimProfileSample;
+
+static void JimProfileFreeVal(void *privdata, void *val)
 {
-    char *buffer = Jim_StrDup(str);
-    char *p = buffer;
+    JIM_NOTUSED(privdata);
+    Jim_Free(val);
+}
 
-    while (*str) {
-        int c;
-        int n;
+static const Jim_HashTableType JimProfileCalleeHashTableType = {
+    JimStringCopyHTHashFunction,     /* hash function */
+    JimStringCopyHTDup,              /* key dup */
+    NULL,                            /* val dup */
+    JimStringCopyHTKeyCompare,       /* key compare */
+    JimStringCopyHTKeyDestructor,    /* key destructor */
+    JimProfileFreeVal                /* val destructor */
+};
 
-        if (!sdescr && isspace(UCHAR(*str)))
-            break;              /* EOS via WS if unspecified */
+static const Jim_HashTableType JimProfileSampleHashTableType = {
+    JimStringCopyHTHashFunction,     /* hash function */
+    JimStringCopyHTDup,              /* key dup */
+    NULL,                            /* val dup */
+    JimStringCopyHTKeyCompare,       /* key compare */
+    JimStringCopyHTKeyDestructor,    /* key destructor */
+    JimProfileFreeVal                /* val destructor */
+};
 
-        n = utf8_tounicode(str, &c);
-        if (sdescr && !JimCharsetMatch(sdescr, c, JIM_CHARSET_SCAN))
-            break;
-        while (n--)
-            *p++ = *str++;
+static void JimProfileEntryDestructor(void *privdata, void *val)
+{
+    JimProfileEntry *entry = val;
+
+    JIM_NOTUSED(privdata);
+    Jim_FreeHashTable(&entry->callees);
+    Jim_Free(entry);
+}
+
+static const Jim_HashTableType JimProfileEntryHashTableType = {
+    JimStringCopyHTHashFunction,     /* hash function */
+    JimStringCopyHTDup,              /* key dup */
+    NULL,                            /* val dup */
+    JimStringCopyHTKeyCompare,       /* key compare */
+    JimStringCopyHTKeyDestructor,    /* key destructor */
+    JimProfileEntryDestructor        /* val destructor */
+};
+
+static void JimSampleStop(struct JimProfiler *prof);
+
+/* Discards any invocations in progress */
+static void JimProfileClearStack(struct JimProfiler *prof)
+{
+    while (prof->depth) {
+        prof->stack[--prof->depth].entry->active--;
     }
-    *p = 0;
-    return Jim_NewStringObjNoAlloc(interp, buffer, p - buffer);
 }
 
-/* ScanOneEntry will scan one entry out of the string passed as argument.
- * It use the sscanf() function for this task. After extracting and
- * converting of the value, the count of scanned characters will be
- * returned of -1 in case of no conversion tool place and string was
- * already scanned thru */
+static void JimProfileReset(struct JimProfiler *prof)
+{
+    JimProfileClearStack(prof);
+    Jim_FreeHashTable(&prof->entries);
+    Jim_InitHashTable(&prof->entries, &JimProfileEntryHashTableType, NULL);
+}
 
-static int ScanOneEntry(Jim_Interp *interp, const char *str, int pos, int strLen,
-    ScanFmtStringObj * fmtObj, long idx, Jim_Obj **valObjPtr)
+static void JimFreeProfiler(struct JimProfiler *prof)
 {
-    const char *tok;
-    const ScanFmtPartDescr *descr = &fmtObj->descr[idx];
-    size_t scanned = 0;
-    size_t anchor = pos;
+    if (prof) {
+        JimSampleStop(prof);
+        Jim_FreeHashTable(&prof->entries);
+        Jim_FreeHashTable(&prof->samples);
+        Jim_Free(prof->stack);
+        Jim_Free(prof);
+    }
+}
+
+/**
+ * Called before the command 'nameObj' is invoked.
+ * Returns a serial number to pass to JimProfileLeave().
+ */
+static jim_wide JimProfileEnter(Jim_Interp *interp, Jim_Obj *nameObj)
+{
+    struct JimProfiler *prof = interp->profiler;
+    const char *name = Jim_String(nameObj);
+    JimProfileEntry *entry;
+    JimProfileFrame *frame;
+    Jim_HashEntry *he;
+
+    he = Jim_FindHashEntry(&prof->entries, name);
+    if (he) {
+        entry = Jim_GetHashEntryVal(he);
+    }
+    else {
+        entry = Jim_Alloc(sizeof(*entry));
+        memset(entry, 0, sizeof(*entry));
+        Jim_InitHashTable(&entry->callees, &JimProfileCalleeHashTableType, NULL);
+        he = JimInsertHashEntry(&prof->entries, name, 0);
+        Jim_SetHashKey(&prof->entries, he, name);
+        Jim_SetHashVal(&prof->entries, he, entry);
+        entry->name = Jim_GetHashEntryKey(he);
+    }
+
+    if (prof->depth == prof->stackLen) {
+        prof->stackLen = prof->stackLen * 2 + 16;
+        prof->stack = Jim_Realloc(prof->stack, sizeof(*prof->stack) * prof->stackLen);
+    }
+    frame = &prof->stack[prof->depth++];
+    frame->entry = entry;
+    frame->serial = ++prof->serial;
+    frame->children = 0;
+    entry->active++;
+    frame->start = JimMonotonicClock();
+    return frame->serial;
+}
+
+/**
+ * Called after the command invocation identified by 'serial' returns.
+ *
+ * Normally this is the innermost invocation. But if profiling was restarted,
+ * or a coroutine yielded, the invocation may be further down the stack (in which
+ * case the invocations above it are discarded), or missing (in which case it is ignored).
+ */
+static void JimProfileLeave(Jim_Interp *interp, jim_wide serial)
+{
+    jim_wide end = JimMonotonicClock();
+    struct JimProfiler *prof = interp->profiler;
+    JimProfileFrame *frame;
+    JimProfileEntry *entry;
+    jim_wide elapsed;
     int i;
-    Jim_Obj *tmpObj = NULL;
 
-    /* First pessimistically assume, we will not scan anything :-) */
-    *valObjPtr = 0;
-    if (descr->prefix) {
-        /* There was a prefix given before the conversion, skip it and adjust
-         * the string-to-be-parsed accordingly */
-        for (i = 0; pos < strLen && descr->prefix[i]; ++i) {
-            /* If prefix require, skip WS */
-            if (isspace(UCHAR(descr->prefix[i])))
-                while (pos < strLen && isspace(UCHAR(str[pos])))
-                    ++pos;
-            else if (descr->prefix[i] != str[pos])
-                break;          /* Prefix do not match here, leave the loop */
-            else
-                ++pos;          /* Prefix matched so far, next round */
+    for (i = prof->depth - 1; i >= 0 && prof->stack[i].serial > serial; i--) {
+    }
+    if (i < 0 || prof->stack[i].serial != serial) {
+        return;
+    }
+    while (prof->depth > i + 1) {
+        prof->stack[--prof->depth].entry->active--;
+    }
+
+    frame = &prof->stack[--prof->depth];
+    entry = frame->entry;
+    elapsed = end - frame->start;
+
+    entry->calls++;
+    entry->exclusive += elapsed - frame->children;
+    if (--entry->active == 0) {
+        entry->inclusive += elapsed;
+    }
+
+    if (prof->depth) {
+        JimProfileFrame *parent = &prof->stack[prof->depth - 1];
+        JimProfileCallee *callee;
+        Jim_HashEntry *he;
+
+        parent->children += elapsed;
+        he = Jim_FindHashEntry(&parent->entry->callees, entry->name);
+        if (he) {
+            callee = Jim_GetHashEntryVal(he);
         }
-        if (pos >= strLen) {
-            return -1;          /* All of str consumed: EOF condition */
+        else {
+            callee = Jim_Alloc(sizeof(*callee));
+            memset(callee, 0, sizeof(*callee));
+            Jim_AddHashEntry(&parent->entry->callees, entry->name, callee);
         }
-        else if (descr->prefix[i] != 0)
-            return 0;           /* Not whole prefix consumed, no conversion possible */
+        callee->calls++;
+        callee->time += elapsed;
     }
-    /* For all but following conversion, skip leading WS */
-    if (descr->type != 'c' && descr->type != '[' && descr->type != 'n')
-        while (isspace(UCHAR(str[pos])))
-            ++pos;
-    /* Determine how much skipped/scanned so far */
-    scanned = pos - anchor;
+}
 
-    /* %c is a special, simple case. no width */
-    if (descr->type == 'n') {
-        /* Return pseudo conversion means: how much scanned so far? */
-        *valObjPtr = Jim_NewIntObj(interp, anchor + scanned);
-    }
-    else if (pos >= strLen) {
-        /* Cannot scan anything, as str is totally consumed */
-        return -1;
+static int JimProfileCompareName(const void *a, const void *b)
+{
+    return strcmp((*(JimProfileEntry **)a)->name, (*(JimProfileEntry **)b)->name);
+}
+
+/* Largest first, then by name */
+static int JimProfileCompareWide(const void *a, const void *b, jim_wide wa, jim_wide wb)
+{
+    if (wa != wb) {
+        return wa < wb ? 1 : -1;
     }
-    else if (descr->type == 'c') {
-            int c;
-            scanned += utf8_tounicode(&str[pos], &c);
-            *valObjPtr = Jim_NewIntObj(interp, c);
-            return scanned;
+    return JimProfileCompareName(a, b);
+}
+
+static int JimProfileCompareCalls(const void *a, const void *b)
+{
+    return JimProfileCompareWide(a, b, (*(JimProfileEntry **)a)->calls, (*(JimProfileEntry **)b)->calls);
+}
+
+static int JimProfileCompareInclusive(const void *a, const void *b)
+{
+    return JimProfileCompareWide(a, b, (*(JimProfileEntry **)a)->inclusive, (*(JimProfileEntry **)b)->inclusive);
+}
+
+static int JimProfileCompareExclusive(const void *a, const void *b)
+{
+    return JimProfileCompareWide(a, b, (*(JimProfileEntry **)a)->exclusive, (*(JimProfileEntry **)b)->exclusive);
+}
+
+/* Returns an array of the profile entries, sorted with 'compare' */
+static JimProfileEntry **JimProfileSortedEntries(struct JimProfiler *prof, int (*compare)(const void *, const void *))
+{
+    JimProfileEntry **entries = Jim_Alloc(sizeof(*entries) * (prof->entries.used + 1));
+    Jim_HashTableIterator htiter;
+    Jim_HashEntry *he;
+    int n = 0;
+
+    JimInitHashTableIterator(&prof->entries, &htiter);
+    while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
+        entries[n++] = Jim_GetHashEntryVal(he);
     }
-    else {
-        /* Processing of conversions follows ... */
-        if (descr->width > 0) {
-            /* Do not try to scan as fas as possible but only the given width.
-             * To ensure this, we copy the part that should be scanned. */
-            size_t sLen = utf8_strlen(&str[pos], strLen - pos);
-            size_t tLen = descr->width > sLen ? sLen : descr->width;
+    qsort(entries, n, sizeof(*entries), compare);
+    return entries;
+}
 
-            tmpObj = Jim_NewStringObjUtf8(interp, str + pos, tLen);
-            tok = tmpObj->bytes;
+/**
+ * Returns a list of command names and profile information (a dict) for each,
+ * sorted with 'compare'. Times are in microseconds.
+ */
+static Jim_Obj *JimProfileReport(Jim_Interp *interp, struct JimProfiler *prof, int (*compare)(const void *, const void *))
+{
+    JimProfileEntry **entries = JimProfileSortedEntries(prof, compare);
+    Jim_Obj *reportObj = Jim_NewListObj(interp, NULL, 0);
+    int i;
+
+    for (i = 0; i < prof->entries.used; i++) {
+        JimProfileEntry *entry = entries[i];
+        Jim_Obj *entryObj;
+        Jim_Obj *calleesObj;
+        Jim_HashTableIterator htiter;
+        Jim_HashEntry *he;
+
+        if (entry->calls == 0) {
+            /* Never returned while profiling */
+            continue;
         }
-        else {
-            /* As no width was given, simply refer to the original string */
-            tok = &str[pos];
+        entryObj = Jim_NewListObj(interp, NULL, 0);
+        calleesObj = Jim_NewListObj(interp, NULL, 0);
+
+        JimInitHashTableIterator(&entry->callees, &htiter);
+        while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
+            JimProfileCallee *callee = Jim_GetHashEntryVal(he);
+            Jim_Obj *calleeObj = Jim_NewListObj(interp, NULL, 0);
+
+            Jim_ListAppendElement(interp, calleeObj, Jim_NewStringObj(interp, "calls", -1));
+            Jim_ListAppendElement(interp, calleeObj, Jim_NewIntObj(interp, callee->calls));
+            Jim_ListAppendElement(interp, calleeObj, Jim_NewStringObj(interp, "time", -1));
+            Jim_ListAppendElement(interp, calleeObj, Jim_NewIntObj(interp, callee->time / 1000));
+            Jim_ListAppendElement(interp, calleesObj, Jim_NewStringObj(interp, Jim_GetHashEntryKey(he), -1));
+            Jim_ListAppendElement(interp, calleesObj, calleeObj);
         }
-        switch (descr->type) {
-            case 'd':
-            case 'o':
-            case 'x':
-            case 'u':
-            case 'i':{
-                    char *endp; /* Position where the number finished */
-                    jim_wide w;
 
-                    int base = descr->type == 'o' ? 8
-                        : descr->type == 'x' ? 16 : descr->type == 'i' ? 0 : 10;
+        Jim_ListAppendElement(interp, entryObj, Jim_NewStringObj(interp, "calls", -1));
+        Jim_ListAppendElement(interp, entryObj, Jim_NewIntObj(interp, entry->calls));
+        Jim_ListAppendElement(interp, entryObj, Jim_NewStringObj(interp, "inclusive", -1));
+        Jim_ListAppendElement(interp, entryObj, Jim_NewIntObj(interp, entry->inclusive / 1000));
+        Jim_ListAppendElement(interp, entryObj, Jim_NewStringObj(interp, "exclusive", -1));
+        Jim_ListAppendElement(interp, entryObj, Jim_NewIntObj(interp, entry->exclusive / 1000));
+        Jim_ListAppendElement(interp, entryObj, Jim_NewStringObj(interp, "callees", -1));
+        Jim_ListAppendElement(interp, entryObj, calleesObj);
+        Jim_ListAppendElement(interp, reportObj, Jim_NewStringObj(interp, entry->name, -1));
+        Jim_ListAppendElement(interp, reportObj, entryObj);
+    }
+    Jim_Free(entries);
+    return reportObj;
+}
 
-                    /* Try to scan a number with the given base */
-                    if (base == 0) {
-                        w = jim_strtoull(tok, &endp);
-                    }
-                    else {
-                        w = strtoull(tok, &endp, base);
-                    }
+/* Writes the profile in callgrind format, for use with tools such as kcachegrind */
+static int JimProfileWriteCallgrind(Jim_Interp *interp, struct JimProfiler *prof, Jim_Obj *filenameObj)
+{
+    JimProfileEntry **entries;
+    FILE *fh;
+    int i;
 
-                    if (endp != tok) {
-                        /* There was some number sucessfully scanned! */
-                        *valObjPtr = Jim_NewIntObj(interp, w);
+    fh = fopen(Jim_String(filenameObj), "w");
+    if (fh == NULL) {
+        Jim_SetResultFormatted(interp, "couldn't open \"%#s\": %s", filenameObj, strerror(errno));
+        return JIM_ERR;
+    }
+    entries = JimProfileSortedEntries(prof, JimProfileCompareName);
 
-                        /* Adjust the number-of-chars scanned so far */
-                        scanned += endp - tok;
-                    }
-                    else {
-                        /* Nothing was scanned. We have to determine if this
-                         * happened due to e.g. prefix mismatch or input str
-                         * exhausted */
-                        scanned = *tok ? 0 : -1;
-                    }
-                    break;
-                }
-            case 's':
-            case '[':{
-                    *valObjPtr = JimScanAString(interp, descr->arg, tok);
-                    scanned += Jim_Length(*valObjPtr);
-                    break;
-                }
-            case 'e':
-            case 'f':
-            case 'g':{
-                    char *endp;
-                    double value = strtod(tok, &endp);
+    fprintf(fh, "# callgrind format\nversion: 1\ncreator: jim\n");
+    fprintf(fh, "event: ns : Time (ns)\nevents: ns\n\n");
+    for (i = 0; i < prof->entries.used; i++) {
+        Jim_HashTableIterator htiter;
+        Jim_HashEntry *he;
 
-                    if (endp != tok) {
-                        /* There was some number sucessfully scanned! */
-                        *valObjPtr = Jim_NewDoubleObj(interp, value);
-                        /* Adjust the number-of-chars scanned so far */
-                        scanned += endp - tok;
-                    }
-                    else {
-                        /* Nothing was scanned. We have to determine if this
-                         * happened due to e.g. prefix mismatch or input str
-                         * exhausted */
-                        scanned = *tok ? 0 : -1;
-                    }
-                    break;
-                }
+        if (entries[i]->calls == 0) {
+            continue;
         }
-        /* If a substring was allocated (due to pre-defined width) do not
-         * forget to free it */
-        if (tmpObj) {
-            Jim_FreeNewObj(interp, tmpObj);
+        fprintf(fh, "fn=%s\n0 %" JIM_WIDE_MODIFIER "\n", entries[i]->name, entries[i]->exclusive);
+        JimInitHashTableIterator(&entries[i]->callees, &htiter);
+        while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
+            JimProfileCallee *callee = Jim_GetHashEntryVal(he);
+
+            fprintf(fh, "cfn=%s\ncalls=%" JIM_WIDE_MODIFIER " 0\n0 %" JIM_WIDE_MODIFIER "\n",
+                (const char *)Jim_GetHashEntryKey(he), callee->calls, callee->time);
         }
+        fputc('\n', fh);
     }
-    return scanned;
+    Jim_Free(entries);
+
+    if (fclose(fh) != 0) {
+        Jim_SetResultFormatted(interp, "error writing \"%#s\": %s", filenameObj, strerror(errno));
+        return JIM_ERR;
+    }
+    return JIM_OK;
 }
 
-/* Jim_ScanString is the workhorse of string scanning. It will scan a given
- * string and returns all converted (and not ignored) values in a list back
- * to the caller. If an error occured, a NULL pointer will be returned */
+/* The sampling profiler.
+ *
+ * SIGPROF only counts ticks, since the interpreter can't safely be examined
+ * from a signal handler. Ticks are recorded when the next command returns,
+ * along with the proc call stack and the name of that command.
+ */
+static volatile sig_atomic_t JimSampleTicks;
+static Jim_Interp *JimSamplingInterp;
 
-Jim_Obj *Jim_ScanString(Jim_Interp *interp, Jim_Obj *strObjPtr, Jim_Obj *fmtObjPtr, int flags)
+#ifdef JIM_THREADS
+/* SIGPROF and the timer are process wide, so only one interp, on any thread, may own them */
+static pthread_mutex_t JimSampleMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+#ifdef HAVE_SETITIMER
+static void JimSampleSignalHandler(int sig)
 {
-    size_t i, pos;
-    int scanned = 1;
-    const char *str = Jim_String(strObjPtr);
-    int strLen = Jim_Utf8Length(interp, strObjPtr);
-    Jim_Obj *resultList = 0;
-    Jim_Obj **resultVec = 0;
-    int resultc;
-    Jim_Obj *emptyStr = 0;
-    ScanFmtStringObj *fmtObj;
+    JimSampleTicks++;
+}
+#endif
 
-    /* This should never happen. The format object should already be of the correct type */
-    JimPanic((fmtObjPtr->typePtr != &scanFmtStringObjType, "Jim_ScanString() for non-scan format"));
+static int JimSampleStart(Jim_Interp *interp, struct JimProfiler *prof, long hz)
+{
+#ifdef HAVE_SETITIMER
+    struct itimerval it;
 
-    fmtObj = (ScanFmtStringObj *) fmtObjPtr->internalRep.ptr;
-    /* Check if format specification was valid */
-    if (fmtObj->error != 0) {
-        if (flags & JIM_ERRMSG)
-            Jim_SetResultString(interp, fmtObj->error, -1);
-        return 0;
+    if (hz <= 0 || hz > 100000) {
+        Jim_SetResultString(interp, "sample rate must be between 1 and 100000", -1);
+        return JIM_ERR;
     }
-    /* Allocate a new "shared" empty string for all unassigned conversions */
-    emptyStr = Jim_NewEmptyStringObj(interp);
-    Jim_IncrRefCount(emptyStr);
-    /* Create a list and fill it with empty strings up to max specified XPG3 */
-    resultList = Jim_NewListObj(interp, NULL, 0);
-    if (fmtObj->maxPos > 0) {
-        for (i = 0; i < fmtObj->maxPos; ++i)
-            Jim_ListAppendElement(interp, resultList, emptyStr);
-        JimListGetElements(interp, resultList, &resultc, &resultVec);
+#ifdef JIM_THREADS
+    pthread_mutex_lock(&JimSampleMutex);
+#endif
+    if (JimSamplingInterp && JimSamplingInterp != interp) {
+#ifdef JIM_THREADS
+        pthread_mutex_unlock(&JimSampleMutex);
+#endif
+        Jim_SetResultString(interp, "sampling is already running in another interpreter", -1);
+        return JIM_ERR;
     }
-    /* Now handle every partial format description */
-    for (i = 0, pos = 0; i < fmtObj->count; ++i) {
-        ScanFmtPartDescr *descr = &(fmtObj->descr[i]);
-        Jim_Obj *value = 0;
+    if (!prof->sampling) {
+        struct sigaction sa;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = JimSampleSignalHandler;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGPROF, &sa, &prof->oldAction);
+    }
+    it.it_interval.tv_sec = hz == 1;
+    it.it_interval.tv_usec = hz == 1 ? 0 : 1000000 / hz;
+    it.it_value = it.it_interval;
+    setitimer(ITIMER_PROF, &it, NULL);
+
+    JimSamplingInterp = interp;
+    JimSampleTicks = 0;
+    prof->sampling = 1;
+#ifdef JIM_THREADS
+    pthread_mutex_unlock(&JimSampleMutex);
+#endif
+    return JIM_OK;
+#else
+    Jim_SetResultString(interp, "sampling is not supported on this platform", -1);
+    return JIM_ERR;
+#endif
+}
 
-        /* Only last type may be "literal" w/o conversion - skip it! */
-        if (descr->type == 0)
-            continue;
-        /* As long as any conversion could be done, we will proceed */
-        if (scanned > 0)
-            scanned = ScanOneEntry(interp, str, pos, strLen, fmtObj, i, &value);
-        /* In case our first try results in EOF, we will leave */
-        if (scanned == -1 && i == 0)
-            goto eof;
-        /* Advance next pos-to-be-scanned for the amount scanned already */
-        pos += scanned;
+static void JimSampleStop(struct JimProfiler *prof)
+{
+#ifdef HAVE_SETITIMER
+    if (prof->sampling) {
+        struct itimerval it;
 
-        /* value == 0 means no conversion took place so take empty string */
-        if (value == 0)
-            value = Jim_NewEmptyStringObj(interp);
-        /* If value is a non-assignable one, skip it */
-        if (descr->pos == -1) {
-            Jim_FreeNewObj(interp, value);
-        }
-        else if (descr->pos == 0)
-            /* Otherwise append it to the result list if no XPG3 was given */
-            Jim_ListAppendElement(interp, resultList, value);
-        else if (resultVec[descr->pos - 1] == emptyStr) {
-            /* But due to given XPG3, put the value into the corr. slot */
-            Jim_DecrRefCount(interp, resultVec[descr->pos - 1]);
-            Jim_IncrRefCount(value);
-            resultVec[descr->pos - 1] = value;
-        }
-        else {
-            /* Otherwise, the slot was already used - free obj and ERROR */
-            Jim_FreeNewObj(interp, value);
-            goto err;
+#ifdef JIM_THREADS
+        pthread_mutex_lock(&JimSampleMutex);
+#endif
+        memset(&it, 0, sizeof(it));
+        setitimer(ITIMER_PROF, &it, NULL);
+        sigaction(SIGPROF, &prof->oldAction, NULL);
+        JimSamplingInterp = NULL;
+        prof->sampling = 0;
+#ifdef JIM_THREADS
+        pthread_mutex_unlock(&JimSampleMutex);
+#endif
+    }
+#endif
+}
+
+/* Appends the proc call stack, outermost first, as name:line for each proc */
+static void JimSampleAppendFrames(Jim_Interp *interp, Jim_Obj *stackObj, Jim_CallFrame *framePtr, int line)
+{
+    if (framePtr->parent) {
+        char buf[JIM_INTEGER_SPACE + 2];
+
+        JimSampleAppendFrames(interp, stackObj, framePtr->parent, framePtr->line);
+        Jim_AppendObj(interp, stackObj, framePtr->argv[0]);
+        if (line) {
+            snprintf(buf, sizeof(buf), ":%d", line);
+            Jim_AppendString(interp, stackObj, buf, -1);
         }
+        Jim_AppendString(interp, stackObj, ";", 1);
     }
-    Jim_DecrRefCount(interp, emptyStr);
-    return resultList;
-  eof:
-    Jim_DecrRefCount(interp, emptyStr);
-    Jim_FreeNewObj(interp, resultList);
-    return (Jim_Obj *)EOF;
-  err:
-    Jim_DecrRefCount(interp, emptyStr);
-    Jim_FreeNewObj(interp, resultList);
-    return 0;
 }
 
+/* Records any pending ticks against the command 'cmdObj' which just returned */
+static void JimSampleRecord(Jim_Interp *interp, struct JimProfiler *prof, Jim_Obj *cmdObj)
+{
+    int ticks = JimSampleTicks;
+    ScriptObj *script = Jim_GetScript(interp, interp->currentScriptObj);
+    Jim_Obj *stackObj = Jim_NewEmptyStringObj(interp);
+    JimProfileSample *sample;
+    Jim_HashEntry *he;
+
+    JimSampleTicks = 0;
+
+    JimSampleAppendFrames(interp, stackObj, interp->framePtr, script ? script->linenr : 0);
+    Jim_AppendObj(interp, stackObj, cmdObj);
+
+    he = Jim_FindHashEntry(&prof->samples, Jim_String(stackObj));
+    if (he) {
+        sample = Jim_GetHashEntryVal(he);
+    }
+    else {
+        sample = Jim_Alloc(sizeof(*sample));
+        sample->count = 0;
+        Jim_AddHashEntry(&prof->samples, Jim_String(stackObj), sample);
+    }
+    sample->count += ticks;
+    Jim_FreeNewObj(interp, stackObj);
+}
+
+/* Returns the samples in collapsed stack format, as used by flamegraph.pl */
+static Jim_Obj *JimSampleCollapsed(Jim_Interp *interp, struct JimProfiler *prof)
+{
+    Jim_Obj *resultObj = Jim_NewEmptyStringObj(interp);
+    Jim_HashTableIterator htiter;
+    Jim_HashEntry *he;
+
+    JimInitHashTableIterator(&prof->samples, &htiter);
+    while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
+        JimProfileSample *sample = Jim_GetHashEntryVal(he);
+        char buf[JIM_INTEGER_SPACE + 3];
+
+        Jim_AppendString(interp, resultObj, Jim_GetHashEntryKey(he), -1);
+        snprintf(buf, sizeof(buf), " %" JIM_WIDE_MODIFIER "\n", sample->count);
+        Jim_AppendString(interp, resultObj, buf, -1);
+    }
+    return resultObj;
+}
+
+#ifdef JIM_DEBUG_COMMAND
 /* -----------------------------------------------------------------------------
- * Pseudo Random Number Generation
+ * Shimmer tracing
+ *
+ * Counts conversions between object types, and regeneration of string reps,
+ * by (from type, to type) and optionally by the source line being evaluated.
+ *
+ * The tracer is per thread, so conversions in other threads (e.g. lsort -parallel,
+ * thread and parallel workers) never touch it, and only one interp per thread may trace.
+ * Conversions made by another interp in the same thread (e.g. a child interp) are
+ * ignored, except for string rep regeneration, which has no interp.
  * ---------------------------------------------------------------------------*/
-/* Initialize the sbox with the numbers from 0 to 255 */
-static void JimPrngInit(Jim_Interp *interp)
+struct JimShimmerTrace {
+    Jim_Interp *interp;
+    int lines;                  /* Attribute conversions to file:line */
+    int busy;                   /* Set while recording, to ignore our own conversions */
+    Jim_HashTable counts;       /* "from to file:line" -> JimShimmerCount */
+};
+
+#ifdef JIM_THREADS
+static pthread_key_t JimShimmerKey;
+static pthread_once_t JimShimmerOnce = PTHREAD_ONCE_INIT;
+
+static void JimShimmerKeyInit(void)
+{
+    pthread_key_create(&JimShimmerKey, NULL);
+}
+
+/* Returns the trace of the interp tracing in this thread, or NULL */
+static struct JimShimmerTrace *JimShimmerThreadTracer(void)
+{
+    pthread_once(&JimShimmerOnce, JimShimmerKeyInit);
+    return pthread_getspecific(JimShimmerKey);
+}
+
+static void JimShimmerSetThreadTracer(struct JimShimmerTrace *trace)
+{
+    if (trace) {
+        __atomic_add_fetch(&JimShimmerActive, 1, __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_sub_fetch(&JimShimmerActive, 1, __ATOMIC_RELAXED);
+    }
+    pthread_setspecific(JimShimmerKey, trace);
+}
+#else
+#define JimShimmerThreadTracer() JimShimmerTracer
+#define JimShimmerSetThreadTracer(T) JimShimmerTracer = (T)
+#endif
+
+typedef struct JimShimmerCount {
+    const char *from;
+    const char *to;             /* "string-rep" if the string rep was regenerated */
+    char *location;             /* file:line, or NULL if not attributed */
+    jim_wide count;
+} JimShimmerCount;
+
+static void JimShimmerCountDestructor(void *privdata, void *val)
+{
+    JimShimmerCount *sc = val;
+
+    JIM_NOTUSED(privdata);
+    Jim_Free(sc->location);
+    Jim_Free(sc);
+}
+
+static const Jim_HashTableType JimShimmerHashTableType = {
+    JimStringCopyHTHashFunction,     /* hash function */
+    JimStringCopyHTDup,              /* key dup */
+    NULL,                            /* val dup */
+    JimStringCopyHTKeyCompare,       /* key compare */
+    JimStringCopyHTKeyDestructor,    /* key destructor */
+    JimShimmerCountDestructor        /* val destructor */
+};
+
+static void JimRecordShimmer(Jim_Interp *interp, Jim_Obj *objPtr, const Jim_ObjType *toType)
 {
-#define PRNG_SEED_SIZE 256
-    int i;
-    unsigned int *seed;
-    time_t t = time(NULL);
+    struct JimShimmerTrace *trace = JimShimmerThreadTracer();
+    const char *from;
+    const char *to;
+    char *location = NULL;
+    char *key;
+    JimShimmerCount *sc;
+    Jim_HashEntry *he;
 
-    interp->prngState = Jim_Alloc(sizeof(Jim_PrngState));
+    if (trace == NULL || (interp && interp != trace->interp)) {
+        /* Not tracing in this thread, or converted by another interp */
+        return;
+    }
+    if (trace->busy || objPtr->typePtr == toType) {
+        /* Our own conversion, or just revalidation of a cached lookup */
+        return;
+    }
+    interp = trace->interp;
+    from = JimObjTypeName(objPtr);
+    to = toType ? toType->name : "string-rep";
+    trace->busy++;
 
-    seed = Jim_Alloc(PRNG_SEED_SIZE * sizeof(*seed));
-    for (i = 0; i < PRNG_SEED_SIZE; i++) {
-        seed[i] = (rand() ^ t ^ clock());
+    if (trace->lines && interp->currentScriptObj->typePtr == &scriptObjType) {
+        ScriptObj *script = Jim_GetIntRepPtr(interp->currentScriptObj);
+        const char *filename = Jim_String(script->fileNameObj);
+
+        location = Jim_Alloc(strlen(filename) + JIM_INTEGER_SPACE + 2);
+        sprintf(location, "%s:%d", filename, script->linenr);
     }
-    JimPrngSeed(interp, (unsigned char *)seed, PRNG_SEED_SIZE * sizeof(*seed));
-    Jim_Free(seed);
-}
 
-/* Generates N bytes of random data */
-static void JimRandomBytes(Jim_Interp *interp, void *dest, unsigned int len)
-{
-    Jim_PrngState *prng;
-    unsigned char *destByte = (unsigned char *)dest;
-    unsigned int si, sj, x;
+    key = Jim_Alloc(strlen(from) + strlen(to) + (location ? strlen(location) : 0) + 3);
+    sprintf(key, "%s %s %s", from, to, location ? location : "");
 
-    /* initialization, only needed the first time */
-    if (interp->prngState == NULL)
-        JimPrngInit(interp);
-    prng = interp->prngState;
-    /* generates 'len' bytes of pseudo-random numbers */
-    for (x = 0; x < len; x++) {
-        prng->i = (prng->i + 1) & 0xff;
-        si = prng->sbox[prng->i];
-        prng->j = (prng->j + si) & 0xff;
-        sj = prng->sbox[prng->j];
-        prng->sbox[prng->i] = sj;
-        prng->sbox[prng->j] = si;
-        *destByte++ = prng->sbox[(si + sj) & 0xff];
+    he = Jim_FindHashEntry(&trace->counts, key);
+    if (he) {
+        sc = Jim_GetHashEntryVal(he);
+        Jim_Free(location);
     }
+    else {
+        sc = Jim_Alloc(sizeof(*sc));
+        sc->from = from;
+        sc->to = to;
+        sc->location = location;
+        sc->count = 0;
+        Jim_AddHashEntry(&trace->counts, key, sc);
+    }
+    sc->count++;
+    Jim_Free(key);
+
+    trace->busy--;
 }
 
-/* Re-seed the generator with user-provided bytes */
-static void JimPrngSeed(Jim_Interp *interp, unsigned char *seed, int seedLen)
+/* Most frequent first, then by key */
+static int JimShimmerCompare(const void *a, const void *b)
 {
-    int i;
-    Jim_PrngState *prng;
+    Jim_HashEntry *ha = *(Jim_HashEntry **)a;
+    Jim_HashEntry *hb = *(Jim_HashEntry **)b;
+    jim_wide ca = ((JimShimmerCount *)Jim_GetHashEntryVal(ha))->count;
+    jim_wide cb = ((JimShimmerCount *)Jim_GetHashEntryVal(hb))->count;
 
-    /* initialization, only needed the first time */
-    if (interp->prngState == NULL)
-        JimPrngInit(interp);
-    prng = interp->prngState;
+    if (ca != cb) {
+        return ca < cb ? 1 : -1;
+    }
+    return strcmp(Jim_GetHashEntryKey(ha), Jim_GetHashEntryKey(hb));
+}
 
-    /* Set the sbox[i] with i */
-    for (i = 0; i < 256; i++)
-        prng->sbox[i] = i;
-    /* Now use the seed to perform a random permutation of the sbox */
-    for (i = 0; i < seedLen; i++) {
-        unsigned char t;
+/* Returns a list of {count from to location}, most frequent first */
+static Jim_Obj *JimShimmerReport(Jim_Interp *interp, struct JimShimmerTrace *trace)
+{
+    Jim_Obj *listObj = Jim_NewListObj(interp, NULL, 0);
+    Jim_HashEntry **entries;
+    Jim_HashTableIterator htiter;
+    Jim_HashEntry *he;
+    int i, n = 0;
 
-        t = prng->sbox[i & 0xFF];
-        prng->sbox[i & 0xFF] = prng->sbox[seed[i]];
-        prng->sbox[seed[i]] = t;
+    if (!trace) {
+        return listObj;
     }
-    prng->i = prng->j = 0;
+    entries = Jim_Alloc(sizeof(*entries) * (trace->counts.used + 1));
+    JimInitHashTableIterator(&trace->counts, &htiter);
+    while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
+        entries[n++] = he;
+    }
+    qsort(entries, n, sizeof(*entries), JimShimmerCompare);
 
-    /* discard at least the first 256 bytes of stream.
-     * borrow the seed buffer for this
-     */
-    for (i = 0; i < 256; i += seedLen) {
-        JimRandomBytes(interp, seed, seedLen);
+    for (i = 0; i < n; i++) {
+        JimShimmerCount *sc = Jim_GetHashEntryVal(entries[i]);
+        Jim_Obj *objv[4];
+
+        objv[0] = Jim_NewWideObj(interp, sc->count);
+        objv[1] = Jim_NewStringObj(interp, sc->from, -1);
+        objv[2] = Jim_NewStringObj(interp, sc->to, -1);
+        objv[3] = Jim_NewStringObj(interp, sc->location ? sc->location : "", -1);
+        Jim_ListAppendElement(interp, listObj, Jim_NewListObj(interp, objv, 4));
     }
+    Jim_Free(entries);
+    return listObj;
 }
 
-/* [incr] */
-static int Jim_IncrCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+/* Starts tracing in this interp, or just changes whether lines are recorded */
+static int JimShimmerStart(Jim_Interp *interp, int lines)
 {
-    jim_wide wideValue, increment = 1;
-    Jim_Obj *intObjPtr;
+    struct JimShimmerTrace *trace = interp->shimmerTrace;
+    struct JimShimmerTrace *current = JimShimmerThreadTracer();
 
-    if (argc != 2 && argc != 3) {
-        Jim_WrongNumArgs(interp, 1, argv, "varName ?increment?");
+    if (current && current->interp != interp) {
+        Jim_SetResultString(interp, "shimmer tracing is active in another interpreter in this thread", -1);
         return JIM_ERR;
     }
-    if (argc == 3) {
-        if (Jim_GetWide(interp, argv[2], &increment) != JIM_OK)
-            return JIM_ERR;
-    }
-    intObjPtr = Jim_GetVariable(interp, argv[1], JIM_UNSHARED);
-    if (!intObjPtr) {
-        /* Set missing variable to 0 */
-        wideValue = 0;
-    }
-    else if (Jim_GetWide(interp, intObjPtr, &wideValue) != JIM_OK) {
-        return JIM_ERR;
+    if (!trace) {
+        trace = interp->shimmerTrace = Jim_Alloc(sizeof(*trace));
+        trace->interp = interp;
+        trace->busy = 0;
+        Jim_InitHashTable(&trace->counts, &JimShimmerHashTableType, NULL);
     }
-    if (!intObjPtr || Jim_IsShared(intObjPtr)) {
-        intObjPtr = Jim_NewIntObj(interp, wideValue + increment);
-        if (Jim_SetVariable(interp, argv[1], intObjPtr) != JIM_OK) {
-            Jim_FreeNewObj(interp, intObjPtr);
-            return JIM_ERR;
-        }
+    trace->lines = lines;
+    if (current == NULL) {
+        JimShimmerSetThreadTracer(trace);
     }
-    else {
-        /* Can do it the quick way */
-        Jim_InvalidateStringRep(intObjPtr);
-        JimWideValue(intObjPtr) = wideValue + increment;
+    return JIM_OK;
+}
 
-        /* The following step is required in order to invalidate the
-         * string repr of "FOO" if the var name is on the form of "FOO(IDX)" */
-        if (argv[1]->typePtr != &variableObjType) {
-            /* Note that this can't fail since GetVariable already succeeded */
-            Jim_SetVariable(interp, argv[1], intObjPtr);
-        }
+static void JimShimmerStop(Jim_Interp *interp)
+{
+    struct JimShimmerTrace *current = JimShimmerThreadTracer();
+
+    if (current && current->interp == interp) {
+        JimShimmerSetThreadTracer(NULL);
     }
-    Jim_SetResult(interp, intObjPtr);
-    return JIM_OK;
 }
 
+static void JimFreeShimmerTrace(Jim_Interp *interp)
+{
+    JimShimmerStop(interp);
+    if (interp->shimmerTrace) {
+        Jim_FreeHashTable(&interp->shimmerTrace->counts);
+        Jim_Free(interp->shimmerTrace);
+        interp->shimmerTrace = NULL;
+    }
+}
+#endif /* JIM_DEBUG_COMMAND */
 
 /* -----------------------------------------------------------------------------
  * Eval
@@ -10144,6 +14393,7 @@ static int JimInvokeCommand(Jim_Interp *interp, int objc, Jim_Obj *const *objv)
 {
     int retcode;
     Jim_Cmd *cmdPtr;
+    jim_wide profileSerial = 0;
 
 #if 0
     printf("invoke");
@@ -10173,6 +14423,9 @@ static int JimInvokeCommand(Jim_Interp *interp, int objc, Jim_Obj *const *objv)
         goto out;
     }
     interp->evalDepth++;
+    if (interp->profiler && interp->profiler->running) {
+        profileSerial = JimProfileEnter(interp, objv[0]);
+    }
 
     /* Call it -- Make sure result is an empty object. */
     Jim_SetEmptyResult(interp);
@@ -10183,6 +14436,14 @@ static int JimInvokeCommand(Jim_Interp *interp, int objc, Jim_Obj *const *objv)
         interp->cmdPrivData = cmdPtr->u.native.privData;
         retcode = cmdPtr->u.native.cmdProc(interp, objc, objv);
     }
+    if (interp->profiler) {
+        if (profileSerial) {
+            JimProfileLeave(interp, profileSerial);
+        }
+        if (JimSampleTicks && interp->profiler->sampling) {
+            JimSampleRecord(interp, interp->profiler, objv[0]);
+        }
+    }
     interp->evalDepth--;
 
 out:
@@ -10399,7 +14660,7 @@ static Jim_Obj *JimInterpolateTokens(Jim_Interp *interp, const ScriptToken * tok
     }
 
 
-    s = objPtr->bytes = Jim_Alloc(totlen + 1);
+    s = objPtr->bytes = JimAllocCategory(totlen + 1, JIM_MEM_STRING);
     objPtr->length = totlen;
     for (i = 0; i < tokens; i++) {
         if (intv[i]) {
@@ -10852,84 +15113,474 @@ static int JimCallProcedure(Jim_Interp *interp, Jim_Cmd *cmd, int argc, Jim_Obj
             if (cmd->u.proc.arglist[d].defaultObjPtr) {
                 nameObjPtr =cmd->u.proc.arglist[d].defaultObjPtr;
             }
-            retcode = Jim_SetVariable(interp, nameObjPtr, listObjPtr);
-            if (retcode != JIM_OK) {
-                goto badargset;
+            retcode = Jim_SetVariable(interp, nameObjPtr, listObjPtr);
+            if (retcode != JIM_OK) {
+                goto badargset;
+            }
+
+            i += argsLen;
+            continue;
+        }
+
+        /* Optional or required? */
+        if (cmd->u.proc.arglist[d].defaultObjPtr == NULL || optargs-- > 0) {
+            retcode = JimSetProcArg(interp, nameObjPtr, argv[i++]);
+        }
+        else {
+            /* Ran out, so use the default */
+            retcode = Jim_SetVariable(interp, nameObjPtr, cmd->u.proc.arglist[d].defaultObjPtr);
+        }
+        if (retcode != JIM_OK) {
+            goto badargset;
+        }
+    }
+
+    /* Eval the body */
+    retcode = Jim_EvalObj(interp, cmd->u.proc.bodyObjPtr);
+
+badargset:
+
+    /* Free the callframe */
+    interp->framePtr = interp->framePtr->parent;
+    JimFreeCallFrame(interp, callFramePtr, JIM_FCF_REUSE);
+
+    if (interp->framePtr->tailcallObj) {
+        /* If a tailcall is already being executed, merge this tailcall with that one */
+        if (interp->framePtr->tailcall++ == 0) {
+            /* No current tailcall in this frame, so invoke the tailcall command */
+            do {
+                Jim_Obj *tailcallObj = interp->framePtr->tailcallObj;
+
+                interp->framePtr->tailcallObj = NULL;
+
+                if (retcode == JIM_EVAL) {
+                    retcode = Jim_EvalObjList(interp, tailcallObj);
+                    if (retcode == JIM_RETURN) {
+                        /* If the result of the tailcall is 'return', push
+                         * it up to the caller
+                         */
+                        interp->returnLevel++;
+                    }
+                }
+                Jim_DecrRefCount(interp, tailcallObj);
+            } while (interp->framePtr->tailcallObj);
+
+            /* If the tailcall chain finished early, may need to manually discard the command */
+            if (interp->framePtr->tailcallCmd) {
+                JimDecrCmdRefCount(interp, interp->framePtr->tailcallCmd);
+                interp->framePtr->tailcallCmd = NULL;
+            }
+        }
+        interp->framePtr->tailcall--;
+    }
+
+    /* Handle the JIM_RETURN return code */
+    if (retcode == JIM_RETURN) {
+        if (--interp->returnLevel <= 0) {
+            retcode = interp->returnCode;
+            interp->returnCode = JIM_OK;
+            interp->returnLevel = 0;
+        }
+    }
+    else if (retcode == JIM_ERR) {
+        interp->addStackTrace++;
+        Jim_DecrRefCount(interp, interp->errorProc);
+        interp->errorProc = argv[0];
+        Jim_IncrRefCount(interp->errorProc);
+    }
+
+    return retcode;
+}
+
+#include <sys/stat.h>
+
+#ifdef JIM_SCRIPT_CACHE
+/* -----------------------------------------------------------------------------
+ * On-disk script cache
+ *
+ * If $JIM_CACHE_DIR is set, the parsed form of sourced scripts (including the
+ * scripts embedded in the executable, such as stdlib.tcl) is saved in that
+ * directory as <name>-<pathhash>.jimc and reused by later processes.
+ * A cache file is only used if the modification time, length, starting line
+ * and content hash of the source all match. Otherwise the script is parsed
+ * as normal and the cache file is rewritten.
+ *
+ * The format uses native byte order and word size and is not portable.
+ * ---------------------------------------------------------------------------*/
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#define JIMC_USE_MMAP
+#endif
+#include <fcntl.h>
+
+#define JIMC_VERSION 1
+
+struct JimcHeader {
+    char magic[4];      /* "JIMC" */
+    int version;        /* JIMC_VERSION */
+    int headerlen;      /* sizeof(struct JimcHeader) */
+    int textlen;        /* Length of the source */
+    jim_wide mtime;     /* Modification time of the source, or 0 if not a file */
+    jim_wide hash;      /* Hash of the source */
+    int line;           /* Line number of the start of the source */
+    int firstline;      /* ScriptObj fields */
+    int linenr;
+    int len;            /* Number of tokens that follow */
+};
+
+/* Each token is stored as a JimcToken followed by 'b' bytes of string data, except
+ * for JIM_TT_LINE (a=argc, b=line) and JIM_TT_WORD (a=number of word tokens).
+ */
+struct JimcToken {
+    int type;
+    int a;
+    int b;
+};
+
+/* 64 bit FNV-1a */
+static jim_wide JimcHash(const char *str, int len)
+{
+    unsigned jim_wide h = 14695981039346656037ULL;
+
+    while (len--) {
+        h ^= (unsigned char)*str++;
+        h *= 1099511628211ULL;
+    }
+    return (jim_wide)h;
+}
+
+/**
+ * Returns the (allocated) name of the cache file for the given script
+ * filename, or NULL if the cache is not enabled.
+ */
+static char *JimcFileName(const char *filename)
+{
+    const char *dir = getenv("JIM_CACHE_DIR");
+    const char *base = strrchr(filename, '/');
+    char *cachefile;
+    unsigned jim_wide hash;
+
+    if (dir == NULL || *dir == 0) {
+        return NULL;
+    }
+    base = base ? base + 1 : filename;
+    cachefile = Jim_Alloc(strlen(dir) + strlen(base) + 40);
+    hash = JimcHash(filename, strlen(filename));
+    sprintf(cachefile, "%s/%s-%08x%08x.jimc", dir, base,
+        (unsigned)(hash >> 32) & 0xffffffff, (unsigned)hash & 0xffffffff);
+    return cachefile;
+}
+
+/* Returns 1 if a token of this type can be (part of) a word */
+static int JimcIsWordToken(int type)
+{
+    switch (type) {
+        case JIM_TT_STR:
+        case JIM_TT_ESC:
+        case JIM_TT_VAR:
+        case JIM_TT_DICTSUGAR:
+        case JIM_TT_CMD:
+        case JIM_TT_EXPRSUGAR:
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Checks that the tokens have the structure that Jim_EvalObj() relies on:
+ * each command is a LINE token followed by argc words, where each word is
+ * either a single word token, or a WORD token followed by that many word tokens.
+ */
+static int JimcCheckTokens(const struct JimcToken *tokens, int len)
+{
+    int i = 0;
+
+    while (i < len) {
+        int argc;
+        int j;
+
+        if (tokens[i].type != JIM_TT_LINE || tokens[i].a < 0) {
+            return 0;
+        }
+        argc = tokens[i++].a;
+        for (j = 0; j < argc; j++) {
+            jim_wide wordtokens = 1;
+
+            if (i < len && tokens[i].type == JIM_TT_WORD) {
+                wordtokens = tokens[i++].a;
+                if (wordtokens < 0) {
+                    wordtokens = -wordtokens;
+                }
+            }
+            if (wordtokens == 0 || wordtokens > len - i) {
+                return 0;
+            }
+            while (wordtokens--) {
+                if (!JimcIsWordToken(tokens[i++].type)) {
+                    return 0;
+                }
             }
-
-            i += argsLen;
-            continue;
         }
+    }
+    return 1;
+}
 
-        /* Optional or required? */
-        if (cmd->u.proc.arglist[d].defaultObjPtr == NULL || optargs-- > 0) {
-            retcode = JimSetProcArg(interp, nameObjPtr, argv[i++]);
+/**
+ * Builds a ScriptObj from the cache file data.
+ * Returns NULL if the data doesn't match 'hdr' or is corrupt.
+ */
+static ScriptObj *JimcLoadScript(Jim_Interp *interp, const char *data, long datalen,
+    const struct JimcHeader *hdr, Jim_Obj *fileNameObj)
+{
+    struct JimcHeader h;
+    ScriptObj *script = NULL;
+    struct JimcToken *tokens;
+    const char **strings;
+    const char *p = data + sizeof(h);
+    const char *end = data + datalen;
+    int i;
+
+    if (datalen < (long)sizeof(h)) {
+        return NULL;
+    }
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, "JIMC", 4) != 0 || h.version != hdr->version || h.headerlen != hdr->headerlen
+        || h.textlen != hdr->textlen || h.mtime != hdr->mtime || h.hash != hdr->hash
+        || h.line != hdr->line || h.len <= 0 || h.len > datalen / (long)sizeof(struct JimcToken)) {
+        return NULL;
+    }
+
+    /* Check the framing and the token structure before creating anything */
+    tokens = Jim_Alloc(sizeof(*tokens) * h.len);
+    strings = Jim_Alloc(sizeof(*strings) * h.len);
+    for (i = 0; i < h.len; i++) {
+        if (end - p < (long)sizeof(*tokens)) {
+            break;
         }
-        else {
-            /* Ran out, so use the default */
-            retcode = Jim_SetVariable(interp, nameObjPtr, cmd->u.proc.arglist[d].defaultObjPtr);
+        memcpy(&tokens[i], p, sizeof(*tokens));
+        p += sizeof(*tokens);
+        strings[i] = p;
+
+        if (JimcIsWordToken(tokens[i].type)) {
+            if (tokens[i].b < 0 || end - p < tokens[i].b) {
+                break;
+            }
+            p += tokens[i].b;
         }
-        if (retcode != JIM_OK) {
-            goto badargset;
+        else if (tokens[i].type != JIM_TT_LINE && tokens[i].type != JIM_TT_WORD) {
+            break;
         }
     }
 
-    /* Eval the body */
-    retcode = Jim_EvalObj(interp, cmd->u.proc.bodyObjPtr);
+    if (i == h.len && p == end && JimcCheckTokens(tokens, h.len)) {
+        script = JimAllocCategory(sizeof(*script), JIM_MEM_SCRIPT);
+        memset(script, 0, sizeof(*script));
+        script->inUse = 1;
+        script->fileNameObj = fileNameObj;
+        Jim_IncrRefCount(fileNameObj);
+        script->firstline = h.firstline;
+        script->linenr = h.linenr;
+        script->token = JimAllocCategory(sizeof(ScriptToken) * h.len, JIM_MEM_SCRIPT);
+        script->len = h.len;
 
-badargset:
+        for (i = 0; i < h.len; i++) {
+            const struct JimcToken *t = &tokens[i];
+            Jim_Obj *objPtr;
 
-    /* Free the callframe */
-    interp->framePtr = interp->framePtr->parent;
-    JimFreeCallFrame(interp, callFramePtr, JIM_FCF_REUSE);
+            if (t->type == JIM_TT_LINE) {
+                objPtr = JimNewScriptLineObj(interp, t->a, t->b);
+            }
+            else if (t->type == JIM_TT_WORD) {
+                objPtr = Jim_NewIntObj(interp, t->a);
+            }
+            else {
+                objPtr = Jim_NewStringObj(interp, strings[i], t->b);
+                JimSetSourceInfo(interp, objPtr, fileNameObj, t->a);
+            }
+            script->token[i].type = t->type;
+            script->token[i].objPtr = objPtr;
+            Jim_IncrRefCount(objPtr);
+        }
+    }
+    Jim_Free(tokens);
+    Jim_Free(strings);
+    return script;
+}
 
-    if (interp->framePtr->tailcallObj) {
-        /* If a tailcall is already being executed, merge this tailcall with that one */
-        if (interp->framePtr->tailcall++ == 0) {
-            /* No current tailcall in this frame, so invoke the tailcall command */
-            do {
-                Jim_Obj *tailcallObj = interp->framePtr->tailcallObj;
+/**
+ * Returns the script from the cache file if it matches 'hdr', or NULL if not.
+ * The cache file is mapped rather than read where possible.
+ */
+static ScriptObj *JimcReadFile(Jim_Interp *interp, const char *cachefile,
+    const struct JimcHeader *hdr, Jim_Obj *fileNameObj)
+{
+    ScriptObj *script = NULL;
+    struct stat sb;
+    char *data;
+    int fd = open(cachefile, O_RDONLY);
 
-                interp->framePtr->tailcallObj = NULL;
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &sb) == 0 && sb.st_size >= (long)sizeof(*hdr)) {
+#ifdef JIMC_USE_MMAP
+        data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            script = JimcLoadScript(interp, data, sb.st_size, hdr, fileNameObj);
+            munmap(data, sb.st_size);
+        }
+#else
+        data = Jim_Alloc(sb.st_size);
+        if (read(fd, data, sb.st_size) == sb.st_size) {
+            script = JimcLoadScript(interp, data, sb.st_size, hdr, fileNameObj);
+        }
+        Jim_Free(data);
+#endif
+    }
+    close(fd);
+    return script;
+}
 
-                if (retcode == JIM_EVAL) {
-                    retcode = Jim_EvalObjList(interp, tailcallObj);
-                    if (retcode == JIM_RETURN) {
-                        /* If the result of the tailcall is 'return', push
-                         * it up to the caller
-                         */
-                        interp->returnLevel++;
-                    }
-                }
-                Jim_DecrRefCount(interp, tailcallObj);
-            } while (interp->framePtr->tailcallObj);
+/**
+ * Writes the tokens of a freshly parsed script to the cache file.
+ * Any failure simply means that no cache file is written.
+ */
+static void JimcWriteFile(Jim_Interp *interp, const char *cachefile,
+    struct JimcHeader *hdr, ScriptObj *script)
+{
+    FILE *fh;
+    char *tmpname;
+    int i;
+    int ok = 1;
+#ifdef HAVE_MKSTEMP
+    int fd;
+#endif
 
-            /* If the tailcall chain finished early, may need to manually discard the command */
-            if (interp->framePtr->tailcallCmd) {
-                JimDecrCmdRefCount(interp, interp->framePtr->tailcallCmd);
-                interp->framePtr->tailcallCmd = NULL;
-            }
+    /* Token objects may have already shimmered if the script came from the parse cache */
+    for (i = 0; i < script->len; i++) {
+        const Jim_ObjType *type = script->token[i].objPtr->typePtr;
+        switch (script->token[i].type) {
+            case JIM_TT_LINE:
+                ok = ok && type == &scriptLineObjType;
+                break;
+            case JIM_TT_WORD:
+                ok = ok && type == &intObjType;
+                break;
+            default:
+                ok = ok && type == &sourceObjType;
+                break;
         }
-        interp->framePtr->tailcall--;
+    }
+    if (!ok) {
+        return;
     }
 
-    /* Handle the JIM_RETURN return code */
-    if (retcode == JIM_RETURN) {
-        if (--interp->returnLevel <= 0) {
-            retcode = interp->returnCode;
-            interp->returnCode = JIM_OK;
-            interp->returnLevel = 0;
+    /* Interps in other threads may be writing the same cache file, so the
+     * temporary file must be unique within the process, not just per process
+     */
+    tmpname = Jim_Alloc(strlen(cachefile) + 40);
+#ifdef HAVE_MKSTEMP
+    sprintf(tmpname, "%s.XXXXXX", cachefile);
+    fd = mkstemp(tmpname);
+    fh = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (fh == NULL && fd >= 0) {
+        close(fd);
+        remove(tmpname);
+    }
+#else
+    sprintf(tmpname, "%s.%d.%p", cachefile, (int)getpid(), (void *)interp);
+    fh = fopen(tmpname, "wb");
+#endif
+    if (fh == NULL) {
+        Jim_Free(tmpname);
+        return;
+    }
+
+    hdr->firstline = script->firstline;
+    hdr->linenr = script->linenr;
+    hdr->len = script->len;
+    ok = fwrite(hdr, sizeof(*hdr), 1, fh) == 1;
+
+    for (i = 0; i < script->len && ok; i++) {
+        Jim_Obj *objPtr = script->token[i].objPtr;
+        struct JimcToken t;
+        int len = 0;
+
+        t.type = script->token[i].type;
+        if (t.type == JIM_TT_LINE) {
+            t.a = objPtr->internalRep.scriptLineValue.argc;
+            t.b = objPtr->internalRep.scriptLineValue.line;
+        }
+        else if (t.type == JIM_TT_WORD) {
+            t.a = (int)JimWideValue(objPtr);
+            t.b = 0;
+        }
+        else {
+            t.a = objPtr->internalRep.sourceValue.lineNumber;
+            t.b = len = Jim_Length(objPtr);
+        }
+        ok = fwrite(&t, sizeof(t), 1, fh) == 1;
+        if (ok && len) {
+            ok = fwrite(Jim_String(objPtr), len, 1, fh) == 1;
         }
     }
-    else if (retcode == JIM_ERR) {
-        interp->addStackTrace++;
-        Jim_DecrRefCount(interp, interp->errorProc);
-        interp->errorProc = argv[0];
-        Jim_IncrRefCount(interp->errorProc);
+    if (fclose(fh) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmpname, cachefile) != 0) {
+        remove(tmpname);
     }
+    Jim_Free(tmpname);
+}
 
-    return retcode;
+/**
+ * Like Jim_GetScript() for a source object with the given file modification time
+ * (or 0 for an embedded script), but uses the on-disk cache if enabled.
+ */
+static ScriptObj *JimGetCachedScript(Jim_Interp *interp, Jim_Obj *scriptObjPtr, jim_wide mtime)
+{
+    struct JimcHeader hdr;
+    ScriptObj *script;
+    Jim_Obj *fileNameObj = scriptObjPtr->internalRep.sourceValue.fileNameObj;
+    char *cachefile;
+    int len;
+    const char *text;
+
+    if (scriptObjPtr->typePtr != &sourceObjType
+        || (cachefile = JimcFileName(Jim_String(fileNameObj))) == NULL) {
+        return Jim_GetScript(interp, scriptObjPtr);
+    }
+
+    text = Jim_GetString(scriptObjPtr, &len);
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, "JIMC", 4);
+    hdr.version = JIMC_VERSION;
+    hdr.headerlen = sizeof(hdr);
+    hdr.textlen = len;
+    hdr.mtime = mtime;
+    hdr.hash = JimcHash(text, len);
+    hdr.line = scriptObjPtr->internalRep.sourceValue.lineNumber;
+
+    script = JimcReadFile(interp, cachefile, &hdr, fileNameObj);
+    if (script) {
+        JimGetParseCache(interp)->diskhits++;
+        Jim_FreeIntRep(interp, scriptObjPtr);
+        Jim_SetIntRepPtr(scriptObjPtr, script);
+        scriptObjPtr->typePtr = &scriptObjType;
+    }
+    else {
+        JimGetParseCache(interp)->diskmisses++;
+        script = Jim_GetScript(interp, scriptObjPtr);
+        if (script) {
+            JimcWriteFile(interp, cachefile, &hdr, script);
+        }
+    }
+    Jim_Free(cachefile);
+    return script;
 }
+#else
+#define JimGetCachedScript(interp, scriptObjPtr, mtime) Jim_GetScript(interp, scriptObjPtr)
+#endif
 
 int Jim_EvalSource(Jim_Interp *interp, const char *filename, int lineno, const char *script)
 {
@@ -10944,6 +15595,12 @@ int Jim_EvalSource(Jim_Interp *interp, const char *filename, int lineno, const c
 
         JimSetSourceInfo(interp, scriptObjPtr, Jim_NewStringObj(interp, filename, -1), lineno);
 
+        /* Embedded scripts (e.g. stdlib.tcl) may come from the script cache */
+        if (JimGetCachedScript(interp, scriptObjPtr, 0) == NULL) {
+            Jim_DecrRefCount(interp, scriptObjPtr);
+            return JIM_ERR;
+        }
+
         prevScriptObj = interp->currentScriptObj;
         interp->currentScriptObj = scriptObjPtr;
 
@@ -10988,8 +15645,6 @@ int Jim_EvalFileGlobal(Jim_Interp *interp, const char *filename)
     return retval;
 }
 
-#include <sys/stat.h>
-
 int Jim_EvalFile(Jim_Interp *interp, const char *filename)
 {
     FILE *fp;
@@ -11025,36 +15680,269 @@ int Jim_EvalFile(Jim_Interp *interp, const char *filename)
     Jim_IncrRefCount(scriptObjPtr);
 
     /* Now check the script for unmatched braces, etc. */
-    if (Jim_GetScript(interp, scriptObjPtr) == NULL) {
+    if (JimGetCachedScript(interp, scriptObjPtr, sb.st_mtime) == NULL) {
         /* EvalFile changes context, so add a stack frame here */
         JimAddErrorToStack(interp, JIM_ERR, (ScriptObj *)Jim_GetIntRepPtr(scriptObjPtr));
         Jim_DecrRefCount(interp, scriptObjPtr);
         return JIM_ERR;
     }
 
-    prevScriptObj = interp->currentScriptObj;
-    interp->currentScriptObj = scriptObjPtr;
-
-    retcode = Jim_EvalObj(interp, scriptObjPtr);
+    prevScriptObj = interp->currentScriptObj;
+    interp->currentScriptObj = scriptObjPtr;
+
+    retcode = Jim_EvalObj(interp, scriptObjPtr);
+
+    /* Handle the JIM_RETURN return code */
+    if (retcode == JIM_RETURN) {
+        if (--interp->returnLevel <= 0) {
+            retcode = interp->returnCode;
+            interp->returnCode = JIM_OK;
+            interp->returnLevel = 0;
+        }
+    }
+    if (retcode == JIM_ERR) {
+        /* EvalFile changes context, so add a stack frame here */
+        interp->addStackTrace++;
+    }
+
+    interp->currentScriptObj = prevScriptObj;
+
+    Jim_DecrRefCount(interp, scriptObjPtr);
+
+    return retcode;
+}
+
+/* -----------------------------------------------------------------------------
+ * Lazy extensions
+ *
+ * An extension which only creates new commands may be registered with
+ * Jim_RegisterLazyExtension() instead of being initialised immediately.
+ * Each of its commands is then created as a stub which initialises the
+ * extension (in the global scope) on first use and then invokes the real
+ * command. [package require] also initialises a registered extension.
+ *
+ * Stubs which were renamed, deleted or redefined before the extension is
+ * initialised are treated as if the real command had been renamed, deleted
+ * or redefined.
+ * ---------------------------------------------------------------------------*/
+struct JimLazyExt;
+
+/* privData of each stub */
+struct JimLazyCmd {
+    struct JimLazyExt *ext;
+    int index;                      /* Index into ext->cmdNames */
+};
+
+struct JimLazyExt {
+    int (*initProc)(Jim_Interp *interp);
+    const char * const *cmdNames;   /* NULL terminated. Must remain valid. */
+    int numCmds;
+    struct JimLazyCmd *cmds;
+    int loaded;                     /* Set once initialisation has started */
+};
+
+/* What happened to a stub. With none of these, it was deleted. */
+#define JIM_LAZY_STUB 1             /* Stub still in place */
+#define JIM_LAZY_RENAMED 2          /* Stub was renamed */
+#define JIM_LAZY_REDEFINED 4        /* Another command now has the stub's name */
+
+static void JimLazyExtHTValDestructor(void *interp, void *val)
+{
+    struct JimLazyExt *ext = val;
+
+    JIM_NOTUSED(interp);
+    Jim_Free(ext->cmds);
+    Jim_Free(ext);
+}
+
+static const Jim_HashTableType JimLazyExtHashTableType = {
+    JimStringCopyHTHashFunction,    /* hash function */
+    JimStringCopyHTDup,             /* key dup */
+    NULL,                           /* val dup */
+    JimStringCopyHTKeyCompare,      /* key compare */
+    JimStringCopyHTKeyDestructor,   /* key destructor */
+    JimLazyExtHTValDestructor       /* val destructor */
+};
+
+static void JimLazyExtDelProc(Jim_Interp *interp, void *data)
+{
+    JIM_NOTUSED(interp);
+    Jim_FreeHashTable(data);
+    Jim_Free(data);
+}
+
+static int JimLazyExtStubCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+
+/* Returns the stub data if cmdPtr is a stub of the given extension (or any if ext is NULL) */
+static struct JimLazyCmd *JimLazyExtStub(Jim_Cmd *cmdPtr, struct JimLazyExt *ext)
+{
+    if (!cmdPtr->isproc && cmdPtr->u.native.cmdProc == JimLazyExtStubCmd) {
+        struct JimLazyCmd *lc = cmdPtr->u.native.privData;
+        if (ext == NULL || lc->ext == ext) {
+            return lc;
+        }
+    }
+    return NULL;
+}
+
+static int JimLoadLazyExt(Jim_Interp *interp, struct JimLazyExt *ext)
+{
+    Jim_CallFrame *savedFramePtr = interp->framePtr;
+    Jim_HashTableIterator htiter;
+    Jim_HashEntry *he;
+    Jim_Obj **renamed;
+    Jim_Obj *nameObj;
+    int *state;
+    int retcode;
+    int i;
+
+    if (ext->loaded) {
+        return JIM_OK;
+    }
+    ext->loaded = 1;
+
+    interp->framePtr = interp->topFramePtr;
+
+    /* Find out what happened to each stub since registration */
+    state = Jim_Alloc(sizeof(*state) * ext->numCmds);
+    renamed = Jim_Alloc(sizeof(*renamed) * ext->numCmds);
+    for (i = 0; i < ext->numCmds; i++) {
+        state[i] = 0;
+        renamed[i] = NULL;
+    }
+    JimInitHashTableIterator(&interp->commands, &htiter);
+    while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
+        struct JimLazyCmd *lc = JimLazyExtStub(Jim_GetHashEntryVal(he), ext);
+        if (lc) {
+            if (strcmp(he->key, ext->cmdNames[lc->index]) == 0) {
+                state[lc->index] = JIM_LAZY_STUB;
+            }
+            else {
+                state[lc->index] = JIM_LAZY_RENAMED;
+                renamed[lc->index] = Jim_NewStringObj(interp, he->key, -1);
+                Jim_IncrRefCount(renamed[lc->index]);
+            }
+        }
+    }
+
+    /* Remove the stubs and move any redefined commands out of the way */
+    for (i = 0; i < ext->numCmds; i++) {
+        const char *name = ext->cmdNames[i];
+
+        if (state[i] & JIM_LAZY_RENAMED) {
+            Jim_DeleteCommand(interp, Jim_String(renamed[i]));
+        }
+        if (state[i] & JIM_LAZY_STUB) {
+            Jim_DeleteCommand(interp, name);
+        }
+        else if (Jim_FindHashEntry(&interp->commands, name)) {
+            state[i] |= JIM_LAZY_REDEFINED;
+            nameObj = Jim_NewStringObj(interp, name, -1);
+            Jim_AppendString(interp, nameObj, " (saved)", -1);
+            Jim_RenameCommand(interp, name, Jim_String(nameObj));
+            Jim_FreeNewObj(interp, nameObj);
+        }
+    }
+
+    retcode = ext->initProc(interp);
+
+    /* Now apply the same changes to the real commands */
+    for (i = 0; i < ext->numCmds; i++) {
+        const char *name = ext->cmdNames[i];
+
+        if (state[i] & JIM_LAZY_STUB) {
+            continue;
+        }
+        if (Jim_FindHashEntry(&interp->commands, name)) {
+            if (state[i] & JIM_LAZY_RENAMED) {
+                Jim_RenameCommand(interp, name, Jim_String(renamed[i]));
+            }
+            else {
+                Jim_DeleteCommand(interp, name);
+            }
+        }
+        if (state[i] & JIM_LAZY_RENAMED) {
+            Jim_DecrRefCount(interp, renamed[i]);
+        }
+        if (state[i] & JIM_LAZY_REDEFINED) {
+            nameObj = Jim_NewStringObj(interp, name, -1);
+            Jim_AppendString(interp, nameObj, " (saved)", -1);
+            Jim_RenameCommand(interp, Jim_String(nameObj), name);
+            Jim_FreeNewObj(interp, nameObj);
+        }
+    }
+    Jim_Free(renamed);
+    Jim_Free(state);
+
+    interp->framePtr = savedFramePtr;
+    return retcode;
+}
+
+static int JimLazyExtStubCmd(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    struct JimLazyCmd *lc = Jim_CmdPrivData(interp);
+    Jim_Cmd *cmdPtr;
+    int retcode = JimLoadLazyExt(interp, lc->ext);
+
+    if (retcode != JIM_OK) {
+        return retcode;
+    }
+    cmdPtr = Jim_GetCommand(interp, argv[0], JIM_ERRMSG);
+    if (cmdPtr == NULL) {
+        return JIM_ERR;
+    }
+    if (JimLazyExtStub(cmdPtr, NULL)) {
+        /* Can't happen unless the extension failed to create the command */
+        Jim_SetResultFormatted(interp, "invalid command name \"%#s\"", argv[0]);
+        return JIM_ERR;
+    }
+    return Jim_EvalObjVector(interp, argc, argv);
+}
+
+int Jim_RegisterLazyExtension(Jim_Interp *interp, const char *name,
+    int (*initProc)(Jim_Interp *interp), const char * const *cmdNames)
+{
+    Jim_HashTable *exts = Jim_GetAssocData(interp, "jim::lazyexts");
+    struct JimLazyExt *ext;
+    int i;
 
-    /* Handle the JIM_RETURN return code */
-    if (retcode == JIM_RETURN) {
-        if (--interp->returnLevel <= 0) {
-            retcode = interp->returnCode;
-            interp->returnCode = JIM_OK;
-            interp->returnLevel = 0;
-        }
+    if (exts == NULL) {
+        exts = Jim_Alloc(sizeof(*exts));
+        Jim_InitHashTable(exts, &JimLazyExtHashTableType, interp);
+        Jim_SetAssocData(interp, "jim::lazyexts", JimLazyExtDelProc, exts);
     }
-    if (retcode == JIM_ERR) {
-        /* EvalFile changes context, so add a stack frame here */
-        interp->addStackTrace++;
+    if (Jim_FindHashEntry(exts, name)) {
+        Jim_SetResultFormatted(interp, "extension \"%s\" is already registered", name);
+        return JIM_ERR;
     }
 
-    interp->currentScriptObj = prevScriptObj;
+    ext = Jim_Alloc(sizeof(*ext));
+    ext->initProc = initProc;
+    ext->cmdNames = cmdNames;
+    for (i = 0; cmdNames[i]; i++) {
+    }
+    ext->numCmds = i;
+    ext->cmds = Jim_Alloc(sizeof(*ext->cmds) * i);
+    ext->loaded = 0;
+    Jim_AddHashEntry(exts, name, ext);
 
-    Jim_DecrRefCount(interp, scriptObjPtr);
+    for (i = 0; i < ext->numCmds; i++) {
+        ext->cmds[i].ext = ext;
+        ext->cmds[i].index = i;
+        Jim_CreateCommand(interp, cmdNames[i], JimLazyExtStubCmd, &ext->cmds[i], NULL);
+    }
+    return JIM_OK;
+}
 
-    return retcode;
+int Jim_InitLazyExtension(Jim_Interp *interp, const char *name)
+{
+    Jim_HashTable *exts = Jim_GetAssocData(interp, "jim::lazyexts");
+    Jim_HashEntry *he;
+
+    if (exts == NULL || (he = Jim_FindHashEntry(exts, name)) == NULL) {
+        return -1;
+    }
+    return JimLoadLazyExt(interp, Jim_GetHashEntryVal(he));
 }
 
 /* -----------------------------------------------------------------------------
@@ -11115,7 +16003,7 @@ static int SetSubstFromAny(Jim_Interp *interp, struct Jim_Obj *objPtr, int flags
     int scriptTextLen;
     const char *scriptText = Jim_GetString(objPtr, &scriptTextLen);
     struct JimParserCtx parser;
-    struct ScriptObj *script = Jim_Alloc(sizeof(*script));
+    struct ScriptObj *script = JimAllocCategory(sizeof(*script), JIM_MEM_SCRIPT);
     ParseTokenList tokenlist;
 
     /* Initially parse the subst into tokens (in tokenlist) */
@@ -11190,6 +16078,403 @@ int Jim_SubstObj(Jim_Interp *interp, Jim_Obj *substObjPtr, Jim_Obj **resObjPtrPt
     return JIM_OK;
 }
 
+/* -----------------------------------------------------------------------------
+ * Coroutines
+ * ---------------------------------------------------------------------------*/
+#ifdef JIM_COROUTINES
+
+/* Size of the C stack given to each coroutine. This must be enough for
+ * interp->maxEvalDepth levels of nested evaluation. */
+#ifndef JIM_COROUTINE_STACK_SIZE
+#define JIM_COROUTINE_STACK_SIZE (2 * 1024 * 1024)
+#endif
+
+enum {
+    JIM_CORO_SUSPENDED,     /* Not started yet, or waiting in yield */
+    JIM_CORO_RUNNING,       /* Running, or resuming another coroutine */
+    JIM_CORO_DONE           /* Returned (or was killed) */
+};
+
+/* The parts of the interpreter which belong to a particular C stack.
+ * Whichever of the resumer or the coroutine is not running holds
+ * its copy here. */
+struct JimCoroutineState {
+    Jim_CallFrame *framePtr;
+    int evalDepth;
+    int signal_level;
+    Jim_Obj *currentScriptObj;
+    Jim_Obj **exprStack;
+    int exprStackLen;
+    int exprStackTop;
+};
+
+struct Jim_Coroutine {
+    Jim_Interp *interp;
+    int state;
+    int killed;             /* Set to make yield return JIM_EXIT */
+    int inYieldto;          /* Suspended in yieldto rather than yield */
+    int cmdDeleted;         /* The command has been deleted */
+    int rc;                 /* Return code of the command once done */
+    Jim_Obj *nameObj;       /* Qualified name of the command */
+    Jim_Obj *cmdObj;        /* The command and arguments to run */
+    Jim_Obj *yieldtoObj;    /* Command for the resumer to run, set by yieldto */
+    struct JimCoroutineState saved;
+    struct Jim_Coroutine *caller;   /* The coroutine which resumed this one, if any */
+    struct Jim_Coroutine *next;     /* Next in interp->coroutines */
+    ucontext_t ctx;
+    ucontext_t callerCtx;
+    void *stack;
+    size_t stackSize;
+};
+
+static int JimCoroutineCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv);
+
+static void *JimCoroutineStackAlloc(size_t *sizePtr)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_MPROTECT)
+    /* Reserve the stack with an inaccessible guard page at the bottom so that
+     * an overflow faults rather than silently corrupting the heap.
+     * Pages are only committed once they are used. */
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    void *p;
+
+    *sizePtr += pagesize;
+    p = mmap(NULL, *sizePtr, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    mprotect(p, pagesize, PROT_NONE);
+    return p;
+#else
+    return Jim_Alloc(*sizePtr);
+#endif
+}
+
+static void JimCoroutineStackFree(void *stack, size_t size)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_MPROTECT)
+    munmap(stack, size);
+#else
+    Jim_Free(stack);
+#endif
+}
+
+static void JimCoroutineSwapState(Jim_Interp *interp, struct JimCoroutineState *state)
+{
+    struct JimCoroutineState tmp = *state;
+
+    state->framePtr = interp->framePtr;
+    state->evalDepth = interp->evalDepth;
+    state->signal_level = interp->signal_level;
+    state->currentScriptObj = interp->currentScriptObj;
+    state->exprStack = interp->exprStack;
+    state->exprStackLen = interp->exprStackLen;
+    state->exprStackTop = interp->exprStackTop;
+
+    interp->framePtr = tmp.framePtr;
+    interp->evalDepth = tmp.evalDepth;
+    interp->signal_level = tmp.signal_level;
+    interp->currentScriptObj = tmp.currentScriptObj;
+    interp->exprStack = tmp.exprStack;
+    interp->exprStackLen = tmp.exprStackLen;
+    interp->exprStackTop = tmp.exprStackTop;
+}
+
+/* makecontext() can only pass int arguments, so the pointer is split in two */
+static void JimCoroutineMain(unsigned int hi, unsigned int lo)
+{
+    Jim_Coroutine *coro = (Jim_Coroutine *)(((unsigned long)hi << 16 << 16) | lo);
+
+    coro->rc = Jim_EvalObjList(coro->interp, coro->cmdObj);
+    coro->state = JIM_CORO_DONE;
+    swapcontext(&coro->ctx, &coro->callerCtx);
+    /* Not reached */
+}
+
+static void JimFreeCoroutine(Jim_Interp *interp, Jim_Coroutine *coro)
+{
+    Jim_Coroutine **cp;
+
+    for (cp = &interp->coroutines; *cp; cp = &(*cp)->next) {
+        if (*cp == coro) {
+            *cp = coro->next;
+            break;
+        }
+    }
+    Jim_DecrRefCount(interp, coro->nameObj);
+    Jim_DecrRefCount(interp, coro->cmdObj);
+    Jim_Free(coro->saved.exprStack);
+    JimCoroutineStackFree(coro->stack, coro->stackSize);
+    Jim_Free(coro);
+}
+
+/**
+ * Resumes a suspended coroutine until it yields or finishes, then kills it
+ * if its command was deleted in the meantime.
+ * Returns JIM_OK (or the coroutine's return code if it finished).
+ */
+static int JimCoroutineSwitch(Jim_Interp *interp, Jim_Coroutine *coro)
+{
+    int rc;
+
+    coro->state = JIM_CORO_RUNNING;
+    coro->caller = interp->coroutine;
+    interp->coroutine = coro;
+    JimCoroutineSwapState(interp, &coro->saved);
+    swapcontext(&coro->callerCtx, &coro->ctx);
+    JimCoroutineSwapState(interp, &coro->saved);
+    interp->coroutine = coro->caller;
+
+    if (coro->state == JIM_CORO_DONE) {
+        return coro->rc;
+    }
+
+    rc = JIM_OK;
+    if (coro->yieldtoObj) {
+        Jim_Obj *objPtr = coro->yieldtoObj;
+
+        coro->yieldtoObj = NULL;
+        rc = Jim_EvalObjList(interp, objPtr);
+        Jim_DecrRefCount(interp, objPtr);
+    }
+    return rc;
+}
+
+/* Unwinds a suspended coroutine by making yield return JIM_EXIT.
+ * The interpreter result is preserved. */
+static void JimKillCoroutine(Jim_Interp *interp, Jim_Coroutine *coro)
+{
+    Jim_Obj *resultObj = Jim_GetResult(interp);
+
+    Jim_IncrRefCount(resultObj);
+    coro->killed = 1;
+    JimCoroutineSwitch(interp, coro);
+    Jim_SetResult(interp, resultObj);
+    Jim_DecrRefCount(interp, resultObj);
+}
+
+static void JimCoroutineDelProc(Jim_Interp *interp, void *privData)
+{
+    Jim_Coroutine *coro = privData;
+
+    coro->cmdDeleted = 1;
+    if (coro->state == JIM_CORO_SUSPENDED) {
+        JimKillCoroutine(interp, coro);
+    }
+    /* If it is running, whoever resumed it frees it when it yields or finishes */
+    if (coro->state == JIM_CORO_DONE) {
+        JimFreeCoroutine(interp, coro);
+    }
+}
+
+static int JimIsCoroutineCmd(Jim_Cmd *cmdPtr, Jim_Coroutine *coro)
+{
+    return !cmdPtr->isproc && cmdPtr->u.native.cmdProc == JimCoroutineCommand && cmdPtr->u.native.privData == coro;
+}
+
+/* Deletes the command for a finished coroutine. This frees the coroutine,
+ * possibly only once the command is no longer in use. */
+static void JimCoroutineDeleteCmd(Jim_Interp *interp, Jim_Coroutine *coro)
+{
+    Jim_HashTableIterator htiter;
+    Jim_HashEntry *he;
+
+    /* Normally the command still has its original name */
+    he = Jim_FindHashEntry(&interp->commands, Jim_String(coro->nameObj));
+    if (!he || !JimIsCoroutineCmd(Jim_GetHashEntryVal(he), coro)) {
+        /* It has been renamed */
+        JimInitHashTableIterator(&interp->commands, &htiter);
+        while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
+            if (JimIsCoroutineCmd(Jim_GetHashEntryVal(he), coro)) {
+                break;
+            }
+        }
+    }
+    if (he) {
+        Jim_DeleteHashEntry(&interp->commands, Jim_GetHashEntryKey(he));
+    }
+}
+
+Jim_Coroutine *Jim_CurrentCoroutine(Jim_Interp *interp)
+{
+    return interp->coroutine;
+}
+
+int Jim_ResumeCoroutine(Jim_Interp *interp, Jim_Coroutine *coro, Jim_Obj *valueObj)
+{
+    int rc;
+
+    if (coro->state != JIM_CORO_SUSPENDED) {
+        Jim_SetResultFormatted(interp, "coroutine \"%#s\" is already running", coro->nameObj);
+        return JIM_ERR;
+    }
+
+    /* The value is passed back as the result of yield */
+    Jim_SetResult(interp, valueObj ? valueObj : interp->emptyObj);
+    rc = JimCoroutineSwitch(interp, coro);
+
+    if (coro->state == JIM_CORO_DONE) {
+        if (coro->cmdDeleted) {
+            JimFreeCoroutine(interp, coro);
+        }
+        else {
+            JimCoroutineDeleteCmd(interp, coro);
+        }
+    }
+    else if (coro->cmdDeleted) {
+        /* Deleted while it was running */
+        JimKillCoroutine(interp, coro);
+        JimFreeCoroutine(interp, coro);
+    }
+    return rc;
+}
+
+int Jim_YieldCoroutine(Jim_Interp *interp, Jim_Obj *valueObj)
+{
+    Jim_Coroutine *coro = interp->coroutine;
+
+    if (coro == NULL) {
+        Jim_SetResultString(interp, "yield can only be called in a coroutine", -1);
+        return JIM_ERR;
+    }
+    if (!coro->killed) {
+        /* The value is passed back as the result of the resume */
+        Jim_SetResult(interp, valueObj ? valueObj : interp->emptyObj);
+        coro->state = JIM_CORO_SUSPENDED;
+        swapcontext(&coro->ctx, &coro->callerCtx);
+        coro->inYieldto = 0;
+    }
+    if (coro->killed) {
+        Jim_SetResultString(interp, "coroutine was deleted", -1);
+        return JIM_EXIT;
+    }
+    return JIM_OK;
+}
+
+/* [coroutine] */
+static int Jim_CoroutineCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    Jim_Coroutine *coro;
+    Jim_Obj *qualifiedNameObj;
+    const char *name;
+    size_t stackSize = JIM_COROUTINE_STACK_SIZE;
+    void *stack;
+    unsigned long p;
+
+    if (argc < 3) {
+        Jim_WrongNumArgs(interp, 1, argv, "name cmd ?arg ...?");
+        return JIM_ERR;
+    }
+    stack = JimCoroutineStackAlloc(&stackSize);
+    if (stack == NULL) {
+        Jim_SetResultString(interp, "couldn't allocate a coroutine stack", -1);
+        return JIM_ERR;
+    }
+
+    coro = Jim_Alloc(sizeof(*coro));
+    memset(coro, 0, sizeof(*coro));
+    coro->interp = interp;
+    coro->state = JIM_CORO_SUSPENDED;
+    coro->stack = stack;
+    coro->stackSize = stackSize;
+    coro->cmdObj = Jim_NewListObj(interp, argv + 2, argc - 2);
+    Jim_IncrRefCount(coro->cmdObj);
+
+    /* The coroutine starts at the global level with nothing on its stack */
+    coro->saved.framePtr = interp->topFramePtr;
+    coro->saved.currentScriptObj = interp->nullScriptObj;
+
+    getcontext(&coro->ctx);
+    coro->ctx.uc_stack.ss_sp = stack;
+    coro->ctx.uc_stack.ss_size = stackSize;
+    coro->ctx.uc_link = NULL;
+    p = (unsigned long)coro;
+    makecontext(&coro->ctx, (void (*)(void))JimCoroutineMain, 2, (unsigned int)(p >> 16 >> 16), (unsigned int)p);
+
+    name = JimQualifyName(interp, Jim_String(argv[1]), &qualifiedNameObj);
+    coro->nameObj = Jim_NewStringObj(interp, name, -1);
+    Jim_IncrRefCount(coro->nameObj);
+    JimFreeQualifiedName(interp, qualifiedNameObj);
+
+    coro->next = interp->coroutines;
+    interp->coroutines = coro;
+    Jim_CreateCommand(interp, Jim_String(coro->nameObj), JimCoroutineCommand, coro, JimCoroutineDelProc);
+
+    /* Run until the first yield */
+    return Jim_ResumeCoroutine(interp, coro, NULL);
+}
+
+/* The command created by [coroutine], which resumes it */
+static int JimCoroutineCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    Jim_Coroutine *coro = Jim_CmdPrivData(interp);
+    Jim_Obj *valueObj = NULL;
+
+    if (coro->inYieldto) {
+        /* yieldto returns all the arguments as a list */
+        valueObj = Jim_NewListObj(interp, argv + 1, argc - 1);
+    }
+    else if (argc > 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "?value?");
+        return JIM_ERR;
+    }
+    else if (argc == 2) {
+        valueObj = argv[1];
+    }
+    return Jim_ResumeCoroutine(interp, coro, valueObj);
+}
+
+/* [yield] */
+static int Jim_YieldCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    if (argc > 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "?value?");
+        return JIM_ERR;
+    }
+    return Jim_YieldCoroutine(interp, argc == 2 ? argv[1] : NULL);
+}
+
+/* [yieldto] */
+static int Jim_YieldtoCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    Jim_Coroutine *coro = interp->coroutine;
+
+    if (argc < 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "cmd ?arg ...?");
+        return JIM_ERR;
+    }
+    if (coro == NULL) {
+        Jim_SetResultString(interp, "yieldto can only be called in a coroutine", -1);
+        return JIM_ERR;
+    }
+    if (coro->killed) {
+        return Jim_YieldCoroutine(interp, NULL);
+    }
+    /* The resumer runs the command in its own context */
+    coro->yieldtoObj = Jim_NewListObj(interp, argv + 1, argc - 1);
+    Jim_IncrRefCount(coro->yieldtoObj);
+    coro->inYieldto = 1;
+    return Jim_YieldCoroutine(interp, NULL);
+}
+
+/* Kills any suspended coroutines so that they can clean up.
+ * Their commands (and the coroutines) are freed along with the other commands. */
+static void JimKillCoroutines(Jim_Interp *interp)
+{
+    Jim_Coroutine *coro;
+
+    do {
+        for (coro = interp->coroutines; coro; coro = coro->next) {
+            if (coro->state == JIM_CORO_SUSPENDED) {
+                /* This may change the list, so start again afterwards */
+                JimKillCoroutine(interp, coro);
+                break;
+            }
+        }
+    } while (coro);
+}
+#endif /* JIM_COROUTINES */
+
 /* -----------------------------------------------------------------------------
  * Core commands utility functions
  * ---------------------------------------------------------------------------*/
@@ -11240,7 +16525,7 @@ static Jim_Obj *JimHashtablePatternMatch(Jim_Interp *interp, Jim_HashTable *ht,
         Jim_HashTableIterator htiter;
         JimInitHashTableIterator(ht, &htiter);
         while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
-            if (patternObjPtr == NULL || JimGlobMatch(Jim_String(patternObjPtr), he->key, 0)) {
+            if (patternObjPtr == NULL || JimGlobMatchObj(interp, patternObjPtr, he->key, strlen(he->key), 0)) {
                 callback(interp, listObjPtr, he, type);
             }
         }
@@ -11859,12 +17144,21 @@ static void JimListIterInit(Jim_ListIter *iter, Jim_Obj *objPtr)
 
 /**
  * Returns the next object from the list, or NULL on end-of-list.
+ *
+ * A range is iterated without being converted to a list, so the object
+ * returned may be new. The caller must hold a reference while using it.
  */
 static Jim_Obj *JimListIterNext(Jim_Interp *interp, Jim_ListIter *iter)
 {
-    if (iter->idx >= Jim_ListLength(interp, iter->objPtr)) {
+    if (iter->idx >= JimListOrRangeLength(interp, iter->objPtr)) {
         return NULL;
     }
+    if (iter->objPtr->typePtr == &rangeObjType) {
+        return JimRangeGetIndex(interp, iter->objPtr, iter->idx++);
+    }
+    if (JimIsFrozenList(iter->objPtr)) {
+        return JimFrozenElement(interp, iter->objPtr, iter->idx++);
+    }
     return iter->objPtr->internalRep.listValue.ele[iter->idx++];
 }
 
@@ -11873,7 +17167,7 @@ static Jim_Obj *JimListIterNext(Jim_Interp *interp, Jim_ListIter *iter)
  */
 static int JimListIterDone(Jim_Interp *interp, Jim_ListIter *iter)
 {
-    return iter->idx >= Jim_ListLength(interp, iter->objPtr);
+    return iter->idx >= JimListOrRangeLength(interp, iter->objPtr);
 }
 
 /* foreach + lmap implementation. */
@@ -11937,7 +17231,10 @@ static int JimForeachMapHelper(Jim_Interp *interp, int argc, Jim_Obj *const *arg
             /* foreach var */
             JimListIterInit(&iters[i], argv[i + 1]);
             while ((varName = JimListIterNext(interp, &iters[i])) != NULL) {
-                Jim_Obj *valObj = JimListIterNext(interp, &iters[i + 1]);
+                Jim_Obj *valObj;
+
+                Jim_IncrRefCount(varName);
+                valObj = JimListIterNext(interp, &iters[i + 1]);
                 if (!valObj) {
                     /* Ran out, so store the empty string */
                     valObj = interp->emptyObj;
@@ -11946,6 +17243,7 @@ static int JimForeachMapHelper(Jim_Interp *interp, int argc, Jim_Obj *const *arg
                 Jim_IncrRefCount(valObj);
                 result = Jim_SetVariable(interp, varName, valObj);
                 Jim_DecrRefCount(interp, valObj);
+                Jim_DecrRefCount(interp, varName);
                 if (result != JIM_OK) {
                     goto err;
                 }
@@ -12005,7 +17303,13 @@ static int Jim_LassignCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *
 
     for (i = 2; i < argc; i++) {
         Jim_Obj *valObj = JimListIterNext(interp, &iter);
-        result = Jim_SetVariable(interp, argv[i], valObj ? valObj : interp->emptyObj);
+
+        if (!valObj) {
+            valObj = interp->emptyObj;
+        }
+        Jim_IncrRefCount(valObj);
+        result = Jim_SetVariable(interp, argv[i], valObj);
+        Jim_DecrRefCount(interp, valObj);
         if (result != JIM_OK) {
             return result;
         }
@@ -12089,13 +17393,134 @@ int Jim_CommandMatchObj(Jim_Interp *interp, Jim_Obj *commandObj, Jim_Obj *patter
     parms[argc++] = patternObj;
     parms[argc++] = stringObj;
 
-    rc = Jim_EvalObjVector(interp, argc, parms);
+    rc = Jim_EvalObjVector(interp, argc, parms);
+
+    if (rc != JIM_OK || Jim_GetLong(interp, Jim_GetResult(interp), &eq) != JIM_OK) {
+        eq = -rc;
+    }
+
+    return eq;
+}
+
+/* -----------------------------------------------------------------------------
+ * Switch Table Object
+ *
+ * The single list form of [switch] caches the pattern/body list on the
+ * list object itself, along with a hash table of the patterns for -exact
+ * matching. This avoids fetching the list every time, and avoids comparing
+ * against each pattern in turn.
+ * ---------------------------------------------------------------------------*/
+typedef struct JimSwitchTable {
+    int inUse;                  /* Used for sharing. */
+    int len;                    /* Number of elements: pattern body ?pattern body ...? */
+    Jim_Obj **ele;              /* The elements, each with a reference held */
+    int defaultIdx;             /* Index of a final "default" pattern, or -1 if none */
+    int hashed;                 /* Set once exactHT has been built */
+    Jim_HashTable exactHT;      /* Maps each pattern to its first slot in 'ele' */
+} JimSwitchTable;
+
+static void FreeSwitchInternalRep(Jim_Interp *interp, Jim_Obj *objPtr);
+static void DupSwitchInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr);
+
+static const Jim_ObjType switchObjType = {
+    "switch",
+    FreeSwitchInternalRep,
+    DupSwitchInternalRep,
+    NULL,
+    JIM_TYPE_REFERENCES,
+};
+
+static void JimSwitchTableRelease(Jim_Interp *interp, JimSwitchTable *table)
+{
+    int i;
+
+    if (--table->inUse != 0) {
+        return;
+    }
+    if (table->hashed) {
+        Jim_FreeHashTable(&table->exactHT);
+    }
+    for (i = 0; i < table->len; i++) {
+        Jim_DecrRefCount(interp, table->ele[i]);
+    }
+    Jim_Free(table->ele);
+    Jim_Free(table);
+}
+
+static void FreeSwitchInternalRep(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    JimSwitchTableRelease(interp, objPtr->internalRep.ptr);
+}
+
+static void DupSwitchInternalRep(Jim_Interp *interp, Jim_Obj *srcPtr, Jim_Obj *dupPtr)
+{
+    JIM_NOTUSED(interp);
+    JIM_NOTUSED(srcPtr);
+
+    /* Just returns an simple string. */
+    dupPtr->typePtr = NULL;
+}
+
+/* Returns the switch table for the pattern/body list, creating it if necessary */
+static JimSwitchTable *JimGetSwitchTable(Jim_Interp *interp, Jim_Obj *objPtr)
+{
+    JimSwitchTable *table;
+    Jim_Obj **vector;
+    int i;
+
+    if (objPtr->typePtr == &switchObjType) {
+        return objPtr->internalRep.ptr;
+    }
+
+    /* The list rep is about to be discarded, so make sure the string rep exists */
+    Jim_String(objPtr);
+
+    table = Jim_Alloc(sizeof(*table));
+    JimListGetElements(interp, objPtr, &table->len, &vector);
+    table->inUse = 1;
+    table->ele = Jim_Alloc(sizeof(*table->ele) * (table->len + 1));
+    for (i = 0; i < table->len; i++) {
+        table->ele[i] = vector[i];
+        Jim_IncrRefCount(table->ele[i]);
+    }
+    table->defaultIdx = -1;
+    if (table->len >= 2 && Jim_CompareStringImmediate(interp, table->ele[table->len - 2], "default")) {
+        table->defaultIdx = table->len - 2;
+    }
+    table->hashed = 0;
+
+    Jim_FreeIntRep(interp, objPtr);
+    objPtr->typePtr = &switchObjType;
+    objPtr->internalRep.ptr = table;
+
+    return table;
+}
+
+/* Returns the index of the first pattern equal to 'strObj', or of the final "default" pattern,
+ * or -1 if there is no match.
+ */
+static int JimSwitchFindExact(JimSwitchTable *table, Jim_Obj *strObj)
+{
+    Jim_HashEntry *he;
+
+    if (!table->hashed) {
+        int i;
 
-    if (rc != JIM_OK || Jim_GetLong(interp, Jim_GetResult(interp), &eq) != JIM_OK) {
-        eq = -rc;
+        Jim_InitHashTable(&table->exactHT, &JimObjectSlotHashTableType, NULL);
+        /* Adding fails for duplicate patterns, leaving the first one */
+        for (i = 0; i < table->len; i += 2) {
+            if (i != table->defaultIdx) {
+                Jim_AddHashEntry(&table->exactHT, table->ele[i], &table->ele[i]);
+            }
+        }
+        table->hashed = 1;
     }
 
-    return eq;
+    he = Jim_FindHashEntry(&table->exactHT, strObj);
+    if (he) {
+        return (Jim_Obj **)Jim_GetHashEntryVal(he) - table->ele;
+    }
+    return table->defaultIdx;
 }
 
 enum
@@ -12105,8 +17530,10 @@ enum
 static int Jim_SwitchCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 {
     int matchOpt = SWITCH_EXACT, opt = 1, patCount, i;
+    int rc = JIM_OK;
     Jim_Obj *command = 0, *const *caseList = 0, *strObj;
     Jim_Obj *script = 0;
+    JimSwitchTable *table = NULL;
 
     if (argc < 3) {
       wrongnumargs:
@@ -12147,20 +17574,42 @@ static int Jim_SwitchCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *a
     strObj = argv[opt++];
     patCount = argc - opt;
     if (patCount == 1) {
-        Jim_Obj **vector;
-
-        JimListGetElements(interp, argv[opt], &patCount, &vector);
-        caseList = vector;
+        table = JimGetSwitchTable(interp, argv[opt]);
+        table->inUse++;
+        patCount = table->len;
+        caseList = table->ele;
     }
     else
         caseList = &argv[opt];
-    if (patCount == 0 || patCount % 2 != 0)
+    if (patCount == 0 || patCount % 2 != 0) {
+        if (table) {
+            JimSwitchTableRelease(interp, table);
+        }
         goto wrongnumargs;
-    for (i = 0; script == 0 && i < patCount; i += 2) {
+    }
+    if (matchOpt == SWITCH_RE) {
+        command = Jim_NewStringObj(interp, "regexp", -1);
+    }
+    if (command) {
+        Jim_IncrRefCount(command);
+    }
+    i = 0;
+    if (table && matchOpt == SWITCH_EXACT) {
+        /* Go straight to the matching arm, or past the end if none */
+        i = JimSwitchFindExact(table, strObj);
+        if (i < 0) {
+            i = patCount;
+        }
+        else {
+            script = caseList[i + 1];
+            i += 2;
+        }
+    }
+    for (; script == 0 && i < patCount; i += 2) {
         Jim_Obj *patObj = caseList[i];
 
-        if (!Jim_CompareStringImmediate(interp, patObj, "default")
-            || i < (patCount - 2)) {
+        if (table ? i != table->defaultIdx : (!Jim_CompareStringImmediate(interp, patObj, "default")
+            || i < (patCount - 2))) {
             switch (matchOpt) {
                 case SWITCH_EXACT:
                     if (Jim_StringEqObj(strObj, patObj))
@@ -12171,25 +17620,14 @@ static int Jim_SwitchCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *a
                         script = caseList[i + 1];
                     break;
                 case SWITCH_RE:
-                    command = Jim_NewStringObj(interp, "regexp", -1);
-                    /* Fall thru intentionally */
                 case SWITCH_CMD:{
-                        int rc = Jim_CommandMatchObj(interp, command, patObj, strObj, 0);
-
-                        /* After the execution of a command we need to
-                         * make sure to reconvert the object into a list
-                         * again. Only for the single-list style [switch]. */
-                        if (argc - opt == 1) {
-                            Jim_Obj **vector;
+                        int eq = Jim_CommandMatchObj(interp, command, patObj, strObj, 0);
 
-                            JimListGetElements(interp, argv[opt], &patCount, &vector);
-                            caseList = vector;
+                        if (eq < 0) {
+                            rc = -eq;
+                            goto done;
                         }
-                        /* command is here already decref'd */
-                        if (rc < 0) {
-                            return -rc;
-                        }
-                        if (rc)
+                        if (eq)
                             script = caseList[i + 1];
                         break;
                     }
@@ -12203,13 +17641,28 @@ static int Jim_SwitchCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *a
         script = caseList[i + 1];
     if (script && Jim_CompareStringImmediate(interp, script, "-")) {
         Jim_SetResultFormatted(interp, "no body specified for pattern \"%#s\"", caseList[i - 2]);
-        return JIM_ERR;
+        rc = JIM_ERR;
+        goto done;
     }
     Jim_SetEmptyResult(interp);
     if (script) {
-        return Jim_EvalObj(interp, script);
+        /* Jim_EvalObj() holds a reference to the script, so the table can be released first */
+        Jim_IncrRefCount(script);
+        if (table) {
+            JimSwitchTableRelease(interp, table);
+            table = NULL;
+        }
+        rc = Jim_EvalObj(interp, script);
+        Jim_DecrRefCount(interp, script);
     }
-    return JIM_OK;
+  done:
+    if (command) {
+        Jim_DecrRefCount(interp, command);
+    }
+    if (table) {
+        JimSwitchTableRelease(interp, table);
+    }
+    return rc;
 }
 
 /* [list] */
@@ -12241,7 +17694,17 @@ static int Jim_LindexCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *a
             Jim_DecrRefCount(interp, listObjPtr);
             return JIM_ERR;
         }
-        if (Jim_ListIndex(interp, listObjPtr, idx, &objPtr, JIM_NONE) != JIM_OK) {
+        if (listObjPtr->typePtr == &rangeObjType) {
+            /* No need to convert a range to a list */
+            objPtr = JimRangeGetIndex(interp, listObjPtr, idx);
+        }
+        else if (JimIsFrozenList(listObjPtr)) {
+            objPtr = JimFrozenGetIndex(interp, listObjPtr, idx);
+        }
+        else {
+            objPtr = Jim_ListGetIndex(interp, listObjPtr, idx);
+        }
+        if (objPtr == NULL) {
             /* Returns an empty object if the index
              * is out of range. */
             Jim_DecrRefCount(interp, listObjPtr);
@@ -12263,7 +17726,7 @@ static int Jim_LlengthCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *
         Jim_WrongNumArgs(interp, 1, argv, "list");
         return JIM_ERR;
     }
-    Jim_SetResultInt(interp, Jim_ListLength(interp, argv[1]));
+    Jim_SetResultInt(interp, JimListOrRangeLength(interp, argv[1]));
     return JIM_OK;
 }
 
@@ -12346,6 +17809,21 @@ static int Jim_LsearchCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *
         Jim_IncrRefCount(commandObj);
     }
 
+    if (opt_match == OPT_EXACT && !opt_nocase && !opt_not && !opt_all) {
+        /* Only the first match is needed, which can use the list membership index */
+        i = JimListFindExact(interp, argv[0], argv[1]);
+        if (opt_bool) {
+            Jim_SetResultBool(interp, i >= 0);
+        }
+        else if (!opt_inline) {
+            Jim_SetResultInt(interp, i);
+        }
+        else if (i >= 0) {
+            Jim_SetResult(interp, Jim_ListGetIndex(interp, argv[0], i));
+        }
+        goto done;
+    }
+
     listlen = Jim_ListLength(interp, argv[0]);
     for (i = 0; i < listlen; i++) {
         int eq = 0;
@@ -12560,10 +18038,12 @@ static int Jim_LsetCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *arg
 static int Jim_LsortCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const argv[])
 {
     static const char * const options[] = {
-        "-ascii", "-nocase", "-increasing", "-decreasing", "-command", "-integer", "-real", "-index", "-unique", NULL
+        "-ascii", "-nocase", "-increasing", "-decreasing", "-command", "-integer", "-real", "-index", "-unique",
+        "-key", NULL
     };
     enum
-    { OPT_ASCII, OPT_NOCASE, OPT_INCREASING, OPT_DECREASING, OPT_COMMAND, OPT_INTEGER, OPT_REAL, OPT_INDEX, OPT_UNIQUE };
+    { OPT_ASCII, OPT_NOCASE, OPT_INCREASING, OPT_DECREASING, OPT_COMMAND, OPT_INTEGER, OPT_REAL, OPT_INDEX, OPT_UNIQUE,
+        OPT_KEY };
     Jim_Obj *resObj;
     int i;
     int retCode;
@@ -12580,7 +18060,7 @@ static int Jim_LsortCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const arg
     info.indexed = 0;
     info.unique = 0;
     info.command = NULL;
-    info.interp = interp;
+    info.key = NULL;
 
     for (i = 1; i < (argc - 1); i++) {
         int option;
@@ -12619,6 +18099,14 @@ static int Jim_LsortCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const arg
                 info.command = argv[i + 1];
                 i++;
                 break;
+            case OPT_KEY:
+                if (i >= (argc - 2)) {
+                    Jim_SetResultString(interp, "\"-key\" option must be followed by key command", -1);
+                    return JIM_ERR;
+                }
+                info.key = argv[i + 1];
+                i++;
+                break;
             case OPT_INDEX:
                 if (i >= (argc - 2)) {
                     Jim_SetResultString(interp, "\"-index\" option must be followed by list index", -1);
@@ -12684,19 +18172,96 @@ static int Jim_AppendCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *a
     return JIM_OK;
 }
 
+#if defined(JIM_DEBUG_COMMAND) && !defined(JIM_BOOTSTRAP)
+/* Approximate bytes owned by an object: the object itself, its string rep and
+ * for lists and dicts, the element vector or hash table (but not the elements).
+ */
+static int JimObjSize(Jim_Obj *objPtr)
+{
+    int size = sizeof(*objPtr);
+
+    if (objPtr->bytes && objPtr->bytes != JimEmptyStringRep) {
+        size += objPtr->length + 1;
+    }
+    if (objPtr->typePtr == &listObjType) {
+        size += objPtr->internalRep.listValue.maxLen * sizeof(Jim_Obj *);
+    }
+    else if (objPtr->typePtr == &dictObjType) {
+        Jim_HashTable *ht = objPtr->internalRep.ptr;
+
+        size += sizeof(*ht) + ht->size * sizeof(Jim_HashEntry *) + ht->used * sizeof(Jim_HashEntry);
+    }
+    return size;
+}
+
+/**
+ * Writes one line for every live object to 'filename', as a list of
+ * {address type refcount size preview}, where preview is the start of the
+ * first line of the string rep (if it exists).
+ * Sets the interp result to the number of objects.
+ */
+static int JimHeapDump(Jim_Interp *interp, const char *filename)
+{
+    Jim_Obj *objPtr = interp->liveList;
+    FILE *fh = fopen(filename, "w");
+    int count = 0;
+
+    if (fh == NULL) {
+        Jim_SetResultFormatted(interp, "couldn't open \"%s\": %s", filename, strerror(errno));
+        return JIM_ERR;
+    }
+    /* Objects created while dumping are added to the head of the list, so they aren't visited */
+    while (objPtr) {
+        Jim_Obj *objv[5];
+        Jim_Obj *lineObj;
+        char buf[32];
+        int len = 0;
+
+        if (objPtr->bytes) {
+            const char *nl;
+
+            len = objPtr->length < 40 ? objPtr->length : 40;
+            /* Keep to one line per object, and don't split a utf-8 sequence */
+            nl = memchr(objPtr->bytes, '\n', len);
+            if (nl) {
+                len = nl - objPtr->bytes;
+            }
+            while (len < objPtr->length && len > 0 && (objPtr->bytes[len] & 0xc0) == 0x80) {
+                len--;
+            }
+        }
+        snprintf(buf, sizeof(buf), "%p", (void *)objPtr);
+        objv[0] = Jim_NewStringObj(interp, buf, -1);
+        objv[1] = Jim_NewStringObj(interp, objPtr->typePtr ? objPtr->typePtr->name : "", -1);
+        objv[2] = Jim_NewIntObj(interp, objPtr->refCount);
+        objv[3] = Jim_NewIntObj(interp, JimObjSize(objPtr));
+        objv[4] = Jim_NewStringObj(interp, objPtr->bytes ? objPtr->bytes : "", len);
+        lineObj = Jim_NewListObj(interp, objv, 5);
+        fprintf(fh, "%s\n", Jim_String(lineObj));
+        Jim_FreeNewObj(interp, lineObj);
+        count++;
+        objPtr = objPtr->nextObjPtr;
+    }
+    fclose(fh);
+    Jim_SetResultInt(interp, count);
+    return JIM_OK;
+}
+#endif
+
 /* [debug] */
 static int Jim_DebugCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 {
 #if defined(JIM_DEBUG_COMMAND) && !defined(JIM_BOOTSTRAP)
     static const char * const options[] = {
         "refcount", "objcount", "objects", "invstr", "scriptlen", "exprlen",
-        "exprbc", "show",
+        "exprbc", "show", "jit", "parsecache", "shimmer", "memstats", "heapdump",
         NULL
     };
     enum
     {
         OPT_REFCOUNT, OPT_OBJCOUNT, OPT_OBJECTS, OPT_INVSTR, OPT_SCRIPTLEN,
-        OPT_EXPRLEN, OPT_EXPRBC, OPT_SHOW,
+        OPT_EXPRLEN, OPT_EXPRBC, OPT_SHOW, OPT_JIT, OPT_PARSECACHE, OPT_SHIMMER,
+        OPT_MEMSTATS, OPT_HEAPDUMP,
     };
     int option;
 
@@ -12884,6 +18449,118 @@ static int Jim_DebugCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *ar
         Jim_SetResult(interp, objPtr);
         return JIM_OK;
     }
+    else if (option == OPT_JIT) {
+#ifdef JIM_JIT
+        Jim_Obj *objPtr;
+        struct JimJitStats stats;
+
+        if (argc != 2) {
+            Jim_WrongNumArgs(interp, 2, argv, "");
+            return JIM_ERR;
+        }
+        memset(&stats, 0, sizeof(stats));
+        if (interp->jitStats) {
+            stats = *interp->jitStats;
+        }
+        objPtr = Jim_NewListObj(interp, NULL, 0);
+        Jim_ListAppendElement(interp, objPtr, Jim_NewStringObj(interp, "compiled", -1));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, stats.compiled));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewStringObj(interp, "rejected", -1));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, stats.rejected));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewStringObj(interp, "bytes", -1));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, stats.codeBytes));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewStringObj(interp, "runs", -1));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, stats.runs));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewStringObj(interp, "guardfails", -1));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, stats.guardFails));
+        Jim_SetResult(interp, objPtr);
+        return JIM_OK;
+#else
+        Jim_SetResultString(interp, "not compiled with JIT support", -1);
+        return JIM_ERR;
+#endif
+    }
+    else if (option == OPT_PARSECACHE) {
+        struct JimParseCache *cache = interp->parseCache;
+        Jim_Obj *objPtr;
+
+        if (argc != 2) {
+            Jim_WrongNumArgs(interp, 2, argv, "");
+            return JIM_ERR;
+        }
+        objPtr = Jim_NewListObj(interp, NULL, 0);
+        Jim_ListAppendElement(interp, objPtr, Jim_NewStringObj(interp, "size", -1));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, cache ? Jim_GetHashTableUsed(&cache->table) : 0));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewStringObj(interp, "hits", -1));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, cache ? cache->hits : 0));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewStringObj(interp, "misses", -1));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, cache ? cache->misses : 0));
+#ifdef JIM_SCRIPT_CACHE
+        Jim_ListAppendElement(interp, objPtr, Jim_NewStringObj(interp, "diskhits", -1));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, cache ? cache->diskhits : 0));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewStringObj(interp, "diskmisses", -1));
+        Jim_ListAppendElement(interp, objPtr, Jim_NewIntObj(interp, cache ? cache->diskmisses : 0));
+#endif
+        Jim_SetResult(interp, objPtr);
+        return JIM_OK;
+    }
+    else if (option == OPT_SHIMMER) {
+        static const char * const shimmerOptions[] = {
+            "on", "lines", "off", "reset", "report", NULL
+        };
+        enum { SHIMMER_ON, SHIMMER_LINES, SHIMMER_OFF, SHIMMER_RESET, SHIMMER_REPORT };
+        int shimmerOption;
+
+        if (argc != 3) {
+            Jim_WrongNumArgs(interp, 2, argv, "on|lines|off|reset|report");
+            return JIM_ERR;
+        }
+        if (Jim_GetEnum(interp, argv[2], shimmerOptions, &shimmerOption, NULL, JIM_ERRMSG | JIM_ENUM_ABBREV) != JIM_OK) {
+            return JIM_ERR;
+        }
+        switch (shimmerOption) {
+            case SHIMMER_ON:
+            case SHIMMER_LINES:
+                return JimShimmerStart(interp, shimmerOption == SHIMMER_LINES);
+            case SHIMMER_OFF:
+                JimShimmerStop(interp);
+                break;
+            case SHIMMER_RESET:
+                if (interp->shimmerTrace) {
+                    Jim_FreeHashTable(&interp->shimmerTrace->counts);
+                    Jim_InitHashTable(&interp->shimmerTrace->counts, &JimShimmerHashTableType, NULL);
+                }
+                break;
+            case SHIMMER_REPORT:
+                Jim_SetResult(interp, JimShimmerReport(interp, interp->shimmerTrace));
+                break;
+        }
+        return JIM_OK;
+    }
+    else if (option == OPT_MEMSTATS) {
+#ifdef JIM_MEMSTATS
+        if (argc == 3 && Jim_CompareStringImmediate(interp, argv[2], "reset")) {
+            JimMemStatsReset();
+            return JIM_OK;
+        }
+        if (argc != 2) {
+            Jim_WrongNumArgs(interp, 2, argv, "?reset?");
+            return JIM_ERR;
+        }
+        Jim_SetResult(interp, JimMemStatsReport(interp));
+        return JIM_OK;
+#else
+        Jim_SetResultString(interp, "not compiled with memory accounting", -1);
+        return JIM_ERR;
+#endif
+    }
+    else if (option == OPT_HEAPDUMP) {
+        if (argc != 3) {
+            Jim_WrongNumArgs(interp, 2, argv, "filename");
+            return JIM_ERR;
+        }
+        return JimHeapDump(interp, Jim_String(argv[2]));
+    }
     else {
         Jim_SetResultString(interp,
             "bad option. Valid options are refcount, " "objcount, objects, invstr", -1);
@@ -13684,35 +19361,30 @@ badcompareargs:
 
         case OPT_FIRST:
         case OPT_LAST:{
-                int idx = 0, l1, l2;
+                int idx = 0, l1, l2, charlen;
                 const char *s1, *s2;
 
                 if (argc != 4 && argc != 5) {
                     Jim_WrongNumArgs(interp, 2, argv, "subString string ?index?");
                     return JIM_ERR;
                 }
-                s1 = Jim_String(argv[2]);
-                s2 = Jim_String(argv[3]);
-                l1 = Jim_Utf8Length(interp, argv[2]);
-                l2 = Jim_Utf8Length(interp, argv[3]);
+                s1 = Jim_GetString(argv[2], &l1);
+                s2 = Jim_GetString(argv[3], &l2);
+                charlen = Jim_Utf8Length(interp, argv[3]);
                 if (argc == 5) {
                     if (Jim_GetIndex(interp, argv[4], &idx) != JIM_OK) {
                         return JIM_ERR;
                     }
-                    idx = JimRelToAbsIndex(l2, idx);
+                    idx = JimRelToAbsIndex(charlen, idx);
                 }
                 else if (option == OPT_LAST) {
-                    idx = l2;
+                    idx = charlen;
                 }
                 if (option == OPT_FIRST) {
-                    Jim_SetResultInt(interp, JimStringFirst(s1, l1, s2, l2, idx));
+                    Jim_SetResultInt(interp, JimStringFirst(s1, l1, s2, l2, charlen, idx));
                 }
                 else {
-#ifdef JIM_UTF8
-                    Jim_SetResultInt(interp, JimStringLastUtf8(s1, l1, s2, idx));
-#else
-                    Jim_SetResultInt(interp, JimStringLast(s1, l1, s2, idx));
-#endif
+                    Jim_SetResultInt(interp, JimStringLast(s1, l1, s2, l2, charlen, idx));
                 }
                 return JIM_OK;
             }
@@ -13801,6 +19473,163 @@ static int Jim_TimeCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *arg
     return JIM_OK;
 }
 
+/* [profile sample] */
+static int JimProfileSampleCommand(Jim_Interp *interp, struct JimProfiler *prof, int argc, Jim_Obj *const *argv)
+{
+    static const char * const options[] = {
+        "start", "stop", "reset", "collapsed", NULL
+    };
+    enum { OPT_START, OPT_STOP, OPT_RESET, OPT_COLLAPSED };
+    int option;
+
+    if (argc < 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "start|stop|reset|collapsed ?...?");
+        return JIM_ERR;
+    }
+    if (Jim_GetEnum(interp, argv[1], options, &option, "subcommand", JIM_ERRMSG) != JIM_OK) {
+        return JIM_ERR;
+    }
+
+    switch (option) {
+        case OPT_START: {
+            long hz = 1000;
+
+            if (argc > 3) {
+                Jim_WrongNumArgs(interp, 2, argv, "?hz?");
+                return JIM_ERR;
+            }
+            if (argc == 3 && Jim_GetLong(interp, argv[2], &hz) != JIM_OK) {
+                return JIM_ERR;
+            }
+            return JimSampleStart(interp, prof, hz);
+        }
+
+        case OPT_STOP:
+        case OPT_RESET:
+            if (argc != 2) {
+                Jim_WrongNumArgs(interp, 2, argv, "");
+                return JIM_ERR;
+            }
+            if (option == OPT_STOP) {
+                JimSampleStop(prof);
+            }
+            else {
+                Jim_FreeHashTable(&prof->samples);
+                Jim_InitHashTable(&prof->samples, &JimProfileSampleHashTableType, NULL);
+            }
+            return JIM_OK;
+
+        case OPT_COLLAPSED: {
+            Jim_Obj *collapsedObj;
+            FILE *fh;
+            int len;
+            const char *str;
+
+            if (argc > 3) {
+                Jim_WrongNumArgs(interp, 2, argv, "?filename?");
+                return JIM_ERR;
+            }
+            collapsedObj = JimSampleCollapsed(interp, prof);
+            if (argc == 2) {
+                Jim_SetResult(interp, collapsedObj);
+                return JIM_OK;
+            }
+            Jim_IncrRefCount(collapsedObj);
+            str = Jim_GetString(collapsedObj, &len);
+            fh = fopen(Jim_String(argv[2]), "w");
+            if (fh) {
+                int ok = fwrite(str, 1, len, fh) == (size_t)len;
+
+                if (fclose(fh) == 0 && ok) {
+                    Jim_DecrRefCount(interp, collapsedObj);
+                    return JIM_OK;
+                }
+            }
+            Jim_SetResultFormatted(interp, "error writing \"%#s\": %s", argv[2], strerror(errno));
+            Jim_DecrRefCount(interp, collapsedObj);
+            return JIM_ERR;
+        }
+    }
+    return JIM_ERR;
+}
+
+/* [profile] */
+static int Jim_ProfileCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    static const char * const options[] = {
+        "start", "stop", "reset", "report", "callgrind", "sample", NULL
+    };
+    enum { OPT_START, OPT_STOP, OPT_RESET, OPT_REPORT, OPT_CALLGRIND, OPT_SAMPLE };
+    static const char * const sortOptions[] = {
+        "exclusive", "inclusive", "calls", "name", NULL
+    };
+    static int (* const sortCompare[])(const void *, const void *) = {
+        JimProfileCompareExclusive, JimProfileCompareInclusive,
+        JimProfileCompareCalls, JimProfileCompareName
+    };
+    struct JimProfiler *prof = interp->profiler;
+    int option;
+    int sort = 0;
+
+    if (argc < 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "start|stop|reset|report|callgrind|sample ?...?");
+        return JIM_ERR;
+    }
+    if (Jim_GetEnum(interp, argv[1], options, &option, "subcommand", JIM_ERRMSG) != JIM_OK) {
+        return JIM_ERR;
+    }
+    if (prof == NULL) {
+        prof = Jim_Alloc(sizeof(*prof));
+        memset(prof, 0, sizeof(*prof));
+        Jim_InitHashTable(&prof->entries, &JimProfileEntryHashTableType, NULL);
+        Jim_InitHashTable(&prof->samples, &JimProfileSampleHashTableType, NULL);
+        interp->profiler = prof;
+    }
+
+    switch (option) {
+        case OPT_START:
+        case OPT_STOP:
+        case OPT_RESET:
+            if (argc != 2) {
+                Jim_WrongNumArgs(interp, 2, argv, "");
+                return JIM_ERR;
+            }
+            if (option == OPT_RESET) {
+                JimProfileReset(prof);
+            }
+            else {
+                /* Invocations in progress are not counted */
+                JimProfileClearStack(prof);
+                prof->running = (option == OPT_START);
+            }
+            return JIM_OK;
+
+        case OPT_REPORT:
+            if (argc == 4 && Jim_CompareStringImmediate(interp, argv[2], "-sort")) {
+                if (Jim_GetEnum(interp, argv[3], sortOptions, &sort, "sort key", JIM_ERRMSG | JIM_ENUM_ABBREV) != JIM_OK) {
+                    return JIM_ERR;
+                }
+            }
+            else if (argc != 2) {
+                Jim_WrongNumArgs(interp, 2, argv, "?-sort exclusive|inclusive|calls|name?");
+                return JIM_ERR;
+            }
+            Jim_SetResult(interp, JimProfileReport(interp, prof, sortCompare[sort]));
+            return JIM_OK;
+
+        case OPT_CALLGRIND:
+            if (argc != 3) {
+                Jim_WrongNumArgs(interp, 2, argv, "filename");
+                return JIM_ERR;
+            }
+            return JimProfileWriteCallgrind(interp, prof, argv[2]);
+
+        case OPT_SAMPLE:
+            return JimProfileSampleCommand(interp, prof, argc - 1, argv + 1);
+    }
+    return JIM_ERR;
+}
+
 /* [exit] */
 static int Jim_ExitCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 {
@@ -14106,7 +19935,7 @@ static Jim_Obj *JimDictPatternMatch(Jim_Interp *interp, Jim_HashTable *ht, Jim_O
     Jim_HashTableIterator htiter;
     JimInitHashTableIterator(ht, &htiter);
     while ((he = Jim_NextHashEntry(&htiter)) != NULL) {
-        if (patternObjPtr == NULL || JimGlobMatch(Jim_String(patternObjPtr), Jim_String((Jim_Obj *)he->key), 0)) {
+        if (patternObjPtr == NULL || Jim_StringMatchObj(interp, patternObjPtr, (Jim_Obj *)he->key, 0)) {
             callback(interp, listObjPtr, he, type);
         }
     }
@@ -14135,6 +19964,9 @@ int Jim_DictValues(Jim_Interp *interp, Jim_Obj *objPtr, Jim_Obj *patternObjPtr)
 
 int Jim_DictSize(Jim_Interp *interp, Jim_Obj *objPtr)
 {
+    if (objPtr->typePtr == &frozenObjType && JimFrozenValue(objPtr)->type == JIM_FROZEN_DICT) {
+        return JimFrozenValue(objPtr)->len / 2;
+    }
     if (SetDictFromAny(interp, objPtr) != JIM_OK) {
         return -1;
     }
@@ -15106,6 +20938,11 @@ static int Jim_RangeCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *ar
         Jim_SetResultString(interp, "Invalid (infinite?) range specified", -1);
         return JIM_ERR;
     }
+    if (step == (int)step) {
+        /* The elements are only created if they are needed */
+        Jim_SetResult(interp, JimNewRangeObj(interp, start, (int)step, len));
+        return JIM_OK;
+    }
     objPtr = Jim_NewListObj(interp, NULL, 0);
     for (i = 0; i < len; i++)
         ListAppendElement(objPtr, Jim_NewIntObj(interp, start + i * step));
@@ -15113,6 +20950,54 @@ static int Jim_RangeCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *ar
     return JIM_OK;
 }
 
+/* [freeze] */
+static int Jim_FreezeCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "value");
+        return JIM_ERR;
+    }
+    Jim_SetResult(interp, Jim_FreezeObj(interp, argv[1]));
+    return JIM_OK;
+}
+
+/* [serialize] */
+static int Jim_SerializeCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    Jim_Obj *objPtr;
+
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "value");
+        return JIM_ERR;
+    }
+    objPtr = Jim_SerializeObj(interp, argv[1]);
+    if (objPtr == NULL) {
+        return JIM_ERR;
+    }
+    Jim_SetResult(interp, objPtr);
+    return JIM_OK;
+}
+
+/* [deserialize] */
+static int Jim_DeserializeCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+    Jim_Obj *objPtr;
+    const char *buf;
+    int len;
+
+    if (argc != 2) {
+        Jim_WrongNumArgs(interp, 1, argv, "data");
+        return JIM_ERR;
+    }
+    buf = Jim_GetString(argv[1], &len);
+    objPtr = Jim_DeserializeObj(interp, buf, len);
+    if (objPtr == NULL) {
+        return JIM_ERR;
+    }
+    Jim_SetResult(interp, objPtr);
+    return JIM_OK;
+}
+
 /* [rand] */
 static int Jim_RandCoreCommand(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
 {
@@ -15193,6 +21078,7 @@ static const struct {
     {"global", Jim_GlobalCoreCommand},
     {"string", Jim_StringCoreCommand},
     {"time", Jim_TimeCoreCommand},
+    {"profile", Jim_ProfileCoreCommand},
     {"exit", Jim_ExitCoreCommand},
     {"catch", Jim_CatchCoreCommand},
 #ifdef JIM_REFERENCES
@@ -15218,11 +21104,19 @@ static const struct {
     {"source", Jim_SourceCoreCommand},
     {"lreverse", Jim_LreverseCoreCommand},
     {"range", Jim_RangeCoreCommand},
+    {"freeze", Jim_FreezeCoreCommand},
+    {"serialize", Jim_SerializeCoreCommand},
+    {"deserialize", Jim_DeserializeCoreCommand},
     {"rand", Jim_RandCoreCommand},
     {"tailcall", Jim_TailcallCoreCommand},
     {"local", Jim_LocalCoreCommand},
     {"upcall", Jim_UpcallCoreCommand},
     {"apply", Jim_ApplyCoreCommand},
+#ifdef JIM_COROUTINES
+    {"coroutine", Jim_CoroutineCoreCommand},
+    {"yield", Jim_YieldCoreCommand},
+    {"yieldto", Jim_YieldtoCoreCommand},
+#endif
     {NULL, NULL},
 };
 
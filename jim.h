@@ -303,14 +303,21 @@ typedef struct Jim_Obj {
         struct {
             struct Jim_Obj *nsObj;
             struct Jim_Cmd *cmdPtr;
-            unsigned long procEpoch; /* for caching */
+            unsigned long procEpoch; /* for caching: interp procEpoch + command cmdEpoch */
         } cmdValue;
         /* List object */
         struct {
             struct Jim_Obj **ele;    /* Elements vector */
             int len;        /* Length */
             int maxLen;        /* Allocated 'ele' length */
+            struct Jim_ListIndex *index; /* Membership index for searches, or NULL */
         } listValue;
+        /* Range type: a lazy list of integers */
+        struct {
+            jim_wide start;
+            int step;
+            int len;
+        } rangeValue;
         /* String type */
         struct {
             int maxLength;
@@ -466,6 +473,8 @@ typedef void Jim_DelCmdProc(struct Jim_Interp *interp, void *privData);
  * two objects referenced by arglistObjPtr and bodyoObjPtr. */
 typedef struct Jim_Cmd {
     int inUse;           /* Reference count */
+    int cacheRefs;       /* References held by cached lookups (keeps the memory, not the command) */
+    unsigned long cmdEpoch; /* Incremented whenever cached lookups of this command become stale */
     int isproc;          /* Is this a procedure? */
     struct Jim_Cmd *prevCmd;    /* Previous command defn if cmd created 'local' */
     union {
@@ -522,9 +531,9 @@ typedef struct Jim_Interp {
     Jim_CallFrame *framePtr; /* Pointer to the current call frame */
     Jim_CallFrame *topFramePtr; /* toplevel/global frame pointer. */
     struct Jim_HashTable commands; /* Commands hash table */
-    unsigned long procEpoch; /* Incremented every time the result
-                of procedures names lookup caching
-                may no longer be valid. */
+    unsigned long procEpoch; /* Incremented to invalidate every cached
+                command lookup at once. Normally only the
+                affected command's cmdEpoch is incremented. */
     unsigned long callFrameEpoch; /* Incremented every time a new
                 callframe is created. This id is used for the
                 'ID' field contained in the Jim_CallFrame
@@ -559,12 +568,25 @@ typedef struct Jim_Interp {
     Jim_PrngState *prngState; /* per interpreter Random Number Gen. state. */
     struct Jim_HashTable packages; /* Provided packages hash table */
     Jim_Stack *loadHandles; /* handles of loaded modules [load] */
+    struct Jim_Obj **exprStack; /* Stack shared by expression evaluations */
+    int exprStackLen; /* Allocated length of exprStack */
+    int exprStackTop; /* Number of exprStack entries in use */
+    struct JimExprValue *exprValues; /* Value stack for compiled numeric expressions */
+    int exprValuesLen; /* Allocated length of exprValues */
+    struct JimJitStats *jitStats; /* Statistics for [debug jit] (JIM_JIT only) */
+    struct JimParseCache *parseCache; /* Recently parsed scripts, shared by content */
+    struct JimProfiler *profiler; /* Data collected by [profile] */
+    struct JimShimmerTrace *shimmerTrace; /* Data collected by [debug shimmer] */
+    struct Jim_Coroutine *coroutine; /* The running coroutine, or NULL (JIM_COROUTINES only) */
+    struct Jim_Coroutine *coroutines; /* All coroutines which have not been freed */
 } Jim_Interp;
 
 /* Currently provided as macro that performs the increment.
  * At some point may be a real function doing more work.
- * The proc epoch is used in order to know when a command lookup
- * cached can no longer considered valid. */
+ * Incrementing the proc epoch invalidates all cached command lookups.
+ * The core only invalidates the commands actually affected
+ * (see cmdEpoch in Jim_Cmd), so this is only needed by code that
+ * changes command resolution behind the interpreter's back. */
 #define Jim_InterpIncrProcEpoch(i) (i)->procEpoch++
 #define Jim_SetResultString(i,s,l) Jim_SetResult(i, Jim_NewStringObj(i,s,l))
 #define Jim_SetResultInt(i,intval) Jim_SetResult(i, Jim_NewIntObj(i,intval))
@@ -661,6 +683,7 @@ JIM_EXPORT int Jim_FreeHashTable (Jim_HashTable *ht);
 JIM_EXPORT Jim_HashEntry * Jim_FindHashEntry (Jim_HashTable *ht,
         const void *key);
 JIM_EXPORT void Jim_ResizeHashTable (Jim_HashTable *ht);
+JIM_EXPORT unsigned int Jim_GenHashFunction (const unsigned char *buf, int len);
 JIM_EXPORT Jim_HashTableIterator *Jim_GetHashTableIterator
         (Jim_HashTable *ht);
 JIM_EXPORT Jim_HashEntry * Jim_NextHashEntry
@@ -811,6 +834,21 @@ JIM_EXPORT int Jim_DictValues(Jim_Interp *interp, Jim_Obj *dictObjPtr, Jim_Obj *
 JIM_EXPORT int Jim_DictSize(Jim_Interp *interp, Jim_Obj *objPtr);
 JIM_EXPORT int Jim_DictInfo(Jim_Interp *interp, Jim_Obj *objPtr);
 
+/* frozen object */
+JIM_EXPORT Jim_Obj *Jim_FreezeObj(Jim_Interp *interp, Jim_Obj *objPtr);
+JIM_EXPORT Jim_Obj *Jim_ShareFrozenObj(Jim_Interp *interp, Jim_Obj *objPtr);
+
+/* serialization */
+JIM_EXPORT Jim_Obj *Jim_SerializeObj(Jim_Interp *interp, Jim_Obj *objPtr);
+JIM_EXPORT Jim_Obj *Jim_DeserializeObj(Jim_Interp *interp, const char *buf, int len);
+
+/* coroutines (JIM_COROUTINES only) */
+typedef struct Jim_Coroutine Jim_Coroutine;
+JIM_EXPORT Jim_Coroutine *Jim_CurrentCoroutine(Jim_Interp *interp);
+JIM_EXPORT int Jim_YieldCoroutine(Jim_Interp *interp, Jim_Obj *valueObj);
+JIM_EXPORT int Jim_ResumeCoroutine(Jim_Interp *interp, Jim_Coroutine *coro,
+        Jim_Obj *valueObj);
+
 /* return code object */
 JIM_EXPORT int Jim_GetReturnCode (Jim_Interp *interp, Jim_Obj *objPtr,
         int *intPtr);
@@ -880,6 +918,9 @@ JIM_EXPORT void Jim_HistoryShow(void);
 
 /* Misc */
 JIM_EXPORT int Jim_InitStaticExtensions(Jim_Interp *interp);
+JIM_EXPORT int Jim_RegisterLazyExtension(Jim_Interp *interp, const char *name,
+        int (*initProc)(Jim_Interp *interp), const char * const *cmdNames);
+JIM_EXPORT int Jim_InitLazyExtension(Jim_Interp *interp, const char *name);
 JIM_EXPORT int Jim_StringToWide(const char *str, jim_wide *widePtr, int base);
 JIM_EXPORT int Jim_IsBigEndian(void);
 
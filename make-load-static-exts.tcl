@@ -17,6 +17,32 @@ array set pri {
     binary 2
 }
 
+# Script extensions which only create commands may be initialised lazily,
+# on first use of one of their commands (see Jim_RegisterLazyExtension).
+# The commands are found by scanning the source for top level procs.
+# Any other commands an extension creates must be listed here.
+# tclcompat is not included since it replaces existing commands.
+array set lazy {
+    stdlib {}
+    nshelper {}
+    oo {}
+    tree {tree}
+    binary {}
+    glob {}
+}
+
+proc lazy-commands {ext} {
+    set cmds $::lazy($ext)
+    set f [open [file join [file dirname [info script]] $ext.tcl]]
+    while {[gets $f buf] >= 0} {
+        if {[regexp {^proc ([^ \t\{\"]+|\{[^\}]*\}|"[^"]*") } $buf -> name]} {
+            lappend cmds [string trim $name \{\}\"]
+        }
+    }
+    close $f
+    return $cmds
+}
+
 foreach i $argv {
     set p 1
     if {[info exists pri($i)]} {
@@ -30,6 +56,23 @@ puts {
 /* autogenerated - do not edit */
 #include "jim.h"
 #include "jimautoconf.h"
+}
+
+puts "#ifdef JIM_LAZY_EXTS"
+foreach e $exts {
+    set ext [lindex $e 1]
+    if {[info exists lazy($ext)]} {
+        set names {}
+        foreach cmd [lazy-commands $ext] {
+            lappend names \"$cmd\"
+        }
+        lappend names NULL
+        puts "static const char * const ${ext}_cmds\[\] = { [join $names {, }] };"
+    }
+}
+puts "#endif"
+
+puts {
 int Jim_InitStaticExtensions(Jim_Interp *interp)
 }
 puts \{
@@ -40,7 +83,15 @@ foreach e $exts {
 }
 foreach e $exts {
     set ext [lindex $e 1]
-    puts "\tJim_${ext}Init(interp);"
+    if {[info exists lazy($ext)]} {
+        puts "#ifdef JIM_LAZY_EXTS"
+        puts "\tJim_RegisterLazyExtension(interp, \"$ext\", Jim_${ext}Init, ${ext}_cmds);"
+        puts "#else"
+        puts "\tJim_${ext}Init(interp);"
+        puts "#endif"
+    } else {
+        puts "\tJim_${ext}Init(interp);"
+    }
 }
 
 puts "\treturn JIM_OK;"